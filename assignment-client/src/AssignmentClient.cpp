@@ -52,6 +52,7 @@ AssignmentClient::AssignmentClient(int &argc, char **argv) :
     const QString ASSIGNMENT_POOL_OPTION = "pool";
     const QString ASSIGNMENT_WALLET_DESTINATION_ID_OPTION = "wallet";
     const QString CUSTOM_ASSIGNMENT_SERVER_HOSTNAME_OPTION = "a";
+    const QString NO_SHARED_MEMORY_OPTION = "no-shared-memory";
 
     Assignment::Type requestAssignmentType = Assignment::AllTypes;
 
@@ -81,6 +82,11 @@ AssignmentClient::AssignmentClient(int &argc, char **argv) :
     // create a NodeList as an unassigned client
     NodeList* nodeList = NodeList::createInstance(NodeType::Unassigned);
 
+    // talk to the domain-server and other assignment-clients on this machine through shared memory, unless told not to
+    if (!argumentVariantMap.contains(NO_SHARED_MEMORY_OPTION)) {
+        nodeList->enableSharedMemoryTransport();
+    }
+
     // check for an overriden assignment server hostname
     if (argumentVariantMap.contains(CUSTOM_ASSIGNMENT_SERVER_HOSTNAME_OPTION)) {
         _assignmentServerHostname = argumentVariantMap.value(CUSTOM_ASSIGNMENT_SERVER_HOSTNAME_OPTION).toString();
@@ -118,11 +124,7 @@ void AssignmentClient::readPendingDatagrams() {
     QByteArray receivedPacket;
     HifiSockAddr senderSockAddr;
 
-    while (nodeList->getNodeSocket().hasPendingDatagrams()) {
-        receivedPacket.resize(nodeList->getNodeSocket().pendingDatagramSize());
-        nodeList->getNodeSocket().readDatagram(receivedPacket.data(), receivedPacket.size(),
-                                               senderSockAddr.getAddressPointer(), senderSockAddr.getPortPointer());
-
+    while (nodeList->readDatagram(receivedPacket, senderSockAddr)) {
         if (nodeList->packetVersionAndHashMatch(receivedPacket)) {
             if (packetTypeForPacket(receivedPacket) == PacketTypeCreateAssignment) {
                 // construct the deployed assignment from the packet data
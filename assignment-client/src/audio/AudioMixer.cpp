@@ -456,6 +456,11 @@ void AudioMixer::sendStatsPacket() {
             statsObject2[qPrintable(property)] = value;
             somethingToSend = true;
             sizeOfStats += property.size() + value.size();
+            
+            property = "sequenceStats." + node->getUUID().toString();
+            value = clientData->getSequenceNumberStatsString();
+            statsObject2[qPrintable(property)] = value;
+            sizeOfStats += property.size() + value.size();
         }
         
         // if we're too large, send the packet
@@ -276,3 +276,14 @@ QString AudioMixerClientData::getAudioStreamStatsString() const {
     }
     return result;
 }
+
+QString AudioMixerClientData::getSequenceNumberStatsString() const {
+    QString result = "mic." + _incomingAvatarAudioSequenceNumberStats.getStatsString();
+    
+    QHash<QUuid, SequenceNumberStats>::const_iterator i = _incomingInjectedAudioSequenceNumberStatsMap.constBegin();
+    while (i != _incomingInjectedAudioSequenceNumberStatsMap.constEnd()) {
+        result += "| injected[" + i.key().toString() + "]." + i.value().getStatsString();
+        i++;
+    }
+    return result;
+}
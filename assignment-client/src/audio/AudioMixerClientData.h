@@ -34,6 +34,7 @@ public:
 
     AudioStreamStats getAudioStreamStatsOfStream(const PositionalAudioRingBuffer* ringBuffer) const;
     QString getAudioStreamStatsString() const;
+    QString getSequenceNumberStatsString() const;
     
     void sendAudioStreamStatsPackets(const SharedNodePointer& destinationNode) const;
     
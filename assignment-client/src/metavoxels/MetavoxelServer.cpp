@@ -10,21 +10,39 @@
 //
 
 #include <QDateTime>
+#include <QElapsedTimer>
 
 #include <PacketHeaders.h>
+#include <SharedUtil.h>
 
+#include <MetavoxelImporter.h>
 #include <MetavoxelMessages.h>
+#include <MetavoxelSnapshotStore.h>
 #include <MetavoxelUtil.h>
 
 #include "MetavoxelServer.h"
 
 const int SEND_INTERVAL = 50;
 
+const char* LOCAL_METAVOXELS_PERSIST_FILE = "resources/metavoxels.snapshots";
+const int DEFAULT_PERSIST_INTERVAL = 30 * MSECS_PER_SECOND;
+
 MetavoxelServer::MetavoxelServer(const QByteArray& packet) :
-    ThreadedAssignment(packet) {
+    ThreadedAssignment(packet),
+    _wantPersist(true),
+    _persistFilename(LOCAL_METAVOXELS_PERSIST_FILE),
+    _persistInterval(DEFAULT_PERSIST_INTERVAL),
+    _snapshotStore(NULL),
+    _importSize(0.0f) {
     
     _sendTimer.setSingleShot(true);
     connect(&_sendTimer, SIGNAL(timeout()), SLOT(sendDeltas()));
+    
+    connect(&_persistTimer, SIGNAL(timeout()), SLOT(saveSnapshot()));
+}
+
+MetavoxelServer::~MetavoxelServer() {
+    delete _snapshotStore;
 }
 
 void MetavoxelServer::applyEdit(const MetavoxelEditMessage& edit) {
@@ -41,6 +59,18 @@ void MetavoxelServer::run() {
     
     connect(nodeList, SIGNAL(nodeAdded(SharedNodePointer)), SLOT(maybeAttachSession(const SharedNodePointer&)));
     
+    parsePayload();
+    if (_wantPersist) {
+        // restore the last snapshot before anyone can see the data
+        qDebug() << "Loading metavoxels from" << _persistFilename;
+        _snapshotStore = new MetavoxelSnapshotStore(_persistFilename);
+        _snapshotStore->load(_data);
+        _persistTimer.start(_persistInterval);
+    }
+    if (!_importFilename.isEmpty()) {
+        importVolume();
+    }
+    
     _lastSend = QDateTime::currentMSecsSinceEpoch();
     _sendTimer.start(SEND_INTERVAL);
 }
@@ -66,6 +96,10 @@ void MetavoxelServer::readPendingDatagrams() {
     }
 }
 
+void MetavoxelServer::aboutToFinish() {
+    saveSnapshot();
+}
+
 void MetavoxelServer::maybeAttachSession(const SharedNodePointer& node) {
     if (node->getType() == NodeType::Agent) {
         QMutexLocker locker(&node->getMutex());
@@ -74,12 +108,14 @@ void MetavoxelServer::maybeAttachSession(const SharedNodePointer& node) {
 }
 
 void MetavoxelServer::sendDeltas() {
-    // send deltas for all sessions
+    // send deltas for all sessions; the data can't change while we do, so they can share encodings
+    _deltaCache.clear();
     foreach (const SharedNodePointer& node, NodeList::getInstance()->getNodeHash()) {
         if (node->getType() == NodeType::Agent) {
             static_cast<MetavoxelSession*>(node->getLinkedData())->update();
         }
     }
+    _deltaCache.clear();
     
     // restart the send timer
     qint64 now = QDateTime::currentMSecsSinceEpoch();
@@ -89,6 +125,66 @@ void MetavoxelServer::sendDeltas() {
     _sendTimer.start(qMax(0, 2 * SEND_INTERVAL - elapsed));
 }
 
+void MetavoxelServer::saveSnapshot() {
+    if (!_snapshotStore) {
+        return;
+    }
+    int nodesWritten = _snapshotStore->getNodesWritten();
+    if (_snapshotStore->save(_data) && _snapshotStore->getNodesWritten() != nodesWritten) {
+        qDebug() << "Saved metavoxel snapshot:" << (_snapshotStore->getNodesWritten() - nodesWritten) << "new nodes," <<
+            _snapshotStore->getFileSize() << "bytes on disk";
+    }
+}
+
+void MetavoxelServer::importVolume() {
+    QScopedPointer<MetavoxelVolume> volume;
+    AttributePointer colorAttribute = AttributeRegistry::getInstance()->getColorAttribute();
+    if (_importFilename.endsWith(".raw", Qt::CaseInsensitive)) {
+        volume.reset(new RawVolume(colorAttribute, _importFilename));
+    } else {
+        volume.reset(new HeightfieldVolume(colorAttribute, QImage(_importFilename)));
+    }
+    if (volume->getResolution() == 0) {
+        qDebug() << "Couldn't import" << _importFilename;
+        return;
+    }
+    float size = (_importSize > 0.0f) ? _importSize : _data.getSize();
+    QElapsedTimer timer;
+    timer.start();
+    importMetavoxelVolume(_data, glm::vec3(size, size, size) * -0.5f, size, *volume);
+    qDebug() << "Imported" << _importFilename << "at resolution" << volume->getResolution() << "in" <<
+        timer.elapsed() << "ms";
+}
+
+void MetavoxelServer::parsePayload() {
+    // options are passed as in the octree servers, e.g. "--persistFilename foo.snapshots --persistInterval 60000"
+    QStringList options = QString(getPayload()).split(" ", QString::SkipEmptyParts);
+    const QString NO_PERSIST_OPTION = "--NoPersist";
+    const QString PERSIST_FILENAME_OPTION = "--persistFilename";
+    const QString PERSIST_INTERVAL_OPTION = "--persistInterval";
+    const QString IMPORT_OPTION = "--import";
+    const QString IMPORT_SIZE_OPTION = "--importSize";
+    for (int i = 0; i < options.size(); i++) {
+        if (options.at(i) == NO_PERSIST_OPTION) {
+            _wantPersist = false;
+        
+        } else if (options.at(i) == PERSIST_FILENAME_OPTION && i + 1 < options.size()) {
+            _persistFilename = options.at(++i);
+            
+        } else if (options.at(i) == PERSIST_INTERVAL_OPTION && i + 1 < options.size()) {
+            _persistInterval = qMax(options.at(++i).toInt(), (int)MSECS_PER_SECOND);
+        
+        } else if (options.at(i) == IMPORT_OPTION && i + 1 < options.size()) {
+            _importFilename = options.at(++i);
+            
+        } else if (options.at(i) == IMPORT_SIZE_OPTION && i + 1 < options.size()) {
+            _importSize = options.at(++i).toFloat();
+        }
+    }
+    qDebug() << "wantPersist=" << _wantPersist << "persistFilename=" << _persistFilename <<
+        "persistInterval=" << _persistInterval;
+}
+
 MetavoxelSession::MetavoxelSession(const SharedNodePointer& node, MetavoxelServer* server) :
     Endpoint(node, new PacketRecord(), NULL),
     _server(server) {
@@ -108,7 +204,7 @@ void MetavoxelSession::update() {
 void MetavoxelSession::writeUpdateMessage(Bitstream& out) {
     out << QVariant::fromValue(MetavoxelDeltaMessage());
     PacketRecord* sendRecord = getLastAcknowledgedSendRecord();
-    _server->getData().writeDelta(sendRecord->getData(), sendRecord->getLOD(), out, _lod);
+    _server->getData().writeDelta(sendRecord->getData(), sendRecord->getLOD(), out, _lod, _server->getDeltaCache());
 }
 
 void MetavoxelSession::handleMessage(const QVariant& message, Bitstream& in) {
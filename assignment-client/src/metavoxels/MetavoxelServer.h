@@ -21,6 +21,7 @@
 
 class MetavoxelEditMessage;
 class MetavoxelSession;
+class MetavoxelSnapshotStore;
 
 /// Maintains a shared metavoxel system, accepting change requests and broadcasting updates.
 class MetavoxelServer : public ThreadedAssignment {
@@ -29,26 +30,49 @@ class MetavoxelServer : public ThreadedAssignment {
 public:
     
     MetavoxelServer(const QByteArray& packet);
+    virtual ~MetavoxelServer();
 
     void applyEdit(const MetavoxelEditMessage& edit);
 
     const MetavoxelData& getData() const { return _data; }
 
+    MetavoxelDeltaCache* getDeltaCache() { return &_deltaCache; }
+
     virtual void run();
     
     virtual void readPendingDatagrams();
     
+    virtual void aboutToFinish();
+    
 private slots:
 
     void maybeAttachSession(const SharedNodePointer& node);
     void sendDeltas();    
+    void saveSnapshot();
     
 private:
     
+    void parsePayload();
+    
+    /// Replaces the color layer with the volume named in the payload, a raw file of colors or a heightfield image.
+    void importVolume();
+    
     QTimer _sendTimer;
     qint64 _lastSend;
     
+    bool _wantPersist;
+    QString _persistFilename;
+    int _persistInterval;
+    MetavoxelSnapshotStore* _snapshotStore;
+    QTimer _persistTimer;
+    
+    QString _importFilename;
+    float _importSize;
+    
     MetavoxelData _data;
+    
+    // shared between the sessions' deltas during a single send
+    MetavoxelDeltaCache _deltaCache;
 };
 
 /// Contains the state of a single client session.
@@ -0,0 +1,175 @@
+//
+//  ModelBoundsCache.cpp
+//  assignment-client/src/models
+//
+//  Copyright 2014 High Fidelity, Inc.
+//
+//  Distributed under the Apache License, Version 2.0.
+//  See the accompanying file LICENSE or http://www.apache.org/licenses/LICENSE-2.0.html
+//
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QRunnable>
+#include <QUrl>
+
+#include <FBXReader.h>
+
+#include "ModelBoundsCache.h"
+
+/// Reads the geometry of one URL on the cache's reader threads.
+class ModelBoundsReader : public QRunnable {
+public:
+
+    ModelBoundsReader(ModelBoundsCache* cache, const QString& url) : _cache(cache), _url(url) { }
+
+    virtual void run();
+
+private:
+
+    FBXGeometry readGeometry(const QString& path);
+
+    ModelBoundsCache* _cache;
+    QString _url;
+};
+
+// sorts the mesh boxes along one axis, so that neighbors can be merged
+class ExtentsCenterLessThan {
+public:
+    ExtentsCenterLessThan(int axis) : _axis(axis) { }
+    bool operator()(const Extents& first, const Extents& second) const {
+        return first.minimum[_axis] + first.maximum[_axis] < second.minimum[_axis] + second.maximum[_axis];
+    }
+private:
+    int _axis;
+};
+
+FBXGeometry* ModelBoundsCache::extractBounds(const FBXGeometry& geometry) {
+    FBXGeometry* bounds = new FBXGeometry();
+    bounds->meshExtents = geometry.meshExtents;
+
+    QVector<Extents> meshBoxes;
+    foreach (const FBXMesh& mesh, geometry.meshes) {
+        if (mesh.meshExtents.isValid()) {
+            meshBoxes.append(mesh.meshExtents);
+        }
+    }
+    if (meshBoxes.size() > MAX_MODEL_PROXY_MESHES) {
+        glm::vec3 dimensions = geometry.meshExtents.maximum - geometry.meshExtents.minimum;
+        int longestAxis = (dimensions.x > dimensions.y) ? ((dimensions.x > dimensions.z) ? 0 : 2) :
+            ((dimensions.y > dimensions.z) ? 1 : 2);
+        qSort(meshBoxes.begin(), meshBoxes.end(), ExtentsCenterLessThan(longestAxis));
+
+        QVector<Extents> mergedBoxes(MAX_MODEL_PROXY_MESHES);
+        for (int i = 0; i < MAX_MODEL_PROXY_MESHES; i++) {
+            mergedBoxes[i].reset();
+        }
+        for (int i = 0; i < meshBoxes.size(); i++) {
+            mergedBoxes[i * MAX_MODEL_PROXY_MESHES / meshBoxes.size()].addExtents(meshBoxes.at(i));
+        }
+        meshBoxes = mergedBoxes;
+    }
+    foreach (const Extents& meshBox, meshBoxes) {
+        FBXMesh mesh;
+        mesh.meshExtents = meshBox;
+        bounds->meshes.append(mesh);
+    }
+    return bounds;
+}
+
+void ModelBoundsReader::run() {
+    FBXGeometry* bounds = NULL;
+    QString path = _cache->getLocalPath(_url);
+    if (path.isEmpty()) {
+        qDebug() << "Not reading" << _url << "- it has no host, or its path leads outside the model directory.";
+
+    } else if (QFileInfo(path).isFile()) {
+        try {
+            FBXGeometry geometry = readGeometry(path);
+            if (geometry.meshExtents.isValid()) {
+                bounds = ModelBoundsCache::extractBounds(geometry);
+            }
+        } catch (const QString& error) {
+            qDebug() << "Error reading " << _url << ": " << error;
+        }
+    } else {
+        qDebug() << "No local copy of" << _url << "at" << path << "- its models will be culled by their radii.";
+    }
+    _cache->setBounds(_url, bounds);
+}
+
+FBXGeometry ModelBoundsReader::readGeometry(const QString& path) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        throw QString("could not open ") + path;
+    }
+    if (path.toLower().endsWith(".svo")) {
+        return readSVO(file.readAll());
+    }
+    if (!path.toLower().endsWith(".fst")) {
+        return readFBX(file.readAll(), QVariantHash());
+    }
+
+    // a mapping names the model file, which lives beside it
+    QVariantHash mapping = readMapping(file.readAll());
+    QFile modelFile(QFileInfo(path).dir().filePath(mapping.value("filename").toString()));
+    if (!_cache->isInDirectory(modelFile.fileName())) {
+        throw QString("the model file leads outside the model directory: ") + modelFile.fileName();
+    }
+    if (!modelFile.open(QIODevice::ReadOnly)) {
+        throw QString("could not open ") + modelFile.fileName();
+    }
+    return readFBX(modelFile.readAll(), mapping);
+}
+
+ModelBoundsCache::ModelBoundsCache(const QString& directory) :
+    _directory(directory) {
+}
+
+ModelBoundsCache::~ModelBoundsCache() {
+    _readers.waitForDone();
+    foreach (FBXGeometry* bounds, _bounds) {
+        delete bounds;
+    }
+}
+
+const FBXGeometry* ModelBoundsCache::getGeometryForModel(const ModelItem& modelItem) {
+    if (!modelItem.hasModel()) {
+        return NULL;
+    }
+    QMutexLocker locker(&_boundsMutex);
+    QHash<QString, FBXGeometry*>::const_iterator it = _bounds.constFind(modelItem.getModelURL());
+    if (it != _bounds.constEnd()) {
+        return it.value();
+    }
+
+    // first time we've seen this URL: read it in the background (the NULL entry marks it as being read)
+    _bounds.insert(modelItem.getModelURL(), NULL);
+    _readers.start(new ModelBoundsReader(this, modelItem.getModelURL()));
+    return NULL;
+}
+
+QString ModelBoundsCache::getLocalPath(const QString& url) const {
+    // the URLs come from the editors, so neither ".." segments nor a missing host may take the path out of the directory
+    QUrl parsedURL(url);
+    if (parsedURL.host().isEmpty()) {
+        return QString();
+    }
+    QString path = QDir::cleanPath(QDir(_directory).absolutePath() + "/" + parsedURL.host() + "/" + parsedURL.path());
+    return isInDirectory(path) ? path : QString();
+}
+
+bool ModelBoundsCache::isInDirectory(const QString& path) const {
+    QString directory = QDir::cleanPath(QDir(_directory).absolutePath());
+    if (!directory.endsWith('/')) {
+        directory += '/';
+    }
+    return QDir::cleanPath(QFileInfo(path).absoluteFilePath()).startsWith(directory);
+}
+
+void ModelBoundsCache::setBounds(const QString& url, FBXGeometry* bounds) {
+    QMutexLocker locker(&_boundsMutex);
+    _bounds.insert(url, bounds);
+}
@@ -0,0 +1,61 @@
+//
+//  ModelBoundsCache.h
+//  assignment-client/src/models
+//
+//  Copyright 2014 High Fidelity, Inc.
+//
+//  Reads the bounds of the models' geometry for the model server, which culls models by them
+//
+//  Distributed under the Apache License, Version 2.0.
+//  See the accompanying file LICENSE or http://www.apache.org/licenses/LICENSE-2.0.html
+//
+
+#ifndef hifi_ModelBoundsCache_h
+#define hifi_ModelBoundsCache_h
+
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QThreadPool>
+
+#include <ModelTree.h>
+
+/// The most mesh boxes kept as a model's coarse proxy; models with more meshes have them merged.
+const int MAX_MODEL_PROXY_MESHES = 8;
+
+/// Reads the geometry of each model URL once, from a local directory that mirrors the URLs (by host, then path), and keeps
+/// only what the server culls by: the geometry's mesh extents, and a coarse proxy of up to MAX_MODEL_PROXY_MESHES meshes
+/// that hold nothing but their extents.  Geometry is read in the background; until a URL has been read (or if there's no
+/// local copy of it), its models are culled by their radii as before.
+class ModelBoundsCache : public ModelItemFBXService {
+public:
+    ModelBoundsCache(const QString& directory);
+    ~ModelBoundsCache();
+
+    /// Returns the bounds of the model's geometry, or NULL if they haven't been read.  Safe to call from any thread.
+    virtual const FBXGeometry* getGeometryForModel(const ModelItem& modelItem);
+
+    /// Returns the bounds kept for a model's geometry: its mesh extents, and a mesh (holding only its extents) for each of
+    /// its meshes, merged with their neighbors along the longest axis down to MAX_MODEL_PROXY_MESHES.
+    static FBXGeometry* extractBounds(const FBXGeometry& geometry);
+
+    /// Returns the path of the local copy of the given URL, or an empty string if the URL has no host or its path leads out
+    /// of the directory.
+    QString getLocalPath(const QString& url) const;
+
+    /// Checks that a path (once any ".." segments are resolved) lies within the directory.
+    bool isInDirectory(const QString& path) const;
+
+    /// Called by the readers with the bounds of a URL's geometry, or NULL if it couldn't be read.
+    void setBounds(const QString& url, FBXGeometry* bounds);
+
+private:
+
+    QString _directory;
+    QThreadPool _readers;
+
+    QMutex _boundsMutex;
+    QHash<QString, FBXGeometry*> _bounds; // NULL while being read, or if it couldn't be
+};
+
+#endif // hifi_ModelBoundsCache_h
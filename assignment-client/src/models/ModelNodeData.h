@@ -20,15 +20,16 @@ class ModelNodeData : public OctreeQueryNode {
 public:
     ModelNodeData() :
         OctreeQueryNode(),
-        _lastDeletedModelsSentAt(0) {  };
+        _deletedModelsSequence(0) {  };
 
     virtual PacketType getMyPacketType() const { return PacketTypeModelData; }
 
-    quint64 getLastDeletedModelsSentAt() const { return _lastDeletedModelsSentAt; }
-    void setLastDeletedModelsSentAt(quint64 sentAt) { _lastDeletedModelsSentAt = sentAt; }
+    /// The sequence number of the next deleted model this node hasn't been sent.
+    quint64 getDeletedModelsSequence() const { return _deletedModelsSequence; }
+    void setDeletedModelsSequence(quint64 sequence) { _deletedModelsSequence = sequence; }
 
 private:
-    quint64 _lastDeletedModelsSentAt;
+    quint64 _deletedModelsSequence;
 };
 
 #endif // hifi_ModelNodeData_h
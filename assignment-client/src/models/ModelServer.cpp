@@ -19,14 +19,18 @@
 const char* MODEL_SERVER_NAME = "Model";
 const char* MODEL_SERVER_LOGGING_TARGET_NAME = "model-server";
 const char* LOCAL_MODELS_PERSIST_FILE = "resources/models.svo";
+const char* LOCAL_MODELS_CACHE_DIRECTORY = "resources/modelCache";
 
-ModelServer::ModelServer(const QByteArray& packet) : OctreeServer(packet) {
-    // nothing special to do here...
+ModelServer::ModelServer(const QByteArray& packet) :
+    OctreeServer(packet),
+    _boundsCache(NULL) {
 }
 
 ModelServer::~ModelServer() {
     ModelTree* tree = (ModelTree*)_tree;
     tree->removeNewlyCreatedHook(this);
+    tree->setFBXService(NULL);
+    delete _boundsCache;
 }
 
 OctreeQueryNode* ModelServer::createOctreeQueryNode() {
@@ -44,6 +48,15 @@ void ModelServer::beforeRun() {
     connect(pruneDeletedModelsTimer, SIGNAL(timeout()), this, SLOT(pruneDeletedModels()));
     const int PRUNE_DELETED_MODELS_INTERVAL_MSECS = 1 * 1000; // once every second
     pruneDeletedModelsTimer->start(PRUNE_DELETED_MODELS_INTERVAL_MSECS);
+
+    // the models are culled by the bounds of their geometry, read from local copies of their URLs
+    const char* MODEL_CACHE_DIRECTORY = "--modelCacheDirectory";
+    const char* modelCacheDirectoryParameter = getCmdOption(_argc, _argv, MODEL_CACHE_DIRECTORY);
+    QString modelCacheDirectory = modelCacheDirectoryParameter ? modelCacheDirectoryParameter : LOCAL_MODELS_CACHE_DIRECTORY;
+    qDebug() << "modelCacheDirectory=" << modelCacheDirectory;
+
+    _boundsCache = new ModelBoundsCache(modelCacheDirectory);
+    static_cast<ModelTree*>(_tree)->setFBXService(_boundsCache);
 }
 
 void ModelServer::modelCreated(const ModelItem& newModel, const SharedNodePointer& senderNode) {
@@ -74,13 +87,13 @@ void ModelServer::modelCreated(const ModelItem& newModel, const SharedNodePointe
 bool ModelServer::hasSpecialPacketToSend(const SharedNodePointer& node) {
     bool shouldSendDeletedModels = false;
 
-    // check to see if any new models have been added since we last sent to this node...
+    // check to see if any models have been deleted since we last sent to this node...
     ModelNodeData* nodeData = static_cast<ModelNodeData*>(node->getLinkedData());
     if (nodeData) {
-        quint64 deletedModelsSentAt = nodeData->getLastDeletedModelsSentAt();
+        quint64 deletedModelsSequence = nodeData->getDeletedModelsSequence();
 
         ModelTree* tree = static_cast<ModelTree*>(_tree);
-        shouldSendDeletedModels = tree->hasModelsDeletedSince(deletedModelsSentAt);
+        shouldSendDeletedModels = tree->hasModelsDeletedSince(deletedModelsSequence);
     }
 
     return shouldSendDeletedModels;
@@ -92,16 +105,16 @@ int ModelServer::sendSpecialPacket(const SharedNodePointer& node, OctreeQueryNod
 
     ModelNodeData* nodeData = static_cast<ModelNodeData*>(node->getLinkedData());
     if (nodeData) {
-        quint64 deletedModelsSentAt = nodeData->getLastDeletedModelsSentAt();
-        quint64 deletePacketSentAt = usecTimestampNow();
-
+        // only the deletions since this node's sequence number are gathered, not the whole log
+        quint64 deletedModelsSequence = nodeData->getDeletedModelsSequence();
+        QVector<uint32_t> deletedModelIDs;
         ModelTree* tree = static_cast<ModelTree*>(_tree);
-        bool hasMoreToSend = true;
+        tree->getModelsDeletedSince(deletedModelsSequence, deletedModelIDs);
 
-        // TODO: is it possible to send too many of these packets? what if you deleted 1,000,000 models?
         packetsSent = 0;
-        while (hasMoreToSend) {
-            hasMoreToSend = tree->encodeModelsDeletedSince(queryNode->getSequenceNumber(), deletedModelsSentAt,
+        int idsSent = 0;
+        do {
+            idsSent = tree->encodeDeletedModels(queryNode->getSequenceNumber(), deletedModelIDs, idsSent,
                                                 outputBuffer, MAX_PACKET_SIZE, packetLength);
 
             //qDebug() << "sending PacketType_MODEL_ERASE packetLength:" << packetLength;
@@ -109,9 +122,9 @@ int ModelServer::sendSpecialPacket(const SharedNodePointer& node, OctreeQueryNod
             NodeList::getInstance()->writeDatagram((char*) outputBuffer, packetLength, SharedNodePointer(node));
             queryNode->packetSent(outputBuffer, packetLength);
             packetsSent++;
-        }
+        } while (idsSent < deletedModelIDs.size());
 
-        nodeData->setLastDeletedModelsSentAt(deletePacketSentAt);
+        nodeData->setDeletedModelsSequence(deletedModelsSequence);
     }
 
     // TODO: caller is expecting a packetLength, what if we send more than one packet??
@@ -123,18 +136,18 @@ void ModelServer::pruneDeletedModels() {
     if (tree->hasAnyDeletedModels()) {
 
         //qDebug() << "there are some deleted models to consider...";
-        quint64 earliestLastDeletedModelsSent = usecTimestampNow() + 1; // in the future
+        quint64 earliestDeletedModelsSequence = tree->getNextDeletedModelSequence();
         foreach (const SharedNodePointer& otherNode, NodeList::getInstance()->getNodeHash()) {
             if (otherNode->getLinkedData()) {
                 ModelNodeData* nodeData = static_cast<ModelNodeData*>(otherNode->getLinkedData());
-                quint64 nodeLastDeletedModelsSentAt = nodeData->getLastDeletedModelsSentAt();
-                if (nodeLastDeletedModelsSentAt < earliestLastDeletedModelsSent) {
-                    earliestLastDeletedModelsSent = nodeLastDeletedModelsSentAt;
+                quint64 nodeDeletedModelsSequence = nodeData->getDeletedModelsSequence();
+                if (nodeDeletedModelsSequence < earliestDeletedModelsSequence) {
+                    earliestDeletedModelsSequence = nodeDeletedModelsSequence;
                 }
             }
         }
-        //qDebug() << "earliestLastDeletedModelsSent=" << earliestLastDeletedModelsSent;
-        tree->forgetModelsDeletedBefore(earliestLastDeletedModelsSent);
+        //qDebug() << "earliestDeletedModelsSequence=" << earliestDeletedModelsSequence;
+        tree->forgetModelsDeletedBefore(earliestDeletedModelsSequence);
     }
 }
 
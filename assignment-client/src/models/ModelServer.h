@@ -14,6 +14,7 @@
 
 #include "../octree/OctreeServer.h"
 
+#include "ModelBoundsCache.h"
 #include "ModelItem.h"
 #include "ModelServerConsts.h"
 #include "ModelTree.h"
@@ -46,6 +47,7 @@ public slots:
     void pruneDeletedModels();
 
 private:
+    ModelBoundsCache* _boundsCache;
 };
 
 #endif // hifi_ModelServer_h
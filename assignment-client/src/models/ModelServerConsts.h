@@ -15,5 +15,6 @@
 extern const char* MODEL_SERVER_NAME;
 extern const char* MODEL_SERVER_LOGGING_TARGET_NAME;
 extern const char* LOCAL_MODELS_PERSIST_FILE;
+extern const char* LOCAL_MODELS_CACHE_DIRECTORY;
 
 #endif // hifi_ModelServerConsts_h
@@ -42,7 +42,9 @@ OctreeQueryNode::OctreeQueryNode() :
     _lastRootTimestamp(0),
     _myPacketType(PacketTypeUnknown),
     _isShuttingDown(false),
-    _sentPacketHistory(1000)
+    _sentPacketHistory(1000),
+    _nackedSequenceNumbers(),
+    _congestionControl()
 {
 }
 
@@ -374,6 +376,7 @@ void OctreeQueryNode::packetSent(unsigned char* packet, int packetLength) {
 
 void OctreeQueryNode::packetSent(const QByteArray& packet) {
     _sentPacketHistory.packetSent(_sequenceNumber, packet);
+    _congestionControl.packetSent(packet.size());
     _sequenceNumber++;
 }
 
@@ -404,4 +407,7 @@ void OctreeQueryNode::parseNackPacket(QByteArray& packet) {
         _nackedSequenceNumbers.enqueue(sequenceNumber);
         dataAt += sizeof(OCTREE_PACKET_SEQUENCE);
     }
+
+    // every nacked sequence number is a loss report that our send rate should respond to
+    _congestionControl.packetsLost(numSequenceNumbers);
 }
@@ -19,10 +19,12 @@
 #include <NodeData.h>
 #include <OctreeConstants.h>
 #include <OctreeElementBag.h>
+#include <OctreeItemSendTimes.h>
 #include <OctreePacketData.h>
 #include <OctreeQuery.h>
 #include <OctreeSceneStats.h>
 #include <ThreadedAssignment.h> // for SharedAssignmentPointer
+#include "CongestionControl.h"
 #include "SentPacketHistory.h"
 #include <qqueue.h>
 
@@ -58,6 +60,7 @@ public:
 
     OctreeElementBag nodeBag;
     CoverageMap map;
+    OctreeItemSendTimes itemSendTimes;
 
     ViewFrustum& getCurrentViewFrustum() { return _currentViewFrustum; }
     ViewFrustum& getLastKnownViewFrustum() { return _lastKnownViewFrustum; }
@@ -112,6 +115,9 @@ public:
     bool hasNextNackedPacket() const;
     const QByteArray* getNextNackedPacket();
 
+    CongestionControl& getCongestionControl() { return _congestionControl; }
+    const CongestionControl& getCongestionControl() const { return _congestionControl; }
+
 private slots:
     void sendThreadFinished();
     
@@ -157,6 +163,8 @@ private:
 
     SentPacketHistory _sentPacketHistory;
     QQueue<OCTREE_PACKET_SEQUENCE> _nackedSequenceNumbers;
+
+    CongestionControl _congestionControl;
 };
 
 #endif // hifi_OctreeQueryNode_h
@@ -294,9 +294,33 @@ int OctreeSendThread::packetDistributor(OctreeQueryNode* nodeData, bool viewFrus
     int clientMaxPacketsPerInterval = std::max(1, (nodeData->getMaxOctreePacketsPerSecond() / INTERVALS_PER_SECOND));
     int maxPacketsPerInterval = std::min(clientMaxPacketsPerInterval, _myServer->getPacketsPerClientPerInterval());
 
+    // the congestion controller tracks this client's path and further limits what we send this interval
+    CongestionControl& congestionControl = nodeData->getCongestionControl();
+    congestionControl.setMaxPacketsPerSecond(std::min(nodeData->getMaxOctreePacketsPerSecond(),
+                                                      _myServer->getPacketsPerClientPerSecond()));
+    congestionControl.roundTripTimeSampled(_node->getPingMs());
+    maxPacketsPerInterval = std::min(maxPacketsPerInterval, congestionControl.getAvailablePackets());
+
     int truePacketsSent = 0;
     int trueBytesSent = 0;
     int packetsSentThisInterval = 0;
+
+    // Re-send packets that were nacked by the client, these take priority over any new scene data
+    while (nodeData->hasNextNackedPacket() && packetsSentThisInterval < maxPacketsPerInterval) {
+        const QByteArray* packet = nodeData->getNextNackedPacket();
+        if (packet) {
+            OctreeServer::didCallWriteDatagram(this);
+            NodeList::getInstance()->writeDatagram(*packet, _node);
+            congestionControl.packetSent(packet->size());
+            trueBytesSent += packet->size();
+            truePacketsSent++;
+            packetsSentThisInterval++;
+
+            _totalBytes += packet->size();
+            _totalPackets++;
+            _totalWastedBytes += MAX_PACKET_SIZE - packet->size();
+        }
+    }
     bool isFullScene = ((!viewFrustumChanged || !nodeData->getWantDelta()) && nodeData->getViewFrustumJustStoppedChanging()) 
                                 || nodeData->hasLodChanged();
 
@@ -333,6 +357,11 @@ int OctreeSendThread::packetDistributor(OctreeQueryNode* nodeData, bool viewFrus
     // the current view frustum for things to send.
     if (viewFrustumChanged || nodeData->nodeBag.isEmpty()) {
 
+        // the items sent in a completed scene have all made it into packets, but if we're restarting the scene part way
+        // through, some of them may have been discarded along with the element data that didn't fit.  this has to be
+        // checked before the out of view elements are dumped, which can empty the bag without their items being sent
+        bool sceneWasComplete = nodeData->nodeBag.isEmpty();
+
         // if our view has changed, we need to reset these things...
         if (viewFrustumChanged) {
             if (nodeData->moveShouldDump() || nodeData->hasLodChanged()) {
@@ -347,6 +376,12 @@ int OctreeSendThread::packetDistributor(OctreeQueryNode* nodeData, bool viewFrus
             nodeData->setLastTimeBagEmpty(now);
         }
 
+        if (sceneWasComplete) {
+            nodeData->itemSendTimes.sceneCompleted();
+        } else {
+            nodeData->itemSendTimes.sceneAbandoned();
+        }
+
         // track completed scenes and send out the stats packet accordingly
         nodeData->stats.sceneCompleted();
         nodeData->setLastRootTimestamp(_myServer->getOctree()->getRoot()->getLastChanged());
@@ -363,6 +398,7 @@ int OctreeSendThread::packetDistributor(OctreeQueryNode* nodeData, bool viewFrus
         // If we're starting a full scene, then definitely we want to empty the nodeBag
         if (isFullScene) {
             nodeData->nodeBag.deleteAll();
+            nodeData->itemSendTimes.clear(); // and to send every item whole
         }
 
         // TODO: add these to stats page
@@ -440,6 +476,7 @@ int OctreeSendThread::packetDistributor(OctreeQueryNode* nodeData, bool viewFrus
                                              wantOcclusionCulling, coverageMap, boundaryLevelAdjust, voxelSizeScale,
                                              nodeData->getLastTimeBagEmpty(),
                                              isFullScene, &nodeData->stats, _myServer->getJurisdiction());
+                params.itemSendTimes = &nodeData->itemSendTimes;
 
                 // TODO: should this include the lock time or not? This stat is sent down to the client,
                 // it seems like it may be a good idea to include the lock time as part of the encode time
@@ -568,20 +605,6 @@ int OctreeSendThread::packetDistributor(OctreeQueryNode* nodeData, bool viewFrus
             packetsSentThisInterval += specialPacketsSent;
         }
 
-        // Re-send packets that were nacked by the client
-        while (nodeData->hasNextNackedPacket() && packetsSentThisInterval < maxPacketsPerInterval) {
-            const QByteArray* packet = nodeData->getNextNackedPacket();
-            if (packet) {
-                NodeList::getInstance()->writeDatagram(*packet, _node);
-                truePacketsSent++;
-                packetsSentThisInterval++;
-
-                _totalBytes += packet->size();
-                _totalPackets++;
-                _totalWastedBytes += MAX_PACKET_SIZE - packet->size();
-            }
-        }
-
         quint64 end = usecTimestampNow();
         int elapsedmsec = (end - start)/USECS_PER_MSEC;
         OctreeServer::trackLoopTime(elapsedmsec);
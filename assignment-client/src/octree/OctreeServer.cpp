@@ -616,6 +616,32 @@ bool OctreeServer::handleHTTPRequest(HTTPConnection* connection, const QUrl& url
         statsString += "\r\n";
         statsString += "\r\n";
 
+        // display the state of each client's congestion controller
+        statsString += QString("<b>%1 Per Client Send Rates...</b>\r\n").arg(getMyServerName());
+        foreach (const SharedNodePointer& node, NodeList::getInstance()->getNodeHash()) {
+            OctreeQueryNode* nodeData = static_cast<OctreeQueryNode*>(node->getLinkedData());
+            if (!nodeData || !nodeData->isOctreeSendThreadInitalized()) {
+                continue;
+            }
+            const CongestionControl& congestionControl = nodeData->getCongestionControl();
+            statsString += QString("\r\n                 Stats for client uuid: %1\r\n").arg(node->getUUID().toString());
+            statsString += QString().sprintf("                      Send rate:  %9.2f pps (max %d pps)\r\n",
+                congestionControl.getPacketsPerSecond(), congestionControl.getMaxPacketsPerSecond());
+            statsString += QString().sprintf("            Estimated bandwidth:  %9.2f kbps\r\n",
+                congestionControl.getEstimatedBandwidth() * BITS_IN_BYTE / 1000.0f);
+            statsString += QString().sprintf("                            RTT:  %9.2f msecs (min %.2f msecs)\r\n",
+                congestionControl.getRoundTripTime(), congestionControl.getMinRoundTripTime());
+            statsString += QString().sprintf("                      Loss rate:      %5.2f%%\r\n",
+                congestionControl.getLossRate() * AS_PERCENT);
+            statsString += QString("                   Packets sent: %1 packets\r\n")
+                .arg(locale.toString((uint)congestionControl.getTotalPacketsSent()).rightJustified(COLUMN_WIDTH, ' '));
+            statsString += QString("                 Packets nacked: %1 packets\r\n")
+                .arg(locale.toString((uint)congestionControl.getTotalPacketsLost()).rightJustified(COLUMN_WIDTH, ' '));
+        }
+
+        statsString += "\r\n";
+        statsString += "\r\n";
+
         // display inbound packet stats
         statsString += QString().sprintf("<b>%s Edit Statistics... <a href='/resetStats'>[RESET]</a></b>\r\n",
                                          getMyServerName());
@@ -1279,6 +1305,27 @@ void OctreeServer::sendStatsPacket() {
         (double)_octreeInboundPacketProcessor->getAverageLockWaitTimePerElement();
 
     NodeList::getInstance()->sendStatsToDomainServer(statsObject3);
+
+    // the health of each sender's edit stream, these can add up to more than an MTU so we split them as needed
+    QJsonObject streamStatsObject;
+    int sizeOfStats = 0;
+    const int TOO_BIG_FOR_MTU = 1200; // some extra space for JSONification
+    NodeToSenderStatsMap& allSenderStats = _octreeInboundPacketProcessor->getSingleSenderStats();
+    for (NodeToSenderStatsMapConstIterator i = allSenderStats.begin(); i != allSenderStats.end(); i++) {
+        QString property = baseName + QString(".4.inbound.streams.") + i.key().toString();
+        QString value = i.value().getIncomingEditSequenceNumberStats().getStatsString();
+        streamStatsObject[property] = value;
+        sizeOfStats += property.size() + value.size();
+
+        if (sizeOfStats > TOO_BIG_FOR_MTU) {
+            NodeList::getInstance()->sendStatsToDomainServer(streamStatsObject);
+            streamStatsObject = QJsonObject();
+            sizeOfStats = 0;
+        }
+    }
+    if (!streamStatsObject.isEmpty()) {
+        NodeList::getInstance()->sendStatsToDomainServer(streamStatsObject);
+    }
 }
 
 QMap<OctreeSendThread*, quint64> OctreeServer::_threadsDidProcess;
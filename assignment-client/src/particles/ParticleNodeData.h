@@ -20,15 +20,16 @@ class ParticleNodeData : public OctreeQueryNode {
 public:
     ParticleNodeData() :
         OctreeQueryNode(),
-        _lastDeletedParticlesSentAt(0) {  };
+        _deletedParticlesSequence(0) {  };
 
     virtual PacketType getMyPacketType() const { return PacketTypeParticleData; }
 
-    quint64 getLastDeletedParticlesSentAt() const { return _lastDeletedParticlesSentAt; }
-    void setLastDeletedParticlesSentAt(quint64 sentAt) { _lastDeletedParticlesSentAt = sentAt; }
+    /// The sequence number of the next deleted particle this node hasn't been sent.
+    quint64 getDeletedParticlesSequence() const { return _deletedParticlesSequence; }
+    void setDeletedParticlesSequence(quint64 sequence) { _deletedParticlesSequence = sequence; }
 
 private:
-    quint64 _lastDeletedParticlesSentAt;
+    quint64 _deletedParticlesSequence;
 };
 
 #endif // hifi_ParticleNodeData_h
@@ -74,13 +74,13 @@ void ParticleServer::particleCreated(const Particle& newParticle, const SharedNo
 bool ParticleServer::hasSpecialPacketToSend(const SharedNodePointer& node) {
     bool shouldSendDeletedParticles = false;
 
-    // check to see if any new particles have been added since we last sent to this node...
+    // check to see if any particles have been deleted since we last sent to this node...
     ParticleNodeData* nodeData = static_cast<ParticleNodeData*>(node->getLinkedData());
     if (nodeData) {
-        quint64 deletedParticlesSentAt = nodeData->getLastDeletedParticlesSentAt();
+        quint64 deletedParticlesSequence = nodeData->getDeletedParticlesSequence();
 
         ParticleTree* tree = static_cast<ParticleTree*>(_tree);
-        shouldSendDeletedParticles = tree->hasParticlesDeletedSince(deletedParticlesSentAt);
+        shouldSendDeletedParticles = tree->hasParticlesDeletedSince(deletedParticlesSequence);
     }
 
     return shouldSendDeletedParticles;
@@ -92,16 +92,16 @@ int ParticleServer::sendSpecialPacket(const SharedNodePointer& node, OctreeQuery
 
     ParticleNodeData* nodeData = static_cast<ParticleNodeData*>(node->getLinkedData());
     if (nodeData) {
-        quint64 deletedParticlesSentAt = nodeData->getLastDeletedParticlesSentAt();
-        quint64 deletePacketSentAt = usecTimestampNow();
-
+        // only the deletions since this node's sequence number are gathered, not the whole log
+        quint64 deletedParticlesSequence = nodeData->getDeletedParticlesSequence();
+        QVector<uint32_t> deletedParticleIDs;
         ParticleTree* tree = static_cast<ParticleTree*>(_tree);
-        bool hasMoreToSend = true;
+        tree->getParticlesDeletedSince(deletedParticlesSequence, deletedParticleIDs);
 
-        // TODO: is it possible to send too many of these packets? what if you deleted 1,000,000 particles?
         packetsSent = 0;
-        while (hasMoreToSend) {
-            hasMoreToSend = tree->encodeParticlesDeletedSince(queryNode->getSequenceNumber(), deletedParticlesSentAt,
+        int idsSent = 0;
+        do {
+            idsSent = tree->encodeDeletedParticles(queryNode->getSequenceNumber(), deletedParticleIDs, idsSent,
                                                 outputBuffer, MAX_PACKET_SIZE, packetLength);
 
             //qDebug() << "sending PacketType_PARTICLE_ERASE packetLength:" << packetLength;
@@ -109,9 +109,9 @@ int ParticleServer::sendSpecialPacket(const SharedNodePointer& node, OctreeQuery
             NodeList::getInstance()->writeDatagram((char*) outputBuffer, packetLength, SharedNodePointer(node));
             queryNode->packetSent(outputBuffer, packetLength);
             packetsSent++;
-        }
+        } while (idsSent < deletedParticleIDs.size());
 
-        nodeData->setLastDeletedParticlesSentAt(deletePacketSentAt);
+        nodeData->setDeletedParticlesSequence(deletedParticlesSequence);
     }
 
     // TODO: caller is expecting a packetLength, what if we send more than one packet??
@@ -123,18 +123,18 @@ void ParticleServer::pruneDeletedParticles() {
     if (tree->hasAnyDeletedParticles()) {
 
         //qDebug() << "there are some deleted particles to consider...";
-        quint64 earliestLastDeletedParticlesSent = usecTimestampNow() + 1; // in the future
+        quint64 earliestDeletedParticlesSequence = tree->getNextDeletedParticleSequence();
         foreach (const SharedNodePointer& otherNode, NodeList::getInstance()->getNodeHash()) {
             if (otherNode->getLinkedData()) {
                 ParticleNodeData* nodeData = static_cast<ParticleNodeData*>(otherNode->getLinkedData());
-                quint64 nodeLastDeletedParticlesSentAt = nodeData->getLastDeletedParticlesSentAt();
-                if (nodeLastDeletedParticlesSentAt < earliestLastDeletedParticlesSent) {
-                    earliestLastDeletedParticlesSent = nodeLastDeletedParticlesSentAt;
+                quint64 nodeDeletedParticlesSequence = nodeData->getDeletedParticlesSequence();
+                if (nodeDeletedParticlesSequence < earliestDeletedParticlesSequence) {
+                    earliestDeletedParticlesSequence = nodeDeletedParticlesSequence;
                 }
             }
         }
-        //qDebug() << "earliestLastDeletedParticlesSent=" << earliestLastDeletedParticlesSent;
-        tree->forgetParticlesDeletedBefore(earliestLastDeletedParticlesSent);
+        //qDebug() << "earliestDeletedParticlesSequence=" << earliestDeletedParticlesSequence;
+        tree->forgetParticlesDeletedBefore(earliestDeletedParticlesSequence);
     }
 }
 
@@ -42,6 +42,7 @@ DomainServer::DomainServer(int argc, char* argv[]) :
     _hostname(),
     _networkReplyUUIDMap(),
     _sessionAuthenticationHash(),
+    _domainListVersion(0),
     _settingsManager()
 {
     setOrganizationName("High Fidelity");
@@ -177,6 +178,12 @@ void DomainServer::setupNodeListAndAssignments(const QUuid& sessionUUID) {
 
     LimitedNodeList* nodeList = LimitedNodeList::createInstance(domainServerPort, domainServerDTLSPort);
 
+    // assignment-clients on this machine can reach us through shared memory
+    const QString NO_SHARED_MEMORY_OPTION = "no-shared-memory";
+    if (!_argumentVariantMap.contains(NO_SHARED_MEMORY_OPTION)) {
+        nodeList->enableSharedMemoryTransport();
+    }
+
     connect(nodeList, &LimitedNodeList::nodeAdded, this, &DomainServer::nodeAdded);
     connect(nodeList, &LimitedNodeList::nodeKilled, this, &DomainServer::nodeKilled);
 
@@ -478,6 +485,9 @@ void DomainServer::handleConnectRequest(const QByteArray& packet, const HifiSock
 
         nodeData->setSendingSockAddr(senderSockAddr);
 
+        // cache the record other nodes will receive for this node, this also marks it as new in the domain list
+        refreshCachedNodeRecord(newNode);
+
         // reply back to the user with a PacketTypeDomainList
         sendDomainListToNode(newNode, senderSockAddr, nodeInterestListFromPacket(packet, numPreInterestBytes));
     }
@@ -560,21 +570,66 @@ NodeSet DomainServer::nodeInterestListFromPacket(const QByteArray& packet, int n
     return nodeInterestSet;
 }
 
+quint32 DomainServer::domainListVersionFromPacket(const QByteArray& packet, int numPreceedingBytes) {
+    QDataStream packetStream(packet);
+    packetStream.skipRawData(numPreceedingBytes);
+
+    // the acknowledged list version follows the node interest list
+    quint8 numInterestTypes = 0;
+    packetStream >> numInterestTypes;
+    packetStream.skipRawData(numInterestTypes * sizeof(NodeType_t));
+
+    quint32 listVersion = 0;
+    if (!packetStream.atEnd()) {
+        packetStream >> listVersion;
+    }
+
+    return listVersion;
+}
+
+void DomainServer::refreshCachedNodeRecord(const SharedNodePointer& node) {
+    DomainServerNodeData* nodeData = reinterpret_cast<DomainServerNodeData*>(node->getLinkedData());
+
+    // every change to a record bumps the domain list version, so that nodes can be sent only what changed
+    if (nodeData->updateCachedRecord(*node, _domainListVersion + 1)) {
+        _domainListVersion++;
+    }
+}
+
+// every so often a node gets the full list regardless of what it has acknowledged, in case a delta went missing
+const int DOMAIN_LISTS_PER_FULL_LIST = 30;
+
 void DomainServer::sendDomainListToNode(const SharedNodePointer& node, const HifiSockAddr &senderSockAddr,
-                                        const NodeSet& nodeInterestList) {
+                                        const NodeSet& nodeInterestList, quint32 acknowledgedListVersion) {
 
     QByteArray broadcastPacket = byteArrayWithPopulatedHeader(PacketTypeDomainList);
 
-    // always send the node their own UUID back
+    DomainServerNodeData* nodeData = reinterpret_cast<DomainServerNodeData*>(node->getLinkedData());
+
+    // we can send only the records that changed since the version the node has acknowledged as long as it is one
+    // we actually sent and it is still interested in the same node types
+    bool isFullList = acknowledgedListVersion == 0 || acknowledgedListVersion > nodeData->getLastSentListVersion()
+        || nodeInterestList != nodeData->getLastInterestList()
+        || nodeData->getListsSinceFullList() >= DOMAIN_LISTS_PER_FULL_LIST;
+
+    nodeData->setLastInterestList(nodeInterestList);
+    nodeData->setLastSentListVersion(_domainListVersion);
+    nodeData->setListsSinceFullList(isFullList ? 0 : nodeData->getListsSinceFullList() + 1);
+
+    // always send the node their own UUID back, followed by the list version, whether or not this is a delta,
+    // and the index and count of the packets making up this list
     QDataStream broadcastDataStream(&broadcastPacket, QIODevice::Append);
-    broadcastDataStream << node->getUUID();
+    broadcastDataStream << node->getUUID() << _domainListVersion << (quint8) isFullList << (quint8) 0;
 
-    int numBroadcastPacketLeadBytes = broadcastDataStream.device()->pos();
+    int numPacketsOffset = broadcastPacket.size();
+    broadcastDataStream << (quint8) 0;
 
-    DomainServerNodeData* nodeData = reinterpret_cast<DomainServerNodeData*>(node->getLinkedData());
+    int numBroadcastPacketLeadBytes = broadcastDataStream.device()->pos();
 
     LimitedNodeList* nodeList = LimitedNodeList::getInstance();
 
+    QList<QByteArray> listPackets;
+
     if (nodeInterestList.size() > 0) {
 
 //        DTLSServerSession* dtlsSession = _isUsingDTLS ? _dtlsSessions[senderSockAddr] : NULL;
@@ -584,14 +639,21 @@ void DomainServer::sendDomainListToNode(const SharedNodePointer& node, const Hif
             // if this authenticated node has any interest types, send back those nodes as well
             foreach (const SharedNodePointer& otherNode, nodeList->getNodeHash()) {
 
-                // reset our nodeByteArray and nodeDataStream
-                QByteArray nodeByteArray;
-                QDataStream nodeDataStream(&nodeByteArray, QIODevice::Append);
-
                 if (otherNode->getUUID() != node->getUUID() && nodeInterestList.contains(otherNode->getType())) {
+                    DomainServerNodeData* otherNodeData = reinterpret_cast<DomainServerNodeData*>(otherNode->getLinkedData());
+
+                    if (otherNodeData->getCachedRecord().isEmpty()) {
+                        refreshCachedNodeRecord(otherNode);
+                    }
+
+                    if (!isFullList && otherNodeData->getRecordVersion() <= acknowledgedListVersion) {
+                        // this node already has an up to date record for otherNode
+                        continue;
+                    }
 
-                    // don't send avatar nodes to other avatars, that will come from avatar mixer
-                    nodeDataStream << *otherNode.data();
+                    // reset our nodeByteArray and nodeDataStream, starting with the cached record
+                    QByteArray nodeByteArray = otherNodeData->getCachedRecord();
+                    QDataStream nodeDataStream(&nodeByteArray, QIODevice::Append);
 
                     // pack the secret that these two nodes will use to communicate with each other
                     QUuid secretUUID = nodeData->getSessionSecretHash().value(otherNode->getUUID());
@@ -603,8 +665,7 @@ void DomainServer::sendDomainListToNode(const SharedNodePointer& node, const Hif
                         nodeData->getSessionSecretHash().insert(otherNode->getUUID(), secretUUID);
 
                         // set it on the other Node's sessionSecretHash
-                        reinterpret_cast<DomainServerNodeData*>(otherNode->getLinkedData())
-                        ->getSessionSecretHash().insert(node->getUUID(), secretUUID);
+                        otherNodeData->getSessionSecretHash().insert(node->getUUID(), secretUUID);
 
                     }
 
@@ -612,13 +673,11 @@ void DomainServer::sendDomainListToNode(const SharedNodePointer& node, const Hif
 
                     if (broadcastPacket.size() +  nodeByteArray.size() > dataMTU) {
                         // we need to break here and start a new packet
-                        // so send the current one
-
-                        nodeList->writeDatagram(broadcastPacket, node, senderSockAddr);
+                        listPackets.append(broadcastPacket);
 
                         // reset the broadcastPacket structure
                         broadcastPacket.resize(numBroadcastPacketLeadBytes);
-                        broadcastDataStream.device()->seek(numBroadcastPacketLeadBytes);
+                        broadcastPacket[numPacketsOffset - 1] = (char) listPackets.size();
                     }
 
                     // append the nodeByteArray to the current state of broadcastDataStream
@@ -626,9 +685,15 @@ void DomainServer::sendDomainListToNode(const SharedNodePointer& node, const Hif
                 }
             }
         }
+    }
+
+    // always write the last broadcastPacket
+    listPackets.append(broadcastPacket);
 
-        // always write the last broadcastPacket
-        nodeList->writeDatagram(broadcastPacket, node, senderSockAddr);
+    // now that we know how many packets make up this list, fill in the count and send them
+    for (int i = 0; i < listPackets.size(); i++) {
+        listPackets[i][numPacketsOffset] = (char) listPackets.size();
+        nodeList->writeDatagram(listPackets.at(i), node, senderSockAddr);
     }
 }
 
@@ -641,10 +706,7 @@ void DomainServer::readAvailableDatagrams() {
     static QByteArray assignmentPacket = byteArrayWithPopulatedHeader(PacketTypeCreateAssignment);
     static int numAssignmentPacketHeaderBytes = assignmentPacket.size();
 
-    while (nodeList->getNodeSocket().hasPendingDatagrams()) {
-        receivedPacket.resize(nodeList->getNodeSocket().pendingDatagramSize());
-        nodeList->getNodeSocket().readDatagram(receivedPacket.data(), receivedPacket.size(),
-                                               senderSockAddr.getAddressPointer(), senderSockAddr.getPortPointer());
+    while (nodeList->readDatagram(receivedPacket, senderSockAddr)) {
         if (packetTypeForPacket(receivedPacket) == PacketTypeRequestAssignment
             && nodeList->packetVersionAndHashMatch(receivedPacket)) {
 
@@ -830,12 +892,14 @@ void DomainServer::processDatagram(const QByteArray& receivedPacket, const HifiS
                                                                   receivedPacket, senderSockAddr);
 
                 SharedNodePointer checkInNode = nodeList->updateSocketsForNode(nodeUUID, nodePublicAddress, nodeLocalAddress);
+                refreshCachedNodeRecord(checkInNode);
 
                 // update last receive to now
                 quint64 timeNow = usecTimestampNow();
                 checkInNode->setLastHeardMicrostamp(timeNow);
 
-                sendDomainListToNode(checkInNode, senderSockAddr, nodeInterestListFromPacket(receivedPacket, numNodeInfoBytes));
+                sendDomainListToNode(checkInNode, senderSockAddr, nodeInterestListFromPacket(receivedPacket, numNodeInfoBytes),
+                                     domainListVersionFromPacket(receivedPacket, numNodeInfoBytes));
             }
         } else if (requestType == PacketTypeNodeJsonStats) {
             SharedNodePointer matchingNode = nodeList->sendingNodeForPacket(receivedPacket);
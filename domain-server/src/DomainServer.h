@@ -67,8 +67,10 @@ private:
     int parseNodeDataFromByteArray(NodeType_t& nodeType, HifiSockAddr& publicSockAddr,
                                     HifiSockAddr& localSockAddr, const QByteArray& packet, const HifiSockAddr& senderSockAddr);
     NodeSet nodeInterestListFromPacket(const QByteArray& packet, int numPreceedingBytes);
+    quint32 domainListVersionFromPacket(const QByteArray& packet, int numPreceedingBytes);
+    void refreshCachedNodeRecord(const SharedNodePointer& node);
     void sendDomainListToNode(const SharedNodePointer& node, const HifiSockAddr& senderSockAddr,
-                              const NodeSet& nodeInterestList);
+                              const NodeSet& nodeInterestList, quint32 acknowledgedListVersion = 0);
     
     void parseAssignmentConfigs(QSet<Assignment::Type>& excludedTypes);
     void addStaticAssignmentToAssignmentHash(Assignment* newAssignment);
@@ -112,6 +114,8 @@ private:
     QMap<QNetworkReply*, QUuid> _networkReplyUUIDMap;
     QHash<QUuid, bool> _sessionAuthenticationHash;
     
+    quint32 _domainListVersion;
+    
     DomainServerSettingsManager _settingsManager;
 };
 
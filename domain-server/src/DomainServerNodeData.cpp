@@ -24,11 +24,30 @@ DomainServerNodeData::DomainServerNodeData() :
     _paymentIntervalTimer(),
     _statsJSONObject(),
     _sendingSockAddr(),
-    _isAuthenticated(true)
+    _isAuthenticated(true),
+    _cachedRecord(),
+    _recordVersion(0),
+    _lastSentListVersion(0),
+    _lastInterestList(),
+    _listsSinceFullList(0)
 {
     _paymentIntervalTimer.start();
 }
 
+bool DomainServerNodeData::updateCachedRecord(const Node& node, quint32 listVersion) {
+    QByteArray record;
+    QDataStream recordStream(&record, QIODevice::Append);
+    recordStream << node;
+    
+    if (record != _cachedRecord) {
+        _cachedRecord = record;
+        _recordVersion = listVersion;
+        return true;
+    }
+    
+    return false;
+}
+
 void DomainServerNodeData::parseJSONStatsPacket(const QByteArray& statsPacket) {
     // push past the packet header
     QDataStream packetStream(statsPacket);
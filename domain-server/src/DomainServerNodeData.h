@@ -18,6 +18,7 @@
 #include <QtCore/QUuid>
 
 #include <HifiSockAddr.h>
+#include <LimitedNodeList.h>
 #include <NodeData.h>
 
 class DomainServerNodeData : public NodeData {
@@ -44,6 +45,20 @@ public:
     bool isAuthenticated() const { return _isAuthenticated; }
     
     QHash<QUuid, QUuid>& getSessionSecretHash() { return _sessionSecretHash; }
+    
+    /// Re-serializes the node's domain list record, returns true if it differs from the cached one
+    bool updateCachedRecord(const Node& node, quint32 listVersion);
+    const QByteArray& getCachedRecord() const { return _cachedRecord; }
+    quint32 getRecordVersion() const { return _recordVersion; }
+    
+    void setLastSentListVersion(quint32 lastSentListVersion) { _lastSentListVersion = lastSentListVersion; }
+    quint32 getLastSentListVersion() const { return _lastSentListVersion; }
+    
+    void setLastInterestList(const NodeSet& lastInterestList) { _lastInterestList = lastInterestList; }
+    const NodeSet& getLastInterestList() const { return _lastInterestList; }
+    
+    int getListsSinceFullList() const { return _listsSinceFullList; }
+    void setListsSinceFullList(int listsSinceFullList) { _listsSinceFullList = listsSinceFullList; }
 private:
     QJsonObject mergeJSONStatsFromNewObject(const QJsonObject& newObject, QJsonObject destinationObject);
     
@@ -54,6 +69,12 @@ private:
     QJsonObject _statsJSONObject;
     HifiSockAddr _sendingSockAddr;
     bool _isAuthenticated;
+    
+    QByteArray _cachedRecord;
+    quint32 _recordVersion;
+    quint32 _lastSentListVersion;
+    NodeSet _lastInterestList;
+    int _listsSinceFullList;
 };
 
 #endif // hifi_DomainServerNodeData_h
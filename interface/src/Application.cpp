@@ -26,6 +26,7 @@
 #include <QActionGroup>
 #include <QColorDialog>
 #include <QDesktopWidget>
+#include <QDir>
 #include <QCheckBox>
 #include <QImage>
 #include <QInputDialog>
@@ -60,6 +61,7 @@
 #include <ParticlesScriptingInterface.h>
 #include <PerfStat.h>
 #include <ResourceCache.h>
+#include <ResourceDiskCache.h>
 #include <UserActivityLogger.h>
 #include <UUID.h>
 #include <OctreeSceneStats.h>
@@ -320,6 +322,8 @@ Application::Application(int& argc, char** argv, QElapsedTimer &startup_time) :
     _networkAccessManager->setCache(cache);
 
     ResourceCache::setNetworkAccessManager(_networkAccessManager);
+    ResourceCache::setDiskCache(new ResourceDiskCache(
+        QDir(!cachePath.isEmpty() ? cachePath : "interfaceCache").filePath("resources"), _networkAccessManager));
     ResourceCache::setRequestLimit(3);
 
     _window->setCentralWidget(_glWidget);
@@ -352,6 +356,9 @@ Application::Application(int& argc, char** argv, QElapsedTimer &startup_time) :
     _particleEditSender.setPacketsPerSecond(3000); // super high!!
     _modelEditSender.setPacketsPerSecond(3000); // super high!!
 
+    // voxel edits come in bulk from imports and scripts, so let the servers' NACKs decide how fast we can go
+    _voxelEditSender.setAdaptivePacketsPerSecond(true);
+
     // Set the sixense filtering
     _sixenseManager.setFilter(Menu::getInstance()->isOptionChecked(MenuOption::FilterSixense));
 
@@ -49,7 +49,13 @@ void MetavoxelSystem::init() {
 
 MetavoxelLOD MetavoxelSystem::getLOD() const {
     const float FIXED_LOD_THRESHOLD = 0.01f;
-    return MetavoxelLOD(Application::getInstance()->getCamera()->getPosition(), FIXED_LOD_THRESHOLD);
+    
+    // snap the position to a grid, so that nearby clients share the server's delta encodings and small movements don't
+    // change the subdivision
+    const float LOD_POSITION_QUANTUM = 0.5f;
+    glm::vec3 position = glm::floor(Application::getInstance()->getCamera()->getPosition() / LOD_POSITION_QUANTUM + 0.5f) *
+        LOD_POSITION_QUANTUM;
+    return MetavoxelLOD(position, FIXED_LOD_THRESHOLD);
 }
 
 void MetavoxelSystem::simulate(float deltaTime) {
@@ -135,11 +141,25 @@ MetavoxelSystem::SimulateVisitor::SimulateVisitor(QVector<Point>& points) :
             AttributeRegistry::getInstance()->getNormalAttribute() <<
             AttributeRegistry::getInstance()->getSpannerColorAttribute() <<
             AttributeRegistry::getInstance()->getSpannerNormalAttribute()),
-    _points(points) {
+    _points(points),
+    _subvisitor(false) {
+}
+
+MetavoxelSystem::SimulateVisitor::SimulateVisitor(const SimulateVisitor& parent) :
+    SpannerVisitor(parent),
+    _points(_subvisitorPoints),
+    _deltaTime(parent._deltaTime),
+    _order(parent._order),
+    _subvisitor(true) {
 }
 
 bool MetavoxelSystem::SimulateVisitor::visit(Spanner* spanner, const glm::vec3& clipMinimum, float clipSize) {
-    spanner->getRenderer()->simulate(_deltaTime);
+    if (_subvisitor) {
+        // renderers belong to the main thread
+        _spanners.append(spanner);
+    } else {
+        spanner->getRenderer()->simulate(_deltaTime);
+    }
     return true;
 }
 
@@ -186,6 +206,18 @@ int MetavoxelSystem::SimulateVisitor::visit(MetavoxelInfo& info) {
     return STOP_RECURSION;
 }
 
+MetavoxelVisitor* MetavoxelSystem::SimulateVisitor::createSubvisitor() {
+    return new SimulateVisitor(*this);
+}
+
+void MetavoxelSystem::SimulateVisitor::mergeSubvisitor(MetavoxelVisitor* subvisitor) {
+    SimulateVisitor* other = static_cast<SimulateVisitor*>(subvisitor);
+    _points += other->_subvisitorPoints;
+    foreach (Spanner* spanner, other->_spanners) {
+        spanner->getRenderer()->simulate(_deltaTime);
+    }
+}
+
 MetavoxelSystem::RenderVisitor::RenderVisitor() :
     SpannerVisitor(QVector<AttributePointer>() << AttributeRegistry::getInstance()->getSpannersAttribute(),
         QVector<AttributePointer>() << AttributeRegistry::getInstance()->getSpannerMaskAttribute()) {
@@ -60,11 +60,18 @@ private:
         void setOrder(const glm::vec3& direction) { _order = encodeOrder(direction); }
         virtual bool visit(Spanner* spanner, const glm::vec3& clipMinimum, float clipSize);
         virtual int visit(MetavoxelInfo& info);
+        virtual MetavoxelVisitor* createSubvisitor();
+        virtual void mergeSubvisitor(MetavoxelVisitor* subvisitor);
     
     private:
+        SimulateVisitor(const SimulateVisitor& parent);
+        
         QVector<Point>& _points;
         float _deltaTime;
         int _order;
+        bool _subvisitor;
+        QVector<Point> _subvisitorPoints; ///< the points gathered by a subvisitor
+        QVector<Spanner*> _spanners; ///< the spanners a subvisitor found, simulated once merged
     };
     
     class RenderVisitor : public SpannerVisitor {
@@ -518,7 +518,7 @@ void SkeletonModel::initRagdollPoints() {
 }
 
 void SkeletonModel::buildRagdollConstraints() {
-    // NOTE: the length of DistanceConstraints is computed and locked in at this time
+    // NOTE: the length of distance constraints is computed and locked in at this time
     // so make sure the ragdoll positions are in a normal configuration before here.
     const int numPoints = _ragdollPoints.size();
     assert(numPoints == _jointStates.size());
@@ -528,11 +528,9 @@ void SkeletonModel::buildRagdollConstraints() {
         const FBXJoint& joint = state.getFBXJoint();
         int parentIndex = joint.parentIndex;
         if (parentIndex == -1) {
-            FixedConstraint* anchor = new FixedConstraint(&(_ragdollPoints[i]), glm::vec3(0.0f));
-            _ragdollConstraints.push_back(anchor);
+            addFixedConstraint(i, glm::vec3(0.0f));
         } else { 
-            DistanceConstraint* bone = new DistanceConstraint(&(_ragdollPoints[i]), &(_ragdollPoints[parentIndex]));
-            _ragdollConstraints.push_back(bone);
+            addDistanceConstraint(i, parentIndex);
         }
     }
 }
@@ -159,7 +159,7 @@ QSharedPointer<NetworkTexture> TextureCache::getTexture(const QUrl& url, bool no
         texture->setCache(this);
         _dilatableNetworkTextures.insert(url, texture);
     } else {
-        _unusedResources.remove(texture->getLRUKey());
+        removeUnusedResource(texture);
     }
     return texture;
 }
@@ -396,6 +396,7 @@ void NetworkTexture::loadContent(const QByteArray& content) {
 
 void NetworkTexture::setImage(const QImage& image, bool translucent) {
     _translucent = translucent;
+    setBytes(image.byteCount());
     
     finishedLoading(true);
     imageLoaded(image);
@@ -377,7 +377,31 @@ void Stats::display(
     MyAvatar* myAvatar = Application::getInstance()->getAvatar();
     glm::vec3 avatarPos = myAvatar->getPosition();
 
-    lines = _expanded ? 5 : 3;
+    QStringList metavoxelStats;
+    if (_expanded) {
+        const float BYTES_PER_KILOBYTE = 1024.0f;
+        foreach (const SharedNodePointer& node, NodeList::getInstance()->getNodeHash()) {
+            if (node->getType() != NodeType::MetavoxelServer) {
+                continue;
+            }
+            QMutexLocker locker(&node->getMutex());
+            MetavoxelClient* client = static_cast<MetavoxelClient*>(node->getLinkedData());
+            if (!client) {
+                continue;
+            }
+            const DatagramSequencer& sequencer = client->getSequencer();
+            metavoxelStats.append(QString("Metavoxels: %1 ms, %2% loss, %3 packets/group").arg(
+                (int)sequencer.getRoundTripTime()).arg((int)(sequencer.getLossRate() * 100.0f)).arg(
+                sequencer.getPacketsPerGroup(), 0, 'f', 1));
+            foreach (ReliableChannel* channel, sequencer.getReliableOutputChannels()) {
+                metavoxelStats.append(QString("  Channel %1: %2 KB/s, %3 KB queued").arg(channel->getIndex()).arg(
+                    channel->getBytesPerSecond() / BYTES_PER_KILOBYTE, 0, 'f', 1).arg(
+                    channel->getBytesAvailable() / BYTES_PER_KILOBYTE, 0, 'f', 1));
+            }
+        }
+    }
+
+    lines = _expanded ? 5 + metavoxelStats.size() : 3;
 
     drawBackground(backgroundColor, horizontalOffset, 0, _geoStatsWidth, lines * STATS_PELS_PER_LINE + 10);
     horizontalOffset += 5;
@@ -419,6 +443,11 @@ void Stats::display(
         
         verticalOffset += STATS_PELS_PER_LINE;
         drawText(horizontalOffset, verticalOffset, scale, rotation, font, downloads.str().c_str(), color);
+        
+        foreach (const QString& metavoxelStat, metavoxelStats) {
+            verticalOffset += STATS_PELS_PER_LINE;
+            drawText(horizontalOffset, verticalOffset, scale, rotation, font, metavoxelStat.toLatin1().constData(), color);
+        }
     }
 
     verticalOffset = 0;
@@ -9,14 +9,19 @@
 //  See the accompanying file LICENSE or http://www.apache.org/licenses/LICENSE-2.0.html
 //
 
+#include <algorithm>
 #include <iostream>
+#include <QAtomicInt>
 #include <QBuffer>
-#include <QDataStream>
 #include <QIODevice>
+#include <QRunnable>
+#include <QSemaphore>
 #include <QStringList>
 #include <QTextStream>
+#include <QThreadPool>
 #include <QtDebug>
-#include <QtEndian>
+
+#include <zlib.h>
 
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtx/quaternion.hpp>
@@ -84,111 +89,174 @@ static int fbxGeometryMetaTypeId = qRegisterMetaType<FBXGeometry>();
 static int fbxAnimationFrameMetaTypeId = qRegisterMetaType<FBXAnimationFrame>();
 static int fbxAnimationFrameVectorMetaTypeId = qRegisterMetaType<QVector<FBXAnimationFrame> >();
 
-template<class T> QVariant readBinaryArray(QDataStream& in) {
-    quint32 arrayLength;
-    quint32 encoding;
-    quint32 compressedLength;
+/// Compressed arrays at least this large (compressed) are inflated on the inflater threads, the rest as they're read.
+const quint32 MIN_PARALLEL_INFLATE_SIZE = 64 * 1024;
 
-    in >> arrayLength;
-    in >> encoding;
-    in >> compressedLength;
+/// The most that deflate can compress by; arrays claiming to inflate to more than this are malformed.
+const quint64 MAX_DEFLATE_RATIO = 1032;
 
-    QVector<T> values;
-    const unsigned int DEFLATE_ENCODING = 1;
-    if (encoding == DEFLATE_ENCODING) {
-        // preface encoded data with uncompressed length
-        QByteArray compressed(sizeof(quint32) + compressedLength, 0);
-        *((quint32*)compressed.data()) = qToBigEndian<quint32>(arrayLength * sizeof(T));
-        in.readRawData(compressed.data() + sizeof(quint32), compressedLength);
-        QByteArray uncompressed = qUncompress(compressed);
-        QDataStream uncompressedIn(uncompressed);
-        uncompressedIn.setByteOrder(QDataStream::LittleEndian);
-        uncompressedIn.setVersion(QDataStream::Qt_4_5); // for single/double precision switch
-        for (quint32 i = 0; i < arrayLength; i++) {
-            T value;
-            uncompressedIn >> value;
-            values.append(value);
-        }
-    } else {
-        for (quint32 i = 0; i < arrayLength; i++) {
-            T value;
-            in >> value;
-            values.append(value);
-        }
+// converts the elements of an array read from the file (which are little-endian) to the host's byte order, in place
+template<class T> void fromLittleEndian(T* values, quint32 count) {
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+    for (quint32 i = 0; i < count; i++) {
+        char* bytes = (char*)&values[i];
+        std::reverse(bytes, bytes + sizeof(T));
     }
-    return QVariant::fromValue(values);
+#endif
 }
 
-QVariant parseBinaryFBXProperty(QDataStream& in) {
-    char ch;
-    in.device()->getChar(&ch);
-    switch (ch) {
-        case 'Y': {
-            qint16 value;
-            in >> value;
-            return QVariant::fromValue(value);
-        }
-        case 'C': {
-            bool value;
-            in >> value;
-            return QVariant::fromValue(value);
-        }
-        case 'I': {
-            qint32 value;
-            in >> value;
-            return QVariant::fromValue(value);
-        }
-        case 'F': {
-            float value;
-            in >> value;
-            return QVariant::fromValue(value);
-        }
-        case 'D': {
-            double value;
-            in >> value;
-            return QVariant::fromValue(value);
-        }
-        case 'L': {
-            qint64 value;
-            in >> value;
-            return QVariant::fromValue(value);
-        }
-        case 'f': {
-            return readBinaryArray<float>(in);
-        }
-        case 'd': {
-            return readBinaryArray<double>(in);
-        }
-        case 'l': {
-            return readBinaryArray<qint64>(in);
-        }
-        case 'i': {
-            return readBinaryArray<qint32>(in);
-        }
-        case 'b': {
-            return readBinaryArray<bool>(in);
-        }
-        case 'S':
-        case 'R': {
-            quint32 length;
-            in >> length;
-            return QVariant::fromValue(in.device()->read(length));
+// booleans are stored as bytes, any nonzero value of which means true
+template<> void fromLittleEndian(bool* values, quint32 count) {
+    Q_STATIC_ASSERT(sizeof(bool) == 1);
+    const quint8* bytes = (const quint8*)values;
+    for (quint32 i = 0; i < count; i++) {
+        values[i] = (bytes[i] != 0);
+    }
+}
+
+template<class T> bool inflateArray(const char* compressed, quint32 compressedLength, T* values, quint32 count) {
+    if (count == 0) {
+        return true;
+    }
+    uLongf length = count * sizeof(T);
+    if (uncompress((Bytef*)values, &length, (const Bytef*)compressed, compressedLength) != Z_OK ||
+            length != count * sizeof(T)) {
+        return false;
+    }
+    fromLittleEndian(values, count);
+    return true;
+}
+
+static QThreadPool* getInflaterPool() {
+    static QThreadPool pool;
+    return &pool;
+}
+
+/// Parses binary FBX straight from memory.  Numeric arrays are read into vectors of their element type allocated up front,
+/// rather than element by element through a QDataStream, and large compressed arrays are inflated on the inflater threads
+/// while the rest of the file is parsed.
+class BinaryFBXParser {
+public:
+
+    BinaryFBXParser(const QByteArray& data);
+    ~BinaryFBXParser();
+
+    FBXNode parse();
+
+    /// Called by the inflaters when they're done.
+    void arrayInflated(bool success);
+
+private:
+
+    template<class T> T read();
+    QByteArray readBytes(quint32 length);
+    void checkAvailable(quint64 length) const;
+
+    FBXNode parseNode();
+    QVariant parseProperty();
+    template<class T> QVariant readArray();
+
+    void waitForInflaters();
+
+    const char* _data;
+    const char* _position;
+    const char* _end;
+
+    // the arrays being inflated, which must outlive their inflaters even if parsing fails
+    QVariantList _inflatingArrays;
+    QSemaphore _inflated;
+    QAtomicInt _inflateFailures;
+};
+
+template<class T> class ArrayInflater : public QRunnable {
+public:
+
+    ArrayInflater(BinaryFBXParser* parser, const char* compressed, quint32 compressedLength, T* values, quint32 count) :
+        _parser(parser), _compressed(compressed), _compressedLength(compressedLength), _values(values), _count(count) { }
+
+    virtual void run() { _parser->arrayInflated(inflateArray(_compressed, _compressedLength, _values, _count)); }
+
+private:
+
+    BinaryFBXParser* _parser;
+    const char* _compressed;
+    quint32 _compressedLength;
+    T* _values;
+    quint32 _count;
+};
+
+BinaryFBXParser::BinaryFBXParser(const QByteArray& data) :
+    _data(data.constData()),
+    _position(data.constData()),
+    _end(data.constData() + data.size()) {
+}
+
+BinaryFBXParser::~BinaryFBXParser() {
+    waitForInflaters();
+}
+
+FBXNode BinaryFBXParser::parse() {
+    // see http://code.blender.org/index.php/2013/08/fbx-binary-file-format-specification/ for an explanation
+    // of the FBX binary format
+
+    // skip the rest of the header
+    const int HEADER_SIZE = 27;
+    checkAvailable(HEADER_SIZE);
+    _position += HEADER_SIZE;
+
+    // parse the top-level node
+    FBXNode top;
+    while (_position < _end) {
+        FBXNode next = parseNode();
+        if (next.name.isNull()) {
+            break;
+
+        } else {
+            top.children.append(next);
         }
-        default:
-            throw QString("Unknown property type: ") + ch;
     }
+
+    waitForInflaters();
+    if (_inflateFailures.load() > 0) {
+        throw QString("Failed to decompress ") + QString::number(_inflateFailures.load()) + " arrays";
+    }
+    return top;
 }
 
-FBXNode parseBinaryFBXNode(QDataStream& in) {
-    quint32 endOffset;
-    quint32 propertyCount;
-    quint32 propertyListLength;
-    quint8 nameLength;
+void BinaryFBXParser::arrayInflated(bool success) {
+    if (!success) {
+        _inflateFailures.ref();
+    }
+    _inflated.release();
+}
 
-    in >> endOffset;
-    in >> propertyCount;
-    in >> propertyListLength;
-    in >> nameLength;
+template<class T> T BinaryFBXParser::read() {
+    checkAvailable(sizeof(T));
+    T value;
+    memcpy(&value, _position, sizeof(T));
+    _position += sizeof(T);
+    fromLittleEndian(&value, 1);
+    return value;
+}
+
+QByteArray BinaryFBXParser::readBytes(quint32 length) {
+    checkAvailable(length);
+    QByteArray bytes(_position, length);
+    _position += length;
+    return bytes;
+}
+
+void BinaryFBXParser::checkAvailable(quint64 length) const {
+    if (length > (quint64)(_end - _position)) {
+        throw QString("Unexpected end of file at ") + QString::number(_position - _data);
+    }
+}
+
+FBXNode BinaryFBXParser::parseNode() {
+    quint32 endOffset = read<quint32>();
+    quint32 propertyCount = read<quint32>();
+    read<quint32>(); // the length of the property list
+    quint8 nameLength = read<quint8>();
 
     FBXNode node;
     const unsigned int MIN_VALID_OFFSET = 40;
@@ -196,14 +264,14 @@ FBXNode parseBinaryFBXNode(QDataStream& in) {
         // use a null name to indicate a null node
         return node;
     }
-    node.name = in.device()->read(nameLength);
+    node.name = readBytes(nameLength);
 
     for (quint32 i = 0; i < propertyCount; i++) {
-        node.properties.append(parseBinaryFBXProperty(in));
+        node.properties.append(parseProperty());
     }
 
-    while (endOffset > in.device()->pos()) {
-        FBXNode child = parseBinaryFBXNode(in);
+    while (endOffset > _position - _data) {
+        FBXNode child = parseNode();
         if (child.name.isNull()) {
             return node;
 
@@ -215,6 +283,94 @@ FBXNode parseBinaryFBXNode(QDataStream& in) {
     return node;
 }
 
+QVariant BinaryFBXParser::parseProperty() {
+    char ch = read<char>();
+    switch (ch) {
+        case 'Y':
+            return QVariant::fromValue(read<qint16>());
+
+        case 'C':
+            return QVariant::fromValue(read<quint8>() != 0);
+
+        case 'I':
+            return QVariant::fromValue(read<qint32>());
+
+        case 'F':
+            return QVariant::fromValue(read<float>());
+
+        case 'D':
+            return QVariant::fromValue(read<double>());
+
+        case 'L':
+            return QVariant::fromValue(read<qint64>());
+
+        case 'f':
+            return readArray<float>();
+
+        case 'd':
+            return readArray<double>();
+
+        case 'l':
+            return readArray<qint64>();
+
+        case 'i':
+            return readArray<qint32>();
+
+        case 'b':
+            return readArray<bool>();
+
+        case 'S':
+        case 'R':
+            return QVariant::fromValue(readBytes(read<quint32>()));
+
+        default:
+            throw QString("Unknown property type: ") + ch;
+    }
+}
+
+template<class T> QVariant BinaryFBXParser::readArray() {
+    quint32 arrayLength = read<quint32>();
+    quint32 encoding = read<quint32>();
+    quint32 compressedLength = read<quint32>();
+
+    const unsigned int DEFLATE_ENCODING = 1;
+    if (encoding != DEFLATE_ENCODING) {
+        checkAvailable((quint64)arrayLength * sizeof(T));
+        QVector<T> values(arrayLength);
+        memcpy(values.data(), _position, arrayLength * sizeof(T));
+        _position += arrayLength * sizeof(T);
+        fromLittleEndian(values.data(), arrayLength);
+        return QVariant::fromValue(values);
+    }
+    checkAvailable(compressedLength);
+    if ((quint64)arrayLength * sizeof(T) > (quint64)compressedLength * MAX_DEFLATE_RATIO) {
+        throw QString("Invalid array length: ") + QString::number(arrayLength);
+    }
+    const char* compressed = _position;
+    _position += compressedLength;
+
+    QVector<T> values(arrayLength);
+    if (compressedLength < MIN_PARALLEL_INFLATE_SIZE) {
+        if (!inflateArray(compressed, compressedLength, values.data(), arrayLength)) {
+            throw QString("Failed to decompress array at ") + QString::number(compressed - _data);
+        }
+        return QVariant::fromValue(values);
+    }
+
+    // the inflater writes to the vector's data, which the variant (and any copies of it) share: nothing may write to them
+    // (and thus detach them) until we've waited for it
+    T* data = values.data();
+    QVariant variant = QVariant::fromValue(values);
+    _inflatingArrays.append(variant);
+    getInflaterPool()->start(new ArrayInflater<T>(this, compressed, compressedLength, data, arrayLength));
+    return variant;
+}
+
+void BinaryFBXParser::waitForInflaters() {
+    _inflated.acquire(_inflatingArrays.size());
+    _inflatingArrays.clear();
+}
+
 class Tokenizer {
 public:
 
@@ -334,39 +490,20 @@ FBXNode parseTextFBXNode(Tokenizer& tokenizer) {
     return node;
 }
 
-FBXNode parseFBX(QIODevice* device) {
+FBXNode parseFBX(const QByteArray& data) {
     // verify the prolog
     const QByteArray BINARY_PROLOG = "Kaydara FBX Binary  ";
-    if (device->peek(BINARY_PROLOG.size()) != BINARY_PROLOG) {
-        // parse as a text file
-        FBXNode top;
-        Tokenizer tokenizer(device);
-        while (device->bytesAvailable()) {
-            FBXNode next = parseTextFBXNode(tokenizer);
-            if (next.name.isNull()) {
-                return top;
-
-            } else {
-                top.children.append(next);
-            }
-        }
-        return top;
+    if (data.startsWith(BINARY_PROLOG)) {
+        return BinaryFBXParser(data).parse();
     }
-    QDataStream in(device);
-    in.setByteOrder(QDataStream::LittleEndian);
-    in.setVersion(QDataStream::Qt_4_5); // for single/double precision switch
 
-    // see http://code.blender.org/index.php/2013/08/fbx-binary-file-format-specification/ for an explanation
-    // of the FBX binary format
-
-    // skip the rest of the header
-    const int HEADER_SIZE = 27;
-    in.skipRawData(HEADER_SIZE);
-
-    // parse the top-level node
+    // parse as a text file
+    QBuffer buffer(const_cast<QByteArray*>(&data));
+    buffer.open(QIODevice::ReadOnly);
     FBXNode top;
-    while (device->bytesAvailable()) {
-        FBXNode next = parseBinaryFBXNode(in);
+    Tokenizer tokenizer(&buffer);
+    while (buffer.bytesAvailable()) {
+        FBXNode next = parseTextFBXNode(tokenizer);
         if (next.name.isNull()) {
             return top;
 
@@ -374,7 +511,6 @@ FBXNode parseFBX(QIODevice* device) {
             top.children.append(next);
         }
     }
-
     return top;
 }
 
@@ -415,6 +551,7 @@ QVariantHash parseMapping(QIODevice* device) {
 
 QVector<glm::vec3> createVec3Vector(const QVector<double>& doubleVector) {
     QVector<glm::vec3> values;
+    values.reserve(doubleVector.size() / 3);
     for (const double* it = doubleVector.constData(), *end = it + (doubleVector.size() / 3 * 3); it != end; ) {
         float x = *it++;
         float y = *it++;
@@ -426,6 +563,7 @@ QVector<glm::vec3> createVec3Vector(const QVector<double>& doubleVector) {
 
 QVector<glm::vec2> createVec2Vector(const QVector<double>& doubleVector) {
     QVector<glm::vec2> values;
+    values.reserve(doubleVector.size() / 2);
     for (const double* it = doubleVector.constData(), *end = it + (doubleVector.size() / 2 * 2); it != end; ) {
         float s = *it++;
         float t = *it++;
@@ -1948,9 +2086,7 @@ QByteArray writeMapping(const QVariantHash& mapping) {
 }
 
 FBXGeometry readFBX(const QByteArray& model, const QVariantHash& mapping) {
-    QBuffer buffer(const_cast<QByteArray*>(&model));
-    buffer.open(QIODevice::ReadOnly);
-    return extractFBXGeometry(parseFBX(&buffer), mapping);
+    return extractFBXGeometry(parseFBX(model), mapping);
 }
 
 bool addMeshVoxelsOperation(OctreeElement* element, void* extraData) {
@@ -242,6 +242,10 @@ QVariantHash readMapping(const QByteArray& data);
 /// Writes an FST mapping to a byte array.
 QByteArray writeMapping(const QVariantHash& mapping);
 
+/// Parses the node tree of an FBX document (binary or text).
+/// \exception QString if an error occurs in parsing
+FBXNode parseFBX(const QByteArray& data);
+
 /// Reads FBX geometry from the supplied model and mapping data.
 /// \exception QString if an error occurs in parsing
 FBXGeometry readFBX(const QByteArray& model, const QVariantHash& mapping);
@@ -17,6 +17,7 @@
 #include <QScriptValueIterator>
 #include <QUrl>
 #include <QtDebug>
+#include <QtEndian>
 
 #include <RegisteredMetaTypes.h>
 #include <SharedUtil.h>
@@ -103,6 +104,11 @@ int Bitstream::registerTypeStreamer(int type, TypeStreamer* streamer) {
         streamer->_self = TypeStreamerPointer(streamer);
     }
     getTypeStreamers().insert(type, streamer);
+    QVector<const TypeStreamer*>& table = getTypeStreamerTable();
+    if (type >= table.size()) {
+        table.resize(type + 1);
+    }
+    table[type] = streamer;
     return 0;
 }
 
@@ -114,6 +120,18 @@ const ObjectStreamer* Bitstream::getObjectStreamer(const QMetaObject* metaObject
     return getObjectStreamers().value(metaObject);
 }
 
+int Bitstream::registerPropertyAccessor(const QMetaObject* metaObject, const char* name, PropertyAccessor* accessor) {
+    getPropertyAccessors().insert(ScopeNamePair(metaObject->className(), name), accessor);
+    return 0;
+}
+
+const PropertyAccessor* Bitstream::getPropertyAccessor(const QMetaProperty& property) {
+    return property.isValid() ? getPropertyAccessors().value(ScopeNamePair(
+        QByteArray::fromRawData(property.enclosingMetaObject()->className(),
+            strlen(property.enclosingMetaObject()->className())),
+        QByteArray::fromRawData(property.name(), strlen(property.name())))) : NULL;
+}
+
 const QMetaObject* Bitstream::getMetaObject(const QByteArray& className) {
     return getMetaObjects().value(className);
 }
@@ -125,8 +143,9 @@ QList<const QMetaObject*> Bitstream::getMetaObjectSubClasses(const QMetaObject*
 Bitstream::Bitstream(QDataStream& underlying, MetadataType metadataType, GenericsMode genericsMode, QObject* parent) :
     QObject(parent),
     _underlying(underlying),
-    _byte(0),
+    _register(0),
     _position(0),
+    _bufferSize(0),
     _metadataType(metadataType),
     _genericsMode(genericsMode),
     _objectStreamerStreamer(*this),
@@ -152,20 +171,63 @@ void Bitstream::addTypeSubstitution(const QByteArray& typeName, const char* repl
     _typeStreamerSubstitutions.insert(typeName, streamer);
 }
 
-const int LAST_BIT_POSITION = BITS_IN_BYTE - 1;
+// the most bits we move through the register at once, leaving room for a partial byte on either side
+const int MAX_WORD_BITS = 56;
+
+const int BITS_IN_WORD = sizeof(quint64) * BITS_IN_BYTE;
+
+// the size at which we hand the buffered bytes to the underlying stream
+const int WRITE_BUFFER_SIZE = 4096;
+
+// reads up to eight bytes into a little-endian word, zero-filled past the end
+static inline quint64 loadWord(const quint8* source, int bytes) {
+    uchar word[sizeof(quint64)] = { 0 };
+    memcpy(word, source, bytes);
+    return qFromLittleEndian<quint64>(word);
+}
+
+// writes the low bytes of a little-endian word
+static inline void storeWord(quint64 value, quint8* dest, int bytes) {
+    uchar word[sizeof(quint64)];
+    qToLittleEndian<quint64>(value, word);
+    memcpy(dest, word, bytes);
+}
+
+static inline quint64 lowBits(int bits) {
+    return ((quint64)1 << bits) - 1;
+}
 
 Bitstream& Bitstream::write(const void* data, int bits, int offset) {
     const quint8* source = (const quint8*)data;
     while (bits > 0) {
-        int bitsToWrite = qMin(BITS_IN_BYTE - _position, qMin(BITS_IN_BYTE - offset, bits));
-        _byte |= ((*source >> offset) & ((1 << bitsToWrite) - 1)) << _position;
-        if ((_position += bitsToWrite) == BITS_IN_BYTE) {
-            flush();
-        }
-        if ((offset += bitsToWrite) == BITS_IN_BYTE) {
-            source++;
-            offset = 0;
+        // whole aligned bytes skip the register entirely
+        if ((_position % BITS_IN_BYTE) == 0 && offset == 0 && bits >= BITS_IN_BYTE) {
+            if (_position != 0) {
+                writeRegister();
+            }
+            int bytes = bits / BITS_IN_BYTE;
+            if (_bufferSize + bytes > WRITE_BUFFER_SIZE) {
+                writeBuffer();
+            }
+            if (bytes > WRITE_BUFFER_SIZE) {
+                _underlying.writeRawData((const char*)source, bytes);
+            } else {
+                if (_buffer.isEmpty()) {
+                    _buffer.resize(WRITE_BUFFER_SIZE + sizeof(quint64));
+                }
+                memcpy(_buffer.data() + _bufferSize, source, bytes);
+                _bufferSize += bytes;
+            }
+            source += bytes;
+            bits -= bytes * BITS_IN_BYTE;
+            continue;
         }
+        int bitsToWrite = qMin(bits, MAX_WORD_BITS);
+        int bytesToLoad = (offset + bitsToWrite + BITS_IN_BYTE - 1) / BITS_IN_BYTE;
+        writeBits((loadWord(source, bytesToLoad) >> offset) & lowBits(bitsToWrite), bitsToWrite);
+        offset += bitsToWrite;
+        source += offset / BITS_IN_BYTE;
+        offset %= BITS_IN_BYTE;
         bits -= bitsToWrite;
     }
     return *this;
@@ -174,17 +236,33 @@ Bitstream& Bitstream::write(const void* data, int bits, int offset) {
 Bitstream& Bitstream::read(void* data, int bits, int offset) {
     quint8* dest = (quint8*)data;
     while (bits > 0) {
-        if (_position == 0) {
-            _underlying >> _byte;
-        }
-        int bitsToRead = qMin(BITS_IN_BYTE - _position, qMin(BITS_IN_BYTE - offset, bits));
-        int mask = ((1 << bitsToRead) - 1) << offset;
-        *dest = (*dest & ~mask) | (((_byte >> _position) << offset) & mask);
-        _position = (_position + bitsToRead) & LAST_BIT_POSITION;
-        if ((offset += bitsToRead) == BITS_IN_BYTE) {
-            dest++;
-            offset = 0;
+        if (_position == 0 && offset == 0 && bits >= BITS_IN_BYTE) {
+            int bytes = bits / BITS_IN_BYTE;
+            _underlying.readRawData((char*)dest, bytes);
+            dest += bytes;
+            bits -= bytes * BITS_IN_BYTE;
+            continue;
         }
+        int bitsToRead = qMin(bits, MAX_WORD_BITS);
+        if (_position < bitsToRead) {
+            // take exactly the bytes we need, since whoever owns the underlying stream may read the rest directly
+            int bytes = (bitsToRead - _position + BITS_IN_BYTE - 1) / BITS_IN_BYTE;
+            quint8 word[sizeof(quint64)];
+            memset(word, 0, sizeof(word));
+            _underlying.readRawData((char*)word, bytes);
+            _register |= loadWord(word, bytes) << _position;
+            _position += bytes * BITS_IN_BYTE;
+        }
+        quint64 mask = lowBits(bitsToRead) << offset;
+        int bytesToStore = (offset + bitsToRead + BITS_IN_BYTE - 1) / BITS_IN_BYTE;
+        quint64 existing = loadWord(dest, bytesToStore);
+        storeWord((existing & ~mask) | ((_register << offset) & mask), dest, bytesToStore);
+        _register >>= bitsToRead;
+        _position -= bitsToRead;
+        
+        offset += bitsToRead;
+        dest += offset / BITS_IN_BYTE;
+        offset %= BITS_IN_BYTE;
         bits -= bitsToRead;
     }
     return *this;
@@ -192,14 +270,54 @@ Bitstream& Bitstream::read(void* data, int bits, int offset) {
 
 void Bitstream::flush() {
     if (_position != 0) {
-        _underlying << _byte;
-        reset();
+        // round up to include the partial byte
+        _position = (_position + BITS_IN_BYTE - 1) / BITS_IN_BYTE * BITS_IN_BYTE;
+        writeRegister();
     }
+    writeBuffer();
+    reset();
 }
 
 void Bitstream::reset() {
-    _byte = 0;
+    _register = 0;
     _position = 0;
+    _bufferSize = 0;
+}
+
+qint64 Bitstream::getBitsWritten() const {
+    return (_underlying.device()->pos() + _bufferSize) * BITS_IN_BYTE + _position;
+}
+
+void Bitstream::writeBits(quint64 value, int bits) {
+    if (_position + bits > BITS_IN_WORD) {
+        writeRegister();
+    }
+    _register |= value << _position;
+    if ((_position += bits) == BITS_IN_WORD) {
+        writeRegister();
+    }
+}
+
+void Bitstream::writeRegister() {
+    if (_bufferSize + (int)sizeof(quint64) > WRITE_BUFFER_SIZE) {
+        writeBuffer();
+    }
+    if (_buffer.isEmpty()) {
+        _buffer.resize(WRITE_BUFFER_SIZE + sizeof(quint64));
+    }
+    // store the whole word, but only count the complete bytes; any partial byte stays in the register
+    int bytes = _position / BITS_IN_BYTE;
+    storeWord(_register, (quint8*)_buffer.data() + _bufferSize, sizeof(quint64));
+    _bufferSize += bytes;
+    _register = (bytes == sizeof(quint64)) ? 0 : (_register >> (bytes * BITS_IN_BYTE));
+    _position -= bytes * BITS_IN_BYTE;
+}
+
+void Bitstream::writeBuffer() {
+    if (_bufferSize > 0) {
+        _underlying.writeRawData(_buffer.constData(), _bufferSize);
+        _bufferSize = 0;
+    }
 }
 
 Bitstream::WriteMappings Bitstream::getAndResetWriteMappings() {
@@ -291,7 +409,7 @@ void Bitstream::readDelta(bool& value, bool reference) {
 
 void Bitstream::writeDelta(const QVariant& value, const QVariant& reference) {
     // QVariant only handles == for built-in types; we need to use our custom operators
-    const TypeStreamer* streamer = getTypeStreamers().value(value.userType());
+    const TypeStreamer* streamer = findTypeStreamer(value.userType());
     if (value.userType() == reference.userType() && (!streamer || streamer->equal(value, reference))) {
         *this << false;
          return;
@@ -302,7 +420,7 @@ void Bitstream::writeDelta(const QVariant& value, const QVariant& reference) {
 }
 
 void Bitstream::writeRawDelta(const QVariant& value, const QVariant& reference) {
-    const TypeStreamer* streamer = getTypeStreamers().value(value.userType());
+    const TypeStreamer* streamer = findTypeStreamer(value.userType());
     _typeStreamerStreamer << streamer;
     streamer->writeRawDelta(*this, value, reference);
 }
@@ -599,20 +717,24 @@ void Bitstream::readRawDelta(QScriptValue& value, const QScriptValue& reference)
 
 Bitstream& Bitstream::operator<<(bool value) {
     if (value) {
-        _byte |= (1 << _position);
+        _register |= ((quint64)1 << _position);
     }
-    if (++_position == BITS_IN_BYTE) {
-        flush();
+    if (++_position == BITS_IN_WORD) {
+        writeRegister();
     }
     return *this;
 }
 
 Bitstream& Bitstream::operator>>(bool& value) {
     if (_position == 0) {
-        _underlying >> _byte;
-    }
-    value = _byte & (1 << _position);
-    _position = (_position + 1) & LAST_BIT_POSITION;
+        quint8 byte;
+        _underlying >> byte;
+        _register = byte;
+        _position = BITS_IN_BYTE;
+    }
+    value = _register & 1;
+    _register >>= 1;
+    _position--;
     return *this;
 }
 
@@ -763,7 +885,7 @@ Bitstream& Bitstream::operator<<(const QVariant& value) {
         _typeStreamerStreamer << NULL;
         return *this;
     }
-    const TypeStreamer* streamer = getTypeStreamers().value(value.userType());
+    const TypeStreamer* streamer = findTypeStreamer(value.userType());
     if (streamer) {
         streamer->writeVariant(*this, value);
     } else {
@@ -1630,6 +1752,21 @@ QHash<int, const TypeStreamer*>& Bitstream::getTypeStreamers() {
     return typeStreamers;
 }
 
+QVector<const TypeStreamer*>& Bitstream::getTypeStreamerTable() {
+    static QVector<const TypeStreamer*> typeStreamerTable;
+    return typeStreamerTable;
+}
+
+const TypeStreamer* Bitstream::findTypeStreamer(int type) {
+    const QVector<const TypeStreamer*>& table = getTypeStreamerTable();
+    return (type >= 0 && type < table.size()) ? table.at(type) : NULL;
+}
+
+QHash<ScopeNamePair, const PropertyAccessor*>& Bitstream::getPropertyAccessors() {
+    static QHash<ScopeNamePair, const PropertyAccessor*> propertyAccessors;
+    return propertyAccessors;
+}
+
 const QHash<ScopeNamePair, const TypeStreamer*>& Bitstream::getEnumStreamers() {
     static QHash<ScopeNamePair, const TypeStreamer*> enumStreamers = createEnumStreamers();
     return enumStreamers;
@@ -2241,6 +2378,9 @@ TypeStreamerPointer JSONReader::getTypeStreamer(const QString& name) const {
     return streamer;
 }
 
+PropertyAccessor::~PropertyAccessor() {
+}
+
 ObjectStreamer::ObjectStreamer(const QMetaObject* metaObject) :
     _metaObject(metaObject) {
 }
@@ -2255,7 +2395,18 @@ const QVector<StreamerPropertyPair>& ObjectStreamer::getProperties() const {
 
 MappedObjectStreamer::MappedObjectStreamer(const QMetaObject* metaObject, const QVector<StreamerPropertyPair>& properties) :
     ObjectStreamer(metaObject),
-    _properties(properties) {
+    _properties(properties),
+    _accessors(properties.size()) {
+    
+    // accessors only apply where the property's streamer is the local one for its type (not so for remote metadata)
+    for (int i = 0; i < properties.size(); i++) {
+        const StreamerPropertyPair& property = properties.at(i);
+        if (property.second.isValid() && property.first && !property.second.isEnumType() &&
+                property.first->getType() == property.second.userType() &&
+                property.first == Bitstream::getTypeStreamer(property.first->getType())) {
+            _accessors[i] = Bitstream::getPropertyAccessor(property.second);
+        }
+    }
 }
 
 const char* MappedObjectStreamer::getName() const {
@@ -2331,7 +2482,15 @@ QObject* MappedObjectStreamer::putJSONData(JSONReader& reader, const QJsonObject
 }
 
 bool MappedObjectStreamer::equal(const QObject* first, const QObject* second) const {
-    foreach (const StreamerPropertyPair& property, _properties) {
+    for (int i = 0; i < _properties.size(); i++) {
+        const PropertyAccessor* accessor = _accessors.at(i);
+        if (accessor) {
+            if (!accessor->equal(first, second)) {
+                return false;
+            }
+            continue;
+        }
+        const StreamerPropertyPair& property = _properties.at(i);
         if (!property.first->equal(property.second.read(first), property.second.read(second))) {
             return false;
         }
@@ -2340,14 +2499,29 @@ bool MappedObjectStreamer::equal(const QObject* first, const QObject* second) co
 }
 
 void MappedObjectStreamer::write(Bitstream& out, const QObject* object) const {
-    foreach (const StreamerPropertyPair& property, _properties) {
+    for (int i = 0; i < _properties.size(); i++) {
+        const PropertyAccessor* accessor = _accessors.at(i);
+        if (accessor) {
+            accessor->write(out, object);
+            continue;
+        }
+        const StreamerPropertyPair& property = _properties.at(i);
         property.first->write(out, property.second.read(object));
     }
 }
 
 void MappedObjectStreamer::writeRawDelta(Bitstream& out, const QObject* object, const QObject* reference) const {
-    foreach (const StreamerPropertyPair& property, _properties) {
-        property.first->writeDelta(out, property.second.read(object), (reference && reference->metaObject() == _metaObject) ?
+    if (reference && reference->metaObject() != _metaObject) {
+        reference = NULL;
+    }
+    for (int i = 0; i < _properties.size(); i++) {
+        const PropertyAccessor* accessor = _accessors.at(i);
+        if (accessor) {
+            accessor->writeDelta(out, object, reference);
+            continue;
+        }
+        const StreamerPropertyPair& property = _properties.at(i);
+        property.first->writeDelta(out, property.second.read(object), reference ?
             property.second.read(reference) : QVariant());
     }
 }
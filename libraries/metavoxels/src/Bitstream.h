@@ -43,6 +43,7 @@ class JSONWriter;
 class ObjectReader;
 class ObjectStreamer;
 class OwnedAttributeValue;
+class PropertyAccessor;
 class TypeStreamer;
 
 typedef SharedObjectPointerTemplate<Attribute> AttributePointer;
@@ -281,6 +282,15 @@ public:
     /// Returns the streamer registered for the supplied object, if any.
     static const ObjectStreamer* getObjectStreamer(const QMetaObject* metaObject);
 
+    /// Registers a typed accessor for the named property of the supplied class, allowing objects of the class (and its
+    /// subclasses) to be written without going through QMetaProperty and QVariant.  Typically, one would use the
+    /// REGISTER_PROPERTY_ACCESSOR macro at the top level of the class's source file rather than calling this directly.
+    /// \return zero; the function only returns a value so that it can be used in static initialization
+    static int registerPropertyAccessor(const QMetaObject* metaObject, const char* name, PropertyAccessor* accessor);
+
+    /// Returns the accessor registered for the supplied property, if any.
+    static const PropertyAccessor* getPropertyAccessor(const QMetaProperty& property);
+
     /// Returns the meta-object registered under the supplied class name, if any.
     static const QMetaObject* getMetaObject(const QByteArray& className);
 
@@ -323,12 +333,16 @@ public:
     /// \param offset the offset of the first bit
     Bitstream& read(void* data, int bits, int offset = 0);    
 
-    /// Flushes any unwritten bits to the underlying stream.
+    /// Flushes any unwritten bits to the underlying stream.  Written bits are buffered until this is called, so it must be
+    /// called before the underlying stream is written to or inspected directly.
     void flush();
 
-    /// Resets to the initial state.
+    /// Resets to the initial state, discarding any unwritten bits (or any unread bits in the current byte).
     void reset();
 
+    /// Returns the number of bits written so far, flushed or not.  Only valid when writing to a stream with a device.
+    qint64 getBitsWritten() const;
+
     /// Returns the set of transient mappings gathered during writing and resets them.
     WriteMappings getAndResetWriteMappings();
 
@@ -505,9 +519,20 @@ private:
     ObjectStreamerPointer readGenericObjectStreamer(const QByteArray& name);
     TypeStreamerPointer readGenericTypeStreamer(const QByteArray& name, int category);
     
+    void writeBits(quint64 value, int bits);
+    void writeRegister();
+    void writeBuffer();
+    
     QDataStream& _underlying;
-    quint8 _byte;
+    
+    // bits are shifted in from the least significant end; when writing, _position is the number of bits waiting to be
+    // written, and when reading, the number of bits read from the underlying stream but not yet consumed
+    quint64 _register;
     int _position;
+    
+    // whole bytes waiting to be written to the underlying stream
+    QByteArray _buffer;
+    int _bufferSize;
 
     MetadataType _metadataType;
     GenericsMode _genericsMode;
@@ -528,6 +553,12 @@ private:
     static QHash<QByteArray, const QMetaObject*>& getMetaObjects();
     static QMultiHash<const QMetaObject*, const QMetaObject*>& getMetaObjectSubClasses();
     static QHash<int, const TypeStreamer*>& getTypeStreamers();
+    
+    /// Returns the streamers indexed directly by type id, for the lookups made for every value written.
+    static QVector<const TypeStreamer*>& getTypeStreamerTable();
+    static const TypeStreamer* findTypeStreamer(int type);
+    
+    static QHash<ScopeNamePair, const PropertyAccessor*>& getPropertyAccessors();
          
     static const QHash<const QMetaObject*, const ObjectStreamer*>& getObjectStreamers();
     static QHash<const QMetaObject*, const ObjectStreamer*> createObjectStreamers();
@@ -1039,6 +1070,49 @@ protected:
     ObjectStreamerPointer _self; ///< set/used for built-in classes (never deleted), to obtain shared pointers
 };
 
+/// Reads a property of a known type straight from objects of a local class, sparing the streamers of the class the
+/// QMetaProperty lookup and QVariant conversion for each value.  The values written are the same as those written through
+/// the property's type streamer, so the choice of path doesn't affect the stream.
+class PropertyAccessor {
+public:
+    
+    virtual ~PropertyAccessor();
+    
+    virtual bool equal(const QObject* first, const QObject* second) const = 0;
+    virtual void write(Bitstream& out, const QObject* object) const = 0;
+    
+    /// Writes the delta of the property, with a null reference standing for the default value.
+    virtual void writeDelta(Bitstream& out, const QObject* object, const QObject* reference) const = 0;
+};
+
+/// An accessor that calls the property's getter.
+template<class T, class C, class R> class GetterPropertyAccessor : public PropertyAccessor {
+public:
+    
+    GetterPropertyAccessor(R (C::*getter)() const) : _getter(getter) { }
+    
+    virtual bool equal(const QObject* first, const QObject* second) const { return get(first) == get(second); }
+    virtual void write(Bitstream& out, const QObject* object) const { out << get(object); }
+    virtual void writeDelta(Bitstream& out, const QObject* object, const QObject* reference) const {
+        if (reference) {
+            out.writeDelta(get(object), get(reference));
+        } else {
+            out.writeDelta(get(object), T());
+        }
+    }
+    
+private:
+    
+    R get(const QObject* object) const { return (static_cast<const C*>(object)->*_getter)(); }
+    
+    R (C::*_getter)() const;
+};
+
+/// Creates an accessor for a property of type T read through the supplied getter.
+template<class T, class C, class R> PropertyAccessor* createPropertyAccessor(R (C::*getter)() const) {
+    return new GetterPropertyAccessor<T, C, R>(getter);
+}
+
 /// A streamer that maps to a local class.
 class MappedObjectStreamer : public ObjectStreamer {
 public:
@@ -1060,6 +1134,7 @@ public:
 private:
     
     QVector<StreamerPropertyPair> _properties;
+    QVector<const PropertyAccessor*> _accessors; ///< for each property, the typed accessor to use when writing, if any
 };
 
 typedef QPair<TypeStreamerPointer, QByteArray> StreamerNamePair;
@@ -1563,6 +1638,11 @@ public:
 #define REGISTER_SIMPLE_TYPE_STREAMER(X) static int X##Streamer = \
     Bitstream::registerTypeStreamer(qMetaTypeId<X>(), new SimpleTypeStreamer<X>());
 
+/// Macro for registering typed property accessors.  Typically, one would use this at the top level of the source file
+/// associated with the class, for the properties of the classes most often streamed.
+#define REGISTER_PROPERTY_ACCESSOR(C, N, T, G) static int C##N##PropertyAccessor = \
+    Bitstream::registerPropertyAccessor(&C::staticMetaObject, #N, createPropertyAccessor<T>(&C::G));
+
 /// Macro for registering collection type (QList, QVector, QSet, QMap) streamers.  Typically, one would use this at the top
 /// level of the source file associated with the type.
 #define REGISTER_COLLECTION_TYPE_STREAMER(X) static int x##Streamer = \
@@ -9,6 +9,7 @@
 //  See the accompanying file LICENSE or http://www.apache.org/licenses/LICENSE-2.0.html
 //
 
+#include <cfloat>
 #include <cstring>
 
 #include <QtDebug>
@@ -26,6 +27,19 @@ const int DEFAULT_MAX_PACKET_SIZE = 3000;
 // the default slow-start threshold, which will be lowered quickly when we first encounter packet loss
 const float DEFAULT_SLOW_START_THRESHOLD = 1000.0f;
 
+// the weights given to new samples of the round trip time and loss
+const float ROUND_TRIP_TIME_SMOOTHING = 0.125f;
+const float LOSS_RATE_SMOOTHING = 0.05f;
+
+// the amount by which the round trip time must exceed the minimum before we take it as a sign of queueing
+const float MIN_QUEUEING_DELAY = 20.0f * USECS_PER_MSEC;
+
+// the share of each packet reserved for reliable data, if any is waiting
+const float MIN_RELIABLE_SHARE = 0.25f;
+
+// the number of packets' worth of reliable data a channel may bank or borrow
+const float MAX_CHANNEL_BURST_PACKETS = 4.0f;
+
 DatagramSequencer::DatagramSequencer(const QByteArray& datagramHeader, QObject* parent) :
     QObject(parent),
     _outgoingPacketStream(&_outgoingPacketData, QIODevice::WriteOnly),
@@ -45,7 +59,10 @@ DatagramSequencer::DatagramSequencer(const QByteArray& datagramHeader, QObject*
     _packetsToWrite(0.0f),
     _slowStartThreshold(DEFAULT_SLOW_START_THRESHOLD),
     _packetRateIncreasePacketNumber(0),
-    _packetRateDecreasePacketNumber(0) {
+    _packetRateDecreasePacketNumber(0),
+    _roundTripTime(0.0f),
+    _minRoundTripTime(FLT_MAX),
+    _lossRate(0.0f) {
 
     _outgoingPacketStream.setByteOrder(QDataStream::LittleEndian);
     _incomingDatagramStream.setByteOrder(QDataStream::LittleEndian);
@@ -109,8 +126,8 @@ int DatagramSequencer::startPacketGroup(int desiredPackets) {
 Bitstream& DatagramSequencer::startPacket() {
     // start with the list of acknowledgements
     _outgoingPacketStream << (quint32)_receiveRecords.size();
-    foreach (const ReceiveRecord& record, _receiveRecords) {
-        _outgoingPacketStream << (quint32)record.packetNumber;
+    for (int i = 0; i < _receiveRecords.size(); i++) {
+        _outgoingPacketStream << (quint32)_receiveRecords.at(i).packetNumber;
     }
     
     // write the high-priority messages
@@ -126,8 +143,10 @@ Bitstream& DatagramSequencer::startPacket() {
 void DatagramSequencer::endPacket() {
     _outputStream.flush();
     
-    // if we have space remaining, send some data from our reliable channels 
-    int remaining = _maxPacketSize - _outgoingPacketStream.device()->pos();
+    // if we have space remaining, send some data from our reliable channels.  they always get a minimum share, so that a
+    // large update can't keep them waiting indefinitely
+    int remaining = qMax((int)(_maxPacketSize - _outgoingPacketStream.device()->pos()),
+        (int)(_maxPacketSize * MIN_RELIABLE_SHARE));
     const int MINIMUM_RELIABLE_SIZE = sizeof(quint32) * 5; // count, channel number, segment count, offset, size
     QVector<ChannelSpan> spans;
     if (remaining > MINIMUM_RELIABLE_SIZE) {
@@ -213,13 +232,12 @@ void DatagramSequencer::receivedDatagram(const QByteArray& datagram) {
         if (index < 0 || index >= _sendRecords.size()) {
             continue;
         }
-        QList<SendRecord>::iterator it = _sendRecords.begin();
         for (int i = 0; i < index; i++) {
-            sendRecordLost(*it++);
+            sendRecordLost(_sendRecords.at(i));
         }
-        sendRecordAcknowledged(*it);
+        sendRecordAcknowledged(_sendRecords.at(index));
         emit sendAcknowledged(index);
-        _sendRecords.erase(_sendRecords.begin(), it + 1);
+        _sendRecords.removeFirst(index + 1);
     }
     
     // read and dispatch the high-priority messages
@@ -285,6 +303,13 @@ void DatagramSequencer::sendRecordAcknowledged(const SendRecord& record) {
     }
     _outputStream.persistWriteMappings(record.mappings);
     
+    // update the round trip time and loss rate
+    float roundTripTime = usecTimestampNow() - record.sendTime;
+    _roundTripTime = (_roundTripTime == 0.0f) ? roundTripTime :
+        glm::mix(_roundTripTime, roundTripTime, ROUND_TRIP_TIME_SMOOTHING);
+    _minRoundTripTime = qMin(_minRoundTripTime, roundTripTime);
+    _lossRate = glm::mix(_lossRate, 0.0f, LOSS_RATE_SMOOTHING);
+    
     // remove the received high priority messages
     for (int i = _highPriorityMessages.size() - 1; i >= 0; i--) {
         if (_highPriorityMessages.at(i).firstPacketNumber <= record.packetNumber) {
@@ -298,8 +323,10 @@ void DatagramSequencer::sendRecordAcknowledged(const SendRecord& record) {
         getReliableOutputChannel(span.channel)->spanAcknowledged(span);
     }
     
-    // increase the packet rate with every ack until we pass the slow start threshold; then, every round trip
-    if (record.packetNumber >= _packetRateIncreasePacketNumber) {
+    // increase the packet rate with every ack until we pass the slow start threshold; then, every round trip.  hold it
+    // steady, though, if the round trip time has grown enough to suggest that our packets are queueing up somewhere
+    bool queueing = (_roundTripTime - _minRoundTripTime > qMax(_minRoundTripTime, MIN_QUEUEING_DELAY));
+    if (record.packetNumber >= _packetRateIncreasePacketNumber && !queueing) {
         if (_packetsPerGroup >= _slowStartThreshold) {
             _packetRateIncreasePacketNumber = _outgoingPacketNumber + 1;
         }
@@ -312,6 +339,7 @@ void DatagramSequencer::sendRecordLost(const SendRecord& record) {
     foreach (const ChannelSpan& span, record.spans) {
         getReliableOutputChannel(span.channel)->spanLost(record.packetNumber, _outgoingPacketNumber + 1);
     }
+    _lossRate = glm::mix(_lossRate, 1.0f, LOSS_RATE_SMOOTHING);
     
     // halve the rate and remember as threshold
     if (record.packetNumber >= _packetRateDecreasePacketNumber) {
@@ -322,34 +350,56 @@ void DatagramSequencer::sendRecordLost(const SendRecord& record) {
 }
 
 void DatagramSequencer::appendReliableData(int bytes, QVector<ChannelSpan>& spans) {
-    // gather total number of bytes to write, priority
-    int totalBytes = 0;
+    // gather the channels with data to send and their total priority
+    QVector<ReliableChannel*> channels;
     float totalPriority = 0.0f;
-    int totalChannels = 0;
     foreach (ReliableChannel* channel, _reliableOutputChannels) {
-        int channelBytes = channel->getBytesAvailable();
-        if (channelBytes > 0) {
-            totalBytes += channelBytes;
+        if (channel->getBytesAvailable() > 0) {
+            channels.append(channel);
             totalPriority += channel->getPriority();
+        
+        } else {
+            channel->_tokens = 0.0f; // idle channels don't bank their share
+        }
+    }
+    
+    // fill each channel's bucket with its share of the packet and let it take what it has tokens for
+    float maxTokens = bytes * MAX_CHANNEL_BURST_PACKETS;
+    QVector<int> channelBytes(channels.size());
+    int remaining = bytes;
+    for (int i = 0; i < channels.size(); i++) {
+        ReliableChannel* channel = channels.at(i);
+        if (totalPriority > 0.0f) {
+            channel->_tokens = qMin(channel->_tokens + bytes * channel->getPriority() / totalPriority, maxTokens);
+        }
+        channelBytes[i] = qMin(qMin(channel->getBytesAvailable(), (int)qMax(channel->_tokens, 0.0f)), remaining);
+        remaining -= channelBytes.at(i);
+    }
+    
+    // hand out the space that went unused to whoever still has data, who will pay it back from their future shares
+    for (int i = 0; i < channels.size() && remaining > 0; i++) {
+        int extra = qMin(channels.at(i)->getBytesAvailable() - channelBytes.at(i), remaining);
+        channelBytes[i] += extra;
+        remaining -= extra;
+    }
+    
+    int totalChannels = 0;
+    for (int i = 0; i < channels.size(); i++) {
+        if (channelBytes.at(i) > 0) {
             totalChannels++;
         }
     }
     _outgoingPacketStream << (quint32)totalChannels;
-    if (totalChannels == 0) {
-        return;    
-    }
-    totalBytes = qMin(bytes, totalBytes);
     
-    foreach (ReliableChannel* channel, _reliableOutputChannels) {
-        int channelBytes = channel->getBytesAvailable();
-        if (channelBytes == 0) {
+    for (int i = 0; i < channels.size(); i++) {
+        ReliableChannel* channel = channels.at(i);
+        channel->_tokens = qMax(channel->_tokens - channelBytes.at(i), -maxTokens);
+        if (channelBytes.at(i) == 0) {
             continue;
         }
         _outgoingPacketStream << (quint32)channel->getIndex();
-        channelBytes = qMin(channelBytes, (int)(totalBytes * channel->getPriority() / totalPriority));
-        channel->writeData(_outgoingPacketStream, channelBytes, spans);   
-        totalBytes -= channelBytes;
-        totalPriority -= channel->getPriority();
+        channel->writeData(_outgoingPacketStream, channelBytes.at(i), spans);
+        channel->_bytesWrittenAverage.updateAverage(channelBytes.at(i));
     }
 }
 
@@ -361,7 +411,7 @@ void DatagramSequencer::sendPacket(const QByteArray& packet, const QVector<Chann
     
     // record the send
     SendRecord record = { _outgoingPacketNumber, _receiveRecords.isEmpty() ? 0 : _receiveRecords.last().packetNumber,
-        _outputStream.getAndResetWriteMappings(), spans };
+        _outputStream.getAndResetWriteMappings(), spans, usecTimestampNow() };
     _sendRecords.append(record);
     
     // write the sequence number and size, which are the same between all fragments
@@ -691,6 +741,7 @@ ReliableChannel::ReliableChannel(DatagramSequencer* sequencer, int index, bool o
     _dataStream(&_buffer),
     _bitstream(_dataStream),
     _priority(1.0f),
+    _tokens(0.0f),
     _offset(0),
     _writePosition(0),
     _writePositionResetPacketNumber(0),
@@ -19,10 +19,64 @@
 #include <QSet>
 #include <QVector>
 
+#include <SharedUtil.h>
+#include <SimpleMovingAverage.h>
+
 #include "AttributeRegistry.h"
 
 class ReliableChannel;
 
+/// A queue of records kept in a circular array, where one may append to the end, remove from the beginning, and access
+/// any element by its index, all in constant time.
+template<class T> class CircularQueue {
+public:
+
+    CircularQueue() : _first(0), _size(0) { }
+
+    bool isEmpty() const { return _size == 0; }
+    int size() const { return _size; }
+
+    const T& at(int index) const { return _items.at((_first + index) & (_items.size() - 1)); }
+    T& operator[](int index) { return _items[(_first + index) & (_items.size() - 1)]; }
+
+    const T& first() const { return at(0); }
+    const T& last() const { return at(_size - 1); }
+
+    /// Appends an item to the end of the queue, growing the array if necessary.
+    void append(const T& item);
+
+    /// Removes items from the beginning of the queue.
+    void removeFirst(int count = 1);
+
+private:
+
+    QVector<T> _items; ///< the capacity is always a power of two, so that indices wrap with a mask
+    int _first;
+    int _size;
+};
+
+template<class T> inline void CircularQueue<T>::append(const T& item) {
+    if (_size == _items.size()) {
+        // unwrap into an array of twice the capacity
+        QVector<T> items(qMax(_items.size() * 2, 16));
+        for (int i = 0; i < _size; i++) {
+            items[i] = at(i);
+        }
+        _items.swap(items);
+        _first = 0;
+    }
+    (*this)[_size++] = item;
+}
+
+template<class T> inline void CircularQueue<T>::removeFirst(int count) {
+    for (int i = 0; i < count; i++) {
+        // release whatever the record holds now rather than when the slot is reused
+        _items[_first] = T();
+        _first = (_first + 1) & (_items.size() - 1);
+    }
+    _size -= count;
+}
+
 /// Performs datagram sequencing, packet fragmentation and reassembly.  Works with Bitstream to provide methods to send and
 /// receive data over UDP with varying reliability and latency characteristics.  To use, create a DatagramSequencer with the
 /// fixed-size header that will be included with all outgoing datagrams and expected in all incoming ones (the contents of the
@@ -48,8 +102,11 @@ class ReliableChannel;
 /// The second method employs a set of independent reliable channels multiplexed onto the packet stream.  These channels are
 /// created lazily through the getReliableOutputChannel/getReliableInputChannel functions.  Output channels contain buffers
 /// to which one may write either arbitrary data (as a QIODevice) or messages (as QVariants), or switch between the two.
-/// Each time a packet is sent, data pending for reliable output channels is added, in proportion to their relative priorities,
-/// until the packet size limit set by setMaxPacketSize is reached.  On the receive side, the streams are reconstructed and
+/// Each time a packet is sent, data pending for reliable output channels is added until the packet size limit set by
+/// setMaxPacketSize is reached, with a guaranteed minimum share for the channels so that a large update can't starve them.
+/// The space is divided between the channels by weighted fair queuing: each channel has a token bucket that fills with its
+/// share of each packet (in proportion to its priority), and any space that a channel doesn't need goes to the others, who
+/// pay it back from their buckets later.  On the receive side, the streams are reconstructed and
 /// (again, depending on whether messages are enabled) either the QIODevice reports that data is available, or, when a complete
 /// message is decoded, the receivedMessage signal is fired.
 class DatagramSequencer : public QObject {
@@ -81,6 +138,15 @@ public:
     /// Returns the packet number of the sent packet at the specified index.
     int getSentPacketNumber(int index) const { return _sendRecords.at(index).packetNumber; }
     
+    /// Returns the smoothed round trip time in milliseconds, as measured from send to acknowledgement.
+    float getRoundTripTime() const { return _roundTripTime / USECS_PER_MSEC; }
+    
+    /// Returns the smoothed fraction of sent packets that were lost.
+    float getLossRate() const { return _lossRate; }
+    
+    /// Returns the current number of packets we send in each group.
+    float getPacketsPerGroup() const { return _packetsPerGroup; }
+    
     /// Adds a message to the high priority queue.  Will be sent with every outgoing packet until received.
     void sendHighPriorityMessage(const QVariant& data);
     
@@ -99,6 +165,9 @@ public:
     /// Returns the intput channel at the specified index, creating it if necessary.
     ReliableChannel* getReliableInputChannel(int index = 0);
     
+    /// Returns the map of output channels, keyed by index.
+    const QHash<int, ReliableChannel*>& getReliableOutputChannels() const { return _reliableOutputChannels; }
+    
     /// Starts a packet group.
     /// \param desiredPackets the number of packets we'd like to write in the group
     /// \return the number of packets to write in the group
@@ -158,7 +227,8 @@ private:
         int packetNumber;
         int lastReceivedPacketNumber;
         Bitstream::WriteMappings mappings;
-        QVector<ChannelSpan> spans; 
+        QVector<ChannelSpan> spans;
+        quint64 sendTime;
     };
     
     class ReceiveRecord {
@@ -183,8 +253,8 @@ private:
     /// readyToWrite) as necessary.
     void sendPacket(const QByteArray& packet, const QVector<ChannelSpan>& spans);
     
-    QList<SendRecord> _sendRecords;
-    QList<ReceiveRecord> _receiveRecords;
+    CircularQueue<SendRecord> _sendRecords;
+    CircularQueue<ReceiveRecord> _receiveRecords;
     
     QByteArray _outgoingPacketData;
     QDataStream _outgoingPacketStream;
@@ -217,6 +287,10 @@ private:
     int _packetRateIncreasePacketNumber;
     int _packetRateDecreasePacketNumber;
     
+    float _roundTripTime; ///< smoothed, in microseconds
+    float _minRoundTripTime;
+    float _lossRate;
+    
     QHash<int, ReliableChannel*> _reliableOutputChannels;
     QHash<int, ReliableChannel*> _reliableInputChannels;
 };
@@ -333,9 +407,13 @@ public:
     void setPriority(float priority) { _priority = priority; }
     float getPriority() const { return _priority; }
 
-    /// Returns the number of bytes available to read from this channel.
+    /// Returns the number of bytes available to read from this channel (for output channels, the number of bytes queued
+    /// and not yet acknowledged).
     int getBytesAvailable() const;
 
+    /// Returns the average rate at which we're writing this channel's data to outgoing packets.
+    float getBytesPerSecond() const { return _bytesWrittenAverage.getAverageSampleValuePerSecond(); }
+
     /// Sets whether we expect to write/read framed messages.
     void setMessagesEnabled(bool enabled) { _messagesEnabled = enabled; }
     bool getMessagesEnabled() const { return _messagesEnabled; }
@@ -375,6 +453,8 @@ private:
     QDataStream _dataStream;
     Bitstream _bitstream;
     float _priority;
+    float _tokens; ///< the bytes this channel may send before exceeding its fair share, negative if it has borrowed
+    SimpleMovingAverage _bytesWrittenAverage;
     
     int _offset;
     int _writePosition;
@@ -9,8 +9,13 @@
 //  See the accompanying file LICENSE or http://www.apache.org/licenses/LICENSE-2.0.html
 //
 
+#include <cstring>
+
 #include <QDateTime>
+#include <QRunnable>
 #include <QScriptEngine>
+#include <QSemaphore>
+#include <QThreadPool>
 #include <QtDebug>
 
 #include <GeometryUtil.h>
@@ -27,6 +32,16 @@ REGISTER_META_OBJECT(Spanner)
 REGISTER_META_OBJECT(Sphere)
 REGISTER_META_OBJECT(StaticModel)
 
+// spanners make up most of the objects in metavoxel updates, so their properties are written without QVariant
+REGISTER_PROPERTY_ACCESSOR(Spanner, bounds, Box, getBounds)
+REGISTER_PROPERTY_ACCESSOR(Spanner, placementGranularity, float, getPlacementGranularity)
+REGISTER_PROPERTY_ACCESSOR(Spanner, voxelizationGranularity, float, getVoxelizationGranularity)
+REGISTER_PROPERTY_ACCESSOR(Transformable, translation, glm::vec3, getTranslation)
+REGISTER_PROPERTY_ACCESSOR(Transformable, rotation, glm::quat, getRotation)
+REGISTER_PROPERTY_ACCESSOR(Transformable, scale, float, getScale)
+REGISTER_PROPERTY_ACCESSOR(Sphere, color, QColor, getColor)
+REGISTER_PROPERTY_ACCESSOR(StaticModel, url, QUrl, getURL)
+
 static int metavoxelDataTypeId = registerSimpleMetaType<MetavoxelData>();
 
 MetavoxelLOD::MetavoxelLOD(const glm::vec3& position, float threshold) :
@@ -105,6 +120,10 @@ void MetavoxelData::guide(MetavoxelVisitor& visitor) {
         MetavoxelNode* node = _roots.value(outputs.at(i));
         firstVisitation.outputNodes[i] = node;
     }
+    // scripted guides are bound to their engine's thread, so only tours using the default guide throughout may be split
+    if (outputs.isEmpty() && !node && guideInParallel(firstVisitation)) {
+        return;
+    }
     static_cast<MetavoxelGuide*>(firstVisitation.info.inputValues.last().getInlineValue<
         SharedObjectPointer>().data())->guide(firstVisitation);
     for (int i = 0; i < outputs.size(); i++) {
@@ -295,9 +314,13 @@ public:
     float getDistance() const { return _distance; }
     
     virtual bool visitSpanner(Spanner* spanner, float distance);
+    
+    virtual MetavoxelVisitor* createSubvisitor();
+    virtual void mergeSubvisitor(MetavoxelVisitor* subvisitor);
 
 private:
     
+    AttributePointer _attribute;
     Spanner* _spanner;
     float _distance;
 };
@@ -306,6 +329,7 @@ FirstRaySpannerIntersectionVisitor::FirstRaySpannerIntersectionVisitor(
         const glm::vec3& origin, const glm::vec3& direction, const AttributePointer& attribute, const MetavoxelLOD& lod) :
     RaySpannerIntersectionVisitor(origin, direction, QVector<AttributePointer>() << attribute,
         QVector<AttributePointer>(), QVector<AttributePointer>(), QVector<AttributePointer>(), lod),
+    _attribute(attribute),
     _spanner(NULL) {
 }
 
@@ -315,6 +339,20 @@ bool FirstRaySpannerIntersectionVisitor::visitSpanner(Spanner* spanner, float di
     return false;
 }
 
+MetavoxelVisitor* FirstRaySpannerIntersectionVisitor::createSubvisitor() {
+    return new FirstRaySpannerIntersectionVisitor(_origin, _direction, _attribute, _lod);
+}
+
+void FirstRaySpannerIntersectionVisitor::mergeSubvisitor(MetavoxelVisitor* subvisitor) {
+    // the octants are merged in ray order, and each subvisitor tracks its own visits (so that a spanner crossing into a
+    // later octant is still found by the nearer one), so the first hit found is the one we'd have found on our own
+    FirstRaySpannerIntersectionVisitor* other = static_cast<FirstRaySpannerIntersectionVisitor*>(subvisitor);
+    if (!_spanner && other->_spanner) {
+        _spanner = other->_spanner;
+        _distance = other->_distance;
+    }
+}
+
 SharedObjectPointer MetavoxelData::findFirstRaySpannerIntersection(
         const glm::vec3& origin, const glm::vec3& direction, const AttributePointer& attribute,
             float& distance, const MetavoxelLOD& lod) {
@@ -541,7 +579,7 @@ void MetavoxelData::readDelta(const MetavoxelData& reference, const MetavoxelLOD
 }
 
 void MetavoxelData::writeDelta(const MetavoxelData& reference, const MetavoxelLOD& referenceLOD,
-        Bitstream& out, const MetavoxelLOD& lod) const {
+        Bitstream& out, const MetavoxelLOD& lod, MetavoxelDeltaCache* cache) const {
     // first things first: there might be no change whatsoever
     glm::vec3 minimum = getMinimum();
     bool becameSubdivided = lod.becameSubdivided(minimum, _size, referenceLOD);
@@ -566,22 +604,29 @@ void MetavoxelData::writeDelta(const MetavoxelData& reference, const MetavoxelLO
         expandedReference = expanded;
     }
 
-    // write the added/changed/subdivided roots
+    // write the added/changed/subdivided roots; an expanded reference is temporary, so its nodes can't be cache keys
+    if (expandedReference != &reference) {
+        cache = NULL;
+    }
     for (QHash<AttributePointer, MetavoxelNode*>::const_iterator it = _roots.constBegin(); it != _roots.constEnd(); it++) {
         MetavoxelNode* referenceRoot = expandedReference->_roots.value(it.key());
         MetavoxelStreamState state = { minimum, _size, it.key(), out, lod, referenceLOD };
         if (it.value() != referenceRoot || becameSubdivided) {
-            out << it.key();    
+            out << it.key();
+            MetavoxelDeltaCache::Mode mode = MetavoxelDeltaCache::ROOT_MODE;
             if (referenceRoot) {
                 if (it.value() == referenceRoot) {
                     out << false;
-                    it.key()->writeMetavoxelSubdivision(*it.value(), state);
+                    mode = MetavoxelDeltaCache::SUBDIVISION_MODE;
                 } else {
                     out << true;
-                    it.key()->writeMetavoxelDelta(*it.value(), *referenceRoot, state);
+                    mode = MetavoxelDeltaCache::DELTA_MODE;
                 }
+            }
+            if (cache) {
+                cache->write(mode, it.value(), referenceRoot, state);
             } else {
-                it.key()->writeMetavoxelRoot(*it.value(), state);
+                MetavoxelDeltaCache::writeDirectly(mode, it.value(), referenceRoot, state);
             }
         }
     }
@@ -610,6 +655,14 @@ MetavoxelNode* MetavoxelData::createRoot(const AttributePointer& attribute) {
     return root = new MetavoxelNode(attribute);
 }
 
+void MetavoxelData::setRoot(const AttributePointer& attribute, MetavoxelNode* root) {
+    MetavoxelNode*& node = _roots[attribute];
+    if (node) {
+        node->decrementReferenceCount(attribute);
+    }
+    node = root;
+}
+
 bool MetavoxelData::deepEquals(const MetavoxelData& other, const MetavoxelLOD& lod) const {
     if (_size != other._size) {
         return false;
@@ -681,6 +734,91 @@ void MetavoxelStreamState::setMinimum(const glm::vec3& lastMinimum, int index) {
     minimum = getNextMinimum(lastMinimum, size, index);
 }
 
+MetavoxelDeltaCache::MetavoxelDeltaCache() :
+    _hits(0),
+    _misses(0) {
+}
+
+void MetavoxelDeltaCache::clear() {
+    _entries.clear();
+    _hits = 0;
+    _misses = 0;
+}
+
+void MetavoxelDeltaCache::write(Mode mode, MetavoxelNode* root, MetavoxelNode* reference, MetavoxelStreamState& state) {
+    Key key = { mode, state.attribute, root, reference, state.size, state.lod, state.referenceLOD };
+    QHash<Key, Entry>::const_iterator it = _entries.constFind(key);
+    if (it != _entries.constEnd()) {
+        if (it->shareable) {
+            state.stream.write(it->data.constData(), it->bits);
+            _hits++;
+        } else {
+            writeDirectly(mode, root, reference, state);
+        }
+        return;
+    }
+    _misses++;
+    
+    // encode to a fresh stream; if that didn't create any mappings, the bits are the same for any stream
+    Entry entry;
+    {
+        QDataStream scratchStream(&entry.data, QIODevice::WriteOnly);
+        Bitstream scratch(scratchStream);
+        MetavoxelStreamState scratchState = { state.minimum, state.size, state.attribute, scratch,
+            state.lod, state.referenceLOD };
+        writeDirectly(mode, root, reference, scratchState);
+        
+        Bitstream::WriteMappings mappings = scratch.getAndResetWriteMappings();
+        entry.shareable = mappings.objectStreamerOffsets.isEmpty() && mappings.typeStreamerOffsets.isEmpty() &&
+            mappings.attributeOffsets.isEmpty() && mappings.scriptStringOffsets.isEmpty() &&
+            mappings.sharedObjectOffsets.isEmpty();
+        entry.bits = scratch.getBitsWritten();
+        scratch.flush();
+    }
+    if (entry.shareable) {
+        state.stream.write(entry.data.constData(), entry.bits);
+    } else {
+        entry.data.clear();
+        writeDirectly(mode, root, reference, state);
+    }
+    _entries.insert(key, entry);
+}
+
+void MetavoxelDeltaCache::writeDirectly(Mode mode, MetavoxelNode* root, MetavoxelNode* reference,
+        MetavoxelStreamState& state) {
+    switch (mode) {
+        case ROOT_MODE:
+            state.attribute->writeMetavoxelRoot(*root, state);
+            break;
+            
+        case SUBDIVISION_MODE:
+            state.attribute->writeMetavoxelSubdivision(*root, state);
+            break;
+            
+        case DELTA_MODE:
+            state.attribute->writeMetavoxelDelta(*root, *reference, state);
+            break;
+    }
+}
+
+bool MetavoxelDeltaCache::Key::operator==(const Key& other) const {
+    return mode == other.mode && attribute == other.attribute && root == other.root && reference == other.reference &&
+        size == other.size && lod.position == other.lod.position && lod.threshold == other.lod.threshold &&
+        referenceLOD.position == other.referenceLOD.position && referenceLOD.threshold == other.referenceLOD.threshold;
+}
+
+static uint hashFloat(float value) {
+    quint32 bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+uint qHash(const MetavoxelDeltaCache::Key& key, uint seed) {
+    // the nodes and the position distinguish nearly all keys; equality takes care of the rest
+    return qHash(key.root, seed) ^ (qHash(key.reference, seed) * 31) ^ hashFloat(key.lod.position.x) ^
+        (hashFloat(key.lod.position.y) * 7) ^ (hashFloat(key.lod.position.z) * 13) ^ (uint)key.mode;
+}
+
 MetavoxelNode::MetavoxelNode(const AttributeValue& attributeValue, const MetavoxelNode* copyChildren) :
         _referenceCount(1) {
 
@@ -1135,6 +1273,14 @@ void MetavoxelVisitor::prepare() {
     // nothing by default
 }
 
+MetavoxelVisitor* MetavoxelVisitor::createSubvisitor() {
+    return NULL;
+}
+
+void MetavoxelVisitor::mergeSubvisitor(MetavoxelVisitor* subvisitor) {
+    // nothing by default
+}
+
 SpannerVisitor::SpannerVisitor(const QVector<AttributePointer>& spannerInputs, const QVector<AttributePointer>& spannerMasks,
         const QVector<AttributePointer>& inputs, const QVector<AttributePointer>& outputs, const MetavoxelLOD& lod) :
     MetavoxelVisitor(inputs + spannerInputs + spannerMasks, outputs, lod),
@@ -1202,7 +1348,7 @@ RaySpannerIntersectionVisitor::RaySpannerIntersectionVisitor(const glm::vec3& or
 }
 
 void RaySpannerIntersectionVisitor::prepare() {
-    Spanner::incrementVisit();
+    _visitedSpanners.clear();
 }
 
 class SpannerDistance {
@@ -1220,7 +1366,8 @@ int RaySpannerIntersectionVisitor::visit(MetavoxelInfo& info, float distance) {
     for (int end = _inputs.size() - _spannerMaskCount, i = end - _spannerInputCount, j = end; i < end; i++, j++) {
         foreach (const SharedObjectPointer& object, info.inputValues.at(i).getInlineValue<SharedObjectSet>()) {
             Spanner* spanner = static_cast<Spanner*>(object.data());
-            if (!(spanner->isMasked() && j < _inputs.size()) && spanner->testAndSetVisited()) {
+            if (!(spanner->isMasked() && j < _inputs.size()) && !_visitedSpanners.contains(spanner)) {
+                _visitedSpanners.insert(spanner);
                 SpannerDistance spannerDistance = { spanner };
                 if (spanner->findRayIntersection(_origin, _direction, glm::vec3(), 0.0f, spannerDistance.distance)) {
                     spannerDistances.append(spannerDistance);
@@ -1269,13 +1416,32 @@ int RaySpannerIntersectionVisitor::visit(MetavoxelInfo& info, float distance) {
 DefaultMetavoxelGuide::DefaultMetavoxelGuide() {
 }
 
-bool DefaultMetavoxelGuide::guide(MetavoxelVisitation& visitation) {
+/// Sets the input nodes and values of the child at the specified index.
+static void setChildInputs(const MetavoxelVisitation& visitation, float lodBase, int index,
+        MetavoxelVisitation& nextVisitation) {
+    for (int j = 0; j < visitation.inputNodes.size(); j++) {
+        MetavoxelNode* node = visitation.inputNodes.at(j);
+        const AttributeValue& parentValue = visitation.info.inputValues.at(j);
+        MetavoxelNode* child = (node && (visitation.info.size >= lodBase *
+            parentValue.getAttribute()->getLODThresholdMultiplier())) ? node->getChild(index) : NULL;
+        nextVisitation.info.inputValues[j] = ((nextVisitation.inputNodes[j] = child)) ?
+            child->getAttributeValue(parentValue.getAttribute()) : parentValue.getAttribute()->inherit(parentValue);
+    }
+}
+
+/// Visits the described metavoxel, returning the encoded order for its children.
+static int visitNode(MetavoxelVisitation& visitation, float& lodBase) {
     // save the core of the LOD calculation; we'll reuse it to determine whether to subdivide each attribute
-    float lodBase = glm::distance(visitation.visitor.getLOD().position, visitation.info.getCenter()) *
+    lodBase = glm::distance(visitation.visitor.getLOD().position, visitation.info.getCenter()) *
         visitation.visitor.getLOD().threshold;
     visitation.info.isLODLeaf = (visitation.info.size < lodBase * visitation.visitor.getMinimumLODThresholdMultiplier());
     visitation.info.isLeaf = visitation.info.isLODLeaf || visitation.allInputNodesLeaves();
-    int encodedOrder = visitation.visitor.visit(visitation.info);
+    return visitation.visitor.visit(visitation.info);
+}
+
+bool DefaultMetavoxelGuide::guide(MetavoxelVisitation& visitation) {
+    float lodBase;
+    int encodedOrder = visitNode(visitation, lodBase);
     if (encodedOrder == MetavoxelVisitor::SHORT_CIRCUIT) {
         return false;
     }
@@ -1303,14 +1469,7 @@ bool DefaultMetavoxelGuide::guide(MetavoxelVisitation& visitation) {
         // the encoded order tells us the child indices for each iteration
         int index = encodedOrder & ORDER_ELEMENT_MASK;
         encodedOrder >>= ORDER_ELEMENT_BITS;
-        for (int j = 0; j < visitation.inputNodes.size(); j++) {
-            MetavoxelNode* node = visitation.inputNodes.at(j);
-            const AttributeValue& parentValue = visitation.info.inputValues.at(j);
-            MetavoxelNode* child = (node && (visitation.info.size >= lodBase *
-                parentValue.getAttribute()->getLODThresholdMultiplier())) ? node->getChild(index) : NULL;
-            nextVisitation.info.inputValues[j] = ((nextVisitation.inputNodes[j] = child)) ?
-                child->getAttributeValue(parentValue.getAttribute()) : parentValue.getAttribute()->inherit(parentValue);
-        }
+        setChildInputs(visitation, lodBase, index, nextVisitation);
         for (int j = 0; j < visitation.outputNodes.size(); j++) {
             MetavoxelNode* node = visitation.outputNodes.at(j);
             MetavoxelNode* child = (node && (visitation.info.size >= lodBase *
@@ -1366,6 +1525,116 @@ bool DefaultMetavoxelGuide::guide(MetavoxelVisitation& visitation) {
     return true;
 }
 
+/// The state shared by the threads touring the octants of a metavoxel in parallel.
+class ParallelTour {
+public:
+    
+    ParallelTour(MetavoxelVisitation& parent, float lodBase);
+    
+    /// Tours octants until none are left.  Called on each thread taking part in the tour.
+    void run();
+    
+    MetavoxelVisitation& parent;
+    float lodBase;
+    int indices[MetavoxelNode::CHILD_COUNT]; ///< the child indices in visitation order
+    MetavoxelVisitor* subvisitors[MetavoxelNode::CHILD_COUNT];
+    QAtomicInt nextOctant;
+    QAtomicInt firstShortCircuit; ///< the position of the first octant whose tour was short-circuited
+    QSemaphore finishedOctants;
+
+private:
+    
+    bool guideOctant(int position);
+};
+
+ParallelTour::ParallelTour(MetavoxelVisitation& parent, float lodBase) :
+    parent(parent),
+    lodBase(lodBase),
+    nextOctant(0),
+    firstShortCircuit(MetavoxelNode::CHILD_COUNT) {
+}
+
+void ParallelTour::run() {
+    // threads that only get started after the last octant has been claimed must not touch anything else, since the
+    // guiding thread may have moved on
+    for (int position; (position = nextOctant.fetchAndAddOrdered(1)) < MetavoxelNode::CHILD_COUNT; ) {
+        // octants after one that short-circuited wouldn't have been visited at all
+        if (position < firstShortCircuit.loadAcquire() && !guideOctant(position)) {
+            int first;
+            do {
+                first = firstShortCircuit.loadAcquire();
+            } while (position < first && !firstShortCircuit.testAndSetOrdered(first, position));
+        }
+        finishedOctants.release();
+    }
+}
+
+bool ParallelTour::guideOctant(int position) {
+    int index = indices[position];
+    MetavoxelVisitation visitation = { &parent, *subvisitors[position], QVector<MetavoxelNode*>(parent.inputNodes.size()),
+        QVector<MetavoxelNode*>(), { &parent.info, glm::vec3(), parent.info.size * 0.5f,
+            QVector<AttributeValue>(parent.inputNodes.size()), QVector<OwnedAttributeValue>() } };
+    setChildInputs(parent, lodBase, index, visitation);
+    visitation.info.minimum = getNextMinimum(parent.info.minimum, visitation.info.size, index);
+    return static_cast<MetavoxelGuide*>(visitation.info.inputValues.last().getInlineValue<
+        SharedObjectPointer>().data())->guide(visitation);
+}
+
+class ParallelTourRunner : public QRunnable {
+public:
+    
+    ParallelTourRunner(const QSharedPointer<ParallelTour>& tour) : _tour(tour) { }
+    
+    virtual void run() { _tour->run(); }
+
+private:
+    
+    QSharedPointer<ParallelTour> _tour;
+};
+
+bool MetavoxelData::guideInParallel(MetavoxelVisitation& firstVisitation) {
+    MetavoxelVisitor& visitor = firstVisitation.visitor;
+    int threadCount = QThreadPool::globalInstance()->maxThreadCount();
+    if (threadCount < 2 || firstVisitation.allInputNodesLeaves()) {
+        return false; // nothing to be gained
+    }
+    MetavoxelVisitor* firstSubvisitor = visitor.createSubvisitor();
+    if (!firstSubvisitor) {
+        return false;
+    }
+    // the root itself is visited by the visitor proper
+    float lodBase;
+    int encodedOrder = visitNode(firstVisitation, lodBase);
+    if (encodedOrder == MetavoxelVisitor::SHORT_CIRCUIT || encodedOrder == MetavoxelVisitor::STOP_RECURSION) {
+        delete firstSubvisitor;
+        return true;
+    }
+    QSharedPointer<ParallelTour> tour(new ParallelTour(firstVisitation, lodBase));
+    for (int i = 0; i < MetavoxelNode::CHILD_COUNT; i++) {
+        tour->indices[i] = encodedOrder & ORDER_ELEMENT_MASK;
+        encodedOrder >>= ORDER_ELEMENT_BITS;
+        MetavoxelVisitor* subvisitor = (i == 0) ? firstSubvisitor : visitor.createSubvisitor();
+        subvisitor->setLOD(visitor.getLOD());
+        tour->subvisitors[i] = subvisitor;
+    }
+    
+    // the pool may be busy with other work (or we may be running on one of its threads), so rather than just waiting,
+    // we tour octants on this thread as well
+    for (int i = 1, count = qMin(threadCount, (int)MetavoxelNode::CHILD_COUNT); i < count; i++) {
+        QThreadPool::globalInstance()->start(new ParallelTourRunner(tour));
+    }
+    tour->run();
+    tour->finishedOctants.acquire(MetavoxelNode::CHILD_COUNT);
+    
+    for (int i = 0, last = qMin(tour->firstShortCircuit.load(), MetavoxelNode::CHILD_COUNT - 1); i <= last; i++) {
+        visitor.mergeSubvisitor(tour->subvisitors[i]);
+    }
+    for (int i = 0; i < MetavoxelNode::CHILD_COUNT; i++) {
+        delete tour->subvisitors[i];
+    }
+    return true;
+}
+
 ThrobbingMetavoxelGuide::ThrobbingMetavoxelGuide() : _rate(10.0) {
 }
 
@@ -1428,7 +1697,20 @@ QScriptValue ScriptedMetavoxelGuide::visit(QScriptContext* context, QScriptEngin
         }
     }
     
-    QScriptValue result = guide->_visitation->visitor.visit(info);
+    // visits already made on the script's behalf by a cached trace aren't repeated
+    int result = (guide->_replayIndex < guide->_replayedResults.size()) ?
+        guide->_replayedResults.at(guide->_replayIndex++) : guide->_visitation->visitor.visit(info);
+    
+    if (guide->_recordedVisits) {
+        CachedVisit cachedVisit = { info.minimum, info.size, info.isLODLeaf,
+            QVector<OwnedAttributeValue>(inputs.size()), result };
+        for (int i = 0; i < inputs.size(); i++) {
+            if (inputValues.property(i).isValid()) {
+                cachedVisit.inputValues[i] = info.inputValues.at(i);
+            }
+        }
+        guide->_recordedVisits->append(cachedVisit);
+    }
     
     // destroy any created values
     for (int i = 0; i < inputs.size(); i++) {
@@ -1440,9 +1722,65 @@ QScriptValue ScriptedMetavoxelGuide::visit(QScriptContext* context, QScriptEngin
     return result;
 }
 
-ScriptedMetavoxelGuide::ScriptedMetavoxelGuide() {
+bool ScriptedMetavoxelGuide::replayCachedVisits(MetavoxelVisitation& visitation, const QList<VisitTrace>& traces) {
+    // all traces that agree with the visitor so far describe the same next visit, since the script is deterministic
+    QList<const VisitTrace*> candidates;
+    foreach (const VisitTrace& trace, traces) {
+        candidates.append(&trace);
+    }
+    _replayedResults.clear();
+    if (candidates.first()->isEmpty()) {
+        return true; // the script makes no visits here
+    }
+    for (int i = 0; !candidates.isEmpty(); i++) {
+        const CachedVisit& cachedVisit = candidates.first()->at(i);
+        MetavoxelInfo info = { NULL, cachedVisit.minimum, cachedVisit.size, visitation.info.inputValues,
+            visitation.info.outputValues, cachedVisit.isLeaf };
+        for (int j = 0; j < cachedVisit.inputValues.size(); j++) {
+            if (cachedVisit.inputValues.at(j).getAttribute()) {
+                info.inputValues[j] = cachedVisit.inputValues.at(j);
+            }
+        }
+        int result = visitation.visitor.visit(info);
+        _replayedResults.append(result);
+        
+        for (int j = candidates.size() - 1; j >= 0; j--) {
+            const VisitTrace* candidate = candidates.at(j);
+            if (candidate->at(i).result != result) {
+                candidates.removeAt(j);
+                
+            } else if (candidate->size() == i + 1) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+ScriptedMetavoxelGuide::ScriptedMetavoxelGuide() :
+    _recordedVisits(NULL),
+    _replayIndex(0),
+    _cacheHits(0),
+    _cacheMisses(0) {
 }
 
+bool ScriptedMetavoxelGuide::CacheKey::operator==(const CacheKey& other) const {
+    return minimum == other.minimum && size == other.size && isLeaf == other.isLeaf && inputs == other.inputs &&
+        outputs == other.outputs;
+}
+
+uint qHash(const ScriptedMetavoxelGuide::CacheKey& key, uint seed) {
+    // the visitor's attributes rarely vary, so leave them to equality
+    return hashFloat(key.minimum.x) ^ (hashFloat(key.minimum.y) * 7) ^ (hashFloat(key.minimum.z) * 13) ^
+        (hashFloat(key.size) * 31) ^ (uint)key.isLeaf ^ seed;
+}
+
+// the number of keys for which we remember traces before starting over
+const int MAX_CACHED_GUIDE_KEYS = 16384;
+
+// the number of distinct traces we remember for each key
+const int MAX_TRACES_PER_KEY = 4;
+
 bool ScriptedMetavoxelGuide::guide(MetavoxelVisitation& visitation) {
     QScriptValue guideFunction;
     if (_guideFunction) {
@@ -1456,6 +1794,20 @@ bool ScriptedMetavoxelGuide::guide(MetavoxelVisitation& visitation) {
         // before we load, just use the default behavior
         return DefaultMetavoxelGuide::guide(visitation);
     }
+    if (!guideFunction.strictlyEquals(_cachedFunction)) {
+        // the script cache has (re)loaded the function, so whatever we remember may no longer hold
+        _cache.clear();
+        _cachedFunction = guideFunction;
+    }
+    CacheKey key = { visitation.info.minimum, visitation.info.size, visitation.info.isLeaf,
+        visitation.visitor.getInputs(), visitation.visitor.getOutputs() };
+    QHash<CacheKey, QList<VisitTrace> >::iterator traces = _cache.find(key);
+    if (traces != _cache.end() && replayCachedVisits(visitation, traces.value())) {
+        _cacheHits++;
+        return true;
+    }
+    _cacheMisses++;
+    
     QScriptEngine* engine = guideFunction.engine();
     if (!_minimumHandle.isValid()) {
         _minimumHandle = engine->toStringHandle("minimum");
@@ -1488,9 +1840,24 @@ bool ScriptedMetavoxelGuide::guide(MetavoxelVisitation& visitation) {
     _info.setProperty(_sizeHandle, visitation.info.size);
     _info.setProperty(_isLeafHandle, visitation.info.isLeaf);
     _visitation = &visitation;
+    VisitTrace trace;
+    _recordedVisits = &trace;
+    _replayIndex = 0;
     guideFunction.call(QScriptValue(), _arguments);
+    _recordedVisits = NULL;
+    _replayedResults.clear();
     if (engine->hasUncaughtException()) {
         qDebug() << "Script error: " << engine->uncaughtException().toString();
+        return true;
+    }
+    if (traces == _cache.end()) {
+        if (_cache.size() >= MAX_CACHED_GUIDE_KEYS) {
+            _cache.clear();
+        }
+        _cache.insert(key, QList<VisitTrace>() << trace);
+        
+    } else if (traces.value().size() < MAX_TRACES_PER_KEY) {
+        traces.value().append(trace);
     }
     return true;
 }
@@ -1499,6 +1866,8 @@ void ScriptedMetavoxelGuide::setURL(const ParameterizedURL& url) {
     _url = url;
     _guideFunction.reset();
     _minimumHandle = QScriptString();
+    _cachedFunction = QScriptValue();
+    _cache.clear();
 }
 
 bool MetavoxelVisitation::allInputNodesLeaves() const {
@@ -1558,11 +1927,8 @@ bool Spanner::blendAttributeValues(MetavoxelInfo& info, bool force) const {
 }
 
 bool Spanner::testAndSetVisited() {
-    if (_lastVisit == _visit) {
-        return false;
-    }
-    _lastVisit = _visit;
-    return true;
+    // octants toured in parallel may reach the same spanner at once; only one of them gets to visit it
+    return _lastVisit.fetchAndStoreOrdered(_visit) != _visit;
 }
 
 SpannerRenderer* Spanner::getRenderer() {
@@ -12,8 +12,10 @@
 #ifndef hifi_MetavoxelData_h
 #define hifi_MetavoxelData_h
 
+#include <QAtomicInt>
 #include <QBitArray>
 #include <QHash>
+#include <QSet>
 #include <QSharedData>
 #include <QSharedPointer>
 #include <QScriptString>
@@ -27,6 +29,7 @@
 
 class QScriptContext;
 
+class MetavoxelDeltaCache;
 class MetavoxelNode;
 class MetavoxelVisitation;
 class MetavoxelVisitor;
@@ -77,7 +80,8 @@ public:
     /// Returns the bounds of the octrees.
     Box getBounds() const;
 
-    /// Applies the specified visitor to the contained voxels.
+    /// Applies the specified visitor to the contained voxels.  Visitors without outputs that can be split (see
+    /// MetavoxelVisitor::createSubvisitor) tour the root's octants in parallel.
     void guide(MetavoxelVisitor& visitor);
    
     /// Inserts a spanner into the specified attribute layer.
@@ -115,11 +119,18 @@ public:
     void write(Bitstream& out, const MetavoxelLOD& lod = MetavoxelLOD()) const;
 
     void readDelta(const MetavoxelData& reference, const MetavoxelLOD& referenceLOD, Bitstream& in, const MetavoxelLOD& lod);
+    /// Writes the delta between the reference and this data.
+    /// \param cache if non-null, a cache through which root deltas may be shared with other writes of the same change
     void writeDelta(const MetavoxelData& reference, const MetavoxelLOD& referenceLOD,
-        Bitstream& out, const MetavoxelLOD& lod) const;
+        Bitstream& out, const MetavoxelLOD& lod, MetavoxelDeltaCache* cache = NULL) const;
 
     MetavoxelNode* getRoot(const AttributePointer& attribute) const { return _roots.value(attribute); }
     MetavoxelNode* createRoot(const AttributePointer& attribute);
+    
+    /// Replaces the root for the specified attribute, taking over the caller's reference to the new root.
+    void setRoot(const AttributePointer& attribute, MetavoxelNode* root);
+    
+    const QHash<AttributePointer, MetavoxelNode*>& getRoots() const { return _roots; }
 
     /// Performs a deep comparison between this data and the specified other (as opposed to the == operator, which does a
     /// shallow comparison).
@@ -132,6 +143,9 @@ private:
 
     friend class MetavoxelVisitation;
    
+    /// Tours the octants of the root on separate threads.  Returns false if the tour should be made on this thread instead.
+    bool guideInParallel(MetavoxelVisitation& firstVisitation);
+    
     void incrementRootReferenceCounts();
     void decrementRootReferenceCounts();
     
@@ -166,6 +180,57 @@ public:
     void setMinimum(const glm::vec3& lastMinimum, int index);
 };
 
+/// Caches encoded root deltas so that streams sending the same change at the same LOD (for instance, the sessions of a
+/// server whose clients have all acknowledged the same state) only compute it once.  Only encodings that don't depend on
+/// the stream's mappings (that is, that write no attributes, shared objects, etc.) are shared; the rest are written
+/// directly.  The cache holds node pointers without references, so it must be cleared whenever the data might change.
+class MetavoxelDeltaCache {
+public:
+    
+    enum Mode { ROOT_MODE, SUBDIVISION_MODE, DELTA_MODE };
+    
+    MetavoxelDeltaCache();
+    
+    void clear();
+    
+    /// Writes the root delta described by the parameters, using a cached encoding if possible.
+    void write(Mode mode, MetavoxelNode* root, MetavoxelNode* reference, MetavoxelStreamState& state);
+    
+    int getHits() const { return _hits; }
+    int getMisses() const { return _misses; }
+    
+    /// Writes the root delta without any caching.
+    static void writeDirectly(Mode mode, MetavoxelNode* root, MetavoxelNode* reference, MetavoxelStreamState& state);
+    
+    class Key {
+    public:
+        Mode mode;
+        AttributePointer attribute;
+        MetavoxelNode* root;
+        MetavoxelNode* reference;
+        float size;
+        MetavoxelLOD lod;
+        MetavoxelLOD referenceLOD;
+        
+        bool operator==(const Key& other) const;
+    };
+    
+private:
+    
+    class Entry {
+    public:
+        bool shareable;
+        QByteArray data;
+        int bits;
+    };
+    
+    QHash<Key, Entry> _entries;
+    int _hits;
+    int _misses;
+};
+
+uint qHash(const MetavoxelDeltaCache::Key& key, uint seed = 0);
+
 /// A single node within a metavoxel layer.
 class MetavoxelNode {
 public:
@@ -294,6 +359,15 @@ public:
     /// \param info the metavoxel data
     /// \return the encoded order in which to traverse the children, zero to stop recursion, or -1 to short-circuit the tour
     virtual int visit(MetavoxelInfo& info) = 0;
+    
+    /// Creates a visitor that will tour one octant of the data on another thread, or returns NULL if the tour can't be
+    /// split (the default).  Only visitors without outputs are split.  The subvisitor's visit functions may run concurrently
+    /// with those of other subvisitors, and its prepare function isn't called.
+    virtual MetavoxelVisitor* createSubvisitor();
+    
+    /// Merges the results of a subvisitor back into this visitor on the guiding thread.  Subvisitors are merged in the order
+    /// in which their octants would have been visited, up to and including the first whose tour was short-circuited.
+    virtual void mergeSubvisitor(MetavoxelVisitor* subvisitor);
 
 protected:
 
@@ -370,6 +444,10 @@ protected:
     
     int _spannerInputCount;
     int _spannerMaskCount;
+    
+    /// The spanners this visitor has visited.  Kept per visitor rather than on the spanners, so that each subvisitor
+    /// considers every spanner in its octant, just as a serial tour would have on reaching the octant.
+    QSet<Spanner*> _visitedSpanners;
 };
 
 /// Interface for objects that guide metavoxel visitors.
@@ -421,19 +499,62 @@ public:
 
     virtual bool guide(MetavoxelVisitation& visitation);
 
+    int getCacheHits() const { return _cacheHits; }
+    int getCacheMisses() const { return _cacheMisses; }
+
+    /// Identifies a call to the guide function by everything the script can see: the bounds and leaf status of the node
+    /// (the latter reflecting the LOD) and the attributes requested by the visitor.
+    class CacheKey {
+    public:
+        glm::vec3 minimum;
+        float size;
+        bool isLeaf;
+        QVector<AttributePointer> inputs;
+        QVector<AttributePointer> outputs;
+        
+        bool operator==(const CacheKey& other) const;
+    };
+
 public slots:
 
     void setURL(const ParameterizedURL& url);
     
 private:
 
+    /// A visit made by the guide function, along with the visitor's response.
+    class CachedVisit {
+    public:
+        glm::vec3 minimum;
+        float size;
+        bool isLeaf;
+        QVector<OwnedAttributeValue> inputValues; ///< the values set by the script, or null where it left the input alone
+        int result;
+    };
+    
+    typedef QList<CachedVisit> VisitTrace;
+
     static QScriptValue getInputs(QScriptContext* context, QScriptEngine* engine);
     static QScriptValue getOutputs(QScriptContext* context, QScriptEngine* engine);
     static QScriptValue visit(QScriptContext* context, QScriptEngine* engine);
 
+    /// Makes the visits of a cached trace on behalf of the script, as long as the visitor responds as it did before.
+    /// \return true if a trace was followed to the end, false if the script has to be run (in which case the results the
+    /// visitor has already returned are left in _replayedResults)
+    bool replayCachedVisits(MetavoxelVisitation& visitation, const QList<VisitTrace>& traces);
+
     ParameterizedURL _url;
 
     QSharedPointer<NetworkValue> _guideFunction;
+    
+    // the guide function is deterministic given what it sees and what the visitor returns, so we remember the visits it
+    // made for each key (one trace per distinct sequence of visitor results) and make them natively next time
+    QScriptValue _cachedFunction;
+    QHash<CacheKey, QList<VisitTrace> > _cache;
+    VisitTrace* _recordedVisits;
+    QVector<int> _replayedResults;
+    int _replayIndex;
+    int _cacheHits;
+    int _cacheMisses;
 
     QScriptString _minimumHandle;
     QScriptString _sizeHandle;
@@ -450,6 +571,8 @@ private:
     MetavoxelVisitation* _visitation;
 };
 
+uint qHash(const ScriptedMetavoxelGuide::CacheKey& key, uint seed = 0);
+
 /// Contains the state associated with a visit to a metavoxel system.
 class MetavoxelVisitation {
 public:
@@ -507,7 +630,7 @@ public:
     virtual bool blendAttributeValues(MetavoxelInfo& info, bool force = false) const;
     
     /// Checks whether we've visited this object on the current traversal.  If we have, returns false.
-    /// If we haven't, sets the last visit identifier and returns true.
+    /// If we haven't, sets the last visit identifier and returns true.  Safe to call from parallel tours.
     bool testAndSetVisited();
 
     /// Returns a pointer to the renderer, creating it if necessary.
@@ -536,7 +659,7 @@ private:
     float _placementGranularity;
     float _voxelizationGranularity;
     bool _masked;
-    int _lastVisit; ///< the identifier of the last visit
+    QAtomicInt _lastVisit; ///< the identifier of the last visit
     
     static int _visit; ///< the global visit counter
 };
@@ -0,0 +1,227 @@
+//
+//  MetavoxelImporter.cpp
+//  libraries/metavoxels/src
+//
+//  Copyright 2014 High Fidelity, Inc.
+//
+//  Distributed under the Apache License, Version 2.0.
+//  See the accompanying file LICENSE or http://www.apache.org/licenses/LICENSE-2.0.html
+//
+
+#include <cmath>
+
+#include <QAtomicInt>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QSharedPointer>
+#include <QThreadPool>
+#include <QtDebug>
+#include <QtEndian>
+
+#include "MetavoxelImporter.h"
+
+static bool isPowerOfTwo(int value) {
+    return value > 0 && (value & (value - 1)) == 0;
+}
+
+MetavoxelVolume::MetavoxelVolume(const AttributePointer& attribute, int resolution) :
+    _attribute(attribute),
+    _resolution(resolution) {
+}
+
+MetavoxelVolume::~MetavoxelVolume() {
+}
+
+RawVolume::RawVolume(const AttributePointer& attribute, const QString& filename) :
+    MetavoxelVolume(attribute),
+    _file(filename),
+    _memory(NULL) {
+
+    if (!_file.open(QIODevice::ReadOnly)) {
+        qDebug() << "Couldn't open volume file:" << filename << _file.errorString();
+        return;
+    }
+    qint64 voxels = _file.size() / sizeof(quint32);
+    int resolution = qRound(pow(voxels, 1.0 / 3.0));
+    if (!isPowerOfTwo(resolution) || (qint64)resolution * resolution * resolution != voxels) {
+        qDebug() << "Volume file isn't a power-of-two cube of 32-bit values:" << filename;
+        return;
+    }
+    if (!(_memory = _file.map(0, _file.size()))) {
+        qDebug() << "Couldn't map volume file:" << filename << _file.errorString();
+        return;
+    }
+    _resolution = resolution;
+}
+
+RawVolume::~RawVolume() {
+    if (_memory) {
+        _file.unmap(const_cast<uchar*>(_memory));
+    }
+}
+
+void* RawVolume::getValue(int x, int y, int z) const {
+    qint64 index = ((qint64)z * _resolution + y) * _resolution + x;
+    return encodeInline(qFromLittleEndian<quint32>(_memory + index * sizeof(quint32)));
+}
+
+HeightfieldVolume::HeightfieldVolume(const AttributePointer& attribute, const QImage& heightImage,
+        const QImage& colorImage) :
+    MetavoxelVolume(attribute),
+    _emptyValue(attribute->getDefaultValue()) {
+
+    int resolution = heightImage.width();
+    if (!isPowerOfTwo(resolution) || heightImage.height() != resolution) {
+        qDebug() << "Heightfield isn't a power-of-two square:" << heightImage.size();
+        return;
+    }
+    bool useColors = (colorImage.size() == heightImage.size());
+    const int MAX_GRAY = 255;
+    _heights.resize(resolution * resolution);
+    _colors.resize(resolution * resolution);
+    for (int z = 0, index = 0; z < resolution; z++) {
+        for (int x = 0; x < resolution; x++, index++) {
+            int gray = qGray(heightImage.pixel(x, z));
+            _heights[index] = gray * (resolution - 1) / MAX_GRAY;
+            _colors[index] = useColors ? (colorImage.pixel(x, z) | 0xFF000000) : qRgb(gray, gray, gray);
+        }
+    }
+    _resolution = resolution;
+}
+
+void* HeightfieldVolume::getValue(int x, int y, int z) const {
+    int index = z * _resolution + x;
+    return (y <= _heights.at(index)) ? encodeInline<QRgb>(_colors.at(index)) : _emptyValue;
+}
+
+/// Builds the node for the cube of the given size (in voxels) at the given coordinates.  Child indices have the x flag in
+/// the lowest bit, then y, then z.
+static MetavoxelNode* buildNode(const MetavoxelVolume& volume, int x, int y, int z, int size) {
+    const AttributePointer& attribute = volume.getAttribute();
+    if (size == 1) {
+        return new MetavoxelNode(AttributeValue(attribute, volume.getValue(x, y, z)));
+    }
+    int halfSize = size / 2;
+    if (halfSize == 1) {
+        // most of the cubes at the bottom are uniform, so try merging their values before creating any child nodes
+        void* values[MetavoxelNode::CHILD_COUNT];
+        for (int i = 0; i < MetavoxelNode::CHILD_COUNT; i++) {
+            values[i] = volume.getValue(x + ((i & 1) ? 1 : 0), y + ((i & 2) ? 1 : 0), z + ((i & 4) ? 1 : 0));
+        }
+        void* value = attribute->create();
+        bool merged = attribute->merge(value, values);
+        MetavoxelNode* node = new MetavoxelNode(AttributeValue(attribute, value));
+        attribute->destroy(value);
+        if (!merged) {
+            for (int i = 0; i < MetavoxelNode::CHILD_COUNT; i++) {
+                node->setChild(i, new MetavoxelNode(AttributeValue(attribute, values[i])));
+            }
+        }
+        return node;
+    }
+    MetavoxelNode* node = new MetavoxelNode(attribute);
+    for (int i = 0; i < MetavoxelNode::CHILD_COUNT; i++) {
+        node->setChild(i, buildNode(volume, x + ((i & 1) ? halfSize : 0), y + ((i & 2) ? halfSize : 0),
+            z + ((i & 4) ? halfSize : 0), halfSize));
+    }
+    node->mergeChildren(attribute);
+    return node;
+}
+
+/// The state shared by the threads building the subtrees of a volume.
+class VolumeBuild {
+public:
+
+    VolumeBuild(const MetavoxelVolume& volume, int jobSize);
+
+    /// Builds subtrees until none are left.  Called on each thread taking part in the build.
+    void run();
+
+    const MetavoxelVolume& volume;
+    int jobSize; ///< the size of each subtree, in voxels
+    int jobsPerSide;
+    int jobCount;
+    QVector<MetavoxelNode*> nodes;
+    QAtomicInt nextJob;
+    QSemaphore finishedJobs;
+};
+
+VolumeBuild::VolumeBuild(const MetavoxelVolume& volume, int jobSize) :
+    volume(volume),
+    jobSize(jobSize),
+    jobsPerSide(volume.getResolution() / jobSize),
+    jobCount(jobsPerSide * jobsPerSide * jobsPerSide),
+    nodes(jobCount),
+    nextJob(0) {
+}
+
+void VolumeBuild::run() {
+    // as with the parallel tour, threads that start after the last job has been claimed must not touch anything else
+    for (int job; (job = nextJob.fetchAndAddOrdered(1)) < jobCount; ) {
+        int x = job % jobsPerSide, y = (job / jobsPerSide) % jobsPerSide, z = job / (jobsPerSide * jobsPerSide);
+        nodes[job] = buildNode(volume, x * jobSize, y * jobSize, z * jobSize, jobSize);
+        finishedJobs.release();
+    }
+}
+
+class VolumeBuildRunner : public QRunnable {
+public:
+
+    VolumeBuildRunner(const QSharedPointer<VolumeBuild>& build) : _build(build) { }
+
+    virtual void run() { _build->run(); }
+
+private:
+
+    QSharedPointer<VolumeBuild> _build;
+};
+
+/// Joins the subtrees built by the jobs into the levels above them.
+static MetavoxelNode* joinNodes(const VolumeBuild& build, int x, int y, int z, int size) {
+    if (size == build.jobSize) {
+        return build.nodes.at(((z / size) * build.jobsPerSide + y / size) * build.jobsPerSide + x / size);
+    }
+    const AttributePointer& attribute = build.volume.getAttribute();
+    int halfSize = size / 2;
+    MetavoxelNode* node = new MetavoxelNode(attribute);
+    for (int i = 0; i < MetavoxelNode::CHILD_COUNT; i++) {
+        node->setChild(i, joinNodes(build, x + ((i & 1) ? halfSize : 0), y + ((i & 2) ? halfSize : 0),
+            z + ((i & 4) ? halfSize : 0), halfSize));
+    }
+    node->mergeChildren(attribute);
+    return node;
+}
+
+// the number of levels split into separate jobs (giving 64 jobs, enough to keep the threads busy as they finish unevenly)
+const int PARALLEL_BUILD_DEPTH = 2;
+
+// volumes below this size aren't worth splitting
+const int MIN_PARALLEL_BUILD_RESOLUTION = 64;
+
+MetavoxelNode* buildMetavoxelTree(const MetavoxelVolume& volume) {
+    int resolution = volume.getResolution();
+    int threadCount = QThreadPool::globalInstance()->maxThreadCount();
+    if (threadCount < 2 || resolution < MIN_PARALLEL_BUILD_RESOLUTION) {
+        return buildNode(volume, 0, 0, 0, resolution);
+    }
+    QSharedPointer<VolumeBuild> build(new VolumeBuild(volume, resolution >> PARALLEL_BUILD_DEPTH));
+    for (int i = 1, count = qMin(threadCount, build->jobCount); i < count; i++) {
+        QThreadPool::globalInstance()->start(new VolumeBuildRunner(build));
+    }
+    build->run();
+    build->finishedJobs.acquire(build->jobCount);
+
+    return joinNodes(*build, 0, 0, 0, resolution);
+}
+
+void importMetavoxelVolume(MetavoxelData& data, const glm::vec3& minimum, float size, const MetavoxelVolume& volume) {
+    if (volume.getResolution() == 0) {
+        return;
+    }
+    MetavoxelData imported;
+    imported.setSize(size);
+    imported.setRoot(volume.getAttribute(), buildMetavoxelTree(volume));
+
+    // setting without blending shares the new tree rather than copying it
+    data.set(minimum, imported);
+}
@@ -0,0 +1,82 @@
+//
+//  MetavoxelImporter.h
+//  libraries/metavoxels/src
+//
+//  Copyright 2014 High Fidelity, Inc.
+//
+//  Bulk import of dense volumes into metavoxel data
+//
+//  Distributed under the Apache License, Version 2.0.
+//  See the accompanying file LICENSE or http://www.apache.org/licenses/LICENSE-2.0.html
+//
+
+#ifndef hifi_MetavoxelImporter_h
+#define hifi_MetavoxelImporter_h
+
+#include <QFile>
+#include <QImage>
+
+#include "MetavoxelData.h"
+
+/// A dense cubic grid of values for a single attribute, to be imported in bulk.  Values are read from several threads at
+/// once, so they must be inline (as with the color and normal attributes) and getValue must be safe to call concurrently.
+class MetavoxelVolume {
+public:
+
+    MetavoxelVolume(const AttributePointer& attribute, int resolution = 0);
+    virtual ~MetavoxelVolume();
+
+    const AttributePointer& getAttribute() const { return _attribute; }
+
+    /// Returns the number of voxels along each side, which is a power of two (or zero if the volume couldn't be loaded).
+    int getResolution() const { return _resolution; }
+
+    /// Returns the value of the voxel at the specified coordinates, where x increases to the right, y up, and z backwards.
+    virtual void* getValue(int x, int y, int z) const = 0;
+
+protected:
+
+    AttributePointer _attribute;
+    int _resolution;
+};
+
+/// A volume of 32-bit values (such as colors) stored little-endian in a raw file, with x varying fastest, then y, then z.
+class RawVolume : public MetavoxelVolume {
+public:
+
+    RawVolume(const AttributePointer& attribute, const QString& filename);
+    virtual ~RawVolume();
+
+    virtual void* getValue(int x, int y, int z) const;
+
+private:
+
+    QFile _file;
+    const uchar* _memory;
+};
+
+/// A color volume derived from a square heightfield image: the voxels at or below the height of each pixel (given by its
+/// gray level) take the color of the corresponding pixel of the color image, or the gray level itself if there is none.
+class HeightfieldVolume : public MetavoxelVolume {
+public:
+
+    HeightfieldVolume(const AttributePointer& attribute, const QImage& heightImage, const QImage& colorImage = QImage());
+
+    virtual void* getValue(int x, int y, int z) const;
+
+private:
+
+    void* _emptyValue;
+    QVector<int> _heights;
+    QVector<QRgb> _colors;
+};
+
+/// Builds the tree for a volume from the leaves up, dividing the work between the threads of the global pool.
+/// \return the root of the tree, with one reference belonging to the caller
+MetavoxelNode* buildMetavoxelTree(const MetavoxelVolume& volume);
+
+/// Replaces the contents of the volume's attribute layer within the specified cube with the volume.  The tree is built in
+/// full before the data is touched, so the change is made in a single step.
+void importMetavoxelVolume(MetavoxelData& data, const glm::vec3& minimum, float size, const MetavoxelVolume& volume);
+
+#endif // hifi_MetavoxelImporter_h
@@ -0,0 +1,347 @@
+//
+//  MetavoxelSnapshotStore.cpp
+//  libraries/metavoxels/src
+//
+//  Copyright 2014 High Fidelity, Inc.
+//
+//  Distributed under the Apache License, Version 2.0.
+//  See the accompanying file LICENSE or http://www.apache.org/licenses/LICENSE-2.0.html
+//
+
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QtDebug>
+#include <QtEndian>
+
+#include "MetavoxelSnapshotStore.h"
+
+const quint32 SNAPSHOT_STORE_MAGIC = 0x48464d53; // "HFMS"
+const quint32 SNAPSHOT_STORE_VERSION = 1;
+const int SNAPSHOT_STORE_HEADER_SIZE = 2 * sizeof(quint32);
+
+const quint8 NODE_RECORD = 0;
+const quint8 SNAPSHOT_RECORD = 1;
+
+const int HASH_SIZE = 20; // SHA-1
+const int NODE_RECORD_HEADER_SIZE = sizeof(quint8) + HASH_SIZE + sizeof(quint32);
+const int SNAPSHOT_RECORD_HEADER_SIZE = sizeof(quint8) + sizeof(quint32);
+
+// we compact when the file is more than this many times the size of the latest snapshot...
+const qint64 COMPACTION_RATIO = 2;
+
+// ...and at least this big
+const qint64 MIN_COMPACTION_SIZE = 1024 * 1024;
+
+MetavoxelSnapshotStore::MetavoxelSnapshotStore(const QString& filename) :
+    _filename(filename),
+    _fileSize(0),
+    _liveBytes(0),
+    _nodesWritten(0),
+    _nodesShared(0) {
+}
+
+bool MetavoxelSnapshotStore::load(MetavoxelData& data) {
+    bool loaded = false;
+    QFile file(_filename);
+    if (file.open(QIODevice::ReadOnly)) {
+        qint64 size = file.size();
+        uchar* memory = file.map(0, size);
+        QByteArray snapshot;
+        bool readable = (memory && scan(memory, size, snapshot));
+        if (readable && !snapshot.isEmpty()) {
+            loaded = readSnapshot(snapshot, memory, size, data);
+            readable = loaded;
+        }
+        if (memory) {
+            file.unmap(memory);
+        }
+        file.close();
+        
+        if (!readable) {
+            // keep whatever it is out of harm's way
+            QString badFilename = _filename + ".bad";
+            QFile::remove(badFilename);
+            QFile::rename(_filename, badFilename);
+            qDebug() << "Moved unreadable metavoxel snapshot file to" << badFilename;
+        }
+    }
+
+    // shared objects are written with identifiers that are only unique within a run, so rather than mix records from
+    // different runs, we start this one with a fresh file containing only what we loaded
+    compact(data);
+    return loaded;
+}
+
+bool MetavoxelSnapshotStore::save(const MetavoxelData& data) {
+    if (!_file.isOpen()) {
+        return compact(data);
+    }
+    if (data == _lastSnapshot) {
+        return true; // nothing has changed
+    }
+    if (!appendSnapshot(data)) {
+        return false;
+    }
+    if (_fileSize > MIN_COMPACTION_SIZE && _fileSize > _liveBytes * COMPACTION_RATIO) {
+        return compact(data);
+    }
+    return true;
+}
+
+bool MetavoxelSnapshotStore::scan(const uchar* memory, qint64 size, QByteArray& snapshot) {
+    if (size < SNAPSHOT_STORE_HEADER_SIZE || qFromBigEndian<quint32>(memory) != SNAPSHOT_STORE_MAGIC ||
+            qFromBigEndian<quint32>(memory + sizeof(quint32)) != SNAPSHOT_STORE_VERSION) {
+        qDebug() << "Not a metavoxel snapshot file:" << _filename;
+        return false;
+    }
+    // a record cut short means we went down while writing it; everything before it is good
+    _records.clear();
+    for (qint64 position = SNAPSHOT_STORE_HEADER_SIZE; position < size; ) {
+        quint8 type = memory[position];
+        if (type == NODE_RECORD) {
+            if (position + NODE_RECORD_HEADER_SIZE > size) {
+                break;
+            }
+            QByteArray hash(reinterpret_cast<const char*>(memory + position + sizeof(quint8)), HASH_SIZE);
+            Record record = { position + NODE_RECORD_HEADER_SIZE,
+                (int)qFromBigEndian<quint32>(memory + position + sizeof(quint8) + HASH_SIZE) };
+            if (record.offset + record.length > size) {
+                break;
+            }
+            _records.insert(hash, record);
+            position = record.offset + record.length;
+
+        } else if (type == SNAPSHOT_RECORD) {
+            if (position + SNAPSHOT_RECORD_HEADER_SIZE > size) {
+                break;
+            }
+            qint64 length = qFromBigEndian<quint32>(memory + position + sizeof(quint8));
+            if (position + SNAPSHOT_RECORD_HEADER_SIZE + length > size) {
+                break;
+            }
+            snapshot = QByteArray(reinterpret_cast<const char*>(memory + position + SNAPSHOT_RECORD_HEADER_SIZE), length);
+            position += SNAPSHOT_RECORD_HEADER_SIZE + length;
+
+        } else {
+            qDebug() << "Unknown record type in metavoxel snapshot file:" << type;
+            break;
+        }
+    }
+    return true;
+}
+
+bool MetavoxelSnapshotStore::readSnapshot(const QByteArray& snapshot, const uchar* memory, qint64 size,
+        MetavoxelData& data) {
+    QByteArray contents = QByteArray::fromRawData(reinterpret_cast<const char*>(memory), size);
+    QBuffer buffer(&contents);
+    buffer.open(QIODevice::ReadOnly);
+    QDataStream stream(&buffer);
+    Bitstream in(stream);
+    QHash<QByteArray, MetavoxelNode*> nodes;
+
+    QDataStream snapshotStream(snapshot);
+    snapshotStream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+    float dataSize;
+    quint32 rootCount;
+    snapshotStream >> dataSize >> rootCount;
+    MetavoxelData snapshotData;
+    snapshotData.setSize(dataSize);
+    for (quint32 i = 0; i < rootCount; i++) {
+        QString name;
+        QByteArray hash(HASH_SIZE, 0);
+        snapshotStream >> name;
+        snapshotStream.readRawData(hash.data(), HASH_SIZE);
+        AttributePointer attribute = AttributeRegistry::getInstance()->getAttribute(name);
+        if (!attribute) {
+            qDebug() << "Unknown attribute in metavoxel snapshot:" << name;
+            continue;
+        }
+        MetavoxelNode* root = readNode(attribute, hash, memory, in, stream, nodes);
+        if (!root) {
+            return false;
+        }
+        snapshotData.setRoot(attribute, root);
+    }
+    data = snapshotData;
+    qDebug() << "Loaded metavoxel snapshot from" << _filename << "-" << nodes.size() << "nodes";
+    return true;
+}
+
+bool MetavoxelSnapshotStore::compact(const MetavoxelData& data) {
+    // write the new file alongside the old, so that we always have at least one complete snapshot on disk
+    _file.close();
+    QString compactFilename = _filename + ".compact";
+    _file.setFileName(compactFilename);
+    if (!_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qDebug() << "Failed to open metavoxel snapshot file:" << compactFilename << _file.errorString();
+        return false;
+    }
+    QDataStream out(&_file);
+    out << SNAPSHOT_STORE_MAGIC << SNAPSHOT_STORE_VERSION;
+    _fileSize = SNAPSHOT_STORE_HEADER_SIZE;
+    _records.clear();
+    _nodeInfo.clear();
+    _lastSnapshot = MetavoxelData();
+
+    if (!appendSnapshot(data)) {
+        _file.close();
+        QFile::remove(compactFilename);
+        return false;
+    }
+    _file.close();
+    QFile::remove(_filename);
+    if (!QFile::rename(compactFilename, _filename)) {
+        qDebug() << "Failed to replace metavoxel snapshot file:" << _filename;
+        return false;
+    }
+    _file.setFileName(_filename);
+    if (!_file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qDebug() << "Failed to open metavoxel snapshot file:" << _filename << _file.errorString();
+        return false;
+    }
+    return true;
+}
+
+bool MetavoxelSnapshotStore::appendSnapshot(const MetavoxelData& data) {
+    QByteArray snapshot;
+    QDataStream out(&snapshot, QIODevice::WriteOnly);
+    out.setFloatingPointPrecision(QDataStream::SinglePrecision);
+    out << data.getSize() << (quint32)data.getRoots().size();
+
+    QHash<const MetavoxelNode*, NodeInfo> nodeInfo;
+    for (QHash<AttributePointer, MetavoxelNode*>::const_iterator it = data.getRoots().constBegin();
+            it != data.getRoots().constEnd(); it++) {
+        QByteArray hash = writeNode(it.key(), it.value(), nodeInfo);
+        if (hash.isEmpty()) {
+            return false;
+        }
+        out << it.key()->getName();
+        out.writeRawData(hash.constData(), HASH_SIZE);
+    }
+
+    // the snapshot record goes last, so that it only ever refers to nodes that are already on disk
+    QByteArray header;
+    QDataStream headerOut(&header, QIODevice::WriteOnly);
+    headerOut << SNAPSHOT_RECORD << (quint32)snapshot.size();
+    if (_file.write(header) != header.size() || _file.write(snapshot) != snapshot.size() || !_file.flush()) {
+        qDebug() << "Failed to write metavoxel snapshot:" << _file.errorString();
+        return false;
+    }
+    _fileSize += header.size() + snapshot.size();
+
+    _liveBytes = 0;
+    foreach (const NodeInfo& info, nodeInfo) {
+        _liveBytes += info.length;
+    }
+    _nodeInfo = nodeInfo;
+    _lastSnapshot = data;
+    return true;
+}
+
+QByteArray MetavoxelSnapshotStore::writeNode(const AttributePointer& attribute, const MetavoxelNode* node,
+        QHash<const MetavoxelNode*, NodeInfo>& nodeInfo) {
+    QHash<const MetavoxelNode*, NodeInfo>::const_iterator it = nodeInfo.constFind(node);
+    if (it != nodeInfo.constEnd()) {
+        return it.value().hash;
+    }
+    it = _nodeInfo.constFind(node);
+    if (it != _nodeInfo.constEnd()) {
+        // unchanged since the last snapshot, as are its descendants, which we need to remember for the next one
+        nodeInfo.insert(node, it.value());
+        if (!node->isLeaf()) {
+            for (int i = 0; i < MetavoxelNode::CHILD_COUNT; i++) {
+                writeNode(attribute, node->getChild(i), nodeInfo);
+            }
+        }
+        _nodesShared++;
+        return it.value().hash;
+    }
+
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    bool leaf = node->isLeaf();
+    stream << (quint8)leaf;
+    if (!leaf) {
+        for (int i = 0; i < MetavoxelNode::CHILD_COUNT; i++) {
+            QByteArray childHash = writeNode(attribute, node->getChild(i), nodeInfo);
+            if (childHash.isEmpty()) {
+                return QByteArray();
+            }
+            stream.writeRawData(childHash.constData(), HASH_SIZE);
+        }
+    }
+    {
+        // each record gets its own stream, so that it can be read on its own
+        Bitstream out(stream);
+        attribute->write(out, node->getAttributeValue(), true);
+        out.flush();
+    }
+    QCryptographicHash hasher(QCryptographicHash::Sha1);
+    hasher.addData(attribute->getName().toUtf8());
+    hasher.addData(payload);
+    NodeInfo info = { hasher.result(), NODE_RECORD_HEADER_SIZE + payload.size() };
+
+    if (_records.contains(info.hash)) {
+        _nodesShared++;
+
+    } else {
+        QByteArray header;
+        QDataStream headerOut(&header, QIODevice::WriteOnly);
+        headerOut << NODE_RECORD;
+        headerOut.writeRawData(info.hash.constData(), HASH_SIZE);
+        headerOut << (quint32)payload.size();
+        if (_file.write(header) != header.size() || _file.write(payload) != payload.size()) {
+            qDebug() << "Failed to write metavoxel node:" << _file.errorString();
+            return QByteArray();
+        }
+        Record record = { _fileSize + NODE_RECORD_HEADER_SIZE, payload.size() };
+        _records.insert(info.hash, record);
+        _fileSize += info.length;
+        _nodesWritten++;
+    }
+    nodeInfo.insert(node, info);
+    return info.hash;
+}
+
+MetavoxelNode* MetavoxelSnapshotStore::readNode(const AttributePointer& attribute, const QByteArray& hash,
+        const uchar* memory, Bitstream& in, QDataStream& stream, QHash<QByteArray, MetavoxelNode*>& nodes) {
+    MetavoxelNode* node = nodes.value(hash);
+    if (node) {
+        node->incrementReferenceCount();
+        return node;
+    }
+    QHash<QByteArray, Record>::const_iterator record = _records.constFind(hash);
+    if (record == _records.constEnd()) {
+        qDebug() << "Missing metavoxel node in snapshot:" << hash.toHex();
+        return NULL;
+    }
+    const uchar* payload = memory + record.value().offset;
+    bool leaf = payload[0];
+    int childHashesSize = leaf ? 0 : MetavoxelNode::CHILD_COUNT * HASH_SIZE;
+    if ((int)sizeof(quint8) + childHashesSize > record.value().length) {
+        qDebug() << "Corrupt metavoxel node in snapshot:" << hash.toHex();
+        return NULL;
+    }
+
+    // the records share a stream so that shared objects appearing in more than one keep their identity
+    stream.device()->seek(record.value().offset + sizeof(quint8) + childHashesSize);
+    in.reset();
+    void* value = attribute->create();
+    attribute->read(in, value, true);
+    in.getAndResetReadMappings();
+    node = new MetavoxelNode(AttributeValue(attribute, value));
+    attribute->destroy(value);
+
+    for (int i = 0; i < MetavoxelNode::CHILD_COUNT && !leaf; i++) {
+        QByteArray childHash(reinterpret_cast<const char*>(payload + sizeof(quint8) + i * HASH_SIZE), HASH_SIZE);
+        MetavoxelNode* child = readNode(attribute, childHash, memory, in, stream, nodes);
+        if (!child) {
+            node->decrementReferenceCount(attribute);
+            return NULL;
+        }
+        node->setChild(i, child);
+    }
+    nodes.insert(hash, node);
+    return node;
+}
@@ -0,0 +1,89 @@
+//
+//  MetavoxelSnapshotStore.h
+//  libraries/metavoxels/src
+//
+//  Copyright 2014 High Fidelity, Inc.
+//
+//  Content-addressed on-disk snapshots of metavoxel data
+//
+//  Distributed under the Apache License, Version 2.0.
+//  See the accompanying file LICENSE or http://www.apache.org/licenses/LICENSE-2.0.html
+//
+
+#ifndef hifi_MetavoxelSnapshotStore_h
+#define hifi_MetavoxelSnapshotStore_h
+
+#include <QFile>
+#include <QHash>
+
+#include "MetavoxelData.h"
+
+/// Persists snapshots of metavoxel data to an append-only file in which each node is stored once, under the hash of its
+/// attribute, value, and children's hashes.  Since nodes are shared between versions of the data until they change, a
+/// snapshot only appends the nodes that changed since the last one; everything else is already in the file under the same
+/// hash.  Loading maps the file into memory and rebuilds the latest complete snapshot, sharing nodes that have the same hash.
+/// The file is compacted when loaded and whenever most of it no longer belongs to the latest snapshot.
+class MetavoxelSnapshotStore {
+public:
+
+    MetavoxelSnapshotStore(const QString& filename);
+
+    const QString& getFilename() const { return _filename; }
+
+    /// Loads the latest snapshot in the file into the provided data.  Must be called before the first save.
+    /// \return true if a snapshot was loaded
+    bool load(MetavoxelData& data);
+
+    /// Writes a snapshot of the data, unless it's unchanged since the last one.
+    /// \return true if the data is safely on disk
+    bool save(const MetavoxelData& data);
+
+    qint64 getFileSize() const { return _fileSize; }
+    qint64 getLiveBytes() const { return _liveBytes; }
+    int getNodesWritten() const { return _nodesWritten; }
+    int getNodesShared() const { return _nodesShared; }
+
+private:
+
+    class Record {
+    public:
+        qint64 offset; ///< the offset of the node's payload
+        int length;
+    };
+
+    class NodeInfo {
+    public:
+        QByteArray hash;
+        int length; ///< the length of the node's record, counting towards the live bytes
+    };
+
+    bool scan(const uchar* memory, qint64 size, QByteArray& snapshot);
+    bool readSnapshot(const QByteArray& snapshot, const uchar* memory, qint64 size, MetavoxelData& data);
+    
+    /// Replaces the file with one containing only a snapshot of the provided data.
+    bool compact(const MetavoxelData& data);
+    
+    bool appendSnapshot(const MetavoxelData& data);
+
+    QByteArray writeNode(const AttributePointer& attribute, const MetavoxelNode* node,
+        QHash<const MetavoxelNode*, NodeInfo>& nodeInfo);
+
+    MetavoxelNode* readNode(const AttributePointer& attribute, const QByteArray& hash, const uchar* memory,
+        Bitstream& in, QDataStream& stream, QHash<QByteArray, MetavoxelNode*>& nodes);
+
+    QString _filename;
+    QFile _file;
+    qint64 _fileSize;
+
+    QHash<QByteArray, Record> _records;
+
+    // the last snapshot keeps its nodes (which don't change while shared) alive, so their hashes can be remembered by address
+    MetavoxelData _lastSnapshot;
+    QHash<const MetavoxelNode*, NodeInfo> _nodeInfo;
+    qint64 _liveBytes;
+
+    int _nodesWritten;
+    int _nodesShared;
+};
+
+#endif // hifi_MetavoxelSnapshotStore_h
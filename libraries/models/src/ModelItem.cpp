@@ -95,6 +95,10 @@ ModelItem::ModelItem(const ModelItemID& modelItemID, const ModelItemProperties&
 
     _jointMappingCompleted = false;
     _lastAnimated = now;
+
+    for (int i = 0; i < MODEL_PROPERTY_COUNT; i++) {
+        _propertyChangedTimes[i] = now;
+    }
     
     setProperties(properties);
 }
@@ -129,9 +133,32 @@ void ModelItem::init(glm::vec3 position, float radius, rgbColor color, uint32_t
     _glowLevel = 0.0f;
     _jointMappingCompleted = false;
     _lastAnimated = now;
+
+    for (int i = 0; i < MODEL_PROPERTY_COUNT; i++) {
+        _propertyChangedTimes[i] = now;
+    }
+}
+
+// the properties included in model data from before models were sent as their changed properties
+static ModelPropertyFlags allModelProperties() {
+    ModelPropertyFlags properties;
+    for (int i = 0; i < MODEL_PROPERTY_COUNT; i++) {
+        properties += (ModelProperty)i;
+    }
+    return properties;
+}
+
+ModelPropertyFlags ModelItem::getChangedProperties(quint64 since) const {
+    ModelPropertyFlags properties;
+    for (int i = 0; i < MODEL_PROPERTY_COUNT; i++) {
+        if (_propertyChangedTimes[i] >= since) {
+            properties += (ModelProperty)i;
+        }
+    }
+    return properties;
 }
 
-bool ModelItem::appendModelData(OctreePacketData* packetData) const {
+bool ModelItem::appendModelData(OctreePacketData* packetData, const ModelPropertyFlags& properties) const {
 
     bool success = packetData->appendValue(getID());
 
@@ -143,21 +170,27 @@ bool ModelItem::appendModelData(OctreePacketData* packetData) const {
     if (success) {
         success = packetData->appendValue(getLastEdited());
     }
+
+    // the properties included, followed by each of them
     if (success) {
+        QByteArray encodedProperties = properties.encode();
+        success = packetData->appendRawData((const unsigned char*)encodedProperties.constData(), encodedProperties.size());
+    }
+    if (success && properties.getHasProperty(MODEL_PROPERTY_RADIUS)) {
         success = packetData->appendValue(getRadius());
     }
-    if (success) {
+    if (success && properties.getHasProperty(MODEL_PROPERTY_POSITION)) {
         success = packetData->appendPosition(getPosition());
     }
-    if (success) {
+    if (success && properties.getHasProperty(MODEL_PROPERTY_COLOR)) {
         success = packetData->appendColor(getColor());
     }
-    if (success) {
+    if (success && properties.getHasProperty(MODEL_PROPERTY_SHOULD_DIE)) {
         success = packetData->appendValue(getShouldDie());
     }
 
     // modelURL
-    if (success) {
+    if (success && properties.getHasProperty(MODEL_PROPERTY_MODEL_URL)) {
         uint16_t modelURLLength = _modelURL.size() + 1; // include NULL
         success = packetData->appendValue(modelURLLength);
         if (success) {
@@ -166,12 +199,12 @@ bool ModelItem::appendModelData(OctreePacketData* packetData) const {
     }
 
     // modelRotation
-    if (success) {
+    if (success && properties.getHasProperty(MODEL_PROPERTY_MODEL_ROTATION)) {
         success = packetData->appendValue(getModelRotation());
     }
 
     // animationURL
-    if (success) {
+    if (success && properties.getHasProperty(MODEL_PROPERTY_ANIMATION_URL)) {
         uint16_t animationURLLength = _animationURL.size() + 1; // include NULL
         success = packetData->appendValue(animationURLLength);
         if (success) {
@@ -180,17 +213,17 @@ bool ModelItem::appendModelData(OctreePacketData* packetData) const {
     }
 
     // animationIsPlaying
-    if (success) {
+    if (success && properties.getHasProperty(MODEL_PROPERTY_ANIMATION_PLAYING)) {
         success = packetData->appendValue(getAnimationIsPlaying());
     }
 
     // animationFrameIndex
-    if (success) {
+    if (success && properties.getHasProperty(MODEL_PROPERTY_ANIMATION_FRAME_INDEX)) {
         success = packetData->appendValue(getAnimationFrameIndex());
     }
 
     // animationFPS
-    if (success) {
+    if (success && properties.getHasProperty(MODEL_PROPERTY_ANIMATION_FPS)) {
         success = packetData->appendValue(getAnimationFPS());
     }
 
@@ -199,17 +232,15 @@ bool ModelItem::appendModelData(OctreePacketData* packetData) const {
 
 int ModelItem::expectedBytes() {
     int expectedBytes = sizeof(uint32_t) // id
-                + sizeof(float) // age
                 + sizeof(quint64) // last updated
                 + sizeof(quint64) // lasted edited
-                + sizeof(float) // radius
-                + sizeof(glm::vec3) // position
-                + sizeof(rgbColor); // color
+                + sizeof(uint8_t); // included properties
                 // potentially more...
     return expectedBytes;
 }
 
-int ModelItem::readModelDataFromBuffer(const unsigned char* data, int bytesLeftToRead, ReadBitstreamToTreeParams& args) {
+int ModelItem::readModelDataFromBuffer(const unsigned char* data, int bytesLeftToRead, ReadBitstreamToTreeParams& args,
+                                       bool* isComplete) {
 
     int bytesRead = 0;
     if (bytesLeftToRead >= expectedBytes()) {
@@ -234,43 +265,76 @@ int ModelItem::readModelDataFromBuffer(const unsigned char* data, int bytesLeftT
         bytesRead += sizeof(_lastEdited);
         _lastEdited -= clockSkew;
 
+        // included properties; older versions include all of them (or all but the animation ones)
+        ModelPropertyFlags properties = allModelProperties();
+        if (args.bitstreamVersion >= VERSION_MODELS_HAVE_PROPERTY_FLAGS) {
+            int bytes = properties.decode(dataAt, bytesLeftToRead - bytesRead);
+            dataAt += bytes;
+            bytesRead += bytes;
+            if (isComplete) {
+                *isComplete = (properties == allModelProperties());
+            }
+        } else {
+            if (args.bitstreamVersion < VERSION_MODELS_HAVE_ANIMATION) {
+                properties -= MODEL_PROPERTY_ANIMATION_URL;
+                properties -= MODEL_PROPERTY_ANIMATION_PLAYING;
+                properties -= MODEL_PROPERTY_ANIMATION_FRAME_INDEX;
+                properties -= MODEL_PROPERTY_ANIMATION_FPS;
+            }
+            if (isComplete) {
+                *isComplete = true;
+            }
+        }
+
         // radius
-        memcpy(&_radius, dataAt, sizeof(_radius));
-        dataAt += sizeof(_radius);
-        bytesRead += sizeof(_radius);
+        if (properties.getHasProperty(MODEL_PROPERTY_RADIUS)) {
+            memcpy(&_radius, dataAt, sizeof(_radius));
+            dataAt += sizeof(_radius);
+            bytesRead += sizeof(_radius);
+        }
 
         // position
-        memcpy(&_position, dataAt, sizeof(_position));
-        dataAt += sizeof(_position);
-        bytesRead += sizeof(_position);
+        if (properties.getHasProperty(MODEL_PROPERTY_POSITION)) {
+            memcpy(&_position, dataAt, sizeof(_position));
+            dataAt += sizeof(_position);
+            bytesRead += sizeof(_position);
+        }
 
         // color
-        memcpy(_color, dataAt, sizeof(_color));
-        dataAt += sizeof(_color);
-        bytesRead += sizeof(_color);
+        if (properties.getHasProperty(MODEL_PROPERTY_COLOR)) {
+            memcpy(_color, dataAt, sizeof(_color));
+            dataAt += sizeof(_color);
+            bytesRead += sizeof(_color);
+        }
 
         // shouldDie
-        memcpy(&_shouldDie, dataAt, sizeof(_shouldDie));
-        dataAt += sizeof(_shouldDie);
-        bytesRead += sizeof(_shouldDie);
+        if (properties.getHasProperty(MODEL_PROPERTY_SHOULD_DIE)) {
+            memcpy(&_shouldDie, dataAt, sizeof(_shouldDie));
+            dataAt += sizeof(_shouldDie);
+            bytesRead += sizeof(_shouldDie);
+        }
 
         // modelURL
-        uint16_t modelURLLength;
-        memcpy(&modelURLLength, dataAt, sizeof(modelURLLength));
-        dataAt += sizeof(modelURLLength);
-        bytesRead += sizeof(modelURLLength);
-        QString modelURLString((const char*)dataAt);
-        setModelURL(modelURLString);
-        dataAt += modelURLLength;
-        bytesRead += modelURLLength;
+        if (properties.getHasProperty(MODEL_PROPERTY_MODEL_URL)) {
+            uint16_t modelURLLength;
+            memcpy(&modelURLLength, dataAt, sizeof(modelURLLength));
+            dataAt += sizeof(modelURLLength);
+            bytesRead += sizeof(modelURLLength);
+            QString modelURLString((const char*)dataAt);
+            setModelURL(modelURLString);
+            dataAt += modelURLLength;
+            bytesRead += modelURLLength;
+        }
 
         // modelRotation
-        int bytes = unpackOrientationQuatFromBytes(dataAt, _modelRotation);
-        dataAt += bytes;
-        bytesRead += bytes;
+        if (properties.getHasProperty(MODEL_PROPERTY_MODEL_ROTATION)) {
+            int bytes = unpackOrientationQuatFromBytes(dataAt, _modelRotation);
+            dataAt += bytes;
+            bytesRead += bytes;
+        }
 
-        if (args.bitstreamVersion >= VERSION_MODELS_HAVE_ANIMATION) {
-            // animationURL
+        // animationURL
+        if (properties.getHasProperty(MODEL_PROPERTY_ANIMATION_URL)) {
             uint16_t animationURLLength;
             memcpy(&animationURLLength, dataAt, sizeof(animationURLLength));
             dataAt += sizeof(animationURLLength);
@@ -279,18 +343,24 @@ int ModelItem::readModelDataFromBuffer(const unsigned char* data, int bytesLeftT
             setAnimationURL(animationURLString);
             dataAt += animationURLLength;
             bytesRead += animationURLLength;
+        }
 
-            // animationIsPlaying
+        // animationIsPlaying
+        if (properties.getHasProperty(MODEL_PROPERTY_ANIMATION_PLAYING)) {
             memcpy(&_animationIsPlaying, dataAt, sizeof(_animationIsPlaying));
             dataAt += sizeof(_animationIsPlaying);
             bytesRead += sizeof(_animationIsPlaying);
+        }
 
-            // animationFrameIndex
+        // animationFrameIndex
+        if (properties.getHasProperty(MODEL_PROPERTY_ANIMATION_FRAME_INDEX)) {
             memcpy(&_animationFrameIndex, dataAt, sizeof(_animationFrameIndex));
             dataAt += sizeof(_animationFrameIndex);
             bytesRead += sizeof(_animationFrameIndex);
+        }
 
-            // animationFPS
+        // animationFPS
+        if (properties.getHasProperty(MODEL_PROPERTY_ANIMATION_FPS)) {
             memcpy(&_animationFPS, dataAt, sizeof(_animationFPS));
             dataAt += sizeof(_animationFPS);
             bytesRead += sizeof(_animationFPS);
@@ -751,7 +821,6 @@ QVector<glm::quat> ModelItem::getAnimationFrame() {
 
 void ModelItem::update(const quint64& updateTime) {
     _lastUpdated = updateTime;
-    setShouldDie(getShouldDie());
 
     quint64 now = usecTimestampNow();
 
@@ -769,6 +838,7 @@ void ModelItem::update(const quint64& updateTime) {
         }
         _lastAnimated = now;
         _animationFrameIndex += deltaTime * _animationFPS;
+        _propertyChangedTimes[MODEL_PROPERTY_ANIMATION_FRAME_INDEX] = now;
 
         if (wantDebugging) {
             qDebug() << "   _animationFrameIndex=" << _animationFrameIndex;
@@ -779,8 +849,88 @@ void ModelItem::update(const quint64& updateTime) {
     }
 }
 
+void ModelItem::setAnimationIsPlaying(bool value) {
+    // models that aren't playing aren't updated, so start counting frames from now rather than from the last update
+    if (value && !_animationIsPlaying) {
+        _lastAnimated = usecTimestampNow();
+    }
+    _animationIsPlaying = value;
+    propertyChanged(MODEL_PROPERTY_ANIMATION_PLAYING);
+}
+
 void ModelItem::copyChangedProperties(const ModelItem& other) {
+    ModelItem before = *this;
     *this = other;
+    stampChangedProperties(before);
+}
+
+void ModelItem::stampChangedProperties(const ModelItem& before) {
+    for (int i = 0; i < MODEL_PROPERTY_COUNT; i++) {
+        _propertyChangedTimes[i] = qMax(_propertyChangedTimes[i], before._propertyChangedTimes[i]);
+    }
+    quint64 now = usecTimestampNow();
+    if (_radius != before._radius) {
+        _propertyChangedTimes[MODEL_PROPERTY_RADIUS] = now;
+    }
+    if (_position != before._position) {
+        _propertyChangedTimes[MODEL_PROPERTY_POSITION] = now;
+    }
+    if (memcmp(_color, before._color, sizeof(_color)) != 0) {
+        _propertyChangedTimes[MODEL_PROPERTY_COLOR] = now;
+    }
+    if (_shouldDie != before._shouldDie) {
+        _propertyChangedTimes[MODEL_PROPERTY_SHOULD_DIE] = now;
+    }
+    if (_modelURL != before._modelURL) {
+        _propertyChangedTimes[MODEL_PROPERTY_MODEL_URL] = now;
+    }
+    if (_modelRotation != before._modelRotation) {
+        _propertyChangedTimes[MODEL_PROPERTY_MODEL_ROTATION] = now;
+    }
+    if (_animationURL != before._animationURL) {
+        _propertyChangedTimes[MODEL_PROPERTY_ANIMATION_URL] = now;
+    }
+    if (_animationIsPlaying != before._animationIsPlaying) {
+        _propertyChangedTimes[MODEL_PROPERTY_ANIMATION_PLAYING] = now;
+    }
+    if (_animationFrameIndex != before._animationFrameIndex) {
+        _propertyChangedTimes[MODEL_PROPERTY_ANIMATION_FRAME_INDEX] = now;
+    }
+    if (_animationFPS != before._animationFPS) {
+        _propertyChangedTimes[MODEL_PROPERTY_ANIMATION_FPS] = now;
+    }
+}
+
+// NOTE: If the model has a bad mesh, then extents will be 0,0,0 & 0,0,0, in which case we will simulate the unit cube
+static Extents fixBadMeshExtents(const Extents& extents) {
+    Extents fixedExtents = extents;
+    if (fixedExtents.minimum == fixedExtents.maximum && fixedExtents.minimum == glm::vec3(0.0f, 0.0f, 0.0f)) {
+        fixedExtents.maximum = glm::vec3(1.0f, 1.0f, 1.0f);
+    }
+    return fixedExtents;
+}
+
+Extents ModelItem::scaleGeometryExtents(const Extents& meshExtents, const Extents& extents) const {
+    Extents geometryExtents = fixBadMeshExtents(meshExtents);
+
+    // size is our "target size in world space"
+    // we need to set our model scale so that the extents of the mesh, fit in a cube that size...
+    float maxDimension = glm::distance(geometryExtents.maximum, geometryExtents.minimum);
+    float scale = getSize() / maxDimension;
+
+    glm::vec3 halfDimensions = (geometryExtents.maximum - geometryExtents.minimum) * 0.5f;
+    glm::vec3 offset = -geometryExtents.minimum - halfDimensions;
+
+    Extents scaledExtents = fixBadMeshExtents(extents);
+    scaledExtents.minimum = (scaledExtents.minimum + offset) * scale;
+    scaledExtents.maximum = (scaledExtents.maximum + offset) * scale;
+    return scaledExtents;
+}
+
+AABox ModelItem::calculateDomainBox(const Extents& scaledExtents) const {
+    Extents rotatedExtents = scaledExtents;
+    calculateRotatedExtents(rotatedExtents, getModelRotation());
+    return AABox(rotatedExtents.minimum + getPosition(), rotatedExtents.maximum - rotatedExtents.minimum);
 }
 
 ModelItemProperties ModelItem::getProperties() const {
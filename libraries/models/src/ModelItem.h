@@ -24,6 +24,7 @@
 #include <SharedUtil.h>
 #include <OctreePacketData.h>
 #include <FBXReader.h>
+#include <PropertyFlags.h>
 
 
 class ModelItem;
@@ -51,6 +52,24 @@ const uint16_t MODEL_PACKET_CONTAINS_ANIMATION_PLAYING = 128;
 const uint16_t MODEL_PACKET_CONTAINS_ANIMATION_FRAME = 256;
 const uint16_t MODEL_PACKET_CONTAINS_ANIMATION_FPS = 512;
 
+/// The properties of a model item, in the order they're written in model data packets.  Models that a viewer already has
+/// are sent as the set of properties changed since they were last sent, followed by those properties.
+enum ModelProperty {
+    MODEL_PROPERTY_RADIUS,
+    MODEL_PROPERTY_POSITION,
+    MODEL_PROPERTY_COLOR,
+    MODEL_PROPERTY_SHOULD_DIE,
+    MODEL_PROPERTY_MODEL_URL,
+    MODEL_PROPERTY_MODEL_ROTATION,
+    MODEL_PROPERTY_ANIMATION_URL,
+    MODEL_PROPERTY_ANIMATION_PLAYING,
+    MODEL_PROPERTY_ANIMATION_FRAME_INDEX,
+    MODEL_PROPERTY_ANIMATION_FPS,
+    MODEL_PROPERTY_COUNT
+};
+
+typedef PropertyFlags<ModelProperty> ModelPropertyFlags;
+
 const float MODEL_DEFAULT_RADIUS = 0.1f / TREE_SCALE;
 const float MINIMUM_MODEL_ELEMENT_SIZE = (1.0f / 100000.0f) / TREE_SCALE; // smallest size container
 const QString MODEL_DEFAULT_MODEL_URL("");
@@ -60,6 +79,7 @@ const float MODEL_DEFAULT_ANIMATION_FPS = 30.0f;
 
 const PacketVersion VERSION_MODELS_HAVE_ANIMATION = 1;
 const PacketVersion VERSION_ROOT_ELEMENT_HAS_DATA = 2;
+const PacketVersion VERSION_MODELS_HAVE_PROPERTY_FLAGS = 3;
 
 /// A collection of properties of a model item used in the scripting API. Translates between the actual properties of a model
 /// and a JavaScript style hash/QScriptValue storing a set of properties. Used in scripting to set/get the complete set of
@@ -207,6 +227,15 @@ public:
 
     /// get maximum dimension in domain scale units (0.0 - 1.0)
     AACube getAACube() const { return AACube(getMinimumPoint(), getSize()); }
+
+    /// Places extents in the space of this model's geometry the way the renderer places the geometry: scaled so that the
+    /// geometry's mesh extents fit the model's size, and centered on the origin (but not rotated or moved to the model's
+    /// position).  Used for the geometry's mesh extents themselves, or for those of one of its meshes.
+    Extents scaleGeometryExtents(const Extents& meshExtents, const Extents& extents) const;
+
+    /// Returns the axis-aligned box, in domain scale units, that holds extents placed by scaleGeometryExtents() once
+    /// they've been rotated and moved to the model's position.
+    AABox calculateDomainBox(const Extents& scaledExtents) const;
     
     // model related properties
     bool hasModel() const { return !_modelURL.isEmpty(); }
@@ -237,34 +266,49 @@ public:
     bool isKnownID() const { return getID() != UNKNOWN_MODEL_ID; }
 
     /// set position in domain scale units (0.0 - 1.0)
-    void setPosition(const glm::vec3& value) { _position = value; }
+    void setPosition(const glm::vec3& value) { _position = value; propertyChanged(MODEL_PROPERTY_POSITION); }
 
-    void setColor(const rgbColor& value) { memcpy(_color, value, sizeof(_color)); }
+    void setColor(const rgbColor& value) { memcpy(_color, value, sizeof(_color)); propertyChanged(MODEL_PROPERTY_COLOR); }
     void setColor(const xColor& value) {
             _color[RED_INDEX] = value.red;
             _color[GREEN_INDEX] = value.green;
             _color[BLUE_INDEX] = value.blue;
+            propertyChanged(MODEL_PROPERTY_COLOR);
     }
     /// set radius in domain scale units (0.0 - 1.0)
-    void setRadius(float value) { _radius = value; }
+    void setRadius(float value) { _radius = value; propertyChanged(MODEL_PROPERTY_RADIUS); }
 
-    void setShouldDie(bool shouldDie) { _shouldDie = shouldDie; }
+    void setShouldDie(bool shouldDie) { _shouldDie = shouldDie; propertyChanged(MODEL_PROPERTY_SHOULD_DIE); }
     void setCreatorTokenID(uint32_t creatorTokenID) { _creatorTokenID = creatorTokenID; }
     
     // model related properties
-    void setModelURL(const QString& url) { _modelURL = url; }
-    void setModelRotation(const glm::quat& rotation) { _modelRotation = rotation; }
-    void setAnimationURL(const QString& url) { _animationURL = url; }
-    void setAnimationFrameIndex(float value) { _animationFrameIndex = value; }
-    void setAnimationIsPlaying(bool value) { _animationIsPlaying = value; }
-    void setAnimationFPS(float value) { _animationFPS = value; }
+    void setModelURL(const QString& url) { _modelURL = url; propertyChanged(MODEL_PROPERTY_MODEL_URL); }
+    void setModelRotation(const glm::quat& rotation) {
+            _modelRotation = rotation;
+            propertyChanged(MODEL_PROPERTY_MODEL_ROTATION);
+    }
+    void setAnimationURL(const QString& url) { _animationURL = url; propertyChanged(MODEL_PROPERTY_ANIMATION_URL); }
+    void setAnimationFrameIndex(float value) {
+            _animationFrameIndex = value;
+            propertyChanged(MODEL_PROPERTY_ANIMATION_FRAME_INDEX);
+    }
+    void setAnimationIsPlaying(bool value);
+    void setAnimationFPS(float value) { _animationFPS = value; propertyChanged(MODEL_PROPERTY_ANIMATION_FPS); }
     void setGlowLevel(float glowLevel) { _glowLevel = glowLevel; }
     void setSittingPoints(QVector<SittingPoint> sittingPoints) { _sittingPoints = sittingPoints; }
     
     void setProperties(const ModelItemProperties& properties);
 
-    bool appendModelData(OctreePacketData* packetData) const;
-    int readModelDataFromBuffer(const unsigned char* data, int bytesLeftToRead, ReadBitstreamToTreeParams& args);
+    /// Returns the properties changed at or after the given time (all of them, for zero).
+    ModelPropertyFlags getChangedProperties(quint64 since) const;
+
+    /// Appends the model's id and timestamps, followed by the given properties.
+    bool appendModelData(OctreePacketData* packetData, const ModelPropertyFlags& properties) const;
+
+    /// Reads the properties included in the model data over this model's, so that a model that's sent as its changed
+    /// properties can be read over the existing one.  If isComplete is given, it's set to whether every property was included.
+    int readModelDataFromBuffer(const unsigned char* data, int bytesLeftToRead, ReadBitstreamToTreeParams& args,
+                                bool* isComplete = NULL);
     static int expectedBytes();
 
     static bool encodeModelEditMessageDetails(PacketType command, ModelItemID id, const ModelItemProperties& details,
@@ -295,6 +339,13 @@ public:
     static void cleanupLoadedAnimations();
 
 protected:
+    /// Stamps the property as changed now, so that it's sent to the viewers that were last sent the model before now.
+    void propertyChanged(ModelProperty property) { _propertyChangedTimes[property] = usecTimestampNow(); }
+
+    /// Keeps the later change time of each property between this model and its earlier state, and stamps the properties
+    /// that differ from it as changed now.  Used when models are replaced wholesale by edited copies.
+    void stampChangedProperties(const ModelItem& before);
+
     glm::vec3 _position;
     rgbColor _color;
     float _radius;
@@ -317,6 +368,8 @@ protected:
     quint64 _lastEdited;
     quint64 _lastAnimated;
 
+    quint64 _propertyChangedTimes[MODEL_PROPERTY_COUNT];
+
     QString _animationURL;
     float _animationFrameIndex; // we keep this as a float and round to int only when we need the exact index
     bool _animationIsPlaying;
@@ -11,10 +11,19 @@
 
 #include "ModelTree.h"
 
-ModelTree::ModelTree(bool shouldReaverage) : Octree(shouldReaverage) {
+ModelTree::ModelTree(bool shouldReaverage) :
+    Octree(shouldReaverage),
+    _fbxService(NULL) {
+
     _rootElement = createNewElement();
 }
 
+ModelTree::~ModelTree() {
+    // the elements forget their models as they're deleted, so delete them while our index is still around
+    delete _rootElement;
+    _rootElement = NULL;
+}
+
 ModelTreeElement* ModelTree::createNewElement(unsigned char * octalCode) {
     ModelTreeElement* newElement = new ModelTreeElement(octalCode);
     newElement->setTree(this);
@@ -32,48 +41,6 @@ bool ModelTree::handlesEditPacketType(PacketType packetType) const {
     }
 }
 
-class FindAndDeleteModelsArgs {
-public:
-    QList<uint32_t> _idsToDelete;
-};
-
-bool ModelTree::findAndDeleteOperation(OctreeElement* element, void* extraData) {
-    //qDebug() << "findAndDeleteOperation()";
-
-    FindAndDeleteModelsArgs* args = static_cast< FindAndDeleteModelsArgs*>(extraData);
-
-    // if we've found and deleted all our target models, then we can stop looking
-    if (args->_idsToDelete.size() <= 0) {
-        return false;
-    }
-
-    ModelTreeElement* modelTreeElement = static_cast<ModelTreeElement*>(element);
-
-    //qDebug() << "findAndDeleteOperation() args->_idsToDelete.size():" << args->_idsToDelete.size();
-
-    for (QList<uint32_t>::iterator it = args->_idsToDelete.begin(); it != args->_idsToDelete.end(); it++) {
-        uint32_t modelID = *it;
-        //qDebug() << "findAndDeleteOperation() modelID:" << modelID;
-
-        if (modelTreeElement->removeModelWithID(modelID)) {
-            // if the model was in this element, then remove it from our search list.
-            //qDebug() << "findAndDeleteOperation() it = args->_idsToDelete.erase(it)";
-            it = args->_idsToDelete.erase(it);
-        }
-
-        if (it == args->_idsToDelete.end()) {
-            //qDebug() << "findAndDeleteOperation() breaking";
-            break;
-        }
-    }
-
-    // if we've found and deleted all our target models, then we can stop looking
-    if (args->_idsToDelete.size() <= 0) {
-        return false;
-    }
-    return true;
-}
-
 class FindAndUpdateModelOperator : public RecurseOctreeOperator {
 public:
     FindAndUpdateModelOperator(const ModelItem& searchModel);
@@ -108,22 +75,23 @@ bool FindAndUpdateModelOperator::PostRecursion(OctreeElement* element) {
     return !_found; // if we haven't yet found it, keep looking
 }
 
-// TODO: improve this to not use multiple recursions
 void ModelTree::storeModel(const ModelItem& model, const SharedNodePointer& senderNode) {
     // First, look for the existing model in the tree..
-    FindAndUpdateModelOperator theOperator(model);
-    recurseTreeWithOperator(&theOperator);
+    bool found = false;
+    if (model.getID() == NEW_MODEL) {
+        FindAndUpdateModelOperator theOperator(model);
+        recurseTreeWithOperator(&theOperator);
+        found = theOperator.wasFound();
+    } else {
+        ModelTreeElement* element = getContainingElement(model.getID());
+        found = element && element->updateModel(model);
+    }
     
-    // if we didn't find it in the tree, then store it...
-    if (!theOperator.wasFound()) {
-        AACube modelCube = model.getAACube();
+    // if we didn't find it in the tree, then store it (the element marks the path down to it as changed, so that viewers
+    // will see the change)
+    if (!found) {
         ModelTreeElement* element = static_cast<ModelTreeElement*>(getOrCreateChildElementContaining(model.getAACube()));
         element->storeModel(model);
-        
-        // In the case where we stored it, we also need to mark the entire "path" down to the model as
-        // having changed. Otherwise viewers won't see this change. So we call this recursion now that
-        // we know it will be found, this find/update will correctly mark the tree as changed.
-        recurseTreeWithOperator(&theOperator);
     }
 
     _isDirty = true;
@@ -169,9 +137,17 @@ bool FindAndUpdateModelWithIDandPropertiesOperator::PostRecursion(OctreeElement*
 
 void ModelTree::updateModel(const ModelItemID& modelID, const ModelItemProperties& properties) {
     // Look for the existing model in the tree..
-    FindAndUpdateModelWithIDandPropertiesOperator theOperator(modelID, properties);
-    recurseTreeWithOperator(&theOperator);
-    if (theOperator.wasFound()) {
+    bool found = false;
+    if (modelID.isKnownID) {
+        ModelTreeElement* element = getContainingElement(modelID.id);
+        found = element && element->updateModel(modelID, properties);
+    } else {
+        // models still waiting for their IDs can only be found by their creator token IDs
+        FindAndUpdateModelWithIDandPropertiesOperator theOperator(modelID, properties);
+        recurseTreeWithOperator(&theOperator);
+        found = theOperator.wasFound();
+    }
+    if (found) {
         _isDirty = true;
     }
 }
@@ -193,12 +169,32 @@ void ModelTree::addModel(const ModelItemID& modelID, const ModelItemProperties&
 
 void ModelTree::deleteModel(const ModelItemID& modelID) {
     if (modelID.isKnownID) {
-        FindAndDeleteModelsArgs args;
-        args._idsToDelete.push_back(modelID.id);
-        recurseTreeWithOperation(findAndDeleteOperation, &args);
+        ModelTreeElement* element = getContainingElement(modelID.id);
+        if (element) {
+            element->removeModelWithID(modelID.id);
+        }
     }
 }
 
+void ModelTree::setContainingElement(uint32_t modelID, ModelTreeElement* element) {
+    if (modelID != NEW_MODEL) {
+        _modelIndex.insert(modelID, element);
+    }
+}
+
+void ModelTree::clearContainingElement(uint32_t modelID, ModelTreeElement* element) {
+    _modelIndex.remove(modelID, element);
+}
+
+void ModelTree::elementEdited(ModelTreeElement* element) {
+    markPathChanged(element);
+    _activeElements.insert(element);
+}
+
+void ModelTree::forgetElement(ModelTreeElement* element) {
+    _activeElements.remove(element);
+}
+
 // scans the tree and handles mapping locally created models to know IDs.
 // in the event that this tree is also viewing the scene, then we need to also
 // search the tree to make sure we don't have a duplicate model from the viewing
@@ -373,49 +369,16 @@ void ModelTree::findModelsForUpdate(const AACube& cube, QVector<ModelItem*> foun
     foundModels.swap(args._foundModels);
 }
 
-class FindByIDArgs {
-public:
-    uint32_t id;
-    bool found;
-    const ModelItem* foundModel;
-};
-
-
-bool ModelTree::findByIDOperation(OctreeElement* element, void* extraData) {
-//qDebug() << "ModelTree::findByIDOperation()....";
-
-    FindByIDArgs* args = static_cast<FindByIDArgs*>(extraData);
-    ModelTreeElement* modelTreeElement = static_cast<ModelTreeElement*>(element);
-
-    // if already found, stop looking
-    if (args->found) {
-        return false;
-    }
-
-    // as the tree element if it has this model
-    const ModelItem* foundModel = modelTreeElement->getModelWithID(args->id);
-    if (foundModel) {
-        args->foundModel = foundModel;
-        args->found = true;
-        return false;
-    }
-
-    // keep looking
-    return true;
-}
-
-
 const ModelItem* ModelTree::findModelByID(uint32_t id, bool alreadyLocked) {
-    FindByIDArgs args = { id, false, NULL };
-
     if (!alreadyLocked) {
         lockForRead();
     }
-    recurseTreeWithOperation(findByIDOperation, &args);
+    ModelTreeElement* element = getContainingElement(id);
+    const ModelItem* foundModel = element ? element->getModelWithID(id) : NULL;
     if (!alreadyLocked) {
         unlock();
     }
-    return args.foundModel;
+    return foundModel;
 }
 
 
@@ -475,13 +438,6 @@ void ModelTree::removeNewlyCreatedHook(NewlyCreatedModelHook* hook) {
 }
 
 
-bool ModelTree::updateOperation(OctreeElement* element, void* extraData) {
-    ModelTreeUpdateArgs* args = static_cast<ModelTreeUpdateArgs*>(extraData);
-    ModelTreeElement* modelTreeElement = static_cast<ModelTreeElement*>(element);
-    modelTreeElement->update(*args);
-    return true;
-}
-
 bool ModelTree::pruneOperation(OctreeElement* element, void* extraData) {
     ModelTreeElement* modelTreeElement = static_cast<ModelTreeElement*>(element);
     for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
@@ -495,10 +451,31 @@ bool ModelTree::pruneOperation(OctreeElement* element, void* extraData) {
 
 void ModelTree::update() {
     lockForWrite();
-    _isDirty = true;
 
+    // nothing to do if everything is at rest
+    if (_activeElements.isEmpty()) {
+        unlock();
+        return;
+    }
+
+    // storing the moving models below may activate elements, so work from a copy of the set
+    QList<ModelTreeElement*> activeElements = _activeElements.toList();
     ModelTreeUpdateArgs args;
-    recurseTreeWithOperation(updateOperation, &args);
+    bool needsPruning = false;
+    foreach (ModelTreeElement* element, activeElements) {
+        if (element->update(args)) {
+            continue;
+        }
+        // nothing in the element is animating: stop visiting it until it's edited again
+        _activeElements.remove(element);
+        needsPruning = needsPruning || !element->hasModels();
+    }
+    foreach (ModelTreeElement* element, args._changedElements) {
+        markPathChanged(element);
+    }
+    if (!args._changedElements.isEmpty()) {
+        _isDirty = true;
+    }
 
     // now add back any of the particles that moved elements....
     int movingModels = args._movingModels.size();
@@ -513,42 +490,44 @@ void ModelTree::update() {
             storeModel(args._movingModels[i]);
         } else {
             uint32_t modelItemID = args._movingModels[i].getID();
-            quint64 deletedAt = usecTimestampNow();
-            _recentlyDeletedModelsLock.lockForWrite();
-            _recentlyDeletedModelItemIDs.insert(deletedAt, modelItemID);
-            _recentlyDeletedModelsLock.unlock();
+            _deletedModelsLock.lockForWrite();
+            _deletedModels.itemDeleted(modelItemID);
+            _deletedModelsLock.unlock();
         }
     }
 
-    // prune the tree...
-    recurseTreeWithOperation(pruneOperation, NULL);
+    // prune the tree, if any elements were emptied...
+    if (needsPruning) {
+        recurseTreeWithOperation(pruneOperation, NULL);
+    }
     unlock();
 }
 
 
-bool ModelTree::hasModelsDeletedSince(quint64 sinceTime) {
-    // we can probably leverage the ordered nature of QMultiMap to do this quickly...
-    bool hasSomethingNewer = false;
+bool ModelTree::hasAnyDeletedModels() {
+    QReadLocker locker(&_deletedModelsLock);
+    return _deletedModels.hasAnyDeleted();
+}
 
-    _recentlyDeletedModelsLock.lockForRead();
-    QMultiMap<quint64, uint32_t>::const_iterator iterator = _recentlyDeletedModelItemIDs.constBegin();
-    while (iterator != _recentlyDeletedModelItemIDs.constEnd()) {
-        //qDebug() << "considering... time/key:" << iterator.key();
-        if (iterator.key() > sinceTime) {
-            //qDebug() << "YES newer... time/key:" << iterator.key();
-            hasSomethingNewer = true;
-        }
-        ++iterator;
-    }
-    _recentlyDeletedModelsLock.unlock();
-    return hasSomethingNewer;
+bool ModelTree::hasModelsDeletedSince(quint64 sinceSequence) {
+    QReadLocker locker(&_deletedModelsLock);
+    return _deletedModels.hasDeletedSince(sinceSequence);
 }
 
-// sinceTime is an in/out parameter - it will be side effected with the last time sent out
-bool ModelTree::encodeModelsDeletedSince(OCTREE_PACKET_SEQUENCE sequenceNumber, quint64& sinceTime, unsigned char* outputBuffer,
-                                            size_t maxLength, size_t& outputLength) {
+quint64 ModelTree::getNextDeletedModelSequence() {
+    QReadLocker locker(&_deletedModelsLock);
+    return _deletedModels.getNextSequence();
+}
+
+// sinceSequence is an in/out parameter - it will be advanced past the models appended
+void ModelTree::getModelsDeletedSince(quint64& sinceSequence, QVector<uint32_t>& modelItemIDs) {
+    QReadLocker locker(&_deletedModelsLock);
+    _deletedModels.getDeletedSince(sinceSequence, modelItemIDs);
+}
 
-    bool hasMoreToSend = true;
+// returns the index of the first model ID that didn't fit in the packet
+int ModelTree::encodeDeletedModels(OCTREE_PACKET_SEQUENCE sequenceNumber, const QVector<uint32_t>& modelItemIDs,
+                                   int firstID, unsigned char* outputBuffer, size_t maxLength, size_t& outputLength) {
 
     unsigned char* copyAt = outputBuffer;
     size_t numBytesPacketHeader = populatePacketHeader(reinterpret_cast<char*>(outputBuffer), PacketTypeModelErase);
@@ -557,21 +536,18 @@ bool ModelTree::encodeModelsDeletedSince(OCTREE_PACKET_SEQUENCE sequenceNumber,
 
     // pack in flags
     OCTREE_PACKET_FLAGS flags = 0;
-    OCTREE_PACKET_FLAGS* flagsAt = (OCTREE_PACKET_FLAGS*)copyAt;
-    *flagsAt = flags;
+    memcpy(copyAt, &flags, sizeof(OCTREE_PACKET_FLAGS));
     copyAt += sizeof(OCTREE_PACKET_FLAGS);
     outputLength += sizeof(OCTREE_PACKET_FLAGS);
 
     // pack in sequence number
-    OCTREE_PACKET_SEQUENCE* sequenceAt = (OCTREE_PACKET_SEQUENCE*)copyAt;
-    *sequenceAt = sequenceNumber;
+    memcpy(copyAt, &sequenceNumber, sizeof(OCTREE_PACKET_SEQUENCE));
     copyAt += sizeof(OCTREE_PACKET_SEQUENCE);
     outputLength += sizeof(OCTREE_PACKET_SEQUENCE);
 
     // pack in timestamp
     OCTREE_PACKET_SENT_TIME now = usecTimestampNow();
-    OCTREE_PACKET_SENT_TIME* timeAt = (OCTREE_PACKET_SENT_TIME*)copyAt;
-    *timeAt = now;
+    memcpy(copyAt, &now, sizeof(OCTREE_PACKET_SENT_TIME));
     copyAt += sizeof(OCTREE_PACKET_SENT_TIME);
     outputLength += sizeof(OCTREE_PACKET_SENT_TIME);
 
@@ -580,75 +556,27 @@ bool ModelTree::encodeModelsDeletedSince(OCTREE_PACKET_SEQUENCE sequenceNumber,
     memcpy(copyAt, &numberOfIds, sizeof(numberOfIds));
     copyAt += sizeof(numberOfIds);
     outputLength += sizeof(numberOfIds);
-    
-    // we keep a multi map of model IDs to timestamps, we only want to include the model IDs that have been
-    // deleted since we last sent to this node
-    _recentlyDeletedModelsLock.lockForRead();
-    QMultiMap<quint64, uint32_t>::const_iterator iterator = _recentlyDeletedModelItemIDs.constBegin();
-    while (iterator != _recentlyDeletedModelItemIDs.constEnd()) {
-        QList<uint32_t> values = _recentlyDeletedModelItemIDs.values(iterator.key());
-        for (int valueItem = 0; valueItem < values.size(); ++valueItem) {
-
-            // if the timestamp is more recent then out last sent time, include it
-            if (iterator.key() > sinceTime) {
-                uint32_t modelID = values.at(valueItem);
-                memcpy(copyAt, &modelID, sizeof(modelID));
-                copyAt += sizeof(modelID);
-                outputLength += sizeof(modelID);
-                numberOfIds++;
-
-                // check to make sure we have room for one more id...
-                if (outputLength + sizeof(uint32_t) > maxLength) {
-                    break;
-                }
-            }
-        }
-
-        // check to make sure we have room for one more id...
-        if (outputLength + sizeof(uint32_t) > maxLength) {
-
-            // let our caller know how far we got
-            sinceTime = iterator.key();
-            break;
-        }
-        ++iterator;
-    }
 
-    // if we got to the end, then we're done sending
-    if (iterator == _recentlyDeletedModelItemIDs.constEnd()) {
-        hasMoreToSend = false;
+    // pack in as many of the IDs as there's room for
+    int nextID = firstID;
+    while (nextID < modelItemIDs.size() && outputLength + sizeof(uint32_t) <= maxLength) {
+        uint32_t modelItemID = modelItemIDs.at(nextID++);
+        memcpy(copyAt, &modelItemID, sizeof(modelItemID));
+        copyAt += sizeof(modelItemID);
+        outputLength += sizeof(modelItemID);
+        numberOfIds++;
     }
-    _recentlyDeletedModelsLock.unlock();
 
     // replace the correct count for ids included
     memcpy(numberOfIDsAt, &numberOfIds, sizeof(numberOfIds));
-    return hasMoreToSend;
-}
-
-// called by the server when it knows all nodes have been sent deleted packets
-
-void ModelTree::forgetModelsDeletedBefore(quint64 sinceTime) {
-    //qDebug() << "forgetModelsDeletedBefore()";
-    QSet<quint64> keysToRemove;
 
-    _recentlyDeletedModelsLock.lockForWrite();
-    QMultiMap<quint64, uint32_t>::iterator iterator = _recentlyDeletedModelItemIDs.begin();
-
-    // First find all the keys in the map that are older and need to be deleted
-    while (iterator != _recentlyDeletedModelItemIDs.end()) {
-        if (iterator.key() <= sinceTime) {
-            keysToRemove << iterator.key();
-        }
-        ++iterator;
-    }
+    return nextID;
+}
 
-    // Now run through the keysToRemove and remove them
-    foreach (quint64 value, keysToRemove) {
-        //qDebug() << "removing the key, _recentlyDeletedModelItemIDs.remove(value); time/key:" << value;
-        _recentlyDeletedModelItemIDs.remove(value);
-    }
-    
-    _recentlyDeletedModelsLock.unlock();
+// called by the server when it knows all nodes have been sent the deletions before sinceSequence
+void ModelTree::forgetModelsDeletedBefore(quint64 sinceSequence) {
+    QWriteLocker locker(&_deletedModelsLock);
+    _deletedModels.forgetDeletedBefore(sinceSequence);
 }
 
 
@@ -672,8 +600,6 @@ void ModelTree::processEraseMessage(const QByteArray& dataByteArray, const Share
     processedBytes += sizeof(numberOfIds);
 
     if (numberOfIds > 0) {
-        FindAndDeleteModelsArgs args;
-
         for (size_t i = 0; i < numberOfIds; i++) {
             if (processedBytes + sizeof(uint32_t) > packetLength) {
                 break; // bail to prevent buffer overflow
@@ -684,10 +610,10 @@ void ModelTree::processEraseMessage(const QByteArray& dataByteArray, const Share
             dataAt += sizeof(modelID);
             processedBytes += sizeof(modelID);
 
-            args._idsToDelete.push_back(modelID);
+            ModelTreeElement* element = getContainingElement(modelID);
+            if (element) {
+                element->removeModelWithID(modelID);
+            }
         }
-
-        // calling recurse to actually delete the models
-        recurseTreeWithOperation(findAndDeleteOperation, &args);
     }
 }
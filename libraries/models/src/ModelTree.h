@@ -13,6 +13,10 @@
 #define hifi_ModelTree_h
 
 #include <Octree.h>
+#include <QSet>
+
+#include <OctreeDeletionLog.h>
+#include <OctreeItemIndex.h>
 #include "ModelTreeElement.h"
 
 class NewlyCreatedModelHook {
@@ -29,6 +33,7 @@ class ModelTree : public Octree {
     Q_OBJECT
 public:
     ModelTree(bool shouldReaverage = false);
+    virtual ~ModelTree();
 
     /// Implements our type specific root element factory
     virtual ModelTreeElement* createNewElement(unsigned char * octalCode = NULL);
@@ -72,10 +77,15 @@ public:
     void addNewlyCreatedHook(NewlyCreatedModelHook* hook);
     void removeNewlyCreatedHook(NewlyCreatedModelHook* hook);
 
-    bool hasAnyDeletedModels() const { return _recentlyDeletedModelItemIDs.size() > 0; }
-    bool hasModelsDeletedSince(quint64 sinceTime);
-    bool encodeModelsDeletedSince(OCTREE_PACKET_SEQUENCE sequenceNumber, quint64& sinceTime, unsigned char* packetData, size_t maxLength, size_t& outputLength);
-    void forgetModelsDeletedBefore(quint64 sinceTime);
+    /// The deleted models are logged with sequence numbers, and each viewer keeps the sequence number it has been sent
+    /// them up to; see OctreeDeletionLog.
+    bool hasAnyDeletedModels();
+    bool hasModelsDeletedSince(quint64 sinceSequence);
+    quint64 getNextDeletedModelSequence();
+    void getModelsDeletedSince(quint64& sinceSequence, QVector<uint32_t>& modelItemIDs);
+    int encodeDeletedModels(OCTREE_PACKET_SEQUENCE sequenceNumber, const QVector<uint32_t>& modelItemIDs, int firstID,
+                            unsigned char* outputBuffer, size_t maxLength, size_t& outputLength);
+    void forgetModelsDeletedBefore(quint64 sinceSequence);
 
     void processEraseMessage(const QByteArray& dataByteArray, const SharedNodePointer& sourceNode);
     void handleAddModelResponse(const QByteArray& packet);
@@ -85,16 +95,26 @@ public:
         return _fbxService ? _fbxService->getGeometryForModel(modelItem) : NULL;
     }
 
+    /// Called by the elements to keep the index from model ID to element current.  Models still waiting for their IDs
+    /// (which all share NEW_MODEL) aren't indexed, and are found by their creator token IDs as before.
+    void setContainingElement(uint32_t modelID, ModelTreeElement* element);
+    void clearContainingElement(uint32_t modelID, ModelTreeElement* element);
+    ModelTreeElement* getContainingElement(uint32_t modelID) const { return _modelIndex.find(modelID); }
+
+    /// Called by the elements when their models are stored, edited or removed: marks the path to the element as changed
+    /// and makes sure the next update visits it.
+    void elementEdited(ModelTreeElement* element);
+
+    /// Called by the elements as they're deleted.
+    void forgetElement(ModelTreeElement* element);
+
 private:
 
-    static bool updateOperation(OctreeElement* element, void* extraData);
     static bool findAndUpdateOperation(OctreeElement* element, void* extraData);
     static bool findAndUpdateWithIDandPropertiesOperation(OctreeElement* element, void* extraData);
     static bool findNearPointOperation(OctreeElement* element, void* extraData);
     static bool findInSphereOperation(OctreeElement* element, void* extraData);
     static bool pruneOperation(OctreeElement* element, void* extraData);
-    static bool findByIDOperation(OctreeElement* element, void* extraData);
-    static bool findAndDeleteOperation(OctreeElement* element, void* extraData);
     static bool findAndUpdateModelItemIDOperation(OctreeElement* element, void* extraData);
     static bool findInCubeForUpdateOperation(OctreeElement* element, void* extraData);
 
@@ -104,9 +124,14 @@ private:
     std::vector<NewlyCreatedModelHook*> _newlyCreatedHooks;
 
 
-    QReadWriteLock _recentlyDeletedModelsLock;
-    QMultiMap<quint64, uint32_t> _recentlyDeletedModelItemIDs;
+    QReadWriteLock _deletedModelsLock;
+    OctreeDeletionLog _deletedModels;
     ModelItemFBXService* _fbxService;
+
+    OctreeItemIndex<ModelTreeElement> _modelIndex;
+
+    // the update only visits the elements that have been edited since the last one, or that have animating models
+    QSet<ModelTreeElement*> _activeElements;
 };
 
 #endif // hifi_ModelTree_h
@@ -17,12 +17,18 @@
 #include "ModelTree.h"
 #include "ModelTreeElement.h"
 
-ModelTreeElement::ModelTreeElement(unsigned char* octalCode) : OctreeElement(), _modelItems(NULL) {
+ModelTreeElement::ModelTreeElement(unsigned char* octalCode) : OctreeElement(), _myTree(NULL), _modelItems(NULL) {
     init(octalCode);
 };
 
 ModelTreeElement::~ModelTreeElement() {
     _voxelMemoryUsage -= sizeof(ModelTreeElement);
+    if (_myTree && _modelItems) {
+        foreach (const ModelItem& model, *_modelItems) {
+            _myTree->clearContainingElement(model.getID(), this);
+        }
+        _myTree->forgetElement(this);
+    }
     delete _modelItems;
     _modelItems = NULL;
 }
@@ -61,36 +67,43 @@ bool ModelTreeElement::appendElementData(OctreePacketData* packetData, EncodeBit
     uint16_t numberOfModels = 0;
     uint16_t actualNumberOfModels = 0;
     QVector<uint16_t> indexesOfModelsToInclude;
+    QVector<ModelPropertyFlags> propertiesToInclude;
 
     for (uint16_t i = 0; i < _modelItems->size(); i++) {
-        if (params.viewFrustum) {
-            const ModelItem& model = (*_modelItems)[i];
-            AACube modelCube = model.getAACube();
-            modelCube.scale(TREE_SCALE);
-            if (params.viewFrustum->cubeInFrustum(modelCube) != ViewFrustum::OUTSIDE) {
-                indexesOfModelsToInclude << i;
-                numberOfModels++;
-            }
-        } else {
-            indexesOfModelsToInclude << i;
-            numberOfModels++;
+        const ModelItem& model = (*_modelItems)[i];
+        if (params.viewFrustum && !isModelInView(model, params)) {
+            continue;
         }
+
+        // models the viewer was already sent only need the properties that changed since, if any did
+        quint64 lastSent = params.itemSendTimes ? params.itemSendTimes->getLastSent(model.getID()) : 0;
+        ModelPropertyFlags properties = model.getChangedProperties(lastSent);
+        if (!properties) {
+            continue;
+        }
+        indexesOfModelsToInclude << i;
+        propertiesToInclude << properties;
+        numberOfModels++;
     }
 
     int numberOfModelsOffset = packetData->getUncompressedByteOffset();
     success = packetData->appendValue(numberOfModels);
 
     if (success) {
-        foreach (uint16_t i, indexesOfModelsToInclude) {
-            const ModelItem& model = (*_modelItems)[i];
+        quint64 now = usecTimestampNow();
+        for (int j = 0; j < indexesOfModelsToInclude.size(); j++) {
+            const ModelItem& model = (*_modelItems)[indexesOfModelsToInclude.at(j)];
             
             LevelDetails modelLevel = packetData->startLevel();
     
-            success = model.appendModelData(packetData);
+            success = model.appendModelData(packetData, propertiesToInclude.at(j));
 
             if (success) {
                 packetData->endLevel(modelLevel);
                 actualNumberOfModels++;
+                if (params.itemSendTimes) {
+                    params.itemSendTimes->itemSent(model.getID(), now);
+                }
             }
             if (!success) {
                 packetData->discardLevel(modelLevel);
@@ -107,6 +120,47 @@ bool ModelTreeElement::appendElementData(OctreePacketData* packetData, EncodeBit
     return success;
 }
 
+bool ModelTreeElement::isModelInView(const ModelItem& model, const EncodeBitstreamParams& params) const {
+    // without its geometry, all we know of a model is that it fits in the cube of its radius
+    const FBXGeometry* fbxGeometry = _myTree->getGeometryForModel(model);
+    if (!(fbxGeometry && fbxGeometry->meshExtents.isValid())) {
+        AACube modelCube = model.getAACube();
+        modelCube.scale(TREE_SCALE);
+        return params.viewFrustum->cubeInFrustum(modelCube) != ViewFrustum::OUTSIDE;
+    }
+
+    AABox modelBox = model.calculateDomainBox(model.scaleGeometryExtents(fbxGeometry->meshExtents,
+        fbxGeometry->meshExtents));
+    modelBox.scale(TREE_SCALE);
+    ViewFrustum::location location = params.viewFrustum->boxInFrustum(modelBox);
+    if (location == ViewFrustum::OUTSIDE) {
+        return false;
+    }
+
+    // models are held to the same LOD as the elements: a model is sent if an element of its largest dimension would be
+    const glm::vec3& dimensions = modelBox.getDimensions();
+    float modelSize = glm::max(dimensions.x, glm::max(dimensions.y, dimensions.z)) / (float)TREE_SCALE;
+    float boundaryDistance = boundaryDistanceForRenderLevel(params.boundaryLevelAdjust, params.octreeElementSizeScale) *
+        modelSize;
+    if (glm::distance(params.viewFrustum->getPosition(), modelBox.calcCenter()) >= boundaryDistance) {
+        return false;
+    }
+
+    // if the model's box straddles the edge of the view, its meshes (the coarse proxy, on the server) might all be outside
+    if (location == ViewFrustum::INTERSECT && fbxGeometry->meshes.size() > 1) {
+        foreach (const FBXMesh& mesh, fbxGeometry->meshes) {
+            AABox meshBox = model.calculateDomainBox(model.scaleGeometryExtents(fbxGeometry->meshExtents,
+                mesh.meshExtents));
+            meshBox.scale(TREE_SCALE);
+            if (params.viewFrustum->boxInFrustum(meshBox) != ViewFrustum::OUTSIDE) {
+                return true;
+            }
+        }
+        return false;
+    }
+    return true;
+}
+
 bool ModelTreeElement::containsModelBounds(const ModelItem& model) const {
     glm::vec3 clampedMin = glm::clamp(model.getMinimumPoint(), 0.0f, 1.0f);
     glm::vec3 clampedMax = glm::clamp(model.getMaximumPoint(), 0.0f, 1.0f);
@@ -133,7 +187,9 @@ bool ModelTreeElement::bestFitModelBounds(const ModelItem& model) const {
     return false;
 }
 
-void ModelTreeElement::update(ModelTreeUpdateArgs& args) {
+bool ModelTreeElement::update(ModelTreeUpdateArgs& args) {
+    bool changed = false;
+    bool active = false;
     args._totalElements++;
     // update our contained models
     QList<ModelItem>::iterator modelItr = _modelItems->begin();
@@ -152,16 +208,23 @@ void ModelTreeElement::update(ModelTreeUpdateArgs& args) {
             args._movingModels.push_back(model);
 
             // erase this model
+            _myTree->clearContainingElement(model.getID(), this);
             modelItr = _modelItems->erase(modelItr);
 
             args._movingItems++;
             
             // this element has changed so mark it...
             markWithChangedTime();
+            changed = true;
         } else {
+            active = active || model.getAnimationIsPlaying();
             ++modelItr;
         }
     }
+    if (changed) {
+        args._changedElements.append(this);
+    }
+    return active;
 }
 
 bool ModelTreeElement::findDetailedRayIntersection(const glm::vec3& origin, const glm::vec3& direction,
@@ -184,38 +247,10 @@ bool ModelTreeElement::findDetailedRayIntersection(const glm::vec3& origin, cons
         if (modelCube.findRayIntersection(origin, direction, localDistance, localFace)) {
             const FBXGeometry* fbxGeometry = _myTree->getGeometryForModel(model);
             if (fbxGeometry && fbxGeometry->meshExtents.isValid()) {
-                Extents extents = fbxGeometry->meshExtents;
-
-                // NOTE: If the model has a bad mesh, then extents will be 0,0,0 & 0,0,0
-                if (extents.minimum == extents.maximum && extents.minimum == glm::vec3(0,0,0)) {
-                    extents.maximum = glm::vec3(1.0f,1.0f,1.0f); // in this case we will simulate the unit cube
-                }
-
-                // NOTE: these extents are model space, so we need to scale and center them accordingly
-                // size is our "target size in world space"
-                // we need to set our model scale so that the extents of the mesh, fit in a cube that size...
-                float maxDimension = glm::distance(extents.maximum, extents.minimum);
-                float scale = model.getSize() / maxDimension;
-
-                glm::vec3 halfDimensions = (extents.maximum - extents.minimum) * 0.5f;
-                glm::vec3 offset = -extents.minimum - halfDimensions;
-                
-                extents.minimum += offset;
-                extents.maximum += offset;
-
-                extents.minimum *= scale;
-                extents.maximum *= scale;
-                
-                Extents rotatedExtents = extents;
+                // these extents are model space, so we need to scale and center them accordingly
+                Extents extents = model.scaleGeometryExtents(fbxGeometry->meshExtents, fbxGeometry->meshExtents);
+                AABox rotatedExtentsBox = model.calculateDomainBox(extents);
 
-                calculateRotatedExtents(rotatedExtents, model.getModelRotation());
-
-                rotatedExtents.minimum += model.getPosition();
-                rotatedExtents.maximum += model.getPosition();
-
-
-                AABox rotatedExtentsBox(rotatedExtents.minimum, (rotatedExtents.maximum - rotatedExtents.minimum));
-                
                 // if it's in our AABOX for our rotated extents, then check to see if it's in our non-AABox
                 if (rotatedExtentsBox.findRayIntersection(origin, direction, localDistance, localFace)) {
                 
@@ -300,6 +335,7 @@ bool ModelTreeElement::updateModel(const ModelItem& model) {
                 
                 thisModel.copyChangedProperties(model);
                 markWithChangedTime();
+                _myTree->elementEdited(this);
             } else {
                 if (wantDebug) {
                     qDebug(">>> IGNORING SERVER!!! Would've caused jutter! <<<  "
@@ -334,6 +370,7 @@ bool ModelTreeElement::updateModel(const ModelItemID& modelID, const ModelItemPr
                 thisModel.setSittingPoints(_myTree->getGeometryForModel(thisModel)->sittingPoints);
             }
             markWithChangedTime(); // mark our element as changed..
+            _myTree->elementEdited(this);
             const bool wantDebug = false;
             if (wantDebug) {
                 uint64_t now = usecTimestampNow();
@@ -349,6 +386,7 @@ bool ModelTreeElement::updateModel(const ModelItemID& modelID, const ModelItemPr
 }
 
 void ModelTreeElement::updateModelItemID(FindAndUpdateModelItemIDArgs* args) {
+    bool creatorTokenFoundHere = false;
     uint16_t numberOfModels = _modelItems->size();
     for (uint16_t i = 0; i < numberOfModels; i++) {
         ModelItem& thisModel = (*_modelItems)[i];
@@ -358,12 +396,14 @@ void ModelTreeElement::updateModelItemID(FindAndUpdateModelItemIDArgs* args) {
             if (thisModel.getCreatorTokenID() == args->creatorTokenID) {
                 thisModel.setID(args->modelID);
                 args->creatorTokenFound = true;
+                creatorTokenFoundHere = true;
             }
         }
         
         // if we're in an isViewing tree, we also need to look for an kill any viewed models
         if (!args->viewedModelFound && args->isViewing) {
             if (thisModel.getCreatorTokenID() == UNKNOWN_MODEL_TOKEN && thisModel.getID() == args->modelID) {
+                _myTree->clearContainingElement(args->modelID, this);
                 _modelItems->removeAt(i); // remove the model at this index
                 numberOfModels--; // this means we have 1 fewer model in this list
                 i--; // and we actually want to back up i as well.
@@ -371,6 +411,10 @@ void ModelTreeElement::updateModelItemID(FindAndUpdateModelItemIDArgs* args) {
             }
         }
     }
+    // index the model under its new ID only now, since the viewed copy we just removed had the same one
+    if (creatorTokenFoundHere) {
+        _myTree->setContainingElement(args->modelID, this);
+    }
 }
 
 
@@ -436,7 +480,10 @@ bool ModelTreeElement::removeModelWithID(uint32_t id) {
     for (uint16_t i = 0; i < numberOfModels; i++) {
         if ((*_modelItems)[i].getID() == id) {
             foundModel = true;
+            _myTree->clearContainingElement(id, this);
             _modelItems->removeAt(i);
+            markWithChangedTime();
+            _myTree->elementEdited(this);
             break;
         }
     }
@@ -469,9 +516,22 @@ int ModelTreeElement::readElementDataFromBuffer(const unsigned char* data, int b
         
         if (bytesLeftToRead >= (int)(numberOfModels * expectedBytesPerModel)) {
             for (uint16_t i = 0; i < numberOfModels; i++) {
+                // models we already have may be sent as only their changed properties, so read them over our copy
                 ModelItem tempModel;
-                int bytesForThisModel = tempModel.readModelDataFromBuffer(dataAt, bytesLeftToRead, args);
-                _myTree->storeModel(tempModel);
+                uint32_t id;
+                memcpy(&id, dataAt, sizeof(id));
+                const ModelItem* existingModel = _myTree->findModelByID(id, true);
+                if (existingModel) {
+                    tempModel = *existingModel;
+                }
+                bool isComplete = true;
+                int bytesForThisModel = tempModel.readModelDataFromBuffer(dataAt, bytesLeftToRead, args, &isComplete);
+
+                // the changed properties of a model we don't have can't be stored; we'll get all of them with the next
+                // full scene
+                if (isComplete || existingModel) {
+                    _myTree->storeModel(tempModel);
+                }
                 dataAt += bytesForThisModel;
                 bytesLeftToRead -= bytesForThisModel;
                 bytesRead += bytesForThisModel;
@@ -499,6 +559,8 @@ bool ModelTreeElement::collapseChildren() {
 
 void ModelTreeElement::storeModel(const ModelItem& model) {
     _modelItems->push_back(model);
+    _myTree->setContainingElement(model.getID(), this);
     markWithChangedTime();
+    _myTree->elementEdited(this);
 }
 
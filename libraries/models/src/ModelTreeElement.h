@@ -14,6 +14,7 @@
 
 #include <OctreeElement.h>
 #include <QList>
+#include <QVector>
 
 #include "ModelItem.h"
 #include "ModelTree.h"
@@ -30,6 +31,7 @@ public:
     { }
     
     QList<ModelItem> _movingModels;
+    QVector<ModelTreeElement*> _changedElements;
     int _totalElements;
     int _totalItems;
     int _movingItems;
@@ -112,7 +114,9 @@ public:
     QList<ModelItem>& getModels() { return *_modelItems; }
     bool hasModels() const { return _modelItems ? _modelItems->size() > 0 : false; }
 
-    void update(ModelTreeUpdateArgs& args);
+    /// Animates our models, adding us to the changed elements if any of them left.
+    /// \return whether we still have animating models, and should be updated again next time
+    bool update(ModelTreeUpdateArgs& args);
     void setTree(ModelTree* tree) { _myTree = tree; }
 
     bool updateModel(const ModelItem& model);
@@ -139,6 +143,9 @@ public:
     bool containsModelBounds(const ModelItem& model) const;
     bool bestFitModelBounds(const ModelItem& model) const;
 
+    /// Checks a model against the viewer's frustum and LOD, using the bounds of its geometry where the tree has them.
+    bool isModelInView(const ModelItem& model, const EncodeBitstreamParams& params) const;
+
 protected:
     virtual void init(unsigned char * octalCode);
 
@@ -0,0 +1,168 @@
+//
+//  CongestionControl.cpp
+//  libraries/networking/src
+//
+//  Copyright 2014 High Fidelity, Inc.
+//
+//  Distributed under the Apache License, Version 2.0.
+//  See the accompanying file LICENSE or http://www.apache.org/licenses/LICENSE-2.0.html
+//
+
+#include <glm/glm.hpp>
+
+#include "CongestionControl.h"
+
+// how often we re-evaluate the send rate
+const quint64 UPDATE_WINDOW_USECS = 100 * USECS_PER_MSEC;
+
+// the minimum round trip time is remembered for this long before it may rise again (route changes)
+const quint64 MIN_RTT_EPOCH_USECS = 10 * USECS_PER_SECOND;
+
+// queuing delay we are willing to add on top of the base round trip time
+const float TARGET_QUEUING_DELAY_MSECS = 25.0f;
+
+// packets per second added per update window when the path shows no sign of congestion
+const float ADDITIVE_INCREASE = 10.0f;
+
+// fraction of the rate removed per update window at one full target of delay overshoot
+const float DELAY_DECREASE_GAIN = 0.25f;
+
+// losses below this ratio are considered noise rather than congestion
+const float LOSS_TOLERANCE = 0.02f;
+const float MAX_LOSS_DECREASE = 0.5f;
+
+// we only grow if the sender actually used at least this much of the last window's rate
+const float APPLICATION_LIMITED_RATIO = 0.5f;
+
+// the bucket never accumulates more than this many seconds of sending
+const float MAX_BURST_SECONDS = 0.05f;
+
+const float SMOOTHING_FACTOR = 0.125f;
+
+CongestionControl::CongestionControl(int minPacketsPerSecond, int maxPacketsPerSecond) :
+    _minPacketsPerSecond(minPacketsPerSecond),
+    _maxPacketsPerSecond(maxPacketsPerSecond)
+{
+    reset();
+}
+
+void CongestionControl::reset() {
+    QMutexLocker locker(&_mutex);
+    quint64 now = usecTimestampNow();
+
+    // start a quarter of the way up so well connected clients get a usable rate immediately
+    _packetsPerSecond = _minPacketsPerSecond + (_maxPacketsPerSecond - _minPacketsPerSecond) / 4.0f;
+    _packetCredit = 0.0f;
+    _estimatedBandwidth = 0.0f;
+    _roundTripTime = 0.0f;
+    _minRoundTripTime = 0.0f;
+    _epochMinRoundTripTime = 0.0f;
+    _lossRate = 0.0f;
+    _windowPacketsSent = 0;
+    _windowBytesSent = 0;
+    _windowPacketsLost = 0;
+    _lastRefill = now;
+    _windowStart = now;
+    _epochStart = now;
+    _lastDecrease = 0;
+    _totalPacketsSent = 0;
+    _totalPacketsLost = 0;
+}
+
+void CongestionControl::setMaxPacketsPerSecond(int maxPacketsPerSecond) {
+    QMutexLocker locker(&_mutex);
+    _maxPacketsPerSecond = glm::max(maxPacketsPerSecond, _minPacketsPerSecond);
+    _packetsPerSecond = glm::min(_packetsPerSecond, (float)_maxPacketsPerSecond);
+}
+
+void CongestionControl::packetSent(int bytes) {
+    QMutexLocker locker(&_mutex);
+    _packetCredit -= 1.0f;
+    _windowPacketsSent++;
+    _windowBytesSent += bytes;
+    _totalPacketsSent++;
+}
+
+void CongestionControl::packetsLost(int numLost) {
+    QMutexLocker locker(&_mutex);
+    _windowPacketsLost += numLost;
+    _totalPacketsLost += numLost;
+}
+
+void CongestionControl::roundTripTimeSampled(int roundTripTimeMsecs) {
+    if (roundTripTimeMsecs <= 0) {
+        return; // no ping reply yet
+    }
+    QMutexLocker locker(&_mutex);
+    float sample = (float)roundTripTimeMsecs;
+    _roundTripTime = (_roundTripTime == 0.0f) ? sample : glm::mix(_roundTripTime, sample, SMOOTHING_FACTOR);
+
+    // keep the minimum of the current and previous epochs, so that the base delay can rise after a route change
+    quint64 now = usecTimestampNow();
+    if (now - _epochStart > MIN_RTT_EPOCH_USECS) {
+        _minRoundTripTime = _epochMinRoundTripTime;
+        _epochMinRoundTripTime = 0.0f;
+        _epochStart = now;
+    }
+    if (_epochMinRoundTripTime == 0.0f || sample < _epochMinRoundTripTime) {
+        _epochMinRoundTripTime = sample;
+    }
+    if (_minRoundTripTime == 0.0f || sample < _minRoundTripTime) {
+        _minRoundTripTime = sample;
+    }
+}
+
+int CongestionControl::getAvailablePackets() {
+    quint64 now = usecTimestampNow();
+    if (now - _windowStart >= UPDATE_WINDOW_USECS) {
+        update(now);
+    }
+
+    QMutexLocker locker(&_mutex);
+    float elapsedSeconds = (float)(now - _lastRefill) / USECS_PER_SECOND;
+    _lastRefill = now;
+    float maxCredit = glm::max(1.0f, _packetsPerSecond * MAX_BURST_SECONDS);
+    _packetCredit = glm::min(_packetCredit + elapsedSeconds * _packetsPerSecond, maxCredit);
+    return glm::max(0, (int)_packetCredit);
+}
+
+void CongestionControl::update(quint64 now) {
+    QMutexLocker locker(&_mutex);
+    float windowSeconds = (float)(now - _windowStart) / USECS_PER_SECOND;
+
+    float windowBandwidth = _windowBytesSent / windowSeconds;
+    _estimatedBandwidth = (_estimatedBandwidth == 0.0f) ? windowBandwidth :
+        glm::mix(_estimatedBandwidth, windowBandwidth, SMOOTHING_FACTOR);
+
+    float windowLossRate = (_windowPacketsSent == 0) ? 0.0f :
+        glm::min(1.0f, (float)_windowPacketsLost / _windowPacketsSent);
+    _lossRate = glm::mix(_lossRate, windowLossRate, SMOOTHING_FACTOR);
+
+    // decrease at most once per round trip, since the feedback for our last decrease hasn't arrived before then
+    quint64 roundTripUsecs = glm::max(_roundTripTime, 1.0f) * USECS_PER_MSEC;
+    bool canDecrease = (now - _lastDecrease) > roundTripUsecs;
+    float queuingDelay = (_minRoundTripTime == 0.0f) ? 0.0f : _roundTripTime - _minRoundTripTime;
+
+    if (windowLossRate > LOSS_TOLERANCE) {
+        if (canDecrease) {
+            _packetsPerSecond *= 1.0f - glm::min(windowLossRate, MAX_LOSS_DECREASE);
+            _lastDecrease = now;
+        }
+    } else if (queuingDelay > TARGET_QUEUING_DELAY_MSECS) {
+        if (canDecrease) {
+            float overshoot = glm::min((queuingDelay - TARGET_QUEUING_DELAY_MSECS) / TARGET_QUEUING_DELAY_MSECS, 1.0f);
+            _packetsPerSecond *= 1.0f - DELAY_DECREASE_GAIN * overshoot;
+            _lastDecrease = now;
+        }
+    } else if (_windowPacketsSent >= _packetsPerSecond * windowSeconds * APPLICATION_LIMITED_RATIO) {
+        // scale the increase by how far under the delay target we are
+        float headroom = 1.0f - queuingDelay / TARGET_QUEUING_DELAY_MSECS;
+        _packetsPerSecond += ADDITIVE_INCREASE * headroom;
+    }
+    _packetsPerSecond = glm::clamp(_packetsPerSecond, (float)_minPacketsPerSecond, (float)_maxPacketsPerSecond);
+
+    _windowPacketsSent = 0;
+    _windowBytesSent = 0;
+    _windowPacketsLost = 0;
+    _windowStart = now;
+}
@@ -0,0 +1,87 @@
+//
+//  CongestionControl.h
+//  libraries/networking/src
+//
+//  Copyright 2014 High Fidelity, Inc.
+//
+//  Delay and loss based send rate controller for a single unicast stream
+//
+//  Distributed under the Apache License, Version 2.0.
+//  See the accompanying file LICENSE or http://www.apache.org/licenses/LICENSE-2.0.html
+//
+
+#ifndef hifi_CongestionControl_h
+#define hifi_CongestionControl_h
+
+#include <QtCore/QMutex>
+
+#include "SharedUtil.h"
+
+const int DEFAULT_MIN_PACKETS_PER_SECOND = 30;
+const int DEFAULT_MAX_PACKETS_PER_SECOND = 3000;
+
+/// Tracks the send rate of a single stream to a single node. The rate grows additively while the measured queuing delay
+/// (round trip time above the minimum seen) stays below a target, backs off in proportion to the delay overshoot (LEDBAT),
+/// and backs off multiplicatively when the receiver reports losses through NACKs. The rate is handed out to the sender
+/// as a token bucket of packets.
+class CongestionControl {
+public:
+    CongestionControl(int minPacketsPerSecond = DEFAULT_MIN_PACKETS_PER_SECOND,
+                      int maxPacketsPerSecond = DEFAULT_MAX_PACKETS_PER_SECOND);
+
+    void reset();
+
+    void setMaxPacketsPerSecond(int maxPacketsPerSecond);
+    int getMaxPacketsPerSecond() const { return _maxPacketsPerSecond; }
+
+    /// Called by the sender for every packet (new or retransmitted) written to the socket.
+    void packetSent(int bytes);
+
+    /// Called when the receiver reports sequence numbers it did not receive.
+    void packetsLost(int numLost);
+
+    /// Feeds a new round trip time sample, in milliseconds.
+    void roundTripTimeSampled(int roundTripTimeMsecs);
+
+    /// Returns the number of whole packets the sender may send right now, refilling the bucket for the time elapsed.
+    int getAvailablePackets();
+
+    float getPacketsPerSecond() const { return _packetsPerSecond; }
+    float getEstimatedBandwidth() const { return _estimatedBandwidth; } // bytes per second
+    float getRoundTripTime() const { return _roundTripTime; } // msecs
+    float getMinRoundTripTime() const { return _minRoundTripTime; } // msecs
+    float getLossRate() const { return _lossRate; } // 0.0 to 1.0
+
+    quint64 getTotalPacketsSent() const { return _totalPacketsSent; }
+    quint64 getTotalPacketsLost() const { return _totalPacketsLost; }
+
+private:
+    void update(quint64 now);
+
+    mutable QMutex _mutex;
+
+    int _minPacketsPerSecond;
+    int _maxPacketsPerSecond;
+    float _packetsPerSecond;
+    float _packetCredit;
+
+    float _estimatedBandwidth;
+    float _roundTripTime;
+    float _minRoundTripTime;
+    float _epochMinRoundTripTime;
+    float _lossRate;
+
+    int _windowPacketsSent;
+    int _windowBytesSent;
+    int _windowPacketsLost;
+
+    quint64 _lastRefill;
+    quint64 _windowStart;
+    quint64 _epochStart;
+    quint64 _lastDecrease;
+
+    quint64 _totalPacketsSent;
+    quint64 _totalPacketsLost;
+};
+
+#endif // hifi_CongestionControl_h
@@ -25,6 +25,7 @@
 #include "Logging.h"
 #include "LimitedNodeList.h"
 #include "PacketHeaders.h"
+#include "SharedMemoryTransport.h"
 #include "SharedUtil.h"
 #include "UUID.h"
 
@@ -67,6 +68,7 @@ LimitedNodeList::LimitedNodeList(unsigned short socketListenPort, unsigned short
     _nodeHashMutex(QMutex::Recursive),
     _nodeSocket(this),
     _dtlsSocket(NULL),
+    _sharedMemoryTransport(NULL),
     _numCollectedPackets(0),
     _numCollectedBytes(0),
     _packetStatTimer()
@@ -194,6 +196,33 @@ bool LimitedNodeList::packetVersionAndHashMatch(const QByteArray& packet) {
     return false;
 }
 
+bool LimitedNodeList::enableSharedMemoryTransport() {
+    if (!_sharedMemoryTransport) {
+        _sharedMemoryTransport = new SharedMemoryTransport(_nodeSocket);
+    }
+    return _sharedMemoryTransport->listen();
+}
+
+bool LimitedNodeList::readDatagram(QByteArray& datagram, HifiSockAddr& senderSockAddr) {
+    if (_sharedMemoryTransport && _sharedMemoryTransport->readDatagram(datagram, senderSockAddr)) {
+        return true;
+    }
+    while (_nodeSocket.hasPendingDatagrams()) {
+        datagram.resize(_nodeSocket.pendingDatagramSize());
+        _nodeSocket.readDatagram(datagram.data(), datagram.size(),
+                                 senderSockAddr.getAddressPointer(), senderSockAddr.getPortPointer());
+
+        if (!_sharedMemoryTransport || datagram.size() != SHARED_MEMORY_DOORBELL_SIZE) {
+            return true;
+        }
+        // a doorbell only tells us there's something waiting in shared memory
+        if (_sharedMemoryTransport->readDatagram(datagram, senderSockAddr)) {
+            return true;
+        }
+    }
+    return false;
+}
+
 qint64 LimitedNodeList::writeDatagram(const QByteArray& datagram, const HifiSockAddr& destinationSockAddr,
                                       const QUuid& connectionSecret) {
     QByteArray datagramCopy = datagram;
@@ -207,6 +236,10 @@ qint64 LimitedNodeList::writeDatagram(const QByteArray& datagram, const HifiSock
     ++_numCollectedPackets;
     _numCollectedBytes += datagram.size();
     
+    if (_sharedMemoryTransport && _sharedMemoryTransport->writeDatagram(datagramCopy, destinationSockAddr)) {
+        return datagramCopy.size();
+    }
+
     qint64 bytesWritten = _nodeSocket.writeDatagram(datagramCopy,
                                                     destinationSockAddr.getAddress(), destinationSockAddr.getPort());
     
@@ -41,6 +41,7 @@ extern const QUrl DEFAULT_NODE_AUTH_URL;
 const char DEFAULT_ASSIGNMENT_SERVER_HOSTNAME[] = "localhost";
 
 class HifiSockAddr;
+class SharedMemoryTransport;
 
 typedef QSet<NodeType_t> NodeSet;
 
@@ -61,6 +62,14 @@ public:
     QUdpSocket& getDTLSSocket();
     
     bool packetVersionAndHashMatch(const QByteArray& packet);
+
+    /// Lets nodes on this host send to us through shared memory, and lets us do the same for them. Once enabled, incoming
+    /// datagrams must be read with readDatagram rather than straight from the node socket.
+    bool enableSharedMemoryTransport();
+    const SharedMemoryTransport* getSharedMemoryTransport() const { return _sharedMemoryTransport; }
+
+    /// Reads the next incoming datagram from shared memory or the node socket. Returns false when there are none left.
+    bool readDatagram(QByteArray& datagram, HifiSockAddr& senderSockAddr);
     
     qint64 writeDatagram(const QByteArray& datagram, const SharedNodePointer& destinationNode,
                          const HifiSockAddr& overridenSockAddr = HifiSockAddr());
@@ -130,6 +139,7 @@ protected:
     QMutex _nodeHashMutex;
     QUdpSocket _nodeSocket;
     QUdpSocket* _dtlsSocket;
+    SharedMemoryTransport* _sharedMemoryTransport;
     int _numCollectedPackets;
     int _numCollectedBytes;
     QElapsedTimer _packetStatTimer;
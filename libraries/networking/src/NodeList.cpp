@@ -59,11 +59,17 @@ NodeList::NodeList(char newOwnerType, unsigned short socketListenPort, unsigned
     _assignmentServerSocket(),
     _publicSockAddr(),
     _hasCompletedInitialSTUNFailure(false),
-    _stunRequestsSinceSuccess(0)
+    _stunRequestsSinceSuccess(0),
+    _domainListVersion(0),
+    _pendingDomainListVersion(0),
+    _numPendingDomainListPackets(0)
 {
     // clear our NodeList when the domain changes
     connect(&_domainHandler, &DomainHandler::hostnameChanged, this, &NodeList::reset);
     
+    // if we drop a node the domain-server still has, we need the full list again to get it back
+    connect(this, &LimitedNodeList::nodeKilled, this, &NodeList::invalidateDomainListVersion);
+    
     // clear our NodeList when logout is requested
     connect(&AccountManager::getInstance(), &AccountManager::logoutComplete , this, &NodeList::reset);
 }
@@ -173,6 +179,9 @@ void NodeList::reset() {
     LimitedNodeList::reset();
     
     _numNoReplyDomainCheckIns = 0;
+    
+    // we'll need a full list from whichever domain-server we talk to next
+    invalidateDomainListVersion();
 
     // refresh the owner UUID to the NULL UUID
     setSessionUUID(QUuid());
@@ -364,6 +373,9 @@ void NodeList::sendDomainServerCheckIn() {
             packetStream << nodeTypeOfInterest;
         }
         
+        // tell the domain-server which version of the list we have so that it can send us only what changed
+        packetStream << _domainListVersion;
+        
         if (!isUsingDTLS) {
             writeDatagram(domainServerPacket, _domainHandler.getSockAddr(), QUuid());
         }
@@ -412,6 +424,20 @@ int NodeList::processDomainServerList(const QByteArray& packet) {
     packetStream >> newUUID;
     setSessionUUID(newUUID);
     
+    // the list version, whether this is the full list or a delta, and which of the packets of this list this is
+    quint32 listVersion;
+    quint8 isFullList, packetIndex, numPackets;
+    packetStream >> listVersion >> isFullList >> packetIndex >> numPackets;
+    
+    // we only acknowledge a version once we have received every packet of its list
+    if (listVersion != _pendingDomainListVersion || packetIndex == 0) {
+        _pendingDomainListVersion = listVersion;
+        _numPendingDomainListPackets = 0;
+    }
+    if (++_numPendingDomainListPackets >= numPackets) {
+        _domainListVersion = listVersion;
+    }
+    
     // pull each node in the packet
     while(packetStream.device()->pos() < packet.size()) {
         packetStream >> nodeType >> nodeUUID >> nodePublicSocket >> nodeLocalSocket;
@@ -83,6 +83,8 @@ public slots:
     void pingInactiveNodes();
 signals:
     void limitOfSilentDomainCheckInsReached();
+private slots:
+    void invalidateDomainListVersion() { _domainListVersion = 0; }
 private:
     static NodeList* _sharedInstance;
 
@@ -105,6 +107,10 @@ private:
     HifiSockAddr _publicSockAddr;
     bool _hasCompletedInitialSTUNFailure;
     unsigned int _stunRequestsSinceSuccess;
+    
+    quint32 _domainListVersion;
+    quint32 _pendingDomainListVersion;
+    int _numPendingDomainListPackets;
 };
 
 #endif // hifi_NodeList_h
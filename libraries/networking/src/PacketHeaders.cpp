@@ -61,7 +61,7 @@ PacketVersion versionForPacketType(PacketType type) {
             return 2;
         case PacketTypeDomainList:
         case PacketTypeDomainListRequest:
-            return 3;
+            return 4;
         case PacketTypeCreateAssignment:
         case PacketTypeRequestAssignment:
             return 2;
@@ -71,11 +71,11 @@ PacketVersion versionForPacketType(PacketType type) {
         case PacketTypeOctreeStats:
             return 1;
         case PacketTypeParticleData:
-            return 1;
+            return 2;
         case PacketTypeParticleErase:
             return 1;
         case PacketTypeModelData:
-            return 2;
+            return 3;
         case PacketTypeModelErase:
             return 1;
         default:
@@ -11,11 +11,12 @@
 
 #include "SequenceNumberStats.h"
 
+#include <cmath>
+#include <cstring>
 #include <limits>
 
 SequenceNumberStats::SequenceNumberStats()
     : _lastReceived(std::numeric_limits<quint16>::max()),
-    _missingSet(),
     _numReceived(0),
     _numUnreasonable(0),
     _numEarly(0),
@@ -23,12 +24,16 @@ SequenceNumberStats::SequenceNumberStats()
     _numLost(0),
     _numRecovered(0),
     _numDuplicate(0),
+    _lastArrival(0),
+    _lastInterArrival(0),
+    _interArrivalJitter(0.0f),
     _lastSenderUUID()
 {
+    reset();
 }
 
 void SequenceNumberStats::reset() {
-    _missingSet.clear();
+    memset(_missingBits, 0, sizeof(_missingBits));
     _numReceived = 0;
     _numUnreasonable = 0;
     _numEarly = 0;
@@ -36,11 +41,59 @@ void SequenceNumberStats::reset() {
     _numLost = 0;
     _numRecovered = 0;
     _numDuplicate = 0;
+    _lastArrival = 0;
+    _lastInterArrival = 0;
+    _interArrivalJitter = 0.0f;
+    memset(_burstLengthHistogram, 0, sizeof(_burstLengthHistogram));
+    memset(_interArrivalHistogram, 0, sizeof(_interArrivalHistogram));
 }
 
 static const int UINT16_RANGE = std::numeric_limits<uint16_t>::max() + 1;
 static const int MAX_REASONABLE_SEQUENCE_GAP = 1000;  // this must be less than UINT16_RANGE / 2 for rollover handling to work
 
+// smoothing for the inter-arrival jitter, as in RFC 3550
+static const float JITTER_GAIN = 1.0f / 16.0f;
+
+// returns the bucket for value in a histogram whose buckets hold 0, 1, 2-3, 4-7, ... 
+static int powerOfTwoBucket(quint64 value, int numBuckets) {
+    int bucket = 0;
+    while (value > 0 && bucket < numBuckets - 1) {
+        value >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+bool SequenceNumberStats::isMissing(quint16 sequence) const {
+    int bit = sequence & (MISSING_WINDOW_SIZE - 1);
+    return (_missingBits[bit / BITS_PER_MISSING_WORD] >> (bit % BITS_PER_MISSING_WORD)) & 1;
+}
+
+void SequenceNumberStats::setMissing(quint16 sequence, bool missing) {
+    int bit = sequence & (MISSING_WINDOW_SIZE - 1);
+    quint64 mask = (quint64)1 << (bit % BITS_PER_MISSING_WORD);
+    if (missing) {
+        _missingBits[bit / BITS_PER_MISSING_WORD] |= mask;
+    } else {
+        _missingBits[bit / BITS_PER_MISSING_WORD] &= ~mask;
+    }
+}
+
+QSet<quint16> SequenceNumberStats::getMissingSet() const {
+    QSet<quint16> missingSet;
+    if (_numReceived == 0) {
+        return missingSet;
+    }
+    // entries further back than the reasonable gap are stale; a late packet that old would be rejected anyway
+    for (int offset = 1; offset <= MAX_REASONABLE_SEQUENCE_GAP; offset++) {
+        quint16 sequence = _lastReceived - (quint16)offset;
+        if (isMissing(sequence)) {
+            missingSet.insert(sequence);
+        }
+    }
+    return missingSet;
+}
+
 void SequenceNumberStats::sequenceNumberReceived(quint16 incoming, QUuid senderUUID, const bool wantExtraDebugging) {
 
     // if the sender node has changed, reset all stats
@@ -51,6 +104,19 @@ void SequenceNumberStats::sequenceNumberReceived(quint16 incoming, QUuid senderU
         _lastSenderUUID = senderUUID;
     }
 
+    // track the inter-arrival times and their variation
+    quint64 now = usecTimestampNow();
+    if (_lastArrival != 0) {
+        quint64 interArrival = now - _lastArrival;
+        _interArrivalHistogram[powerOfTwoBucket(interArrival / USECS_PER_MSEC, NUM_INTER_ARRIVAL_BUCKETS)]++;
+        if (_lastInterArrival != 0) {
+            float variation = std::abs((float)interArrival - (float)_lastInterArrival);
+            _interArrivalJitter += (variation - _interArrivalJitter) * JITTER_GAIN;
+        }
+        _lastInterArrival = interArrival;
+    }
+    _lastArrival = now;
+
     // determine our expected sequence number... handle rollover appropriately
     quint16 expected = _numReceived > 0 ? _lastReceived + (quint16)1 : incoming;
 
@@ -58,6 +124,9 @@ void SequenceNumberStats::sequenceNumberReceived(quint16 incoming, QUuid senderU
 
     if (incoming == expected) { // on time
         _lastReceived = incoming;
+
+        // this slot of the window may still hold a sequence number from a window ago
+        setMissing(incoming, false);
     } else { // out of order
 
         if (wantExtraDebugging) {
@@ -93,19 +162,17 @@ void SequenceNumberStats::sequenceNumberReceived(quint16 incoming, QUuid senderU
                 qDebug() << ">>>>>>>> missing gap=" << (incomingInt - expectedInt);
             }
 
+            int burstLength = incomingInt - expectedInt;
             _numEarly++;
-            _numLost += (incomingInt - expectedInt);
+            _numLost += burstLength;
+            _burstLengthHistogram[powerOfTwoBucket(burstLength - 1, NUM_BURST_LENGTH_BUCKETS)]++;
 
-            // add all sequence numbers that were skipped to the missing sequence numbers list
+            // mark all sequence numbers that were skipped as missing; since the gap is smaller than the window,
+            // this also overwrites whatever those slots held a window ago
             for (int missingInt = expectedInt; missingInt < incomingInt; missingInt++) {
-                _missingSet.insert((quint16)(missingInt < 0 ? missingInt + UINT16_RANGE : missingInt));
-            }
-            
-            // prune missing sequence list if it gets too big; sequence numbers that are older than MAX_REASONABLE_SEQUENCE_GAP
-            // will be removed.
-            if (_missingSet.size() > MAX_REASONABLE_SEQUENCE_GAP) {
-                pruneMissingSet(wantExtraDebugging);
+                setMissing((quint16)(missingInt < 0 ? missingInt + UINT16_RANGE : missingInt), true);
             }
+            setMissing(incoming, false);
 
             _lastReceived = incoming;
         } else { // late
@@ -115,15 +182,16 @@ void SequenceNumberStats::sequenceNumberReceived(quint16 incoming, QUuid senderU
             _numLate++;
 
             // remove this from missing sequence number if it's in there
-            if (_missingSet.remove(incoming)) {
+            if (isMissing(incoming)) {
                 if (wantExtraDebugging) {
-                    qDebug() << "found it in _missingSet";
+                    qDebug() << "found it in the missing window";
                 }
+                setMissing(incoming, false);
                 _numLost--;
                 _numRecovered++;
             } else {
                 if (wantExtraDebugging) {
-                    qDebug() << "sequence:" << incoming << "was NOT found in _missingSet and is probably a duplicate";
+                    qDebug() << "sequence:" << incoming << "was NOT found in the missing window and is probably a duplicate";
                 }
                 _numDuplicate++;
             }
@@ -133,52 +201,23 @@ void SequenceNumberStats::sequenceNumberReceived(quint16 incoming, QUuid senderU
     }
 }
 
-void SequenceNumberStats::pruneMissingSet(const bool wantExtraDebugging) {
-    if (wantExtraDebugging) {
-        qDebug() << "pruning _missingSet! size:" << _missingSet.size();
+QString SequenceNumberStats::getStatsString() const {
+    QString result = "received:" + QString::number(_numReceived)
+        + " lost:" + QString::number(_numLost)
+        + " early:" + QString::number(_numEarly)
+        + " late:" + QString::number(_numLate)
+        + " recovered:" + QString::number(_numRecovered)
+        + " duplicate:" + QString::number(_numDuplicate)
+        + " unreasonable:" + QString::number(_numUnreasonable)
+        + " jitter:" + QString::number(getInterArrivalJitter(), 'f', 2) + "ms";
+
+    result += " bursts:";
+    for (int i = 0; i < NUM_BURST_LENGTH_BUCKETS; i++) {
+        result += (i == 0 ? "" : ",") + QString::number(_burstLengthHistogram[i]);
     }
-
-    // some older sequence numbers may be from before a rollover point; this must be handled.
-    // some sequence numbers in this list may be larger than _incomingLastSequence, indicating that they were received
-    // before the most recent rollover.
-    int cutoff = (int)_lastReceived - MAX_REASONABLE_SEQUENCE_GAP;
-    if (cutoff >= 0) {
-        quint16 nonRolloverCutoff = (quint16)cutoff;
-        QSet<quint16>::iterator i = _missingSet.begin();
-        while (i != _missingSet.end()) {
-            quint16 missing = *i;
-            if (wantExtraDebugging) {
-                qDebug() << "checking item:" << missing << "is it in need of pruning?";
-                qDebug() << "old age cutoff:" << nonRolloverCutoff;
-            }
-
-            if (missing > _lastReceived || missing < nonRolloverCutoff) {
-                i = _missingSet.erase(i);
-                if (wantExtraDebugging) {
-                    qDebug() << "pruning really old missing sequence:" << missing;
-                }
-            } else {
-                i++;
-            }
-        }
-    } else {
-        quint16 rolloverCutoff = (quint16)(cutoff + UINT16_RANGE);
-        QSet<quint16>::iterator i = _missingSet.begin();
-        while (i != _missingSet.end()) {
-            quint16 missing = *i;
-            if (wantExtraDebugging) {
-                qDebug() << "checking item:" << missing << "is it in need of pruning?";
-                qDebug() << "old age cutoff:" << rolloverCutoff;
-            }
-
-            if (missing > _lastReceived && missing < rolloverCutoff) {
-                i = _missingSet.erase(i);
-                if (wantExtraDebugging) {
-                    qDebug() << "pruning really old missing sequence:" << missing;
-                }
-            } else {
-                i++;
-            }
-        }
+    result += " arrivals:";
+    for (int i = 0; i < NUM_INTER_ARRIVAL_BUCKETS; i++) {
+        result += (i == 0 ? "" : ",") + QString::number(_interArrivalHistogram[i]);
     }
+    return result;
 }
@@ -13,8 +13,19 @@
 #define hifi_SequenceNumberStats_h
 
 #include "SharedUtil.h"
+#include <qset.h>
 #include <quuid.h>
 
+// the window of sequence numbers behind the last received one that we remember as missing; must be a power of two
+// larger than the largest gap we consider reasonable
+const int MISSING_WINDOW_SIZE = 1024;
+const int BITS_PER_MISSING_WORD = 64;
+const int NUM_MISSING_WORDS = MISSING_WINDOW_SIZE / BITS_PER_MISSING_WORD;
+
+// histograms use power of two buckets, with the last bucket holding everything larger
+const int NUM_BURST_LENGTH_BUCKETS = 8; // in packets lost in a row: 1, 2, 3-4, 5-8, ... 65+
+const int NUM_INTER_ARRIVAL_BUCKETS = 10; // in msecs between arrivals: 0, 1, 2-3, 4-7, ... 256+
+
 class SequenceNumberStats {
 public:
     SequenceNumberStats();
@@ -31,13 +42,25 @@ public:
     quint32 getNumLost() const { return _numLost; }
     quint32 getNumRecovered() const { return _numRecovered; }
     quint32 getNumDuplicate() const { return _numDuplicate; }
-    const QSet<quint16>& getMissingSet() const { return _missingSet; }
+
+    /// Returns the sequence numbers within the reasonable gap behind the last received one that have not arrived yet.
+    QSet<quint16> getMissingSet() const;
+    bool isMissing(quint16 sequence) const;
+
+    /// Returns the smoothed variation in packet inter-arrival times, in msecs.
+    float getInterArrivalJitter() const { return _interArrivalJitter / USECS_PER_MSEC; }
+
+    const quint32* getBurstLengthHistogram() const { return _burstLengthHistogram; }
+    const quint32* getInterArrivalHistogram() const { return _interArrivalHistogram; }
+
+    /// Returns a one line summary of the stream's health, suitable for the JSON stats sent to the domain-server.
+    QString getStatsString() const;
 
 private:
-    void pruneMissingSet(const bool wantExtraDebugging);
+    void setMissing(quint16 sequence, bool missing);
 
     quint16 _lastReceived;
-    QSet<quint16> _missingSet;
+    quint64 _missingBits[NUM_MISSING_WORDS];
 
     quint32 _numReceived;
     quint32 _numUnreasonable;
@@ -47,6 +70,12 @@ private:
     quint32 _numRecovered;
     quint32 _numDuplicate;
 
+    quint64 _lastArrival;
+    quint64 _lastInterArrival;
+    float _interArrivalJitter;
+    quint32 _burstLengthHistogram[NUM_BURST_LENGTH_BUCKETS];
+    quint32 _interArrivalHistogram[NUM_INTER_ARRIVAL_BUCKETS];
+
     QUuid _lastSenderUUID;
 };
 
@@ -0,0 +1,305 @@
+//
+//  SharedMemoryTransport.cpp
+//  libraries/networking/src
+//
+//  Copyright 2014 High Fidelity, Inc.
+//
+//  Distributed under the Apache License, Version 2.0.
+//  See the accompanying file LICENSE or http://www.apache.org/licenses/LICENSE-2.0.html
+//
+
+#include <cstring>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <signal.h>
+#endif
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDebug>
+#include <QtNetwork/QNetworkInterface>
+
+#include "LimitedNodeList.h"
+#include "SharedUtil.h"
+#include "SharedMemoryTransport.h"
+
+const int SHARED_MEMORY_MAGIC = 0x48534d31; // "HSM1", bump if the layout below changes
+const int SHARED_MEMORY_MAX_SENDERS = 16;
+const int SHARED_MEMORY_RING_SLOTS = 128; // must be a power of two
+const int SHARED_MEMORY_RING_MASK = SHARED_MEMORY_RING_SLOTS - 1;
+
+// how often a sender makes sure the process that owns a segment is still around
+const quint64 LIVENESS_CHECK_INTERVAL_USECS = USECS_PER_SECOND;
+
+// how long we wait before trying to attach again to a port that had no segment
+const quint64 UNREACHABLE_RETRY_USECS = 5 * USECS_PER_SECOND;
+
+const QString SHARED_MEMORY_KEY_PREFIX = "hifi-node-socket-";
+
+struct SharedMemorySlot {
+    quint32 address;
+    quint16 port;
+    quint16 size;
+    char data[MAX_PACKET_SIZE];
+};
+
+struct SharedMemoryRing {
+    QAtomicInt ownerPID;
+    QAtomicInt head; // only written by the receiver
+    QAtomicInt tail; // only written by the owning sender
+    SharedMemorySlot slots[SHARED_MEMORY_RING_SLOTS];
+};
+
+struct SharedMemorySegment {
+    QAtomicInt magic;
+    QAtomicInt receiverPID;
+    QAtomicInt sleeping;
+    SharedMemoryRing rings[SHARED_MEMORY_MAX_SENDERS];
+};
+
+static bool isProcessAlive(int pid) {
+#ifdef _WIN32
+    return false;
+#else
+    return pid != 0 && (kill(pid, 0) == 0 || errno == EPERM);
+#endif
+}
+
+SharedMemoryTransport::SharedMemoryTransport(QUdpSocket& socket) :
+    _socket(socket),
+    _inbound(),
+    _segment(NULL),
+    _nextRing(0),
+    _localAddresses(QNetworkInterface::allAddresses()),
+    _datagramsWritten(0),
+    _datagramsRead(0),
+    _doorbellsSent(0)
+{
+}
+
+SharedMemoryTransport::~SharedMemoryTransport() {
+    qDeleteAll(_channels);
+    qDeleteAll(_retiredChannels);
+    if (_segment) {
+        _segment->magic.storeRelease(0);
+    }
+}
+
+bool SharedMemoryTransport::listen() {
+#ifdef _WIN32
+    return false;
+#else
+    if (_segment) {
+        return true;
+    }
+    _inbound.setKey(SHARED_MEMORY_KEY_PREFIX + QString::number(_socket.localPort()));
+    if (!_inbound.create(sizeof(SharedMemorySegment))) {
+        // a process that held our port before us didn't get to clean up, so take its segment over
+        if (_inbound.error() != QSharedMemory::AlreadyExists || !_inbound.attach() ||
+                _inbound.size() < (int)sizeof(SharedMemorySegment)) {
+            qDebug() << "Could not set up shared memory transport -" << _inbound.errorString();
+            return false;
+        }
+    }
+    _segment = static_cast<SharedMemorySegment*>(_inbound.data());
+
+    // senders check the magic before anything else, so it goes last
+    _segment->magic.storeRelease(0);
+    memset(_segment->rings, 0, sizeof(_segment->rings));
+    _segment->receiverPID.storeRelease(QCoreApplication::applicationPid());
+    _segment->sleeping.storeRelease(1);
+    _segment->magic.storeRelease(SHARED_MEMORY_MAGIC);
+
+    qDebug() << "Shared memory transport is listening on" << _socket.localPort();
+    return true;
+#endif
+}
+
+bool SharedMemoryTransport::writeDatagram(const QByteArray& datagram, const HifiSockAddr& destinationSockAddr) {
+    // the slots only have room for IPv4 addresses
+    if (datagram.size() > MAX_PACKET_SIZE || datagram.size() <= SHARED_MEMORY_DOORBELL_SIZE ||
+            destinationSockAddr.getAddress().protocol() != QAbstractSocket::IPv4Protocol ||
+            !isLocalAddress(destinationSockAddr.getAddress()) || destinationSockAddr.getPort() == _socket.localPort()) {
+        return false;
+    }
+    Channel* channel = channelForPort(destinationSockAddr.getPort());
+    if (!channel) {
+        return false;
+    }
+    bool written = writeToChannel(channel, datagram, destinationSockAddr);
+    channel->mutex.unlock();
+    return written;
+}
+
+bool SharedMemoryTransport::writeToChannel(Channel* channel, const QByteArray& datagram,
+                                           const HifiSockAddr& destinationSockAddr) {
+    if (!claimRing(channel)) {
+        return false;
+    }
+    SharedMemoryRing* ring = channel->ring;
+    int tail = ring->tail.load();
+    if (tail - ring->head.loadAcquire() >= SHARED_MEMORY_RING_SLOTS) {
+        return false; // the receiver is behind, let the kernel buffer this one
+    }
+    SharedMemorySlot& slot = ring->slots[tail & SHARED_MEMORY_RING_MASK];
+    slot.address = getSenderAddress(destinationSockAddr.getAddress());
+    slot.port = _socket.localPort();
+    slot.size = datagram.size();
+    memcpy(slot.data, datagram.constData(), datagram.size());
+    ring->tail.storeRelease(tail + 1);
+    _datagramsWritten++;
+
+    // the receiver sets this before its last look at the rings, so either it sees our packet or we see the flag
+    if (channel->segment->sleeping.fetchAndStoreOrdered(0) != 0) {
+        _socket.writeDatagram(QByteArray(SHARED_MEMORY_DOORBELL_SIZE, 0),
+                              destinationSockAddr.getAddress(), destinationSockAddr.getPort());
+        _doorbellsSent++;
+    }
+    return true;
+}
+
+bool SharedMemoryTransport::readDatagram(QByteArray& datagram, HifiSockAddr& senderSockAddr) {
+    if (!_segment) {
+        return false;
+    }
+    if (popDatagram(datagram, senderSockAddr)) {
+        if (_segment->sleeping.load() != 0) {
+            _segment->sleeping.storeRelease(0);
+        }
+        return true;
+    }
+    // ask for a doorbell, then look once more to close the race with a sender that just checked the flag
+    _segment->sleeping.fetchAndStoreOrdered(1);
+    if (popDatagram(datagram, senderSockAddr)) {
+        _segment->sleeping.storeRelease(0);
+        return true;
+    }
+    return false;
+}
+
+bool SharedMemoryTransport::popDatagram(QByteArray& datagram, HifiSockAddr& senderSockAddr) {
+    // round robin over the rings so that one busy sender can't starve the others
+    for (int i = 0; i < SHARED_MEMORY_MAX_SENDERS; i++) {
+        int index = (_nextRing + i) % SHARED_MEMORY_MAX_SENDERS;
+        SharedMemoryRing& ring = _segment->rings[index];
+        int head = ring.head.load();
+        if (head == ring.tail.loadAcquire()) {
+            continue;
+        }
+        const SharedMemorySlot& slot = ring.slots[head & SHARED_MEMORY_RING_MASK];
+        datagram = QByteArray(slot.data, slot.size);
+        senderSockAddr = HifiSockAddr(QHostAddress(slot.address), slot.port);
+        ring.head.storeRelease(head + 1);
+
+        _nextRing = (index + 1) % SHARED_MEMORY_MAX_SENDERS;
+        _datagramsRead++;
+        return true;
+    }
+    return false;
+}
+
+SharedMemoryTransport::Channel* SharedMemoryTransport::channelForPort(quint16 port) {
+#ifdef _WIN32
+    return NULL;
+#else
+    QMutexLocker locker(&_channelsMutex);
+    quint64 now = usecTimestampNow();
+    if (!_retiredChannels.isEmpty()) {
+        freeRetiredChannels();
+    }
+
+    // the channel is locked before we let go of the channels, so that it can't be retired and freed under the writer
+    Channel* channel = _channels.value(port);
+    if (channel) {
+        if (now - channel->lastLivenessCheck < LIVENESS_CHECK_INTERVAL_USECS) {
+            channel->mutex.lock();
+            return channel;
+        }
+        channel->lastLivenessCheck = now;
+        if (channel->segment->magic.loadAcquire() == SHARED_MEMORY_MAGIC &&
+                isProcessAlive(channel->segment->receiverPID.loadAcquire())) {
+            channel->mutex.lock();
+            return channel;
+        }
+        // the receiver went away, it may come back under a new segment. Another thread may still be writing through
+        // this channel, so it's freed once that write is done.
+        _channels.remove(port);
+        _retiredChannels.append(channel);
+        _unreachablePorts.insert(port, now);
+        freeRetiredChannels();
+        return NULL;
+    }
+
+    QHash<quint16, quint64>::const_iterator unreachable = _unreachablePorts.constFind(port);
+    if (unreachable != _unreachablePorts.constEnd() && now - unreachable.value() < UNREACHABLE_RETRY_USECS) {
+        return NULL;
+    }
+
+    channel = new Channel(SHARED_MEMORY_KEY_PREFIX + QString::number(port));
+    if (channel->memory.attach() && channel->memory.size() >= (int)sizeof(SharedMemorySegment)) {
+        channel->segment = static_cast<SharedMemorySegment*>(channel->memory.data());
+        if (channel->segment->magic.loadAcquire() == SHARED_MEMORY_MAGIC &&
+                isProcessAlive(channel->segment->receiverPID.loadAcquire())) {
+            channel->lastLivenessCheck = now;
+            _channels.insert(port, channel);
+            _unreachablePorts.remove(port);
+            channel->mutex.lock();
+            return channel;
+        }
+    }
+    delete channel;
+    _unreachablePorts.insert(port, now);
+    return NULL;
+#endif
+}
+
+void SharedMemoryTransport::freeRetiredChannels() {
+    // retired channels can't be found any more, and writers lock theirs before letting go of the channels, so a retired
+    // channel that nobody has locked now never will be again
+    QList<Channel*>::iterator it = _retiredChannels.begin();
+    while (it != _retiredChannels.end()) {
+        Channel* channel = *it;
+        if (channel->mutex.tryLock()) {
+            channel->mutex.unlock();
+            delete channel;
+            it = _retiredChannels.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+bool SharedMemoryTransport::claimRing(Channel* channel) {
+    int pid = QCoreApplication::applicationPid();
+
+    // the receiver wipes the rings when it takes over a stale segment, so check that we still own ours
+    if (channel->ring && channel->ring->ownerPID.loadAcquire() == pid) {
+        return true;
+    }
+    channel->ring = NULL;
+    for (int i = 0; i < SHARED_MEMORY_MAX_SENDERS; i++) {
+        SharedMemoryRing& ring = channel->segment->rings[i];
+        int owner = ring.ownerPID.loadAcquire();
+        if (owner == pid || ((owner == 0 || !isProcessAlive(owner)) && ring.ownerPID.testAndSetOrdered(owner, pid))) {
+            // pick up after whoever had it last, the receiver is still working through their packets
+            channel->ring = &ring;
+            return true;
+        }
+    }
+    return false;
+}
+
+quint32 SharedMemoryTransport::getSenderAddress(const QHostAddress& destination) const {
+    // the receiver should see the address we'd have sent from over UDP: for a socket bound to any address, the kernel
+    // sends a datagram for one of our own addresses from that same address, so loopback stays loopback
+    QHostAddress boundAddress = _socket.localAddress();
+    if (boundAddress.protocol() == QAbstractSocket::IPv4Protocol && boundAddress != QHostAddress::AnyIPv4) {
+        return boundAddress.toIPv4Address();
+    }
+    return destination.toIPv4Address();
+}
+
+bool SharedMemoryTransport::isLocalAddress(const QHostAddress& address) const {
+    return address == QHostAddress::LocalHost || _localAddresses.contains(address);
+}
@@ -0,0 +1,95 @@
+//
+//  SharedMemoryTransport.h
+//  libraries/networking/src
+//
+//  Copyright 2014 High Fidelity, Inc.
+//
+//  Shared memory datagram transport between node lists on the same host
+//
+//  Distributed under the Apache License, Version 2.0.
+//  See the accompanying file LICENSE or http://www.apache.org/licenses/LICENSE-2.0.html
+//
+
+#ifndef hifi_SharedMemoryTransport_h
+#define hifi_SharedMemoryTransport_h
+
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QSharedMemory>
+#include <QtNetwork/QHostAddress>
+#include <QtNetwork/QUdpSocket>
+
+#include "HifiSockAddr.h"
+
+// size of the UDP datagram used to wake a receiver that has drained its rings; real packets are always larger
+const int SHARED_MEMORY_DOORBELL_SIZE = 1;
+
+struct SharedMemorySegment;
+struct SharedMemoryRing;
+
+/// Carries datagrams between processes on the same host through a shared memory segment owned by the receiver. Each
+/// sending process claims its own single producer, single consumer ring in the receiver's segment, so the only
+/// cross-process synchronization is the ring indices. Segments are found by the receiver's UDP port, which is unique
+/// per host. When the receiver has drained its rings it asks to be woken, and the next sender rings its "doorbell" by
+/// sending it a one byte UDP datagram. Anything that can't go through shared memory (other hosts, IPv6, full rings,
+/// receivers that never set up a segment) is left to the caller to send over UDP.
+class SharedMemoryTransport {
+public:
+    SharedMemoryTransport(QUdpSocket& socket);
+    ~SharedMemoryTransport();
+
+    /// Creates our inbound segment, keyed by the port our UDP socket is bound to.
+    bool listen();
+    bool isListening() const { return _segment != NULL; }
+
+    /// Writes an already hashed datagram to the destination's segment. Returns false if the caller should use UDP instead.
+    bool writeDatagram(const QByteArray& datagram, const HifiSockAddr& destinationSockAddr);
+
+    /// Pops the next datagram from our inbound rings, if any. The sender address is the one the datagram would have come
+    /// from over UDP.
+    bool readDatagram(QByteArray& datagram, HifiSockAddr& senderSockAddr);
+
+    quint64 getDatagramsWritten() const { return _datagramsWritten; }
+    quint64 getDatagramsRead() const { return _datagramsRead; }
+    quint64 getDoorbellsSent() const { return _doorbellsSent; }
+
+private:
+    class Channel {
+    public:
+        Channel(const QString& key) : memory(key), segment(NULL), ring(NULL), lastLivenessCheck(0) { }
+
+        QSharedMemory memory;
+        SharedMemorySegment* segment;
+        SharedMemoryRing* ring;
+        QMutex mutex;
+        quint64 lastLivenessCheck;
+    };
+
+    /// Returns the channel to the segment of the receiver on the port, locked, or NULL if there's no live receiver there.
+    Channel* channelForPort(quint16 port);
+    void freeRetiredChannels();
+    bool writeToChannel(Channel* channel, const QByteArray& datagram, const HifiSockAddr& destinationSockAddr);
+    bool claimRing(Channel* channel);
+    bool popDatagram(QByteArray& datagram, HifiSockAddr& senderSockAddr);
+    quint32 getSenderAddress(const QHostAddress& destination) const;
+    bool isLocalAddress(const QHostAddress& address) const;
+
+    QUdpSocket& _socket;
+    QSharedMemory _inbound;
+    SharedMemorySegment* _segment;
+    int _nextRing;
+
+    QList<QHostAddress> _localAddresses;
+
+    QMutex _channelsMutex;
+    QHash<quint16, Channel*> _channels;
+    QList<Channel*> _retiredChannels;
+    QHash<quint16, quint64> _unreachablePorts; // port to time of the last failed attach
+
+    quint64 _datagramsWritten;
+    quint64 _datagramsRead;
+    quint64 _doorbellsSent;
+};
+
+#endif // hifi_SharedMemoryTransport_h
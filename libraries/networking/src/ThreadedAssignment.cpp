@@ -85,14 +85,5 @@ void ThreadedAssignment::checkInWithDomainServerOrExit() {
 }
 
 bool ThreadedAssignment::readAvailableDatagram(QByteArray& destinationByteArray, HifiSockAddr& senderSockAddr) {
-    NodeList* nodeList = NodeList::getInstance();
-    
-    if (nodeList->getNodeSocket().hasPendingDatagrams()) {
-        destinationByteArray.resize(nodeList->getNodeSocket().pendingDatagramSize());
-        nodeList->getNodeSocket().readDatagram(destinationByteArray.data(), destinationByteArray.size(),
-                                               senderSockAddr.getAddressPointer(), senderSockAddr.getPortPointer());
-        return true;
-    } else {
-        return false;
-    }
+    return NodeList::getInstance()->readDatagram(destinationByteArray, senderSockAddr);
 }
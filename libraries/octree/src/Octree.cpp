@@ -145,6 +145,19 @@ void Octree::recurseElementWithOperationDistanceSorted(OctreeElement* element, R
     }
 }
 
+void Octree::markPathChanged(OctreeElement* element) {
+    // walk down from the root by octal code, since elements don't know their parents
+    OctreeElement* pathElement = _rootElement;
+    while (pathElement) {
+        pathElement->markWithChangedTime();
+        if (pathElement == element) {
+            break;
+        }
+        pathElement = pathElement->getChildAtIndex(branchIndexWithDescendant(pathElement->getOctalCode(),
+            element->getOctalCode()));
+    }
+}
+
 void Octree::recurseTreeWithOperator(RecurseOctreeOperator* operatorObject) {
     recurseElementWithOperator(_rootElement, operatorObject);
 }
@@ -714,6 +727,273 @@ bool Octree::findSpherePenetration(const glm::vec3& center, float radius, glm::v
     return args.found;
 }
 
+// the element bounds are expanded by this much (in tree units) for the batched slab tests, so that they only ever
+// let through more rays than the exact test on the elements would
+const float RAY_BATCH_SLAB_EXPANSION = 1.0e-6f;
+
+// stands in for zero components of the ray directions, so that the inverse directions stay finite
+const float RAY_BATCH_MIN_DIRECTION = 1.0e-12f;
+
+// combines the arguments of a batch of ray casts, with the rays laid out by component so that each element's slab test
+// runs down contiguous arrays
+class RayBatchArgs {
+public:
+    RayBatchArgs(QVector<OctreeRayQuery>& queries);
+
+    QVector<OctreeRayQuery>& queries;
+    QVector<float> originX, originY, originZ;
+    QVector<float> inverseX, inverseY, inverseZ;
+
+    // the indices of the rays still passing through each element on the path from the root, as a stack of ranges
+    QVector<int> activeRays;
+};
+
+static float inverseOfDirection(float direction) {
+    return 1.0f / ((direction == 0.0f) ? RAY_BATCH_MIN_DIRECTION : direction);
+}
+
+RayBatchArgs::RayBatchArgs(QVector<OctreeRayQuery>& queries) :
+    queries(queries) {
+
+    int numQueries = queries.size();
+    originX.resize(numQueries);
+    originY.resize(numQueries);
+    originZ.resize(numQueries);
+    inverseX.resize(numQueries);
+    inverseY.resize(numQueries);
+    inverseZ.resize(numQueries);
+    activeRays.resize(numQueries);
+    for (int i = 0; i < numQueries; i++) {
+        OctreeRayQuery& query = queries[i];
+        query.found = false;
+        query.element = NULL;
+        query.distance = FLT_MAX;
+        query.face = UNKNOWN_FACE;
+        query.intersectedObject = NULL;
+
+        glm::vec3 origin = query.origin / (float)(TREE_SCALE);
+        originX[i] = origin.x;
+        originY[i] = origin.y;
+        originZ[i] = origin.z;
+        inverseX[i] = inverseOfDirection(query.direction.x);
+        inverseY[i] = inverseOfDirection(query.direction.y);
+        inverseZ[i] = inverseOfDirection(query.direction.z);
+        activeRays[i] = i;
+    }
+}
+
+// tests the element against the rays in [begin, end) of the active list, then recurses on its children with the rays
+// that should keep searching, just as findRayIntersectionOp does for a single ray
+static void findRayIntersectionsInElement(OctreeElement* element, RayBatchArgs& args, int begin, int end,
+        int recursionCount = 0) {
+    if (recursionCount > DANGEROUSLY_DEEP_RECURSION) {
+        qDebug() << "findRayIntersectionsInElement() reached DANGEROUSLY_DEEP_RECURSION, bailing!";
+        return;
+    }
+    const AACube& cube = element->getAACube();
+    glm::vec3 minimum = cube.getCorner() - glm::vec3(RAY_BATCH_SLAB_EXPANSION);
+    glm::vec3 maximum = cube.getCorner() + glm::vec3(cube.getScale() + RAY_BATCH_SLAB_EXPANSION);
+    bool canIntersect = element->canRayIntersect();
+    int childBegin = args.activeRays.size();
+    for (int i = begin; i < end; i++) {
+        int ray = args.activeRays.at(i);
+
+        // slab test: clip the ray against each pair of planes in turn
+        float enter = (minimum.x - args.originX.at(ray)) * args.inverseX.at(ray);
+        float leave = (maximum.x - args.originX.at(ray)) * args.inverseX.at(ray);
+        if (enter > leave) {
+            qSwap(enter, leave);
+        }
+        float enterY = (minimum.y - args.originY.at(ray)) * args.inverseY.at(ray);
+        float leaveY = (maximum.y - args.originY.at(ray)) * args.inverseY.at(ray);
+        if (enterY > leaveY) {
+            qSwap(enterY, leaveY);
+        }
+        float enterZ = (minimum.z - args.originZ.at(ray)) * args.inverseZ.at(ray);
+        float leaveZ = (maximum.z - args.originZ.at(ray)) * args.inverseZ.at(ray);
+        if (enterZ > leaveZ) {
+            qSwap(enterZ, leaveZ);
+        }
+        enter = glm::max(glm::max(enter, enterY), glm::max(enterZ, 0.0f));
+        leave = glm::min(leave, glm::min(leaveY, leaveZ));
+        if (enter > leave) {
+            continue; // misses the element, and so all of its children
+        }
+
+        // nothing within the element can be nearer than where the ray enters it
+        OctreeRayQuery& query = args.queries[ray];
+        if (enter * (float)(TREE_SCALE) > query.distance) {
+            continue;
+        }
+        bool keepSearching = true;
+        if (canIntersect) {
+            glm::vec3 origin(args.originX.at(ray), args.originY.at(ray), args.originZ.at(ray));
+            if (element->findRayIntersection(origin, query.direction, keepSearching, query.element, query.distance,
+                    query.face, &query.intersectedObject)) {
+                query.found = true;
+            }
+        }
+        if (keepSearching) {
+            args.activeRays.append(ray);
+        }
+    }
+    int childEnd = args.activeRays.size();
+    if (childEnd > childBegin) {
+        for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+            OctreeElement* child = element->getChildAtIndex(i);
+            if (child) {
+                findRayIntersectionsInElement(child, args, childBegin, childEnd, recursionCount + 1);
+            }
+        }
+    }
+    args.activeRays.resize(childBegin);
+}
+
+bool Octree::findRayIntersections(QVector<OctreeRayQuery>& queries, Octree::lockType lockType, bool* accurateResult) {
+    RayBatchArgs args(queries);
+
+    bool gotLock = false;
+    if (lockType == Octree::Lock) {
+        lockForRead();
+        gotLock = true;
+    } else if (lockType == Octree::TryLock) {
+        gotLock = tryLockForRead();
+        if (!gotLock) {
+            if (accurateResult) {
+                *accurateResult = false; // if user asked to accuracy or result, let them know this is inaccurate
+            }
+            return false; // if we wanted to tryLock, and we couldn't then just bail...
+        }
+    }
+
+    if (!queries.isEmpty()) {
+        findRayIntersectionsInElement(_rootElement, args, 0, queries.size());
+    }
+
+    if (gotLock) {
+        unlock();
+    }
+
+    if (accurateResult) {
+        *accurateResult = true; // if user asked to accuracy or result, let them know this is accurate
+    }
+    bool found = false;
+    foreach (const OctreeRayQuery& query, queries) {
+        found |= query.found;
+    }
+    return found;
+}
+
+// combines the arguments of a batch of sphere tests, with the spheres converted to tree units
+class SphereBatchArgs {
+public:
+    SphereBatchArgs(QVector<OctreeSphereQuery>& queries);
+
+    QVector<OctreeSphereQuery>& queries;
+    QVector<glm::vec3> centers;
+    QVector<float> radii;
+
+    // the indices of the spheres reaching into each element on the path from the root, as a stack of ranges
+    QVector<int> activeSpheres;
+};
+
+SphereBatchArgs::SphereBatchArgs(QVector<OctreeSphereQuery>& queries) :
+    queries(queries) {
+
+    int numQueries = queries.size();
+    centers.resize(numQueries);
+    radii.resize(numQueries);
+    activeSpheres.resize(numQueries);
+    for (int i = 0; i < numQueries; i++) {
+        OctreeSphereQuery& query = queries[i];
+        query.found = false;
+        query.penetration = glm::vec3(0.0f, 0.0f, 0.0f);
+        query.penetratedObject = NULL;
+
+        centers[i] = query.center / (float)(TREE_SCALE);
+        radii[i] = query.radius / (float)(TREE_SCALE);
+        activeSpheres[i] = i;
+    }
+}
+
+// tests the element against the spheres in [begin, end) of the active list, then recurses on its children with the
+// spheres whose expanded bounds reach into it, just as findSpherePenetrationOp does for a single sphere
+static void findSpherePenetrationsInElement(OctreeElement* element, SphereBatchArgs& args, int begin, int end,
+        int recursionCount = 0) {
+    if (recursionCount > DANGEROUSLY_DEEP_RECURSION) {
+        qDebug() << "findSpherePenetrationsInElement() reached DANGEROUSLY_DEEP_RECURSION, bailing!";
+        return;
+    }
+    const AACube& box = element->getAACube();
+    bool isLeaf = element->isLeaf();
+    bool hasContent = isLeaf && element->hasContent();
+    int childBegin = args.activeSpheres.size();
+    for (int i = begin; i < end; i++) {
+        int sphere = args.activeSpheres.at(i);
+        if (!box.expandedContains(args.centers.at(sphere), args.radii.at(sphere))) {
+            continue;
+        }
+        if (!isLeaf) {
+            args.activeSpheres.append(sphere);
+
+        } else if (hasContent) {
+            OctreeSphereQuery& query = args.queries[sphere];
+            glm::vec3 elementPenetration;
+            if (element->findSpherePenetration(args.centers.at(sphere), args.radii.at(sphere), elementPenetration,
+                    &query.penetratedObject)) {
+                // NOTE: as with findSpherePenetration(), the accumulated penetration may have zero length
+                query.penetration = addPenetrations(query.penetration, elementPenetration * (float)(TREE_SCALE));
+                query.found = true;
+            }
+        }
+    }
+    int childEnd = args.activeSpheres.size();
+    if (childEnd > childBegin) {
+        for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+            OctreeElement* child = element->getChildAtIndex(i);
+            if (child) {
+                findSpherePenetrationsInElement(child, args, childBegin, childEnd, recursionCount + 1);
+            }
+        }
+    }
+    args.activeSpheres.resize(childBegin);
+}
+
+bool Octree::findSpherePenetrations(QVector<OctreeSphereQuery>& queries, Octree::lockType lockType, bool* accurateResult) {
+    SphereBatchArgs args(queries);
+
+    bool gotLock = false;
+    if (lockType == Octree::Lock) {
+        lockForRead();
+        gotLock = true;
+    } else if (lockType == Octree::TryLock) {
+        gotLock = tryLockForRead();
+        if (!gotLock) {
+            if (accurateResult) {
+                *accurateResult = false; // if user asked to accuracy or result, let them know this is inaccurate
+            }
+            return false; // if we wanted to tryLock, and we couldn't then just bail...
+        }
+    }
+
+    if (!queries.isEmpty()) {
+        findSpherePenetrationsInElement(_rootElement, args, 0, queries.size());
+    }
+
+    if (gotLock) {
+        unlock();
+    }
+
+    if (accurateResult) {
+        *accurateResult = true; // if user asked to accuracy or result, let them know this is accurate
+    }
+    bool found = false;
+    foreach (const OctreeSphereQuery& query, queries) {
+        found |= query.found;
+    }
+    return found;
+}
+
 class CapsuleArgs {
 public:
     glm::vec3 start;
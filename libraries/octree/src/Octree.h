@@ -12,6 +12,7 @@
 #ifndef hifi_Octree_h
 #define hifi_Octree_h
 
+#include <cfloat>
 #include <set>
 #include <SimpleMovingAverage.h>
 
@@ -28,6 +29,7 @@ class Shape;
 #include "ViewFrustum.h"
 #include "OctreeElement.h"
 #include "OctreeElementBag.h"
+#include "OctreeItemSendTimes.h"
 #include "OctreePacketData.h"
 #include "OctreeSceneStats.h"
 
@@ -35,6 +37,7 @@ class Shape;
 
 #include <QObject>
 #include <QReadWriteLock>
+#include <QVector>
 
 /// derive from this class to use the Octree::recurseTreeWithOperator() method
 class RecurseOctreeOperator {
@@ -45,6 +48,37 @@ public:
 
 // Callback function, for recuseTreeWithOperation
 typedef bool (*RecurseOctreeOperation)(OctreeElement* element, void* extraData);
+
+/// A ray to cast with Octree::findRayIntersections(), along with the results of the cast.
+class OctreeRayQuery {
+public:
+    OctreeRayQuery(const glm::vec3& origin = glm::vec3(), const glm::vec3& direction = glm::vec3()) :
+        origin(origin), direction(direction), found(false), element(NULL), distance(FLT_MAX), face(UNKNOWN_FACE),
+        intersectedObject(NULL) { }
+
+    glm::vec3 origin;
+    glm::vec3 direction;
+
+    bool found;
+    OctreeElement* element;
+    float distance;
+    BoxFace face;
+    void* intersectedObject;
+};
+
+/// A sphere to test with Octree::findSpherePenetrations(), along with the results of the test.
+class OctreeSphereQuery {
+public:
+    OctreeSphereQuery(const glm::vec3& center = glm::vec3(), float radius = 0.0f) :
+        center(center), radius(radius), found(false), penetration(0.0f), penetratedObject(NULL) { }
+
+    glm::vec3 center;
+    float radius;
+
+    bool found;
+    glm::vec3 penetration;
+    void* penetratedObject; /// the type is defined by the type of Octree, the caller is assumed to know the type
+};
 typedef enum {GRADIENT, RANDOM, NATURAL} creationMode;
 
 const bool NO_EXISTS_BITS         = false;
@@ -85,6 +119,9 @@ public:
     CoverageMap* map;
     JurisdictionMap* jurisdictionMap;
 
+    // when set, elements holding items (particles, models) send each item's properties changed since it was last sent
+    OctreeItemSendTimes* itemSendTimes;
+
     // output hints from the encode process
     typedef enum {
         UNKNOWN,
@@ -132,6 +169,7 @@ public:
             stats(stats),
             map(map),
             jurisdictionMap(jurisdictionMap),
+            itemSendTimes(NULL),
             stopReason(UNKNOWN)
     {}
 
@@ -238,6 +276,9 @@ public:
     OctreeElement* getOrCreateChildElementAt(float x, float y, float z, float s);
     OctreeElement* getOrCreateChildElementContaining(const AACube& box);
 
+    /// Marks the element and all of its ancestors as changed, so that viewers will descend to the change.
+    void markPathChanged(OctreeElement* element);
+
     void recurseTreeWithOperation(RecurseOctreeOperation operation, void* extraData = NULL);
     void recurseTreeWithPostOperation(RecurseOctreeOperation operation, void* extraData = NULL);
 
@@ -277,6 +318,17 @@ public:
     bool findCapsulePenetration(const glm::vec3& start, const glm::vec3& end, float radius, glm::vec3& penetration, 
                                     Octree::lockType lockType = Octree::TryLock, bool* accurateResult = NULL);
 
+    /// Casts a batch of rays in a single traversal of the tree, under a single lock, filling in the results of each query.
+    /// Each element is tested against all of the rays still passing through its parent at once.
+    /// \return true if any of the rays hit something
+    bool findRayIntersections(QVector<OctreeRayQuery>& queries,
+                                    Octree::lockType lockType = Octree::TryLock, bool* accurateResult = NULL);
+
+    /// Tests a batch of spheres in a single traversal of the tree, under a single lock, filling in the results of each query.
+    /// \return true if any of the spheres penetrated something
+    bool findSpherePenetrations(QVector<OctreeSphereQuery>& queries,
+                                    Octree::lockType lockType = Octree::TryLock, bool* accurateResult = NULL);
+
     bool findShapeCollisions(const Shape* shape, CollisionList& collisions, 
                                     Octree::lockType = Octree::TryLock, bool* accurateResult = NULL);
 
@@ -0,0 +1,128 @@
+//
+//  OctreeDeletionLog.h
+//  libraries/octree/src
+//
+//  Copyright 2014 High Fidelity, Inc.
+//
+//  A bounded log of the IDs of the items deleted from an octree (particles, models), for telling viewers about them
+//
+//  Distributed under the Apache License, Version 2.0.
+//  See the accompanying file LICENSE or http://www.apache.org/licenses/LICENSE-2.0.html
+//
+
+#ifndef hifi_OctreeDeletionLog_h
+#define hifi_OctreeDeletionLog_h
+
+#include <stdint.h>
+
+#include <QMap>
+#include <QVector>
+
+const int DEFAULT_DELETION_LOG_CAPACITY = 16384;
+const int MAX_DELETION_TOMBSTONE_RANGES = 16384;
+
+/// Each deletion gets the next sequence number, and each viewer keeps the sequence number it has been sent deletions up to,
+/// so that it can be sent just the ones since.  The most recent deletions are kept in a ring; when the ring is full, the
+/// oldest deletion is folded into the tombstones, a compacted set of ID ranges (IDs are handed out in order, so deletions
+/// in bulk compact well).  Viewers that fall behind the ring are sent the tombstones, followed by the whole ring.  Once
+/// every viewer has been sent a deletion, the log can forget it.  If there are ever more tombstone ranges than the maximum,
+/// the lowest are dropped; only viewers that have stopped listening for that long miss them.  The log isn't thread safe:
+/// the trees guard theirs with a lock.
+class OctreeDeletionLog {
+public:
+    OctreeDeletionLog(int capacity = DEFAULT_DELETION_LOG_CAPACITY) :
+        _deletions(capacity),
+        _firstSequence(0),
+        _nextSequence(0),
+        _tombstonesUpTo(0) { }
+
+    /// Logs the deletion of the item with the given ID.
+    void itemDeleted(uint32_t id) {
+        if (_nextSequence - _firstSequence == (quint64)_deletions.size()) {
+            addTombstone(_deletions.at(_firstSequence % _deletions.size()));
+            _firstSequence++;
+            _tombstonesUpTo = _firstSequence;
+        }
+        _deletions[_nextSequence % _deletions.size()] = id;
+        _nextSequence++;
+    }
+
+    /// Returns the sequence number of the next deletion; viewers that have been sent up to it are up to date.
+    quint64 getNextSequence() const { return _nextSequence; }
+
+    /// Returns true if the log holds any deletions at all.
+    bool hasAnyDeleted() const { return _firstSequence < _nextSequence || !_tombstones.isEmpty(); }
+
+    /// Returns true if there are deletions a viewer that has been sent up to the given sequence number hasn't been sent.
+    bool hasDeletedSince(quint64 sequence) const {
+        return qMax(sequence, _firstSequence) < _nextSequence || (sequence < _tombstonesUpTo && !_tombstones.isEmpty());
+    }
+
+    /// Appends the IDs deleted since the given sequence number, and advances it past them.
+    void getDeletedSince(quint64& sequence, QVector<uint32_t>& ids) const {
+        if (sequence < _firstSequence) {
+            if (sequence < _tombstonesUpTo) {
+                for (QMap<uint32_t, uint32_t>::const_iterator it = _tombstones.constBegin();
+                        it != _tombstones.constEnd(); ++it) {
+                    for (quint64 id = it.key(); id <= it.value(); id++) {
+                        ids.append((uint32_t)id);
+                    }
+                }
+            }
+            sequence = _firstSequence;
+        }
+        for (; sequence < _nextSequence; sequence++) {
+            ids.append(_deletions.at(sequence % _deletions.size()));
+        }
+    }
+
+    /// Forgets the deletions before the given sequence number, which every viewer has been sent.
+    void forgetDeletedBefore(quint64 sequence) {
+        _firstSequence = qMax(_firstSequence, qMin(sequence, _nextSequence));
+        if (sequence >= _tombstonesUpTo) {
+            _tombstones.clear();
+        }
+    }
+
+    int getTombstoneRangeCount() const { return _tombstones.size(); }
+
+private:
+
+    void addTombstone(uint32_t id) {
+        // merge the ID into the ranges on either side of it, if it's adjacent to them
+        QMap<uint32_t, uint32_t>::iterator next = _tombstones.upperBound(id);
+        if (next != _tombstones.begin()) {
+            QMap<uint32_t, uint32_t>::iterator previous = next - 1;
+            if (previous.value() >= id) {
+                return; // already a tombstone
+            }
+            if (previous.value() + 1 == id) {
+                previous.value() = id;
+                if (next != _tombstones.end() && next.key() == id + 1) {
+                    previous.value() = next.value();
+                    _tombstones.erase(next);
+                }
+                return;
+            }
+        }
+        if (next != _tombstones.end() && next.key() == id + 1) {
+            uint32_t last = next.value();
+            _tombstones.erase(next);
+            _tombstones.insert(id, last);
+            return;
+        }
+        _tombstones.insert(id, id);
+        if (_tombstones.size() > MAX_DELETION_TOMBSTONE_RANGES) {
+            _tombstones.erase(_tombstones.begin());
+        }
+    }
+
+    QVector<uint32_t> _deletions; // the ring, holding the deletions from _firstSequence up to _nextSequence
+    quint64 _firstSequence;
+    quint64 _nextSequence;
+
+    QMap<uint32_t, uint32_t> _tombstones; // the first and last IDs of each range
+    quint64 _tombstonesUpTo; // the sequence number after the last deletion folded into the tombstones
+};
+
+#endif // hifi_OctreeDeletionLog_h
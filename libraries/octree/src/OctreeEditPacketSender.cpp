@@ -20,13 +20,17 @@
 EditPacketBuffer::EditPacketBuffer(PacketType type, unsigned char* buffer, ssize_t length, QUuid nodeUUID) :
     _nodeUUID(nodeUUID),
     _currentType(type),
-    _currentSize(length)
+    _currentSize(length),
+    _coalescedType(PacketTypeUnknown)
 {
     memcpy(_currentBuffer, buffer, length);
 };
 
 const int OctreeEditPacketSender::DEFAULT_MAX_PENDING_MESSAGES = PacketSender::DEFAULT_PACKETS_PER_SECOND;
 
+// the most edits we'll hold back per server for coalescing before packing them, roughly 80 full packets of voxel edits
+const int MAX_COALESCED_EDITS = 4096;
+
 
 OctreeEditPacketSender::OctreeEditPacketSender() :
     PacketSender(),
@@ -35,7 +39,10 @@ OctreeEditPacketSender::OctreeEditPacketSender() :
     _releaseQueuedMessagesPending(false),
     _serverJurisdictions(NULL),
     _sequenceNumber(0),
-    _maxPacketSize(MAX_PACKET_SIZE) {
+    _maxPacketSize(MAX_PACKET_SIZE),
+    _adaptivePacketsPerSecond(false),
+    _rateControl(),
+    _totalEditsCoalesced(0) {
 }
 
 OctreeEditPacketSender::~OctreeEditPacketSender() {
@@ -98,6 +105,8 @@ void OctreeEditPacketSender::queuePacketToNode(const QUuid& nodeUUID, const unsi
             if (node->getActiveSocket()) {
                 QByteArray packet(reinterpret_cast<const char*>(buffer), length);
                 queuePacketForSending(node, packet);
+                _rateControl.packetSent(length);
+                _rateControl.roundTripTimeSampled(node->getPingMs());
 
                 // extract sequence number and add packet to history
                 int numBytesPacketHeader = numBytesForPacketHeader(packet);
@@ -259,18 +268,6 @@ void OctreeEditPacketSender::queueOctreeEditMessage(PacketType type, unsigned ch
                 EditPacketBuffer& packetBuffer = _pendingEditPackets[nodeUUID];
                 packetBuffer._nodeUUID = nodeUUID;
 
-                // If we're switching type, then we send the last one and start over
-                if ((type != packetBuffer._currentType && packetBuffer._currentSize > 0) ||
-                    (packetBuffer._currentSize + length >= _maxPacketSize)) {
-                    releaseQueuedPacket(packetBuffer);
-                    initializePacket(packetBuffer, type);
-                }
-
-                // If the buffer is empty and not correctly initialized for our type...
-                if (type != packetBuffer._currentType && packetBuffer._currentSize == 0) {
-                    initializePacket(packetBuffer, type);
-                }
-
                 // This is really the first time we know which server/node this particular edit message
                 // is going to, so we couldn't adjust for clock skew till now. But here's our chance.
                 // We call this virtual function that allows our specific type of EditPacketSender to
@@ -279,13 +276,97 @@ void OctreeEditPacketSender::queueOctreeEditMessage(PacketType type, unsigned ch
                     adjustEditPacketForClockSkew(codeColorBuffer, length, node->getClockSkewUsec());
                 }
 
-                memcpy(&packetBuffer._currentBuffer[packetBuffer._currentSize], codeColorBuffer, length);
-                packetBuffer._currentSize += length;
+                if (isCoalescableEditType(type)) {
+                    coalesceEditMessage(packetBuffer, type, codeColorBuffer, length);
+                } else {
+                    // anything held back for coalescing was queued before this message, so it must go out first
+                    flushCoalescedEdits(packetBuffer);
+                    appendEditMessage(packetBuffer, type, codeColorBuffer, length);
+                }
             }
         }
     }
 }
 
+void OctreeEditPacketSender::appendEditMessage(EditPacketBuffer& packetBuffer, PacketType type,
+                                               const unsigned char* buffer, ssize_t length) {
+    // If we're switching type, then we send the last one and start over
+    if ((type != packetBuffer._currentType && packetBuffer._currentSize > 0) ||
+        (packetBuffer._currentSize + length >= _maxPacketSize)) {
+        releaseQueuedPacket(packetBuffer);
+        initializePacket(packetBuffer, type);
+    }
+
+    // If the buffer is empty and not correctly initialized for our type...
+    if (type != packetBuffer._currentType && packetBuffer._currentSize == 0) {
+        initializePacket(packetBuffer, type);
+    }
+
+    memcpy(&packetBuffer._currentBuffer[packetBuffer._currentSize], buffer, length);
+    packetBuffer._currentSize += length;
+}
+
+// Returns the octcode of an edit message as one octal digit per level, so that ancestors are prefixes of their
+// descendants and lexical order is depth first order.
+static QByteArray octalPathForEdit(const unsigned char* buffer) {
+    int sections = numberOfThreeBitSectionsInCode(buffer);
+    QByteArray path(sections, '0');
+    for (int i = 0; i < sections; i++) {
+        path[i] = '0' + getOctalCodeSectionValue(buffer, i);
+    }
+    return path;
+}
+
+void OctreeEditPacketSender::coalesceEditMessage(EditPacketBuffer& packetBuffer, PacketType type,
+                                                 const unsigned char* buffer, ssize_t length) {
+    if (type != packetBuffer._coalescedType) {
+        flushCoalescedEdits(packetBuffer);
+        packetBuffer._coalescedType = type;
+    }
+    QByteArray path = octalPathForEdit(buffer);
+    QMap<QByteArray, QByteArray>& edits = packetBuffer._coalescedEdits;
+
+    // Reordering is only safe between edits of disjoint elements: an edit of an ancestor or descendant of something
+    // we're holding must be applied after it, so in that case we send what we have first.
+    bool overlaps = false;
+    for (int i = 1; i < path.size() && !overlaps; i++) {
+        overlaps = edits.contains(path.left(i));
+    }
+    if (!overlaps) {
+        QMap<QByteArray, QByteArray>::const_iterator next = edits.lowerBound(path);
+        if (next != edits.constEnd() && next.key() == path) {
+            next++;
+        }
+        overlaps = (next != edits.constEnd() && next.key().startsWith(path));
+    }
+    if (overlaps) {
+        flushCoalescedEdits(packetBuffer);
+        packetBuffer._coalescedType = type;
+    }
+
+    if (edits.contains(path)) {
+        _totalEditsCoalesced++;
+    }
+    edits.insert(path, QByteArray(reinterpret_cast<const char*>(buffer), length));
+
+    if (edits.size() >= MAX_COALESCED_EDITS) {
+        flushCoalescedEdits(packetBuffer);
+    }
+}
+
+void OctreeEditPacketSender::flushCoalescedEdits(EditPacketBuffer& packetBuffer) {
+    if (packetBuffer._coalescedEdits.isEmpty()) {
+        return;
+    }
+    // neighboring elements end up in the same packets, which keeps the server's tree walks local
+    foreach (const QByteArray& edit, packetBuffer._coalescedEdits) {
+        appendEditMessage(packetBuffer, packetBuffer._coalescedType,
+                          reinterpret_cast<const unsigned char*>(edit.constData()), edit.size());
+    }
+    packetBuffer._coalescedEdits.clear();
+    packetBuffer._coalescedType = PacketTypeUnknown;
+}
+
 void OctreeEditPacketSender::releaseQueuedMessages() {
     // if we don't yet have jurisdictions then we can't actually release messages yet because we don't
     // know where to send them to. Instead, just remember this request and when we eventually get jurisdictions
@@ -294,6 +375,7 @@ void OctreeEditPacketSender::releaseQueuedMessages() {
         _releaseQueuedMessagesPending = true;
     } else {
         for (QHash<QUuid, EditPacketBuffer>::iterator i = _pendingEditPackets.begin(); i != _pendingEditPackets.end(); i++) {
+            flushCoalescedEdits(i.value());
             releaseQueuedPacket(i.value());
         }
     }
@@ -334,6 +416,12 @@ bool OctreeEditPacketSender::process() {
         processPreServerExistsPackets();
     }
 
+    if (_adaptivePacketsPerSecond) {
+        // refreshing the bucket lets the controller re-evaluate its rate once per window
+        _rateControl.getAvailablePackets();
+        setPacketsPerSecond((int)_rateControl.getPacketsPerSecond());
+    }
+
     // base class does most of the work.
     return PacketSender::process();
 }
@@ -354,6 +442,9 @@ void OctreeEditPacketSender::processNackPacket(const QByteArray& packet) {
     // read number of sequence numbers
     uint16_t numSequenceNumbers = (*(uint16_t*)dataAt);
     dataAt += sizeof(uint16_t);
+
+    // the server is telling us it lost packets, which is our signal to slow down
+    _rateControl.packetsLost(numSequenceNumbers);
     
     // read sequence numbers and queue packets for resend
     for (int i = 0; i < numSequenceNumbers; i++) {
@@ -365,10 +456,19 @@ void OctreeEditPacketSender::processNackPacket(const QByteArray& packet) {
         if (packet) {
             const SharedNodePointer& node = NodeList::getInstance()->getNodeHash().value(sendingNodeUUID);
             queuePacketForSending(node, *packet);
+            _rateControl.packetSent(packet->size());
         }
     }
 }
 
+void OctreeEditPacketSender::setAdaptivePacketsPerSecond(bool adaptive, int maxPacketsPerSecond) {
+    _adaptivePacketsPerSecond = adaptive;
+    if (adaptive) {
+        _rateControl.setMaxPacketsPerSecond(maxPacketsPerSecond);
+        _rateControl.reset();
+    }
+}
+
 void OctreeEditPacketSender::nodeKilled(SharedNodePointer node) {
     // TODO: add locks
     QUuid nodeUUID = node->getUUID();
@@ -12,7 +12,9 @@
 #ifndef hifi_OctreeEditPacketSender_h
 #define hifi_OctreeEditPacketSender_h
 
+#include <qmap.h>
 #include <qqueue.h>
+#include <CongestionControl.h>
 #include <PacketSender.h>
 #include <PacketHeaders.h>
 #include "JurisdictionMap.h"
@@ -21,12 +23,17 @@
 /// Used for construction of edit packets
 class EditPacketBuffer {
 public:
-    EditPacketBuffer() : _nodeUUID(), _currentType(PacketTypeUnknown), _currentSize(0)  { }
+    EditPacketBuffer() : _nodeUUID(), _currentType(PacketTypeUnknown), _currentSize(0), _coalescedType(PacketTypeUnknown) { }
     EditPacketBuffer(PacketType type, unsigned char* codeColorBuffer, ssize_t length, const QUuid nodeUUID = QUuid());
     QUuid _nodeUUID;
     PacketType _currentType;
     unsigned char _currentBuffer[MAX_PACKET_SIZE];
     ssize_t _currentSize;
+
+    // edits waiting to be packed, keyed by the octal digits of their octcode so that they come out in depth first
+    // (Morton) order and a later edit of the same element replaces the earlier one
+    PacketType _coalescedType;
+    QMap<QByteArray, QByteArray> _coalescedEdits;
 };
 
 /// Utility for processing, packing, queueing and sending of outbound edit messages.
@@ -88,10 +95,24 @@ public:
     /// returns the current desired max packet size in bytes that the OctreeEditPacketSender will create
     int getMaxPacketSize() const { return _maxPacketSize; }
 
+    /// When adaptive, the send rate is driven by the NACK feedback and round trip times of our servers, between
+    /// the minimum rate and maxPacketsPerSecond, instead of the fixed rate set with setPacketsPerSecond().
+    void setAdaptivePacketsPerSecond(bool adaptive, int maxPacketsPerSecond = DEFAULT_MAX_PACKETS_PER_SECOND);
+    bool getAdaptivePacketsPerSecond() const { return _adaptivePacketsPerSecond; }
+
+    const CongestionControl& getRateControl() const { return _rateControl; }
+
+    /// returns the number of edits that were dropped because a later edit of the same element replaced them before send
+    quint64 getLifetimeEditsCoalesced() const { return _totalEditsCoalesced; }
+
     // you must override these...
     virtual char getMyNodeType() const = 0;
     virtual void adjustEditPacketForClockSkew(unsigned char* codeColorBuffer, ssize_t length, int clockSkew) { };
 
+    /// Override to return true for edit types that are addressed by the leading octcode alone, and where the last edit
+    /// to an element wins. Such edits are held back, deduplicated and sorted by octcode before being packed.
+    virtual bool isCoalescableEditType(PacketType type) const { return false; }
+
 public slots:
     void nodeKilled(SharedNodePointer node);
 
@@ -105,6 +126,9 @@ protected:
     void queuePacketToNodes(unsigned char* buffer, ssize_t length);
     void initializePacket(EditPacketBuffer& packetBuffer, PacketType type);
     void releaseQueuedPacket(EditPacketBuffer& packetBuffer); // releases specific queued packet
+    void appendEditMessage(EditPacketBuffer& packetBuffer, PacketType type, const unsigned char* buffer, ssize_t length);
+    void coalesceEditMessage(EditPacketBuffer& packetBuffer, PacketType type, const unsigned char* buffer, ssize_t length);
+    void flushCoalescedEdits(EditPacketBuffer& packetBuffer);
     
     void processPreServerExistsPackets();
 
@@ -127,5 +151,9 @@ protected:
 
     // TODO: add locks for this and _pendingEditPackets
     QHash<QUuid, SentPacketHistory> _sentPacketHistories;
+
+    bool _adaptivePacketsPerSecond;
+    CongestionControl _rateControl;
+    quint64 _totalEditsCoalesced;
 };
 #endif // hifi_OctreeEditPacketSender_h
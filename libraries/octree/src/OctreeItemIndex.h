@@ -0,0 +1,49 @@
+//
+//  OctreeItemIndex.h
+//  libraries/octree/src
+//
+//  Copyright 2014 High Fidelity, Inc.
+//
+//  Maps the IDs of the items stored in an octree (particles, models) to the elements that hold them
+//
+//  Distributed under the Apache License, Version 2.0.
+//  See the accompanying file LICENSE or http://www.apache.org/licenses/LICENSE-2.0.html
+//
+
+#ifndef hifi_OctreeItemIndex_h
+#define hifi_OctreeItemIndex_h
+
+#include <stdint.h>
+
+#include <QHash>
+
+/// An index from item ID to containing element, so that trees can find their items without searching.  The elements keep
+/// the index current: they record the items they store, and forget the items they remove, including the ones still held
+/// when they are deleted.  The index is guarded by the tree's lock, like the elements themselves.
+template<class E> class OctreeItemIndex {
+public:
+
+    /// Records that the item with the given ID is now held by the element.
+    void insert(uint32_t id, E* element) { _elements.insert(id, element); }
+
+    /// Forgets the item with the given ID, if it's recorded as held by the element (it may have moved on already).
+    void remove(uint32_t id, E* element) {
+        typename QHash<uint32_t, E*>::iterator it = _elements.find(id);
+        if (it != _elements.end() && it.value() == element) {
+            _elements.erase(it);
+        }
+    }
+
+    /// Returns the element holding the item with the given ID, or NULL if the item isn't in the tree.
+    E* find(uint32_t id) const { return _elements.value(id); }
+
+    int size() const { return _elements.size(); }
+
+    void clear() { _elements.clear(); }
+
+private:
+
+    QHash<uint32_t, E*> _elements;
+};
+
+#endif // hifi_OctreeItemIndex_h
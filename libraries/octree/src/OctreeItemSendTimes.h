@@ -0,0 +1,54 @@
+//
+//  OctreeItemSendTimes.h
+//  libraries/octree/src
+//
+//  Copyright 2014 High Fidelity, Inc.
+//
+//  Remembers when the items stored in an octree (particles, models) were last sent to a viewer
+//
+//  Distributed under the Apache License, Version 2.0.
+//  See the accompanying file LICENSE or http://www.apache.org/licenses/LICENSE-2.0.html
+//
+
+#ifndef hifi_OctreeItemSendTimes_h
+#define hifi_OctreeItemSendTimes_h
+
+#include <stdint.h>
+
+#include <QHash>
+
+/// The times at which items were last sent to one viewer, so that the elements can send only the properties that changed
+/// since.  Sends are held as pending until the scene they're part of has been completely sent: the encoder can still discard
+/// element data after the element has appended it, in which case the element goes back in the bag to be sent again later in
+/// the same scene.  If the scene is abandoned instead, the pending sends are forgotten, and the items are sent against the
+/// last completed scene (which only costs the properties that are sent twice).
+class OctreeItemSendTimes {
+public:
+
+    /// Returns the time at which the item was last sent in a completed scene, or zero if it hasn't been.
+    quint64 getLastSent(uint32_t id) const { return _sent.value(id); }
+
+    /// Records that the item was sent, as of the given time, in the scene in progress.
+    void itemSent(uint32_t id, quint64 sentAt) { _pending.insert(id, sentAt); }
+
+    /// Called when every element in the scene has been sent: the pending sends are now known to have been.
+    void sceneCompleted() {
+        for (QHash<uint32_t, quint64>::const_iterator it = _pending.constBegin(); it != _pending.constEnd(); ++it) {
+            _sent.insert(it.key(), it.value());
+        }
+        _pending.clear();
+    }
+
+    /// Called when the scene was restarted before it was completed.
+    void sceneAbandoned() { _pending.clear(); }
+
+    /// Forgets every send, so that every item will be sent whole; used when the viewer is sent a full scene.
+    void clear() { _sent.clear(); _pending.clear(); }
+
+private:
+
+    QHash<uint32_t, quint64> _sent;
+    QHash<uint32_t, quint64> _pending;
+};
+
+#endif // hifi_OctreeItemSendTimes_h
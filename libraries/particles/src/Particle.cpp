@@ -17,15 +17,9 @@
 #include <VoxelsScriptingInterface.h>
 #include <VoxelDetail.h>
 
-
-// This is not ideal, but adding script-engine as a linked library, will cause a circular reference
-// I'm open to other potential solutions. Could we change cmake to allow libraries to reference each others
-// headers, but not link to each other, this is essentially what this construct is doing, but would be
-// better to add includes to the include path, but not link
-#include "../../script-engine/src/ScriptEngine.h"
-
 #include "ParticlesScriptingInterface.h"
 #include "Particle.h"
+#include "ParticleScriptPool.h"
 #include "ParticleTree.h"
 
 uint32_t Particle::_nextID = 0;
@@ -98,6 +92,10 @@ Particle::Particle(const ParticleID& particleID, const ParticleProperties& prope
     _modelTranslation = DEFAULT_MODEL_TRANSLATION;
     _modelRotation = DEFAULT_MODEL_ROTATION;
     _modelScale = DEFAULT_MODEL_SCALE;
+
+    for (int i = 0; i < PARTICLE_PROPERTY_COUNT; i++) {
+        _propertyChangedTimes[i] = now;
+    }
     
     setProperties(properties);
 }
@@ -134,6 +132,10 @@ void Particle::init(glm::vec3 position, float radius, rgbColor color, glm::vec3
     _modelTranslation = DEFAULT_MODEL_TRANSLATION;
     _modelRotation = DEFAULT_MODEL_ROTATION;
     _modelScale = DEFAULT_MODEL_SCALE;
+
+    for (int i = 0; i < PARTICLE_PROPERTY_COUNT; i++) {
+        _propertyChangedTimes[i] = now;
+    }
 }
 
 void Particle::setMass(float value) {
@@ -142,7 +144,26 @@ void Particle::setMass(float value) {
     }
 }
 
-bool Particle::appendParticleData(OctreePacketData* packetData) const {
+// the properties included in particle data from before particles were sent as their changed properties
+static ParticlePropertyFlags allParticleProperties() {
+    ParticlePropertyFlags properties;
+    for (int i = 0; i < PARTICLE_PROPERTY_COUNT; i++) {
+        properties += (ParticleProperty)i;
+    }
+    return properties;
+}
+
+ParticlePropertyFlags Particle::getChangedProperties(quint64 since) const {
+    ParticlePropertyFlags properties;
+    for (int i = 0; i < PARTICLE_PROPERTY_COUNT; i++) {
+        if (_propertyChangedTimes[i] >= since) {
+            properties += (ParticleProperty)i;
+        }
+    }
+    return properties;
+}
+
+bool Particle::appendParticleData(OctreePacketData* packetData, const ParticlePropertyFlags& properties) const {
 
     bool success = packetData->appendValue(getID());
 
@@ -157,34 +178,40 @@ bool Particle::appendParticleData(OctreePacketData* packetData) const {
     if (success) {
         success = packetData->appendValue(getLastEdited());
     }
+
+    // the properties included, followed by each of them
     if (success) {
+        QByteArray encodedProperties = properties.encode();
+        success = packetData->appendRawData((const unsigned char*)encodedProperties.constData(), encodedProperties.size());
+    }
+    if (success && properties.getHasProperty(PARTICLE_PROPERTY_RADIUS)) {
         success = packetData->appendValue(getRadius());
     }
-    if (success) {
+    if (success && properties.getHasProperty(PARTICLE_PROPERTY_POSITION)) {
         success = packetData->appendPosition(getPosition());
     }
-    if (success) {
+    if (success && properties.getHasProperty(PARTICLE_PROPERTY_COLOR)) {
         success = packetData->appendColor(getColor());
     }
-    if (success) {
+    if (success && properties.getHasProperty(PARTICLE_PROPERTY_VELOCITY)) {
         success = packetData->appendValue(getVelocity());
     }
-    if (success) {
+    if (success && properties.getHasProperty(PARTICLE_PROPERTY_GRAVITY)) {
         success = packetData->appendValue(getGravity());
     }
-    if (success) {
+    if (success && properties.getHasProperty(PARTICLE_PROPERTY_DAMPING)) {
         success = packetData->appendValue(getDamping());
     }
-    if (success) {
+    if (success && properties.getHasProperty(PARTICLE_PROPERTY_LIFETIME)) {
         success = packetData->appendValue(getLifetime());
     }
-    if (success) {
+    if (success && properties.getHasProperty(PARTICLE_PROPERTY_IN_HAND)) {
         success = packetData->appendValue(getInHand());
     }
-    if (success) {
+    if (success && properties.getHasProperty(PARTICLE_PROPERTY_SHOULD_DIE)) {
         success = packetData->appendValue(getShouldDie());
     }
-    if (success) {
+    if (success && properties.getHasProperty(PARTICLE_PROPERTY_SCRIPT)) {
         uint16_t scriptLength = _script.size() + 1; // include NULL
         success = packetData->appendValue(scriptLength);
         if (success) {
@@ -193,7 +220,7 @@ bool Particle::appendParticleData(OctreePacketData* packetData) const {
     }
 
     // modelURL
-    if (success) {
+    if (success && properties.getHasProperty(PARTICLE_PROPERTY_MODEL_URL)) {
         uint16_t modelURLLength = _modelURL.size() + 1; // include NULL
         success = packetData->appendValue(modelURLLength);
         if (success) {
@@ -202,16 +229,16 @@ bool Particle::appendParticleData(OctreePacketData* packetData) const {
     }
 
     // modelScale
-    if (success) {
+    if (success && properties.getHasProperty(PARTICLE_PROPERTY_MODEL_SCALE)) {
         success = packetData->appendValue(getModelScale());
     }
 
     // modelTranslation
-    if (success) {
+    if (success && properties.getHasProperty(PARTICLE_PROPERTY_MODEL_TRANSLATION)) {
         success = packetData->appendValue(getModelTranslation());
     }
     // modelRotation
-    if (success) {
+    if (success && properties.getHasProperty(PARTICLE_PROPERTY_MODEL_ROTATION)) {
         success = packetData->appendValue(getModelRotation());
     }
     return success;
@@ -222,19 +249,13 @@ int Particle::expectedBytes() {
                 + sizeof(float) // age
                 + sizeof(quint64) // last updated
                 + sizeof(quint64) // lasted edited
-                + sizeof(float) // radius
-                + sizeof(glm::vec3) // position
-                + sizeof(rgbColor) // color
-                + sizeof(glm::vec3) // velocity
-                + sizeof(glm::vec3) // gravity
-                + sizeof(float) // damping
-                + sizeof(float) // lifetime
-                + sizeof(bool); // inhand
+                + sizeof(uint8_t); // included properties
                 // potentially more...
     return expectedBytes;
 }
 
-int Particle::readParticleDataFromBuffer(const unsigned char* data, int bytesLeftToRead, ReadBitstreamToTreeParams& args) {
+int Particle::readParticleDataFromBuffer(const unsigned char* data, int bytesLeftToRead, ReadBitstreamToTreeParams& args,
+                                         bool* isComplete) {
     int bytesRead = 0;
     if (bytesLeftToRead >= expectedBytes()) {
         int clockSkew = args.sourceNode ? args.sourceNode->getClockSkewUsec() : 0;
@@ -265,85 +286,124 @@ int Particle::readParticleDataFromBuffer(const unsigned char* data, int bytesLef
         bytesRead += sizeof(_lastEdited);
         _lastEdited -= clockSkew;
 
+        // included properties; older versions include all of them
+        ParticlePropertyFlags properties = allParticleProperties();
+        if (args.bitstreamVersion >= VERSION_PARTICLES_HAVE_PROPERTY_FLAGS) {
+            int bytes = properties.decode(dataAt, bytesLeftToRead - bytesRead);
+            dataAt += bytes;
+            bytesRead += bytes;
+        }
+        if (isComplete) {
+            *isComplete = (properties == allParticleProperties());
+        }
+
         // radius
-        memcpy(&_radius, dataAt, sizeof(_radius));
-        dataAt += sizeof(_radius);
-        bytesRead += sizeof(_radius);
+        if (properties.getHasProperty(PARTICLE_PROPERTY_RADIUS)) {
+            memcpy(&_radius, dataAt, sizeof(_radius));
+            dataAt += sizeof(_radius);
+            bytesRead += sizeof(_radius);
+        }
 
         // position
-        memcpy(&_position, dataAt, sizeof(_position));
-        dataAt += sizeof(_position);
-        bytesRead += sizeof(_position);
+        if (properties.getHasProperty(PARTICLE_PROPERTY_POSITION)) {
+            memcpy(&_position, dataAt, sizeof(_position));
+            dataAt += sizeof(_position);
+            bytesRead += sizeof(_position);
+        }
 
         // color
-        memcpy(_color, dataAt, sizeof(_color));
-        dataAt += sizeof(_color);
-        bytesRead += sizeof(_color);
+        if (properties.getHasProperty(PARTICLE_PROPERTY_COLOR)) {
+            memcpy(_color, dataAt, sizeof(_color));
+            dataAt += sizeof(_color);
+            bytesRead += sizeof(_color);
+        }
 
         // velocity
-        memcpy(&_velocity, dataAt, sizeof(_velocity));
-        dataAt += sizeof(_velocity);
-        bytesRead += sizeof(_velocity);
+        if (properties.getHasProperty(PARTICLE_PROPERTY_VELOCITY)) {
+            memcpy(&_velocity, dataAt, sizeof(_velocity));
+            dataAt += sizeof(_velocity);
+            bytesRead += sizeof(_velocity);
+        }
 
         // gravity
-        memcpy(&_gravity, dataAt, sizeof(_gravity));
-        dataAt += sizeof(_gravity);
-        bytesRead += sizeof(_gravity);
+        if (properties.getHasProperty(PARTICLE_PROPERTY_GRAVITY)) {
+            memcpy(&_gravity, dataAt, sizeof(_gravity));
+            dataAt += sizeof(_gravity);
+            bytesRead += sizeof(_gravity);
+        }
 
         // damping
-        memcpy(&_damping, dataAt, sizeof(_damping));
-        dataAt += sizeof(_damping);
-        bytesRead += sizeof(_damping);
+        if (properties.getHasProperty(PARTICLE_PROPERTY_DAMPING)) {
+            memcpy(&_damping, dataAt, sizeof(_damping));
+            dataAt += sizeof(_damping);
+            bytesRead += sizeof(_damping);
+        }
 
         // lifetime
-        memcpy(&_lifetime, dataAt, sizeof(_lifetime));
-        dataAt += sizeof(_lifetime);
-        bytesRead += sizeof(_lifetime);
+        if (properties.getHasProperty(PARTICLE_PROPERTY_LIFETIME)) {
+            memcpy(&_lifetime, dataAt, sizeof(_lifetime));
+            dataAt += sizeof(_lifetime);
+            bytesRead += sizeof(_lifetime);
+        }
 
         // inHand
-        memcpy(&_inHand, dataAt, sizeof(_inHand));
-        dataAt += sizeof(_inHand);
-        bytesRead += sizeof(_inHand);
+        if (properties.getHasProperty(PARTICLE_PROPERTY_IN_HAND)) {
+            memcpy(&_inHand, dataAt, sizeof(_inHand));
+            dataAt += sizeof(_inHand);
+            bytesRead += sizeof(_inHand);
+        }
 
         // shouldDie
-        memcpy(&_shouldDie, dataAt, sizeof(_shouldDie));
-        dataAt += sizeof(_shouldDie);
-        bytesRead += sizeof(_shouldDie);
+        if (properties.getHasProperty(PARTICLE_PROPERTY_SHOULD_DIE)) {
+            memcpy(&_shouldDie, dataAt, sizeof(_shouldDie));
+            dataAt += sizeof(_shouldDie);
+            bytesRead += sizeof(_shouldDie);
+        }
 
         // script
-        uint16_t scriptLength;
-        memcpy(&scriptLength, dataAt, sizeof(scriptLength));
-        dataAt += sizeof(scriptLength);
-        bytesRead += sizeof(scriptLength);
-        QString tempString((const char*)dataAt);
-        _script = tempString;
-        dataAt += scriptLength;
-        bytesRead += scriptLength;
+        if (properties.getHasProperty(PARTICLE_PROPERTY_SCRIPT)) {
+            uint16_t scriptLength;
+            memcpy(&scriptLength, dataAt, sizeof(scriptLength));
+            dataAt += sizeof(scriptLength);
+            bytesRead += sizeof(scriptLength);
+            QString tempString((const char*)dataAt);
+            _script = tempString;
+            dataAt += scriptLength;
+            bytesRead += scriptLength;
+        }
 
         // modelURL
-        uint16_t modelURLLength;
-        memcpy(&modelURLLength, dataAt, sizeof(modelURLLength));
-        dataAt += sizeof(modelURLLength);
-        bytesRead += sizeof(modelURLLength);
-        QString modelURLString((const char*)dataAt);
-        _modelURL = modelURLString;
-        dataAt += modelURLLength;
-        bytesRead += modelURLLength;
+        if (properties.getHasProperty(PARTICLE_PROPERTY_MODEL_URL)) {
+            uint16_t modelURLLength;
+            memcpy(&modelURLLength, dataAt, sizeof(modelURLLength));
+            dataAt += sizeof(modelURLLength);
+            bytesRead += sizeof(modelURLLength);
+            QString modelURLString((const char*)dataAt);
+            _modelURL = modelURLString;
+            dataAt += modelURLLength;
+            bytesRead += modelURLLength;
+        }
 
         // modelScale
-        memcpy(&_modelScale, dataAt, sizeof(_modelScale));
-        dataAt += sizeof(_modelScale);
-        bytesRead += sizeof(_modelScale);
+        if (properties.getHasProperty(PARTICLE_PROPERTY_MODEL_SCALE)) {
+            memcpy(&_modelScale, dataAt, sizeof(_modelScale));
+            dataAt += sizeof(_modelScale);
+            bytesRead += sizeof(_modelScale);
+        }
 
         // modelTranslation
-        memcpy(&_modelTranslation, dataAt, sizeof(_modelTranslation));
-        dataAt += sizeof(_modelTranslation);
-        bytesRead += sizeof(_modelTranslation);
+        if (properties.getHasProperty(PARTICLE_PROPERTY_MODEL_TRANSLATION)) {
+            memcpy(&_modelTranslation, dataAt, sizeof(_modelTranslation));
+            dataAt += sizeof(_modelTranslation);
+            bytesRead += sizeof(_modelTranslation);
+        }
 
         // modelRotation
-        int bytes = unpackOrientationQuatFromBytes(dataAt, _modelRotation);
-        dataAt += bytes;
-        bytesRead += bytes;
+        if (properties.getHasProperty(PARTICLE_PROPERTY_MODEL_ROTATION)) {
+            int bytes = unpackOrientationQuatFromBytes(dataAt, _modelRotation);
+            dataAt += bytes;
+            bytesRead += bytes;
+        }
 
         //printf("Particle::readParticleDataFromBuffer()... "); debugDump();
     }
@@ -817,19 +877,29 @@ void Particle::applyHardCollision(const CollisionInfo& collisionInfo) {
     setVelocity(velocity);
 }
 
+void Particle::checkLifetime() {
+    if (getAge() > getLifetime()) {
+        setShouldDie(true);
+    }
+}
+
+bool Particle::isActive() const {
+    if (!_script.isEmpty()) {
+        return true;
+    }
+    // particles in hand don't move or fall; the others do, unless they're at rest (and above the ground)
+    return !getInHand() && (_velocity != glm::vec3(0.0f, 0.0f, 0.0f) || _gravity != glm::vec3(0.0f, 0.0f, 0.0f) ||
+        _position.y < 0.0f);
+}
+
 void Particle::update(const quint64& now) {
     float timeElapsed = (float)(now - _lastUpdated) / (float)(USECS_PER_SECOND);
     _lastUpdated = now;
 
-    // calculate our default shouldDie state... then allow script to change it if it wants...
-    bool isInHand = getInHand();
-    bool shouldDie = (getAge() > getLifetime()) || getShouldDie();
-    setShouldDie(shouldDie);
-
-    executeUpdateScripts(); // allow the javascript to alter our state
-
     // If the ball is in hand, it doesn't move or have gravity effect it
-    if (!isInHand) {
+    if (!getInHand()) {
+        _propertyChangedTimes[PARTICLE_PROPERTY_POSITION] = now;
+        _propertyChangedTimes[PARTICLE_PROPERTY_VELOCITY] = now;
         _position += _velocity * timeElapsed;
 
         // handle bounces off the ground...
@@ -848,59 +918,17 @@ void Particle::update(const quint64& now) {
     }
 }
 
-void Particle::startParticleScriptContext(ScriptEngine& engine, ParticleScriptObject& particleScriptable) {
-    if (_voxelEditSender) {
-        engine.getVoxelsScriptingInterface()->setPacketSender(_voxelEditSender);
-    }
-    if (_particleEditSender) {
-        engine.getParticlesScriptingInterface()->setPacketSender(_particleEditSender);
-    }
-
-    // Add the "this" Particle object
-    engine.registerGlobalObject("Particle", &particleScriptable);
-    engine.evaluate();
-}
-
-void Particle::endParticleScriptContext(ScriptEngine& engine, ParticleScriptObject& particleScriptable) {
-    if (_voxelEditSender) {
-        _voxelEditSender->releaseQueuedMessages();
-    }
-    if (_particleEditSender) {
-        _particleEditSender->releaseQueuedMessages();
-    }
-}
-
-void Particle::executeUpdateScripts() {
-    // Only run this particle script if there's a script attached directly to the particle.
-    if (!_script.isEmpty()) {
-        ScriptEngine engine(_script);
-        ParticleScriptObject particleScriptable(this);
-        startParticleScriptContext(engine, particleScriptable);
-        particleScriptable.emitUpdate();
-        endParticleScriptContext(engine, particleScriptable);
-    }
-}
-
 void Particle::collisionWithParticle(Particle* other, const glm::vec3& penetration) {
     // Only run this particle script if there's a script attached directly to the particle.
     if (!_script.isEmpty()) {
-        ScriptEngine engine(_script);
-        ParticleScriptObject particleScriptable(this);
-        startParticleScriptContext(engine, particleScriptable);
-        ParticleScriptObject otherParticleScriptable(other);
-        particleScriptable.emitCollisionWithParticle(&otherParticleScriptable, penetration);
-        endParticleScriptContext(engine, particleScriptable);
+        ParticleScriptPool::getInstance()->collisionWithParticle(this, other, penetration);
     }
 }
 
 void Particle::collisionWithVoxel(VoxelDetail* voxelDetails, const glm::vec3& penetration) {
     // Only run this particle script if there's a script attached directly to the particle.
     if (!_script.isEmpty()) {
-        ScriptEngine engine(_script);
-        ParticleScriptObject particleScriptable(this);
-        startParticleScriptContext(engine, particleScriptable);
-        particleScriptable.emitCollisionWithVoxel(*voxelDetails, penetration);
-        endParticleScriptContext(engine, particleScriptable);
+        ParticleScriptPool::getInstance()->collisionWithVoxel(this, *voxelDetails, penetration);
     }
 }
 
@@ -911,8 +939,59 @@ void Particle::setAge(float age) {
 
 void Particle::copyChangedProperties(const Particle& other) {
     float age = getAge();
+    Particle before = *this;
     *this = other;
     setAge(age);
+    stampChangedProperties(before);
+}
+
+void Particle::stampChangedProperties(const Particle& before) {
+    for (int i = 0; i < PARTICLE_PROPERTY_COUNT; i++) {
+        _propertyChangedTimes[i] = qMax(_propertyChangedTimes[i], before._propertyChangedTimes[i]);
+    }
+    quint64 now = usecTimestampNow();
+    if (_radius != before._radius) {
+        _propertyChangedTimes[PARTICLE_PROPERTY_RADIUS] = now;
+    }
+    if (_position != before._position) {
+        _propertyChangedTimes[PARTICLE_PROPERTY_POSITION] = now;
+    }
+    if (memcmp(_color, before._color, sizeof(_color)) != 0) {
+        _propertyChangedTimes[PARTICLE_PROPERTY_COLOR] = now;
+    }
+    if (_velocity != before._velocity) {
+        _propertyChangedTimes[PARTICLE_PROPERTY_VELOCITY] = now;
+    }
+    if (_gravity != before._gravity) {
+        _propertyChangedTimes[PARTICLE_PROPERTY_GRAVITY] = now;
+    }
+    if (_damping != before._damping) {
+        _propertyChangedTimes[PARTICLE_PROPERTY_DAMPING] = now;
+    }
+    if (_lifetime != before._lifetime) {
+        _propertyChangedTimes[PARTICLE_PROPERTY_LIFETIME] = now;
+    }
+    if (_inHand != before._inHand) {
+        _propertyChangedTimes[PARTICLE_PROPERTY_IN_HAND] = now;
+    }
+    if (_shouldDie != before._shouldDie) {
+        _propertyChangedTimes[PARTICLE_PROPERTY_SHOULD_DIE] = now;
+    }
+    if (_script != before._script) {
+        _propertyChangedTimes[PARTICLE_PROPERTY_SCRIPT] = now;
+    }
+    if (_modelURL != before._modelURL) {
+        _propertyChangedTimes[PARTICLE_PROPERTY_MODEL_URL] = now;
+    }
+    if (_modelScale != before._modelScale) {
+        _propertyChangedTimes[PARTICLE_PROPERTY_MODEL_SCALE] = now;
+    }
+    if (_modelTranslation != before._modelTranslation) {
+        _propertyChangedTimes[PARTICLE_PROPERTY_MODEL_TRANSLATION] = now;
+    }
+    if (_modelRotation != before._modelRotation) {
+        _propertyChangedTimes[PARTICLE_PROPERTY_MODEL_ROTATION] = now;
+    }
 }
 
 ParticleProperties Particle::getProperties() const {
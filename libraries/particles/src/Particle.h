@@ -21,6 +21,7 @@
 #include <CollisionInfo.h>
 #include <SharedUtil.h>
 #include <OctreePacketData.h>
+#include <PropertyFlags.h>
 
 class Particle;
 class ParticleEditPacketSender;
@@ -52,6 +53,30 @@ const uint16_t CONTAINS_MODEL_TRANSLATION = 1024;
 const uint16_t CONTAINS_MODEL_ROTATION = 2048;
 const uint16_t CONTAINS_MODEL_SCALE = 4096;
 
+/// The properties of a particle, in the order they're written in particle data packets.  Particles that a viewer already
+/// has are sent as the set of properties changed since they were last sent, followed by those properties.
+enum ParticleProperty {
+    PARTICLE_PROPERTY_RADIUS,
+    PARTICLE_PROPERTY_POSITION,
+    PARTICLE_PROPERTY_COLOR,
+    PARTICLE_PROPERTY_VELOCITY,
+    PARTICLE_PROPERTY_GRAVITY,
+    PARTICLE_PROPERTY_DAMPING,
+    PARTICLE_PROPERTY_LIFETIME,
+    PARTICLE_PROPERTY_IN_HAND,
+    PARTICLE_PROPERTY_SHOULD_DIE,
+    PARTICLE_PROPERTY_SCRIPT,
+    PARTICLE_PROPERTY_MODEL_URL,
+    PARTICLE_PROPERTY_MODEL_SCALE,
+    PARTICLE_PROPERTY_MODEL_TRANSLATION,
+    PARTICLE_PROPERTY_MODEL_ROTATION,
+    PARTICLE_PROPERTY_COUNT
+};
+
+typedef PropertyFlags<ParticleProperty> ParticlePropertyFlags;
+
+const PacketVersion VERSION_PARTICLES_HAVE_PROPERTY_FLAGS = 2;
+
 const float DEFAULT_LIFETIME = 10.0f; // particles live for 10 seconds by default
 const float DEFAULT_DAMPING = 0.99f;
 const float DEFAULT_RADIUS = 0.1f / TREE_SCALE;
@@ -238,6 +263,7 @@ public:
 
     /// The last updated/simulated time of this particle from the time perspective of the authoritative server/source
     quint64 getLastUpdated() const { return _lastUpdated; }
+    void setLastUpdated(quint64 lastUpdated) { _lastUpdated = lastUpdated; }
 
     /// The last edited time of this particle from the time perspective of the authoritative server/source
     quint64 getLastEdited() const { return _lastEdited; }
@@ -254,39 +280,57 @@ public:
     bool isNewlyCreated() const { return _newlyCreated; }
 
     /// set position in domain scale units (0.0 - 1.0)
-    void setPosition(const glm::vec3& value) { _position = value; }
+    void setPosition(const glm::vec3& value) { _position = value; propertyChanged(PARTICLE_PROPERTY_POSITION); }
 
     /// set velocity in domain scale units (0.0 - 1.0)
-    void setVelocity(const glm::vec3& value) { _velocity = value; }
-    void setColor(const rgbColor& value) { memcpy(_color, value, sizeof(_color)); }
+    void setVelocity(const glm::vec3& value) { _velocity = value; propertyChanged(PARTICLE_PROPERTY_VELOCITY); }
+    void setColor(const rgbColor& value) {
+            memcpy(_color, value, sizeof(_color));
+            propertyChanged(PARTICLE_PROPERTY_COLOR);
+    }
     void setColor(const xColor& value) {
             _color[RED_INDEX] = value.red;
             _color[GREEN_INDEX] = value.green;
             _color[BLUE_INDEX] = value.blue;
+            propertyChanged(PARTICLE_PROPERTY_COLOR);
     }
     /// set radius in domain scale units (0.0 - 1.0)
-    void setRadius(float value) { _radius = value; }
+    void setRadius(float value) { _radius = value; propertyChanged(PARTICLE_PROPERTY_RADIUS); }
     void setMass(float value);
 
     /// set gravity in domain scale units (0.0 - 1.0)
-    void setGravity(const glm::vec3& value) { _gravity = value; }
-    void setInHand(bool inHand) { _inHand = inHand; }
-    void setDamping(float value) { _damping = value; }
-    void setShouldDie(bool shouldDie) { _shouldDie = shouldDie; }
-    void setLifetime(float value) { _lifetime = value; }
-    void setScript(QString updateScript) { _script = updateScript; }
+    void setGravity(const glm::vec3& value) { _gravity = value; propertyChanged(PARTICLE_PROPERTY_GRAVITY); }
+    void setInHand(bool inHand) { _inHand = inHand; propertyChanged(PARTICLE_PROPERTY_IN_HAND); }
+    void setDamping(float value) { _damping = value; propertyChanged(PARTICLE_PROPERTY_DAMPING); }
+    void setShouldDie(bool shouldDie) { _shouldDie = shouldDie; propertyChanged(PARTICLE_PROPERTY_SHOULD_DIE); }
+    void setLifetime(float value) { _lifetime = value; propertyChanged(PARTICLE_PROPERTY_LIFETIME); }
+    void setScript(QString updateScript) { _script = updateScript; propertyChanged(PARTICLE_PROPERTY_SCRIPT); }
     void setCreatorTokenID(uint32_t creatorTokenID) { _creatorTokenID = creatorTokenID; }
     
     // model related properties
-    void setModelURL(const QString& url) { _modelURL = url; }
-    void setModelScale(float scale) { _modelScale = scale; }
-    void setModelTranslation(const glm::vec3&  translation) { _modelTranslation = translation; }
-    void setModelRotation(const glm::quat& rotation) { _modelRotation = rotation; }
+    void setModelURL(const QString& url) { _modelURL = url; propertyChanged(PARTICLE_PROPERTY_MODEL_URL); }
+    void setModelScale(float scale) { _modelScale = scale; propertyChanged(PARTICLE_PROPERTY_MODEL_SCALE); }
+    void setModelTranslation(const glm::vec3&  translation) {
+            _modelTranslation = translation;
+            propertyChanged(PARTICLE_PROPERTY_MODEL_TRANSLATION);
+    }
+    void setModelRotation(const glm::quat& rotation) {
+            _modelRotation = rotation;
+            propertyChanged(PARTICLE_PROPERTY_MODEL_ROTATION);
+    }
     
     void setProperties(const ParticleProperties& properties);
 
-    bool appendParticleData(OctreePacketData* packetData) const;
-    int readParticleDataFromBuffer(const unsigned char* data, int bytesLeftToRead, ReadBitstreamToTreeParams& args);
+    /// Returns the properties changed at or after the given time (all of them, for zero).
+    ParticlePropertyFlags getChangedProperties(quint64 since) const;
+
+    /// Appends the particle's id, age and timestamps, followed by the given properties.
+    bool appendParticleData(OctreePacketData* packetData, const ParticlePropertyFlags& properties) const;
+
+    /// Reads the properties included in the particle data over this particle's, so that a particle that's sent as its changed
+    /// properties can be read over the existing one.  If isComplete is given, it's set to whether every property was included.
+    int readParticleDataFromBuffer(const unsigned char* data, int bytesLeftToRead, ReadBitstreamToTreeParams& args,
+                                   bool* isComplete = NULL);
     static int expectedBytes();
 
     static bool encodeParticleEditMessageDetails(PacketType command, ParticleID id, const ParticleProperties& details,
@@ -296,6 +340,17 @@ public:
     
     void applyHardCollision(const CollisionInfo& collisionInfo);
 
+    /// Flags the particle to die if it has outlived its lifetime.  The tree calls this before running the update scripts
+    /// (in a batch, through the ParticleScriptPool), so that they can change their particles' fate.
+    void checkLifetime();
+
+    /// Returns the time (in usecs) at which the particle will have outlived its lifetime.
+    quint64 getExpiry() const { return _created + (quint64)(glm::max(_lifetime, 0.0f) * USECS_PER_SECOND); }
+
+    /// Checks whether the particle can change without being edited: whether it's moving, falling, or running a script.
+    /// Particles that aren't active are left alone by the update until they're edited or they expire.
+    bool isActive() const;
+
     void update(const quint64& now);
     void collisionWithParticle(Particle* other, const glm::vec3& penetration);
     void collisionWithVoxel(VoxelDetail* voxel, const glm::vec3& penetration);
@@ -324,12 +379,15 @@ protected:
     static VoxelEditPacketSender* _voxelEditSender;
     static ParticleEditPacketSender* _particleEditSender;
 
-    void startParticleScriptContext(ScriptEngine& engine, ParticleScriptObject& particleScriptable);
-    void endParticleScriptContext(ScriptEngine& engine, ParticleScriptObject& particleScriptable);
-    void executeUpdateScripts();
-
     void setAge(float age);
 
+    /// Stamps the property as changed now, so that it's sent to the viewers that were last sent the particle before now.
+    void propertyChanged(ParticleProperty property) { _propertyChangedTimes[property] = usecTimestampNow(); }
+
+    /// Keeps the later change time of each property between this particle and its earlier state, and stamps the properties
+    /// that differ from it as changed now.  Used when particles are replaced wholesale by edited copies.
+    void stampChangedProperties(const Particle& before);
+
     glm::vec3 _position;
     rgbColor _color;
     float _radius;
@@ -359,6 +417,8 @@ protected:
     // this doesn't go on the wire, we send it as lifetime
     quint64 _created;
 
+    quint64 _propertyChangedTimes[PARTICLE_PROPERTY_COUNT];
+
     // used by the static interfaces for creator token ids
     static uint32_t _nextCreatorTokenID;
     static std::map<uint32_t,uint32_t> _tokenIDsToIDs;
@@ -370,6 +430,10 @@ class ParticleScriptObject  : public QObject {
     Q_OBJECT
 public:
     ParticleScriptObject(Particle* particle) { _particle = particle; }
+    
+    /// Points this object at another particle (or at none, in which case the getters return defaults and the setters do
+    /// nothing).
+    void setParticle(Particle* particle) { _particle = particle; }
     //~ParticleScriptObject() { qDebug() << "~ParticleScriptObject() this=" << this; }
 
     void emitUpdate() { emit update(); }
@@ -379,45 +443,45 @@ public:
                 { emit collisionWithVoxel(voxel, penetration); }
 
 public slots:
-    unsigned int getID() const { return _particle->getID(); }
+    unsigned int getID() const { return _particle ? _particle->getID() : UNKNOWN_PARTICLE_ID; }
     
     /// get position in meter units
-    glm::vec3 getPosition() const { return _particle->getPosition() * (float)TREE_SCALE; }
+    glm::vec3 getPosition() const { return _particle ? _particle->getPosition() * (float)TREE_SCALE : glm::vec3(); }
 
     /// get velocity in meter units
-    glm::vec3 getVelocity() const { return _particle->getVelocity() * (float)TREE_SCALE; }
-    xColor getColor() const { return _particle->getXColor(); }
+    glm::vec3 getVelocity() const { return _particle ? _particle->getVelocity() * (float)TREE_SCALE : glm::vec3(); }
+    xColor getColor() const { return _particle ? _particle->getXColor() : xColor(); }
 
     /// get gravity in meter units
-    glm::vec3 getGravity() const { return _particle->getGravity() * (float)TREE_SCALE; }
+    glm::vec3 getGravity() const { return _particle ? _particle->getGravity() * (float)TREE_SCALE : glm::vec3(); }
 
-    float getDamping() const { return _particle->getDamping(); }
+    float getDamping() const { return _particle ? _particle->getDamping() : 0.0f; }
 
     /// get radius in meter units
-    float getRadius() const { return _particle->getRadius() * (float)TREE_SCALE; }
-    bool getShouldDie() { return _particle->getShouldDie(); }
-    float getAge() const { return _particle->getAge(); }
-    float getLifetime() const { return _particle->getLifetime(); }
-    ParticleProperties getProperties() const { return _particle->getProperties(); }
+    float getRadius() const { return _particle ? _particle->getRadius() * (float)TREE_SCALE : 0.0f; }
+    bool getShouldDie() { return _particle ? _particle->getShouldDie() : false; }
+    float getAge() const { return _particle ? _particle->getAge() : 0.0f; }
+    float getLifetime() const { return _particle ? _particle->getLifetime() : 0.0f; }
+    ParticleProperties getProperties() const { return _particle ? _particle->getProperties() : ParticleProperties(); }
 
     /// set position in meter units
-    void setPosition(glm::vec3 value) { _particle->setPosition(value / (float)TREE_SCALE); }
+    void setPosition(glm::vec3 value) { if (_particle) { _particle->setPosition(value / (float)TREE_SCALE); } }
 
     /// set velocity in meter units
-    void setVelocity(glm::vec3 value) { _particle->setVelocity(value / (float)TREE_SCALE); }
+    void setVelocity(glm::vec3 value) { if (_particle) { _particle->setVelocity(value / (float)TREE_SCALE); } }
 
     /// set gravity in meter units
-    void setGravity(glm::vec3 value) { _particle->setGravity(value / (float)TREE_SCALE); }
+    void setGravity(glm::vec3 value) { if (_particle) { _particle->setGravity(value / (float)TREE_SCALE); } }
     
-    void setDamping(float value) { _particle->setDamping(value); }
-    void setColor(xColor value) { _particle->setColor(value); }
+    void setDamping(float value) { if (_particle) { _particle->setDamping(value); } }
+    void setColor(xColor value) { if (_particle) { _particle->setColor(value); } }
 
     /// set radius in meter units
-    void setRadius(float value) { _particle->setRadius(value / (float)TREE_SCALE); }
-    void setShouldDie(bool value) { _particle->setShouldDie(value); }
-    void setScript(const QString& script) { _particle->setScript(script); }
-    void setLifetime(float value) const { return _particle->setLifetime(value); }
-    void setProperties(const ParticleProperties& properties) { return _particle->setProperties(properties); }
+    void setRadius(float value) { if (_particle) { _particle->setRadius(value / (float)TREE_SCALE); } }
+    void setShouldDie(bool value) { if (_particle) { _particle->setShouldDie(value); } }
+    void setScript(const QString& script) { if (_particle) { _particle->setScript(script); } }
+    void setLifetime(float value) const { if (_particle) { _particle->setLifetime(value); } }
+    void setProperties(const ParticleProperties& properties) { if (_particle) { _particle->setProperties(properties); } }
 
 signals:
     void update();
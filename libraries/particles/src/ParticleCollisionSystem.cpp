@@ -11,6 +11,7 @@
 
 #include <algorithm>
 #include <AbstractAudioInterface.h>
+#include <GeometryUtil.h>
 #include <VoxelTree.h>
 #include <AvatarData.h>
 #include <HeadData.h>
@@ -46,12 +47,11 @@ bool ParticleCollisionSystem::updateOperation(OctreeElement* element, void* extr
     ParticleCollisionSystem* system = static_cast<ParticleCollisionSystem*>(extraData);
     ParticleTreeElement* particleTreeElement = static_cast<ParticleTreeElement*>(element);
 
-    // iterate the particles...
+    // gather the particles...
     QList<Particle>& particles = particleTreeElement->getParticles();
     uint16_t numberOfParticles = particles.size();
     for (uint16_t i = 0; i < numberOfParticles; i++) {
-        Particle* particle = &particles[i];
-        system->checkParticle(particle);
+        system->_frameParticles.append(&particles[i]);
     }
 
     return true;
@@ -61,16 +61,53 @@ bool ParticleCollisionSystem::updateOperation(OctreeElement* element, void* extr
 void ParticleCollisionSystem::update() {
     // update all particles
     if (_particles->tryLockForRead()) {
+        _frameParticles.clear();
         _particles->recurseTreeWithOperation(updateOperation, this);
-        _particles->unlock();
-    }
-}
 
+        // test all of the particles against the voxels in a single pass
+        _voxelQueries.clear();
+        foreach (Particle* particle, _frameParticles) {
+            _voxelQueries.append(OctreeSphereQuery(particle->getPosition() * (float)(TREE_SCALE),
+                particle->getRadius() * (float)(TREE_SCALE)));
+        }
+        _voxels->findSpherePenetrations(_voxelQueries);
+        for (int i = 0; i < _voxelQueries.size(); i++) {
+            const OctreeSphereQuery& query = _voxelQueries.at(i);
+            if (query.found) {
+                applyCollisionWithVoxel(_frameParticles.at(i), query.penetration,
+                    static_cast<VoxelDetail*>(query.penetratedObject));
+            }
+        }
 
-void ParticleCollisionSystem::checkParticle(Particle* particle) {
-    updateCollisionWithVoxels(particle);
-    updateCollisionWithParticles(particle);
-    updateCollisionWithAvatars(particle);
+        // rather than searching the tree and every avatar for each particle, put the particles and the avatars' bounding
+        // spheres (in tree units) into the broadphase together, and only test the pairs that it finds near each other
+        _broadphase.clear();
+        foreach (Particle* particle, _frameParticles) {
+            _broadphase.addSphere(particle->getPosition(), particle->getRadius());
+        }
+        _frameAvatars.clear();
+        if (_avatars) {
+            foreach (const AvatarSharedPointer& avatarPointer, _avatars->getAvatarHash()) {
+                AvatarData* avatar = avatarPointer.data();
+                _frameAvatars.append(avatar);
+                _broadphase.addSphere(avatar->getPosition() / (float)TREE_SCALE,
+                    avatar->getBoundingRadius() / (float)TREE_SCALE);
+            }
+        }
+        _broadphase.findOverlappingPairs(_candidatePairs);
+
+        // the particles come first in the broadphase, so pairs of particles have both indices below the count
+        int particleCount = _frameParticles.size();
+        foreach (const IndexPair& pair, _candidatePairs) {
+            if (pair.second < particleCount) {
+                updateCollisionWithParticle(_frameParticles.at(pair.first), _frameParticles.at(pair.second));
+
+            } else if (pair.first < particleCount) {
+                updateCollisionWithAvatar(_frameParticles.at(pair.first), _frameAvatars.at(pair.second - particleCount));
+            }
+        }
+        _particles->unlock();
+    }
 }
 
 void ParticleCollisionSystem::emitGlobalParticleCollisionWithVoxel(Particle* particle, 
@@ -90,45 +127,51 @@ void ParticleCollisionSystem::emitGlobalParticleCollisionWithParticle(Particle*
 void ParticleCollisionSystem::updateCollisionWithVoxels(Particle* particle) {
     glm::vec3 center = particle->getPosition() * (float)(TREE_SCALE);
     float radius = particle->getRadius() * (float)(TREE_SCALE);
+    glm::vec3 penetration;
+    VoxelDetail* voxelDetails = NULL;
+    if (_voxels->findSpherePenetration(center, radius, penetration, (void**)&voxelDetails)) {
+        applyCollisionWithVoxel(particle, penetration, voxelDetails);
+    }
+}
+
+void ParticleCollisionSystem::applyCollisionWithVoxel(Particle* particle, const glm::vec3& penetration,
+        VoxelDetail* voxelDetails) {
     const float ELASTICITY = 0.4f;
     const float DAMPING = 0.05f;
     const float COLLISION_FREQUENCY = 0.5f;
     CollisionInfo collisionInfo;
     collisionInfo._damping = DAMPING;
     collisionInfo._elasticity = ELASTICITY;
-    VoxelDetail* voxelDetails = NULL;
-    if (_voxels->findSpherePenetration(center, radius, collisionInfo._penetration, (void**)&voxelDetails)) {
-
-        // let the particles run their collision scripts if they have them
-        particle->collisionWithVoxel(voxelDetails, collisionInfo._penetration);
-
-        // findSpherePenetration() only computes the penetration but we also want some other collision info
-        // so we compute it ourselves here.  Note that we must multiply scale by TREE_SCALE when feeding 
-        // the results to systems outside of this octree reference frame.
-        updateCollisionSound(particle, collisionInfo._penetration, COLLISION_FREQUENCY);
-        collisionInfo._contactPoint = (float)TREE_SCALE * (particle->getPosition() + particle->getRadius() * glm::normalize(collisionInfo._penetration));
-        // let the global script run their collision scripts for particles if they have them
-        emitGlobalParticleCollisionWithVoxel(particle, voxelDetails, collisionInfo);
-
-        // we must scale back down to the octree reference frame before updating the particle properties
-        collisionInfo._penetration /= (float)(TREE_SCALE);
-        collisionInfo._contactPoint /= (float)(TREE_SCALE);
-        particle->applyHardCollision(collisionInfo);
-        queueParticlePropertiesUpdate(particle);
-
-        delete voxelDetails; // cleanup returned details
-    }
+    collisionInfo._penetration = penetration;
+
+    // let the particles run their collision scripts if they have them
+    particle->collisionWithVoxel(voxelDetails, collisionInfo._penetration);
+
+    // findSpherePenetration() only computes the penetration but we also want some other collision info
+    // so we compute it ourselves here.  Note that we must multiply scale by TREE_SCALE when feeding 
+    // the results to systems outside of this octree reference frame.
+    updateCollisionSound(particle, collisionInfo._penetration, COLLISION_FREQUENCY);
+    collisionInfo._contactPoint = (float)TREE_SCALE * (particle->getPosition() + particle->getRadius() * glm::normalize(collisionInfo._penetration));
+    // let the global script run their collision scripts for particles if they have them
+    emitGlobalParticleCollisionWithVoxel(particle, voxelDetails, collisionInfo);
+
+    // we must scale back down to the octree reference frame before updating the particle properties
+    collisionInfo._penetration /= (float)(TREE_SCALE);
+    collisionInfo._contactPoint /= (float)(TREE_SCALE);
+    particle->applyHardCollision(collisionInfo);
+    wakeParticle(particle);
+    queueParticlePropertiesUpdate(particle);
+
+    delete voxelDetails; // cleanup returned details
 }
 
-void ParticleCollisionSystem::updateCollisionWithParticles(Particle* particleA) {
-    glm::vec3 center = particleA->getPosition() * (float)(TREE_SCALE);
-    float radius = particleA->getRadius() * (float)(TREE_SCALE);
+void ParticleCollisionSystem::updateCollisionWithParticle(Particle* particleA, Particle* particleB) {
     //const float ELASTICITY = 0.4f;
     //const float DAMPING = 0.0f;
     const float COLLISION_FREQUENCY = 0.5f;
     glm::vec3 penetration;
-    Particle* particleB;
-    if (_particles->findSpherePenetration(center, radius, penetration, (void**)&particleB, Octree::NoLock)) {
+    if (findSphereSpherePenetration(particleA->getPosition(), particleA->getRadius(),
+            particleB->getPosition(), particleB->getRadius(), penetration)) {
         // NOTE: 'penetration' is the depth that 'particleA' overlaps 'particleB'.  It points from A into B.
 
         // Even if the particles overlap... when the particles are already moving appart
@@ -176,6 +219,9 @@ void ParticleCollisionSystem::updateCollisionWithParticles(Particle* particleA)
 
             _packetSender->releaseQueuedMessages();
 
+            wakeParticle(particleA);
+            wakeParticle(particleB);
+
             updateCollisionSound(particleA, penetration, COLLISION_FREQUENCY);
         }
     }
@@ -185,9 +231,9 @@ void ParticleCollisionSystem::updateCollisionWithParticles(Particle* particleA)
 const float MIN_EXPECTED_FRAME_PERIOD = 0.0167f;  // 1/60th of a second
 const float HALTING_SPEED = 9.8 * MIN_EXPECTED_FRAME_PERIOD / (float)(TREE_SCALE);
 
-void ParticleCollisionSystem::updateCollisionWithAvatars(Particle* particle) {
+void ParticleCollisionSystem::updateCollisionWithAvatar(Particle* particle, AvatarData* avatar) {
     // particles that are in hand, don't collide with avatars
-    if (!_avatars || particle->getInHand()) {
+    if (particle->getInHand()) {
         return;
     }
 
@@ -196,41 +242,39 @@ void ParticleCollisionSystem::updateCollisionWithAvatars(Particle* particle) {
     const float ELASTICITY = 0.9f;
     const float DAMPING = 0.1f;
     const float COLLISION_FREQUENCY = 0.5f;
-    glm::vec3 penetration;
 
     _collisions.clear();
-    foreach (const AvatarSharedPointer& avatarPointer, _avatars->getAvatarHash()) {
-        AvatarData* avatar = avatarPointer.data();
-
-        float totalRadius = avatar->getBoundingRadius() + radius;
-        glm::vec3 relativePosition = center - avatar->getPosition();
-        if (glm::dot(relativePosition, relativePosition) > (totalRadius * totalRadius)) {
-            continue;
-        }
-
-        if (avatar->findSphereCollisions(center, radius, _collisions)) {
-            int numCollisions = _collisions.size();
-            for (int i = 0; i < numCollisions; ++i) {
-                CollisionInfo* collision = _collisions.getCollision(i);
-                collision->_damping = DAMPING;
-                collision->_elasticity = ELASTICITY;
-    
-                collision->_addedVelocity /= (float)(TREE_SCALE);
-                glm::vec3 relativeVelocity = collision->_addedVelocity - particle->getVelocity();
-    
-                if (glm::dot(relativeVelocity, collision->_penetration) <= 0.f) {
-                    // only collide when particle and collision point are moving toward each other
-                    // (doing this prevents some "collision snagging" when particle penetrates the object)
-                    updateCollisionSound(particle, collision->_penetration, COLLISION_FREQUENCY);
-                    collision->_penetration /= (float)(TREE_SCALE);
-                    particle->applyHardCollision(*collision);
-                    queueParticlePropertiesUpdate(particle);
-                }
+    if (avatar->findSphereCollisions(center, radius, _collisions)) {
+        int numCollisions = _collisions.size();
+        for (int i = 0; i < numCollisions; ++i) {
+            CollisionInfo* collision = _collisions.getCollision(i);
+            collision->_damping = DAMPING;
+            collision->_elasticity = ELASTICITY;
+
+            collision->_addedVelocity /= (float)(TREE_SCALE);
+            glm::vec3 relativeVelocity = collision->_addedVelocity - particle->getVelocity();
+
+            if (glm::dot(relativeVelocity, collision->_penetration) <= 0.f) {
+                // only collide when particle and collision point are moving toward each other
+                // (doing this prevents some "collision snagging" when particle penetrates the object)
+                updateCollisionSound(particle, collision->_penetration, COLLISION_FREQUENCY);
+                collision->_penetration /= (float)(TREE_SCALE);
+                particle->applyHardCollision(*collision);
+                wakeParticle(particle);
+                queueParticlePropertiesUpdate(particle);
             }
         }
     }
 }
 
+void ParticleCollisionSystem::wakeParticle(Particle* particle) {
+    // the particle may have been at rest, in which case the tree won't move it until the server echoes our edit back
+    ParticleTreeElement* element = _particles->getContainingElement(particle->getID());
+    if (element) {
+        _particles->elementEdited(element);
+    }
+}
+
 void ParticleCollisionSystem::queueParticlePropertiesUpdate(Particle* particle) {
     // queue the result for sending to the particle server
     ParticleProperties properties;
@@ -21,7 +21,9 @@
 #include <AvatarHashMap.h>
 #include <CollisionInfo.h>
 #include <SharedUtil.h>
+#include <Octree.h>
 #include <OctreePacketData.h>
+#include <SweepAndPrune.h>
 
 #include "Particle.h"
 
@@ -47,10 +49,17 @@ public:
 
     void update();
 
-    void checkParticle(Particle* particle);
     void updateCollisionWithVoxels(Particle* particle);
-    void updateCollisionWithParticles(Particle* particle);
-    void updateCollisionWithAvatars(Particle* particle);
+
+    /// Collides a particle with the voxels it penetrates, taking ownership of the details.
+    void applyCollisionWithVoxel(Particle* particle, const glm::vec3& penetration, VoxelDetail* voxelDetails);
+
+    /// Collides a pair of particles found by the broadphase, if they actually penetrate.
+    void updateCollisionWithParticle(Particle* particleA, Particle* particleB);
+
+    /// Collides a particle with an avatar whose bounds the broadphase found it near.
+    void updateCollisionWithAvatar(Particle* particle, AvatarData* avatar);
+
     void queueParticlePropertiesUpdate(Particle* particle);
     void updateCollisionSound(Particle* particle, const glm::vec3 &penetration, float frequency);
 
@@ -60,6 +69,10 @@ signals:
 
 private:
     static bool updateOperation(OctreeElement* element, void* extraData);
+
+    /// Makes sure the tree's next update moves a particle whose velocity a collision has changed.
+    void wakeParticle(Particle* particle);
+
     void emitGlobalParticleCollisionWithVoxel(Particle* particle, VoxelDetail* voxelDetails, const CollisionInfo& penetration);
     void emitGlobalParticleCollisionWithParticle(Particle* particleA, Particle* particleB, const CollisionInfo& penetration);
 
@@ -69,6 +82,13 @@ private:
     AbstractAudioInterface* _audio;
     AvatarHashMap* _avatars;
     CollisionList _collisions;
+
+    // per-frame broadphase state, kept to reuse the storage
+    SweepAndPrune _broadphase;
+    QVector<Particle*> _frameParticles;
+    QVector<AvatarData*> _frameAvatars;
+    QVector<IndexPair> _candidatePairs;
+    QVector<OctreeSphereQuery> _voxelQueries;
 };
 
 #endif // hifi_ParticleCollisionSystem_h
@@ -0,0 +1,137 @@
+//
+//  ParticleScriptPool.cpp
+//  libraries/particles/src
+//
+//  Copyright 2014 High Fidelity, Inc.
+//
+//  Distributed under the Apache License, Version 2.0.
+//  See the accompanying file LICENSE or http://www.apache.org/licenses/LICENSE-2.0.html
+//
+
+#include <QtCore/QThreadStorage>
+
+#include <VoxelsScriptingInterface.h>
+
+// This is not ideal, but adding script-engine as a linked library, will cause a circular reference
+// I'm open to other potential solutions. Could we change cmake to allow libraries to reference each others
+// headers, but not link to each other, this is essentially what this construct is doing, but would be
+// better to add includes to the include path, but not link
+#include "../../script-engine/src/ScriptEngine.h"
+
+#include "ParticleEditPacketSender.h"
+#include "ParticlesScriptingInterface.h"
+#include "ParticleScriptPool.h"
+
+// each engine costs a full interpreter, so only this many are kept around per thread
+const int MAX_SCRIPT_VMS = 32;
+
+ParticleScriptVM::ParticleScriptVM(const QString& script) :
+    _engine(new ScriptEngine(script)),
+    _program(script),
+    _particleScriptable(NULL),
+    _lastUsed(0) {
+
+    if (Particle::getVoxelEditPacketSender()) {
+        _engine->getVoxelsScriptingInterface()->setPacketSender(Particle::getVoxelEditPacketSender());
+    }
+    if (Particle::getParticleEditPacketSender()) {
+        _engine->getParticlesScriptingInterface()->setPacketSender(Particle::getParticleEditPacketSender());
+    }
+}
+
+ParticleScriptVM::~ParticleScriptVM() {
+    delete _particleScriptable;
+    delete _engine;
+}
+
+ParticleScriptObject& ParticleScriptVM::bind(Particle* particle) {
+    // a fresh object per particle, so that the handlers connected for the last one don't fire again for this one
+    delete _particleScriptable;
+    _particleScriptable = new ParticleScriptObject(particle);
+    _engine->registerGlobalObject("Particle", _particleScriptable);
+    _engine->evaluateProgram(_program);
+    return *_particleScriptable;
+}
+
+void ParticleScriptVM::unbind() {
+    delete _particleScriptable;
+    _particleScriptable = NULL;
+    _engine->stopAllTimers();
+}
+
+ParticleScriptPool* ParticleScriptPool::getInstance() {
+    static QThreadStorage<ParticleScriptPool*> pools;
+    if (!pools.hasLocalData()) {
+        pools.setLocalData(new ParticleScriptPool());
+    }
+    return pools.localData();
+}
+
+ParticleScriptPool::ParticleScriptPool() :
+    _useCounter(0) {
+}
+
+ParticleScriptPool::~ParticleScriptPool() {
+    qDeleteAll(_vms);
+}
+
+void ParticleScriptPool::update(const QVector<Particle*>& particles) {
+    QHash<QString, QVector<Particle*> > particlesByScript;
+    foreach (Particle* particle, particles) {
+        particlesByScript[particle->getScript()].append(particle);
+    }
+    for (QHash<QString, QVector<Particle*> >::const_iterator it = particlesByScript.constBegin();
+            it != particlesByScript.constEnd(); it++) {
+        ParticleScriptVM* vm = getVM(it.key());
+        foreach (Particle* particle, it.value()) {
+            vm->bind(particle).emitUpdate();
+        }
+        vm->unbind();
+    }
+    releaseQueuedMessages();
+}
+
+void ParticleScriptPool::collisionWithParticle(Particle* particle, Particle* other, const glm::vec3& penetration) {
+    ParticleScriptVM* vm = getVM(particle->getScript());
+    ParticleScriptObject otherParticleScriptable(other);
+    vm->bind(particle).emitCollisionWithParticle(&otherParticleScriptable, penetration);
+    vm->unbind();
+    releaseQueuedMessages();
+}
+
+void ParticleScriptPool::collisionWithVoxel(Particle* particle, const VoxelDetail& voxelDetails,
+        const glm::vec3& penetration) {
+    ParticleScriptVM* vm = getVM(particle->getScript());
+    vm->bind(particle).emitCollisionWithVoxel(voxelDetails, penetration);
+    vm->unbind();
+    releaseQueuedMessages();
+}
+
+ParticleScriptVM* ParticleScriptPool::getVM(const QString& script) {
+    ParticleScriptVM* vm = _vms.value(script);
+    if (!vm) {
+        if (_vms.size() >= MAX_SCRIPT_VMS) {
+            QHash<QString, ParticleScriptVM*>::iterator leastRecentlyUsed = _vms.begin();
+            for (QHash<QString, ParticleScriptVM*>::iterator it = _vms.begin(); it != _vms.end(); it++) {
+                if (it.value()->getLastUsed() < leastRecentlyUsed.value()->getLastUsed()) {
+                    leastRecentlyUsed = it;
+                }
+            }
+            delete leastRecentlyUsed.value();
+            _vms.erase(leastRecentlyUsed);
+        }
+        vm = new ParticleScriptVM(script);
+        _vms.insert(script, vm);
+    }
+    vm->setLastUsed(++_useCounter);
+    return vm;
+}
+
+void ParticleScriptPool::releaseQueuedMessages() {
+    if (Particle::getVoxelEditPacketSender()) {
+        Particle::getVoxelEditPacketSender()->releaseQueuedMessages();
+    }
+    if (Particle::getParticleEditPacketSender()) {
+        Particle::getParticleEditPacketSender()->releaseQueuedMessages();
+    }
+}
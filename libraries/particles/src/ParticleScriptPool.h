@@ -0,0 +1,85 @@
+//
+//  ParticleScriptPool.h
+//  libraries/particles/src
+//
+//  Copyright 2014 High Fidelity, Inc.
+//
+//  Reusable script engines for particle scripts
+//
+//  Distributed under the Apache License, Version 2.0.
+//  See the accompanying file LICENSE or http://www.apache.org/licenses/LICENSE-2.0.html
+//
+
+#ifndef hifi_ParticleScriptPool_h
+#define hifi_ParticleScriptPool_h
+
+#include <QtCore/QHash>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+#include <QtScript/QScriptProgram>
+
+#include "Particle.h"
+
+/// A script engine for one particle script.  The engine is set up and the script compiled once, but the script's top-level
+/// program runs again for each particle it's bound to (with a "Particle" object for just that particle), as it did when
+/// every particle had its own engine: scripts act on the particle at top level as well as connecting handlers to its
+/// signals.
+class ParticleScriptVM {
+public:
+
+    ParticleScriptVM(const QString& script);
+    ~ParticleScriptVM();
+
+    /// Runs the script's top-level program for the supplied particle and returns the object through which its handlers
+    /// are called.
+    ParticleScriptObject& bind(Particle* particle);
+
+    /// Releases the particle bound last (along with the handlers connected for it) and cancels any timers the script set
+    /// while running: before engines were reused, they never outlived the call.
+    void unbind();
+
+    quint64 getLastUsed() const { return _lastUsed; }
+    void setLastUsed(quint64 lastUsed) { _lastUsed = lastUsed; }
+
+private:
+
+    ScriptEngine* _engine;
+    QScriptProgram _program;
+    ParticleScriptObject* _particleScriptable;
+    quint64 _lastUsed;
+};
+
+/// Keeps one engine per distinct script source, so that each script is compiled once rather than every time a particle runs
+/// it.  Engines can only be used on the thread that created them, so each thread has its own pool.  Note that scripts now
+/// share their global variables between the particles running them (and between calls), so per-particle state belongs on
+/// the particle itself.
+class ParticleScriptPool {
+public:
+
+    /// Returns the pool for the current thread.
+    static ParticleScriptPool* getInstance();
+
+    ParticleScriptPool();
+    ~ParticleScriptPool();
+
+    /// Runs the update handlers for the supplied particles, grouped by script so that each engine is set up once.
+    void update(const QVector<Particle*>& particles);
+
+    void collisionWithParticle(Particle* particle, Particle* other, const glm::vec3& penetration);
+    void collisionWithVoxel(Particle* particle, const VoxelDetail& voxelDetails, const glm::vec3& penetration);
+
+    int getVMCount() const { return _vms.size(); }
+
+private:
+
+    /// Returns the engine for the script, creating it (and evicting the least recently used one, if over the limit) as
+    /// necessary.
+    ParticleScriptVM* getVM(const QString& script);
+
+    void releaseQueuedMessages();
+
+    QHash<QString, ParticleScriptVM*> _vms;
+    quint64 _useCounter;
+};
+
+#endif // hifi_ParticleScriptPool_h
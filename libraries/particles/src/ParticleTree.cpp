@@ -9,12 +9,19 @@
 //  See the accompanying file LICENSE or http://www.apache.org/licenses/LICENSE-2.0.html
 //
 
+#include "ParticleScriptPool.h"
 #include "ParticleTree.h"
 
 ParticleTree::ParticleTree(bool shouldReaverage) : Octree(shouldReaverage) {
     _rootElement = createNewElement();
 }
 
+ParticleTree::~ParticleTree() {
+    // the elements forget their particles as they're deleted, so delete them while our index is still around
+    delete _rootElement;
+    _rootElement = NULL;
+}
+
 ParticleTreeElement* ParticleTree::createNewElement(unsigned char * octalCode) {
     ParticleTreeElement* newElement = new ParticleTreeElement(octalCode);
     newElement->setTree(this);
@@ -32,49 +39,6 @@ bool ParticleTree::handlesEditPacketType(PacketType packetType) const {
     }
 }
 
-class FindAndDeleteParticlesArgs {
-public:
-    QList<uint32_t> _idsToDelete;
-};
-
-bool ParticleTree::findAndDeleteOperation(OctreeElement* element, void* extraData) {
-    //qDebug() << "findAndDeleteOperation()";
-
-    FindAndDeleteParticlesArgs* args = static_cast< FindAndDeleteParticlesArgs*>(extraData);
-
-    // if we've found and deleted all our target particles, then we can stop looking
-    if (args->_idsToDelete.size() <= 0) {
-        return false;
-    }
-
-    ParticleTreeElement* particleTreeElement = static_cast<ParticleTreeElement*>(element);
-
-    //qDebug() << "findAndDeleteOperation() args->_idsToDelete.size():" << args->_idsToDelete.size();
-
-    for (QList<uint32_t>::iterator it = args->_idsToDelete.begin(); it != args->_idsToDelete.end(); it++) {
-        uint32_t particleID = *it;
-        //qDebug() << "findAndDeleteOperation() particleID:" << particleID;
-
-        if (particleTreeElement->removeParticleWithID(particleID)) {
-            // if the particle was in this element, then remove it from our search list.
-            //qDebug() << "findAndDeleteOperation() it = args->_idsToDelete.erase(it)";
-            it = args->_idsToDelete.erase(it);
-        }
-
-        if (it == args->_idsToDelete.end()) {
-            //qDebug() << "findAndDeleteOperation() breaking";
-            break;
-        }
-    }
-
-    // if we've found and deleted all our target particles, then we can stop looking
-    if (args->_idsToDelete.size() <= 0) {
-        return false;
-    }
-    return true;
-}
-
-
 class FindAndUpdateParticleArgs {
 public:
     const Particle& searchParticle;
@@ -95,7 +59,12 @@ bool ParticleTree::findAndUpdateOperation(OctreeElement* element, void* extraDat
 void ParticleTree::storeParticle(const Particle& particle, const SharedNodePointer& senderNode) {
     // First, look for the existing particle in the tree..
     FindAndUpdateParticleArgs args = { particle, false };
-    recurseTreeWithOperation(findAndUpdateOperation, &args);
+    if (particle.getID() == NEW_PARTICLE) {
+        recurseTreeWithOperation(findAndUpdateOperation, &args);
+    } else {
+        ParticleTreeElement* element = getContainingElement(particle.getID());
+        args.found = element && element->updateParticle(particle);
+    }
 
     // if we didn't find it in the tree, then store it...
     if (!args.found) {
@@ -136,7 +105,13 @@ bool ParticleTree::findAndUpdateWithIDandPropertiesOperation(OctreeElement* elem
 void ParticleTree::updateParticle(const ParticleID& particleID, const ParticleProperties& properties) {
     // First, look for the existing particle in the tree..
     FindAndUpdateParticleWithIDandPropertiesArgs args = { particleID, properties, false };
-    recurseTreeWithOperation(findAndUpdateWithIDandPropertiesOperation, &args);
+    if (particleID.isKnownID) {
+        ParticleTreeElement* element = getContainingElement(particleID.id);
+        args.found = element && element->updateParticle(particleID, properties);
+    } else {
+        // particles still waiting for their IDs can only be found by their creator token IDs
+        recurseTreeWithOperation(findAndUpdateWithIDandPropertiesOperation, &args);
+    }
     // if we found it in the tree, then mark the tree as dirty
     if (args.found) {
         _isDirty = true;
@@ -160,9 +135,45 @@ void ParticleTree::addParticle(const ParticleID& particleID, const ParticlePrope
 
 void ParticleTree::deleteParticle(const ParticleID& particleID) {
     if (particleID.isKnownID) {
-        FindAndDeleteParticlesArgs args;
-        args._idsToDelete.push_back(particleID.id);
-        recurseTreeWithOperation(findAndDeleteOperation, &args);
+        ParticleTreeElement* element = getContainingElement(particleID.id);
+        if (element) {
+            element->removeParticleWithID(particleID.id);
+        }
+    }
+}
+
+void ParticleTree::setContainingElement(uint32_t particleID, ParticleTreeElement* element) {
+    if (particleID != NEW_PARTICLE) {
+        _particleIndex.insert(particleID, element);
+    }
+}
+
+void ParticleTree::clearContainingElement(uint32_t particleID, ParticleTreeElement* element) {
+    _particleIndex.remove(particleID, element);
+}
+
+void ParticleTree::elementEdited(ParticleTreeElement* element) {
+    markPathChanged(element);
+    cancelExpiry(element);
+    _activeElements.insert(element);
+}
+
+void ParticleTree::forgetElement(ParticleTreeElement* element) {
+    cancelExpiry(element);
+    _activeElements.remove(element);
+}
+
+void ParticleTree::scheduleExpiry(ParticleTreeElement* element, quint64 expiry) {
+    cancelExpiry(element);
+    _expiringElements.insert(expiry, element);
+    _elementExpiries.insert(element, expiry);
+}
+
+void ParticleTree::cancelExpiry(ParticleTreeElement* element) {
+    QHash<ParticleTreeElement*, quint64>::iterator it = _elementExpiries.find(element);
+    if (it != _elementExpiries.end()) {
+        _expiringElements.remove(it.value(), element);
+        _elementExpiries.erase(it);
     }
 }
 
@@ -340,49 +351,16 @@ void ParticleTree::findParticlesForUpdate(const AACube& cube, QVector<Particle*>
     foundParticles.swap(args._foundParticles);
 }
 
-class FindByIDArgs {
-public:
-    uint32_t id;
-    bool found;
-    const Particle* foundParticle;
-};
-
-
-bool ParticleTree::findByIDOperation(OctreeElement* element, void* extraData) {
-//qDebug() << "ParticleTree::findByIDOperation()....";
-
-    FindByIDArgs* args = static_cast<FindByIDArgs*>(extraData);
-    ParticleTreeElement* particleTreeElement = static_cast<ParticleTreeElement*>(element);
-
-    // if already found, stop looking
-    if (args->found) {
-        return false;
-    }
-
-    // as the tree element if it has this particle
-    const Particle* foundParticle = particleTreeElement->getParticleWithID(args->id);
-    if (foundParticle) {
-        args->foundParticle = foundParticle;
-        args->found = true;
-        return false;
-    }
-
-    // keep looking
-    return true;
-}
-
-
 const Particle* ParticleTree::findParticleByID(uint32_t id, bool alreadyLocked) {
-    FindByIDArgs args = { id, false, NULL };
-
     if (!alreadyLocked) {
         lockForRead();
     }
-    recurseTreeWithOperation(findByIDOperation, &args);
+    ParticleTreeElement* element = getContainingElement(id);
+    const Particle* foundParticle = element ? element->getParticleWithID(id) : NULL;
     if (!alreadyLocked) {
         unlock();
     }
-    return args.foundParticle;
+    return foundParticle;
 }
 
 
@@ -442,13 +420,6 @@ void ParticleTree::removeNewlyCreatedHook(NewlyCreatedParticleHook* hook) {
 }
 
 
-bool ParticleTree::updateOperation(OctreeElement* element, void* extraData) {
-    ParticleTreeUpdateArgs* args = static_cast<ParticleTreeUpdateArgs*>(extraData);
-    ParticleTreeElement* particleTreeElement = static_cast<ParticleTreeElement*>(element);
-    particleTreeElement->update(*args);
-    return true;
-}
-
 bool ParticleTree::pruneOperation(OctreeElement* element, void* extraData) {
     ParticleTreeElement* particleTreeElement = static_cast<ParticleTreeElement*>(element);
     for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
@@ -462,10 +433,54 @@ bool ParticleTree::pruneOperation(OctreeElement* element, void* extraData) {
 
 void ParticleTree::update() {
     lockForWrite();
-    _isDirty = true;
 
-    ParticleTreeUpdateArgs args = { };
-    recurseTreeWithOperation(updateOperation, &args);
+    // wake the elements whose particles were at rest, but have now outlived their lifetimes
+    quint64 now = usecTimestampNow();
+    while (!_expiringElements.isEmpty() && _expiringElements.begin().key() <= now) {
+        ParticleTreeElement* element = _expiringElements.begin().value();
+        _expiringElements.erase(_expiringElements.begin());
+        _elementExpiries.remove(element);
+        _activeElements.insert(element);
+    }
+
+    // nothing to do if everything is at rest
+    if (_activeElements.isEmpty()) {
+        unlock();
+        return;
+    }
+
+    // storing the moving particles below may activate elements, so work from a copy of the set
+    QList<ParticleTreeElement*> activeElements = _activeElements.toList();
+    ParticleTreeUpdateArgs args;
+    foreach (ParticleTreeElement* element, activeElements) {
+        element->prepareForUpdate(args);
+    }
+
+    // allow the javascript to alter the state of the particles, one engine per distinct script
+    if (!args._scriptedParticles.isEmpty()) {
+        ParticleScriptPool::getInstance()->update(args._scriptedParticles);
+        args._scriptedParticles.clear();
+    }
+
+    bool needsPruning = false;
+    foreach (ParticleTreeElement* element, activeElements) {
+        if (element->update(args)) {
+            continue;
+        }
+        // the element has come to rest: stop visiting it until it's edited or one of its particles expires
+        _activeElements.remove(element);
+        if (element->hasParticles()) {
+            scheduleExpiry(element, element->getNextExpiry());
+        } else {
+            needsPruning = true;
+        }
+    }
+    foreach (ParticleTreeElement* element, args._changedElements) {
+        markPathChanged(element);
+    }
+    if (!args._changedElements.isEmpty()) {
+        _isDirty = true;
+    }
 
     // now add back any of the particles that moved elements....
     int movingParticles = args._movingParticles.size();
@@ -479,42 +494,44 @@ void ParticleTree::update() {
             storeParticle(args._movingParticles[i]);
         } else {
             uint32_t particleID = args._movingParticles[i].getID();
-            quint64 deletedAt = usecTimestampNow();
-            _recentlyDeletedParticlesLock.lockForWrite();
-            _recentlyDeletedParticleIDs.insert(deletedAt, particleID);
-            _recentlyDeletedParticlesLock.unlock();
+            _deletedParticlesLock.lockForWrite();
+            _deletedParticles.itemDeleted(particleID);
+            _deletedParticlesLock.unlock();
         }
     }
 
-    // prune the tree...
-    recurseTreeWithOperation(pruneOperation, NULL);
+    // prune the tree, if any elements were emptied...
+    if (needsPruning) {
+        recurseTreeWithOperation(pruneOperation, NULL);
+    }
     unlock();
 }
 
 
-bool ParticleTree::hasParticlesDeletedSince(quint64 sinceTime) {
-    // we can probably leverage the ordered nature of QMultiMap to do this quickly...
-    bool hasSomethingNewer = false;
+bool ParticleTree::hasAnyDeletedParticles() {
+    QReadLocker locker(&_deletedParticlesLock);
+    return _deletedParticles.hasAnyDeleted();
+}
 
-    _recentlyDeletedParticlesLock.lockForRead();
-    QMultiMap<quint64, uint32_t>::const_iterator iterator = _recentlyDeletedParticleIDs.constBegin();
-    while (iterator != _recentlyDeletedParticleIDs.constEnd()) {
-        //qDebug() << "considering... time/key:" << iterator.key();
-        if (iterator.key() > sinceTime) {
-            //qDebug() << "YES newer... time/key:" << iterator.key();
-            hasSomethingNewer = true;
-        }
-        ++iterator;
-    }
-    _recentlyDeletedParticlesLock.unlock();
-    return hasSomethingNewer;
+bool ParticleTree::hasParticlesDeletedSince(quint64 sinceSequence) {
+    QReadLocker locker(&_deletedParticlesLock);
+    return _deletedParticles.hasDeletedSince(sinceSequence);
 }
 
-// sinceTime is an in/out parameter - it will be side effected with the last time sent out
-bool ParticleTree::encodeParticlesDeletedSince(OCTREE_PACKET_SEQUENCE sequenceNumber, quint64& sinceTime, unsigned char* outputBuffer,
-                                                size_t maxLength, size_t& outputLength) {
+quint64 ParticleTree::getNextDeletedParticleSequence() {
+    QReadLocker locker(&_deletedParticlesLock);
+    return _deletedParticles.getNextSequence();
+}
+
+// sinceSequence is an in/out parameter - it will be advanced past the particles appended
+void ParticleTree::getParticlesDeletedSince(quint64& sinceSequence, QVector<uint32_t>& particleIDs) {
+    QReadLocker locker(&_deletedParticlesLock);
+    _deletedParticles.getDeletedSince(sinceSequence, particleIDs);
+}
 
-    bool hasMoreToSend = true;
+// returns the index of the first particle ID that didn't fit in the packet
+int ParticleTree::encodeDeletedParticles(OCTREE_PACKET_SEQUENCE sequenceNumber, const QVector<uint32_t>& particleIDs,
+                                         int firstID, unsigned char* outputBuffer, size_t maxLength, size_t& outputLength) {
 
     unsigned char* copyAt = outputBuffer;
     size_t numBytesPacketHeader = populatePacketHeader(reinterpret_cast<char*>(outputBuffer), PacketTypeParticleErase);
@@ -538,82 +555,32 @@ bool ParticleTree::encodeParticlesDeletedSince(OCTREE_PACKET_SEQUENCE sequenceNu
     copyAt += sizeof(OCTREE_PACKET_SENT_TIME);
     outputLength += sizeof(OCTREE_PACKET_SENT_TIME);
 
-
     uint16_t numberOfIds = 0; // placeholder for now
     unsigned char* numberOfIDsAt = copyAt;
     memcpy(copyAt, &numberOfIds, sizeof(numberOfIds));
     copyAt += sizeof(numberOfIds);
     outputLength += sizeof(numberOfIds);
 
-    // we keep a multi map of particle IDs to timestamps, we only want to include the particle IDs that have been
-    // deleted since we last sent to this node
-    _recentlyDeletedParticlesLock.lockForRead();
-    QMultiMap<quint64, uint32_t>::const_iterator iterator = _recentlyDeletedParticleIDs.constBegin();
-    while (iterator != _recentlyDeletedParticleIDs.constEnd()) {
-        QList<uint32_t> values = _recentlyDeletedParticleIDs.values(iterator.key());
-        for (int valueItem = 0; valueItem < values.size(); ++valueItem) {
-
-            // if the timestamp is more recent then out last sent time, include it
-            if (iterator.key() > sinceTime) {
-                uint32_t particleID = values.at(valueItem);
-                memcpy(copyAt, &particleID, sizeof(particleID));
-                copyAt += sizeof(particleID);
-                outputLength += sizeof(particleID);
-                numberOfIds++;
-
-                // check to make sure we have room for one more id...
-                if (outputLength + sizeof(uint32_t) > maxLength) {
-                    break;
-                }
-            }
-        }
-
-        // check to make sure we have room for one more id...
-        if (outputLength + sizeof(uint32_t) > maxLength) {
-
-            // let our caller know how far we got
-            sinceTime = iterator.key();
-            break;
-        }
-        ++iterator;
-    }
-
-    // if we got to the end, then we're done sending
-    if (iterator == _recentlyDeletedParticleIDs.constEnd()) {
-        hasMoreToSend = false;
+    // pack in as many of the IDs as there's room for
+    int nextID = firstID;
+    while (nextID < particleIDs.size() && outputLength + sizeof(uint32_t) <= maxLength) {
+        uint32_t particleID = particleIDs.at(nextID++);
+        memcpy(copyAt, &particleID, sizeof(particleID));
+        copyAt += sizeof(particleID);
+        outputLength += sizeof(particleID);
+        numberOfIds++;
     }
-    _recentlyDeletedParticlesLock.unlock();
 
     // replace the correct count for ids included
     memcpy(numberOfIDsAt, &numberOfIds, sizeof(numberOfIds));
 
-    return hasMoreToSend;
+    return nextID;
 }
 
-// called by the server when it knows all nodes have been sent deleted packets
-
-void ParticleTree::forgetParticlesDeletedBefore(quint64 sinceTime) {
-    //qDebug() << "forgetParticlesDeletedBefore()";
-    QSet<quint64> keysToRemove;
-
-    _recentlyDeletedParticlesLock.lockForWrite();
-    QMultiMap<quint64, uint32_t>::iterator iterator = _recentlyDeletedParticleIDs.begin();
-
-    // First find all the keys in the map that are older and need to be deleted
-    while (iterator != _recentlyDeletedParticleIDs.end()) {
-        if (iterator.key() <= sinceTime) {
-            keysToRemove << iterator.key();
-        }
-        ++iterator;
-    }
-
-    // Now run through the keysToRemove and remove them
-    foreach (quint64 value, keysToRemove) {
-        //qDebug() << "removing the key, _recentlyDeletedParticleIDs.remove(value); time/key:" << value;
-        _recentlyDeletedParticleIDs.remove(value);
-    }
-    
-    _recentlyDeletedParticlesLock.unlock();
+// called by the server when it knows all nodes have been sent the deletions before sinceSequence
+void ParticleTree::forgetParticlesDeletedBefore(quint64 sinceSequence) {
+    QWriteLocker locker(&_deletedParticlesLock);
+    _deletedParticles.forgetDeletedBefore(sinceSequence);
 }
 
 
@@ -637,8 +604,6 @@ void ParticleTree::processEraseMessage(const QByteArray& dataByteArray, const Sh
     processedBytes += sizeof(numberOfIds);
 
     if (numberOfIds > 0) {
-        FindAndDeleteParticlesArgs args;
-
         for (size_t i = 0; i < numberOfIds; i++) {
             if (processedBytes + sizeof(uint32_t) > packetLength) {
                 break; // bail to prevent buffer overflow
@@ -649,10 +614,10 @@ void ParticleTree::processEraseMessage(const QByteArray& dataByteArray, const Sh
             dataAt += sizeof(particleID);
             processedBytes += sizeof(particleID);
 
-            args._idsToDelete.push_back(particleID);
+            ParticleTreeElement* element = getContainingElement(particleID);
+            if (element) {
+                element->removeParticleWithID(particleID);
+            }
         }
-
-        // calling recurse to actually delete the particles
-        recurseTreeWithOperation(findAndDeleteOperation, &args);
     }
 }
@@ -13,6 +13,10 @@
 #define hifi_ParticleTree_h
 
 #include <Octree.h>
+#include <QSet>
+
+#include <OctreeDeletionLog.h>
+#include <OctreeItemIndex.h>
 #include "ParticleTreeElement.h"
 
 class NewlyCreatedParticleHook {
@@ -24,6 +28,7 @@ class ParticleTree : public Octree {
     Q_OBJECT
 public:
     ParticleTree(bool shouldReaverage = false);
+    virtual ~ParticleTree();
 
     /// Implements our type specific root element factory
     virtual ParticleTreeElement* createNewElement(unsigned char * octalCode = NULL);
@@ -36,6 +41,7 @@ public:
     // own definition. Implement these to allow your octree based server to support editing
     virtual bool getWantSVOfileVersions() const { return true; }
     virtual PacketType expectedDataPacketType() const { return PacketTypeParticleData; }
+    virtual bool canProcessVersion(PacketVersion thisVersion) const { return true; } // we support all versions
     virtual bool handlesEditPacketType(PacketType packetType) const;
     virtual int processEditPacketData(PacketType packetType, const unsigned char* packetData, int packetLength,
                     const unsigned char* editData, int maxLength, const SharedNodePointer& senderNode);
@@ -65,35 +71,61 @@ public:
     void addNewlyCreatedHook(NewlyCreatedParticleHook* hook);
     void removeNewlyCreatedHook(NewlyCreatedParticleHook* hook);
 
-    bool hasAnyDeletedParticles() const { return _recentlyDeletedParticleIDs.size() > 0; }
-    bool hasParticlesDeletedSince(quint64 sinceTime);
-    bool encodeParticlesDeletedSince(OCTREE_PACKET_SEQUENCE sequenceNumber, quint64& sinceTime, unsigned char* packetData, size_t maxLength, size_t& outputLength);
-    void forgetParticlesDeletedBefore(quint64 sinceTime);
+    /// The deleted particles are logged with sequence numbers, and each viewer keeps the sequence number it has been sent
+    /// them up to; see OctreeDeletionLog.
+    bool hasAnyDeletedParticles();
+    bool hasParticlesDeletedSince(quint64 sinceSequence);
+    quint64 getNextDeletedParticleSequence();
+    void getParticlesDeletedSince(quint64& sinceSequence, QVector<uint32_t>& particleIDs);
+    int encodeDeletedParticles(OCTREE_PACKET_SEQUENCE sequenceNumber, const QVector<uint32_t>& particleIDs, int firstID,
+                               unsigned char* outputBuffer, size_t maxLength, size_t& outputLength);
+    void forgetParticlesDeletedBefore(quint64 sinceSequence);
 
     void processEraseMessage(const QByteArray& dataByteArray, const SharedNodePointer& sourceNode);
     void handleAddParticleResponse(const QByteArray& packet);
 
+    /// Called by the elements to keep the index from particle ID to element current.  Particles still waiting for their
+    /// IDs (which all share NEW_PARTICLE) aren't indexed, and are found by their creator token IDs as before.
+    void setContainingElement(uint32_t particleID, ParticleTreeElement* element);
+    void clearContainingElement(uint32_t particleID, ParticleTreeElement* element);
+    ParticleTreeElement* getContainingElement(uint32_t particleID) const { return _particleIndex.find(particleID); }
+
+    /// Called by the elements when their particles are stored, edited or removed: marks the path to the element as changed
+    /// and makes sure the next update visits it.
+    void elementEdited(ParticleTreeElement* element);
+
+    /// Called by the elements as they're deleted.
+    void forgetElement(ParticleTreeElement* element);
+
 private:
 
-    static bool updateOperation(OctreeElement* element, void* extraData);
     static bool findAndUpdateOperation(OctreeElement* element, void* extraData);
     static bool findAndUpdateWithIDandPropertiesOperation(OctreeElement* element, void* extraData);
     static bool findNearPointOperation(OctreeElement* element, void* extraData);
     static bool findInSphereOperation(OctreeElement* element, void* extraData);
     static bool pruneOperation(OctreeElement* element, void* extraData);
-    static bool findByIDOperation(OctreeElement* element, void* extraData);
-    static bool findAndDeleteOperation(OctreeElement* element, void* extraData);
     static bool findAndUpdateParticleIDOperation(OctreeElement* element, void* extraData);
     static bool findInCubeForUpdateOperation(OctreeElement* element, void* extraData);
 
+    void scheduleExpiry(ParticleTreeElement* element, quint64 expiry);
+    void cancelExpiry(ParticleTreeElement* element);
+
     void notifyNewlyCreatedParticle(const Particle& newParticle, const SharedNodePointer& senderNode);
 
     QReadWriteLock _newlyCreatedHooksLock;
     std::vector<NewlyCreatedParticleHook*> _newlyCreatedHooks;
 
 
-    QReadWriteLock _recentlyDeletedParticlesLock;
-    QMultiMap<quint64, uint32_t> _recentlyDeletedParticleIDs;
+    QReadWriteLock _deletedParticlesLock;
+    OctreeDeletionLog _deletedParticles;
+
+    OctreeItemIndex<ParticleTreeElement> _particleIndex;
+
+    // the update only visits the elements with active (moving, falling or scripted) particles, and the elements whose
+    // particles have all come to rest are woken again when the first of those expires
+    QSet<ParticleTreeElement*> _activeElements;
+    QMultiMap<quint64, ParticleTreeElement*> _expiringElements;
+    QHash<ParticleTreeElement*, quint64> _elementExpiries;
 };
 
 #endif // hifi_ParticleTree_h
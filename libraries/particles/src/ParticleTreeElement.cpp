@@ -9,17 +9,25 @@
 //  See the accompanying file LICENSE or http://www.apache.org/licenses/LICENSE-2.0.html
 //
 
+#include <limits>
+
 #include <GeometryUtil.h>
 
 #include "ParticleTree.h"
 #include "ParticleTreeElement.h"
 
-ParticleTreeElement::ParticleTreeElement(unsigned char* octalCode) : OctreeElement(), _particles(NULL) {
+ParticleTreeElement::ParticleTreeElement(unsigned char* octalCode) : OctreeElement(), _myTree(NULL), _particles(NULL) {
     init(octalCode);
 };
 
 ParticleTreeElement::~ParticleTreeElement() {
     _voxelMemoryUsage -= sizeof(ParticleTreeElement);
+    if (_myTree && _particles) {
+        foreach (const Particle& particle, *_particles) {
+            _myTree->clearContainingElement(particle.getID(), this);
+        }
+        _myTree->forgetElement(this);
+    }
     QList<Particle>* tmpParticles = _particles;
     _particles = NULL;
     delete tmpParticles;
@@ -51,31 +59,71 @@ ParticleTreeElement* ParticleTreeElement::addChildAtIndex(int index) {
 bool ParticleTreeElement::appendElementData(OctreePacketData* packetData, EncodeBitstreamParams& params) const {
     bool success = true; // assume the best...
 
+    // particles the viewer was already sent only need the properties that changed since, if any did
+    QVector<uint16_t> indexesOfParticlesToInclude;
+    QVector<ParticlePropertyFlags> propertiesToInclude;
+    for (uint16_t i = 0; i < _particles->size(); i++) {
+        const Particle& particle = (*_particles)[i];
+        quint64 lastSent = params.itemSendTimes ? params.itemSendTimes->getLastSent(particle.getID()) : 0;
+        ParticlePropertyFlags properties = particle.getChangedProperties(lastSent);
+        if (!properties) {
+            continue;
+        }
+        indexesOfParticlesToInclude << i;
+        propertiesToInclude << properties;
+    }
+
     // write our particles out...
-    uint16_t numberOfParticles = _particles->size();
+    uint16_t numberOfParticles = indexesOfParticlesToInclude.size();
     success = packetData->appendValue(numberOfParticles);
 
     if (success) {
-        for (uint16_t i = 0; i < numberOfParticles; i++) {
-            const Particle& particle = (*_particles)[i];
-            success = particle.appendParticleData(packetData);
+        for (int j = 0; j < indexesOfParticlesToInclude.size(); j++) {
+            const Particle& particle = (*_particles)[indexesOfParticlesToInclude.at(j)];
+            success = particle.appendParticleData(packetData, propertiesToInclude.at(j));
             if (!success) {
                 break;
             }
         }
     }
+
+    // the element's data is discarded unless all of the particles fit, so only then are they sent
+    if (success && params.itemSendTimes) {
+        quint64 now = usecTimestampNow();
+        foreach (uint16_t i, indexesOfParticlesToInclude) {
+            params.itemSendTimes->itemSent((*_particles)[i].getID(), now);
+        }
+    }
     return success;
 }
 
-void ParticleTreeElement::update(ParticleTreeUpdateArgs& args) {
-    markWithChangedTime();
-    // TODO: early exit when _particles is empty
+void ParticleTreeElement::prepareForUpdate(ParticleTreeUpdateArgs& args) {
+    for (QList<Particle>::iterator particleItr = _particles->begin(); particleItr != _particles->end(); ++particleItr) {
+        Particle& particle = (*particleItr);
+        particle.checkLifetime();
+        if (!particle.getScript().isEmpty()) {
+            args._scriptedParticles.append(&particle);
+        }
+    }
+}
+
+bool ParticleTreeElement::update(ParticleTreeUpdateArgs& args) {
+    quint64 now = usecTimestampNow();
+    bool changed = false;
+    bool active = false;
 
     // update our contained particles
     QList<Particle>::iterator particleItr = _particles->begin();
     while(particleItr != _particles->end()) {
         Particle& particle = (*particleItr);
-        particle.update(_lastChanged);
+
+        // particles at rest don't change, so they don't mark us as changed either
+        if (particle.isActive()) {
+            particle.update(now);
+            changed = true;
+        } else {
+            particle.setLastUpdated(now);
+        }
 
         // If the particle wants to die, or if it's left our bounding box, then move it
         // into the arguments moving particles. These will be added back or deleted completely
@@ -83,15 +131,31 @@ void ParticleTreeElement::update(ParticleTreeUpdateArgs& args) {
             args._movingParticles.push_back(particle);
 
             // erase this particle
+            _myTree->clearContainingElement(particle.getID(), this);
             particleItr = _particles->erase(particleItr);
+            changed = true;
         } else {
+            active = active || particle.isActive();
             ++particleItr;
         }
     }
+    if (changed) {
+        markWithChangedTime();
+        args._changedElements.append(this);
+    }
     // TODO: if _particles is empty after while loop consider freeing memory in _particles if
     // internal array is too big (QList internal array does not decrease size except in dtor and
     // assignment operator).  Otherwise _particles could become a "resource leak" for large
     // roaming piles of particles.
+    return active;
+}
+
+quint64 ParticleTreeElement::getNextExpiry() const {
+    quint64 nextExpiry = std::numeric_limits<quint64>::max();
+    foreach (const Particle& particle, *_particles) {
+        nextExpiry = qMin(nextExpiry, particle.getExpiry());
+    }
+    return nextExpiry;
 }
 
 bool ParticleTreeElement::findSpherePenetration(const glm::vec3& center, float radius,
@@ -149,6 +213,8 @@ bool ParticleTreeElement::updateParticle(const Particle& particle) {
                             difference, debug::valueOf(particle.isNewlyCreated()) );
                 }
                 thisParticle.copyChangedProperties(particle);
+                markWithChangedTime();
+                _myTree->elementEdited(this);
             } else {
                 if (wantDebug) {
                     qDebug(">>> IGNORING SERVER!!! Would've caused jutter! <<<  "
@@ -178,7 +244,14 @@ bool ParticleTreeElement::updateParticle(const ParticleID& particleID, const Par
             found = thisParticle.getCreatorTokenID() == particleID.creatorTokenID;
         }
         if (found) {
+            // particles that were at rest haven't been simulated since, so they start again from now
+            bool wasActive = thisParticle.isActive();
             thisParticle.setProperties(properties);
+            if (!wasActive) {
+                thisParticle.setLastUpdated(usecTimestampNow());
+            }
+            markWithChangedTime();
+            _myTree->elementEdited(this);
 
             const bool wantDebug = false;
             if (wantDebug) {
@@ -195,6 +268,7 @@ bool ParticleTreeElement::updateParticle(const ParticleID& particleID, const Par
 }
 
 void ParticleTreeElement::updateParticleID(FindAndUpdateParticleIDArgs* args) {
+    bool creatorTokenFoundHere = false;
     uint16_t numberOfParticles = _particles->size();
     for (uint16_t i = 0; i < numberOfParticles; i++) {
         Particle& thisParticle = (*_particles)[i];
@@ -204,12 +278,14 @@ void ParticleTreeElement::updateParticleID(FindAndUpdateParticleIDArgs* args) {
             if (thisParticle.getCreatorTokenID() == args->creatorTokenID) {
                 thisParticle.setID(args->particleID);
                 args->creatorTokenFound = true;
+                creatorTokenFoundHere = true;
             }
         }
         
         // if we're in an isViewing tree, we also need to look for an kill any viewed particles
         if (!args->viewedParticleFound && args->isViewing) {
             if (thisParticle.getCreatorTokenID() == UNKNOWN_TOKEN && thisParticle.getID() == args->particleID) {
+                _myTree->clearContainingElement(args->particleID, this);
                 _particles->removeAt(i); // remove the particle at this index
                 numberOfParticles--; // this means we have 1 fewer particle in this list
                 i--; // and we actually want to back up i as well.
@@ -217,6 +293,10 @@ void ParticleTreeElement::updateParticleID(FindAndUpdateParticleIDArgs* args) {
             }
         }
     }
+    // index the particle under its new ID only now, since the viewed copy we just removed had the same one
+    if (creatorTokenFoundHere) {
+        _myTree->setContainingElement(args->particleID, this);
+    }
 }
 
 
@@ -283,7 +363,10 @@ bool ParticleTreeElement::removeParticleWithID(uint32_t id) {
         for (uint16_t i = 0; i < numberOfParticles; i++) {
             if ((*_particles)[i].getID() == id) {
                 foundParticle = true;
+                _myTree->clearContainingElement(id, this);
                 _particles->removeAt(i);
+                markWithChangedTime();
+                _myTree->elementEdited(this);
                 break;
             }
         }
@@ -308,9 +391,23 @@ int ParticleTreeElement::readElementDataFromBuffer(const unsigned char* data, in
 
         if (bytesLeftToRead >= (int)(numberOfParticles * expectedBytesPerParticle)) {
             for (uint16_t i = 0; i < numberOfParticles; i++) {
+                // particles we already have may be sent as only their changed properties, so read them over our copy
                 Particle tempParticle;
-                int bytesForThisParticle = tempParticle.readParticleDataFromBuffer(dataAt, bytesLeftToRead, args);
-                _myTree->storeParticle(tempParticle);
+                uint32_t id;
+                memcpy(&id, dataAt, sizeof(id));
+                const Particle* existingParticle = _myTree->findParticleByID(id, true);
+                if (existingParticle) {
+                    tempParticle = *existingParticle;
+                }
+                bool isComplete = true;
+                int bytesForThisParticle = tempParticle.readParticleDataFromBuffer(dataAt, bytesLeftToRead, args,
+                                                                                   &isComplete);
+
+                // the changed properties of a particle we don't have can't be stored; we'll get all of them with the next
+                // full scene
+                if (isComplete || existingParticle) {
+                    _myTree->storeParticle(tempParticle);
+                }
                 dataAt += bytesForThisParticle;
                 bytesLeftToRead -= bytesForThisParticle;
                 bytesRead += bytesForThisParticle;
@@ -338,6 +435,8 @@ bool ParticleTreeElement::collapseChildren() {
 
 void ParticleTreeElement::storeParticle(const Particle& particle) {
     _particles->push_back(particle);
+    _myTree->setContainingElement(particle.getID(), this);
     markWithChangedTime();
+    _myTree->elementEdited(this);
 }
 
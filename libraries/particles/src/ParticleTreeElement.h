@@ -16,6 +16,7 @@
 
 #include <OctreeElement.h>
 #include <QList>
+#include <QVector>
 
 #include "Particle.h"
 #include "ParticleTree.h"
@@ -26,6 +27,8 @@ class ParticleTreeElement;
 class ParticleTreeUpdateArgs {
 public:
     QList<Particle> _movingParticles;
+    QVector<Particle*> _scriptedParticles;
+    QVector<ParticleTreeElement*> _changedElements;
 };
 
 class FindAndUpdateParticleIDArgs {
@@ -96,7 +99,17 @@ public:
     QList<Particle>& getParticles() { return *_particles; }
     bool hasParticles() const { return _particles->size() > 0; }
 
-    void update(ParticleTreeUpdateArgs& args);
+    /// Checks the lifetimes of our particles and gathers the ones with scripts, which the tree runs in a batch before the
+    /// update proper.
+    void prepareForUpdate(ParticleTreeUpdateArgs& args);
+
+    /// Simulates our active particles, adding us to the changed elements if any of them moved (or left).
+    /// \return whether we still have active particles, and should be updated again next time
+    bool update(ParticleTreeUpdateArgs& args);
+
+    /// Returns the earliest time at which one of our particles will expire.
+    quint64 getNextExpiry() const;
+
     void setTree(ParticleTree* tree) { _myTree = tree; }
 
     bool updateParticle(const Particle& particle);
@@ -306,11 +306,15 @@ void ScriptEngine::registerGetterSetter(const QString& name, QScriptEngine::Func
 }
 
 void ScriptEngine::evaluate() {
+    evaluateProgram(QScriptProgram(_scriptContents));
+}
+
+void ScriptEngine::evaluateProgram(const QScriptProgram& program) {
     if (!_isInitialized) {
         init();
     }
 
-    QScriptValue result = _engine.evaluate(_scriptContents);
+    QScriptValue result = _engine.evaluate(program);
 
     if (_engine.hasUncaughtException()) {
         int line = _engine.uncaughtExceptionLineNumber();
@@ -616,6 +620,14 @@ void ScriptEngine::stopTimer(QTimer *timer) {
     }
 }
 
+void ScriptEngine::stopAllTimers() {
+    foreach (QTimer* timer, _timerFunctionMap.keys()) {
+        timer->stop();
+        delete timer;
+    }
+    _timerFunctionMap.clear();
+}
+
 QUrl ScriptEngine::resolveInclude(const QString& include) const {
     // first lets check to see if it's already a full URL
     QUrl url(include);
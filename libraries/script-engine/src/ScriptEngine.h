@@ -17,6 +17,7 @@
 #include <QtCore/QObject>
 #include <QtCore/QUrl>
 #include <QtScript/QScriptEngine>
+#include <QtScript/QScriptProgram>
 
 #include <AnimationCache.h>
 #include <AudioScriptingInterface.h>
@@ -81,8 +82,10 @@ public:
     void init();
     void run(); /// runs continuously until Agent.stop() is called
     void evaluate(); /// initializes the engine, and evaluates the script, but then returns control to caller
+    void evaluateProgram(const QScriptProgram& program); /// like evaluate(), but runs an already compiled program
 
     void timerFired();
+    void stopAllTimers(); /// stops and deletes all of the timers set by the script
 
     bool hasScript() const { return !_scriptContents.isEmpty(); }
 
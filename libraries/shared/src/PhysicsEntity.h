@@ -46,7 +46,7 @@ public:
 
     virtual void buildShapes() = 0;
     virtual void clearShapes();
-    const QVector<Shape*> getShapes() const { return _shapes; }
+    const QVector<Shape*>& getShapes() const { return _shapes; }
 
     PhysicsSimulation* getSimulation() const { return _simulation; }
 
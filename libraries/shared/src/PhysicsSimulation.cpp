@@ -12,18 +12,29 @@
 #include <glm/glm.hpp>
 #include <iostream>
 
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThreadPool>
+
 #include "PhysicsSimulation.h"
 
 #include "PhysicsEntity.h"
 #include "Ragdoll.h"
 #include "SharedUtil.h"
+#include "Shape.h"
 #include "ShapeCollider.h"
 
-int MAX_DOLLS_PER_SIMULATION = 16;
+int MAX_DOLLS_PER_SIMULATION = 64;
 int MAX_ENTITIES_PER_SIMULATION = 64;
 int MAX_COLLISIONS_PER_SIMULATION = 256;
 
 
+// below this many candidate pairs per job, the narrowphase isn't worth splitting across threads
+const int MIN_PAIRS_PER_NARROWPHASE_JOB = 32;
+
+// likewise for the dolls whose constraints are enforced by each job
+const int MIN_DOLLS_PER_CONSTRAINT_JOB = 8;
+
 const int NUM_SHAPE_BITS = 6;
 const int SHAPE_INDEX_MASK = (1 << (NUM_SHAPE_BITS + 1)) - 1;
 
@@ -41,6 +52,8 @@ PhysicsSimulation::~PhysicsSimulation() {
 
     // but Ragdolls do not
     _dolls.clear();
+
+    qDeleteAll(_jobCollisionLists);
 }
 
 bool PhysicsSimulation::addEntity(PhysicsEntity* entity) {
@@ -151,8 +164,8 @@ void PhysicsSimulation::stepForward(float deltaTime, float minError, int maxIter
     quint64 expiry = startTime + maxUsec;
 
     moveRagdolls(deltaTime);
+    updateContactCache();
 
-    int numDolls = _dolls.size();
     _numCollisions = 0;
     int iterations = 0;
     float error = 0.0f;
@@ -160,11 +173,7 @@ void PhysicsSimulation::stepForward(float deltaTime, float minError, int maxIter
         computeCollisions();
         processCollisions();
 
-        // enforce constraints
-        error = 0.0f;
-        for (int i = 0; i < numDolls; ++i) {
-            error = glm::max(error, _dolls[i]->enforceRagdollConstraints());
-        }
+        error = enforceConstraints();
         ++iterations;
 
         now = usecTimestampNow();
@@ -190,37 +199,222 @@ void PhysicsSimulation::moveRagdolls(float deltaTime) {
     }
 }
 
-void PhysicsSimulation::computeCollisions() {
-    _collisionList.clear();
-    // TODO: keep track of QSet<PhysicsEntity*> collidedEntities;
+static AABox computeShapeBounds(const Shape* shape) {
+    if (shape->getType() == Shape::PLANE_SHAPE) {
+        // planes have no bounds to speak of, so give them more than anything they could meet
+        const float PLANE_EXTENT = 1.0e6f;
+        return AABox(glm::vec3(-PLANE_EXTENT), 2.0f * PLANE_EXTENT);
+    }
+    float extent = shape->getBoundingRadius() + CONTACT_CACHE_MARGIN;
+    return AABox(shape->getTranslation() - glm::vec3(extent), 2.0f * extent);
+}
+
+void PhysicsSimulation::updateContactCache() {
+    _candidatePairs.clear();
+    _broadphase.clear();
+    _broadphaseEntities.clear();
     int numEntities = _entities.size();
+    _shapeBounds.resize(numEntities);
     for (int i = 0; i < numEntities; ++i) {
         PhysicsEntity* entity = _entities.at(i);
-        const QVector<Shape*> shapes = entity->getShapes();
+        const QVector<Shape*>& shapes = entity->getShapes();
         int numShapes = shapes.size();
-        // collide with self
+        QVector<AABox>& bounds = _shapeBounds[i];
+        bounds.resize(numShapes);
+        glm::vec3 minimum(FLT_MAX), maximum(-FLT_MAX);
         for (int j = 0; j < numShapes; ++j) {
             const Shape* shape = shapes.at(j);
             if (!shape) {
                 continue;
             }
-            for (int k = j+1; k < numShapes; ++k) {
+            bounds[j] = computeShapeBounds(shape);
+            minimum = glm::min(minimum, bounds.at(j).getCorner());
+            maximum = glm::max(maximum, bounds.at(j).getCorner() + bounds.at(j).getDimensions());
+
+            // collide with self
+            for (int k = 0; k < j; ++k) {
                 const Shape* otherShape = shapes.at(k);
-                if (otherShape && entity->collisionsAreEnabled(j, k)) {
-                    ShapeCollider::collideShapes(shape, otherShape, _collisionList);
+                if (otherShape && entity->collisionsAreEnabled(k, j) && bounds.at(k).touches(bounds.at(j))) {
+                    _candidatePairs.append(ShapePair(otherShape, shape));
                 }
             }
         }
+        if (minimum.x <= maximum.x) {
+            _broadphase.addBox(minimum, maximum);
+            _broadphaseEntities.append(i);
+        }
+    }
 
-        // collide with others
-        for (int j = i+1; j < numEntities; ++j) {
-            const QVector<Shape*> otherShapes = _entities.at(j)->getShapes();
-            ShapeCollider::collideShapesWithShapes(shapes, otherShapes, _collisionList);
+    // collide with others, where the entities' bounds overlap
+    _broadphase.findOverlappingPairs(_entityPairs);
+    foreach (const IndexPair& entityPair, _entityPairs) {
+        int entityIndex = _broadphaseEntities.at(entityPair.first);
+        int otherEntityIndex = _broadphaseEntities.at(entityPair.second);
+        const QVector<Shape*>& shapes = _entities.at(entityIndex)->getShapes();
+        const QVector<Shape*>& otherShapes = _entities.at(otherEntityIndex)->getShapes();
+        const QVector<AABox>& bounds = _shapeBounds.at(entityIndex);
+        const QVector<AABox>& otherBounds = _shapeBounds.at(otherEntityIndex);
+        for (int j = 0; j < shapes.size(); ++j) {
+            const Shape* shape = shapes.at(j);
+            if (!shape) {
+                continue;
+            }
+            for (int k = 0; k < otherShapes.size(); ++k) {
+                const Shape* otherShape = otherShapes.at(k);
+                if (otherShape && bounds.at(j).touches(otherBounds.at(k))) {
+                    _candidatePairs.append(ShapePair(shape, otherShape));
+                }
+            }
+        }
+    }
+}
+
+/// Tests a range of candidate pairs, writing the collisions into a list of its own.
+class NarrowphaseJob : public QRunnable {
+public:
+
+    NarrowphaseJob(const QVector<ShapePair>& pairs, int begin, int end, CollisionList* collisions,
+            QSemaphore* finishedJobs = NULL);
+
+    virtual void run();
+
+private:
+
+    const QVector<ShapePair>& _pairs;
+    int _begin;
+    int _end;
+    CollisionList* _collisions;
+    QSemaphore* _finishedJobs;
+};
+
+NarrowphaseJob::NarrowphaseJob(const QVector<ShapePair>& pairs, int begin, int end, CollisionList* collisions,
+        QSemaphore* finishedJobs) :
+    _pairs(pairs),
+    _begin(begin),
+    _end(end),
+    _collisions(collisions),
+    _finishedJobs(finishedJobs) {
+}
+
+void NarrowphaseJob::run() {
+    _collisions->clear();
+    for (int i = _begin; i < _end; ++i) {
+        const ShapePair& pair = _pairs.at(i);
+        ShapeCollider::collideShapes(pair.first, pair.second, *_collisions);
+    }
+    if (_finishedJobs) {
+        _finishedJobs->release();
+    }
+}
+
+void PhysicsSimulation::computeCollisions() {
+    _collisionList.clear();
+    int numPairs = _candidatePairs.size();
+    int numJobs = qMin(QThreadPool::globalInstance()->maxThreadCount(), numPairs / MIN_PAIRS_PER_NARROWPHASE_JOB);
+    if (numJobs < 2) {
+        NarrowphaseJob(_candidatePairs, 0, numPairs, &_collisionList).run();
+        _numCollisions = _collisionList.size();
+        return;
+    }
+
+    // the verlet capsules cache their translations and rotations as they're read, so read them all here first: since
+    // nothing moves during the narrowphase, the jobs will then find the caches current and leave them alone
+    foreach (PhysicsEntity* entity, _entities) {
+        foreach (const Shape* shape, entity->getShapes()) {
+            if (shape) {
+                shape->getTranslation();
+                shape->getRotation();
+            }
+        }
+    }
+
+    // the jobs take contiguous ranges and are merged in order, so the result is the same as testing the pairs serially
+    while (_jobCollisionLists.size() < numJobs) {
+        _jobCollisionLists.append(new CollisionList(MAX_COLLISIONS_PER_SIMULATION));
+    }
+    QSemaphore finishedJobs;
+    for (int i = 1; i < numJobs; ++i) {
+        QThreadPool::globalInstance()->start(new NarrowphaseJob(_candidatePairs, i * numPairs / numJobs,
+            (i + 1) * numPairs / numJobs, _jobCollisionLists.at(i), &finishedJobs));
+    }
+    NarrowphaseJob(_candidatePairs, 0, numPairs / numJobs, _jobCollisionLists.at(0)).run();
+    finishedJobs.acquire(numJobs - 1);
+
+    for (int i = 0; i < numJobs; ++i) {
+        CollisionList* jobCollisions = _jobCollisionLists.at(i);
+        for (int j = 0; j < jobCollisions->size(); ++j) {
+            CollisionInfo* collision = _collisionList.getNewCollision();
+            if (!collision) {
+                break; // the list is full
+            }
+            *collision = *jobCollisions->getCollision(j);
         }
     }
     _numCollisions = _collisionList.size();
 }
 
+/// Enforces the constraints of a range of dolls, noting the largest correction.
+class ConstraintJob : public QRunnable {
+public:
+
+    ConstraintJob(const QVector<Ragdoll*>& dolls, int begin, int end, float* error, QSemaphore* finishedJobs = NULL);
+
+    virtual void run();
+
+private:
+
+    const QVector<Ragdoll*>& _dolls;
+    int _begin;
+    int _end;
+    float* _error;
+    QSemaphore* _finishedJobs;
+};
+
+ConstraintJob::ConstraintJob(const QVector<Ragdoll*>& dolls, int begin, int end, float* error,
+        QSemaphore* finishedJobs) :
+    _dolls(dolls),
+    _begin(begin),
+    _end(end),
+    _error(error),
+    _finishedJobs(finishedJobs) {
+}
+
+void ConstraintJob::run() {
+    float error = 0.0f;
+    for (int i = _begin; i < _end; ++i) {
+        error = glm::max(error, _dolls.at(i)->enforceRagdollConstraints());
+    }
+    *_error = error;
+    if (_finishedJobs) {
+        _finishedJobs->release();
+    }
+}
+
+float PhysicsSimulation::enforceConstraints() {
+    int numDolls = _dolls.size();
+    int numJobs = qMin(QThreadPool::globalInstance()->maxThreadCount(), numDolls / MIN_DOLLS_PER_CONSTRAINT_JOB);
+    float error = 0.0f;
+    if (numJobs < 2) {
+        ConstraintJob(_dolls, 0, numDolls, &error).run();
+        return error;
+    }
+
+    // each doll's constraints only touch its own points, so the dolls can be split across threads freely
+    _jobErrors.resize(numJobs);
+    QSemaphore finishedJobs;
+    for (int i = 1; i < numJobs; ++i) {
+        QThreadPool::globalInstance()->start(new ConstraintJob(_dolls, i * numDolls / numJobs,
+            (i + 1) * numDolls / numJobs, &_jobErrors[i], &finishedJobs));
+    }
+    ConstraintJob(_dolls, 0, numDolls / numJobs, &_jobErrors[0]).run();
+    finishedJobs.acquire(numJobs - 1);
+
+    foreach (float jobError, _jobErrors) {
+        error = glm::max(error, jobError);
+    }
+    return error;
+}
+
 void PhysicsSimulation::processCollisions() {
     // walk all collisions, accumulate movement on shapes, and build a list of affected shapes
     QSet<Shape*> shapes;
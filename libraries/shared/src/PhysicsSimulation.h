@@ -12,12 +12,22 @@
 #ifndef hifi_PhysicsSimulation
 #define hifi_PhysicsSimulation
 
+#include <QPair>
 #include <QVector>
 
+#include "AABox.h"
 #include "CollisionInfo.h"
+#include "SweepAndPrune.h"
 
 class PhysicsEntity;
 class Ragdoll;
+class Shape;
+
+typedef QPair<const Shape*, const Shape*> ShapePair;
+
+// shape bounds are expanded by this much (in meters) for the contact cache, so that the pairs found at the start of a step
+// still cover the shapes after the constraint iterations have moved them
+const float CONTACT_CACHE_MARGIN = 0.05f;
 
 class PhysicsSimulation {
 public:
@@ -42,14 +52,43 @@ public:
     void stepForward(float deltaTime, float minError, int maxIterations, quint64 maxUsec);
 
     void moveRagdolls(float deltaTime);
+
+    /// Finds the pairs of shapes whose bounds (expanded by a margin) overlap: the candidates that computeCollisions()
+    /// tests.  Called once per step, since the constraint iterations only move the shapes a little.
+    void updateContactCache();
+
+    /// Tests the candidate pairs found by updateContactCache(), splitting the work across threads when there are enough.
     void computeCollisions();
     void processCollisions();
 
+    /// Enforces the constraints of all the dolls, splitting them across threads when there are enough.
+    /// \return the largest correction made
+    float enforceConstraints();
+
+    int getNumCandidatePairs() const { return _candidatePairs.size(); }
+    int getNumCollisions() const { return _numCollisions; }
+    int getNumIterations() const { return _numIterations; }
+    float getConstraintError() const { return _constraintError; }
+    quint64 getStepTime() const { return _stepTime; }
+
 private:
     CollisionList _collisionList;
     QVector<PhysicsEntity*> _entities;
     QVector<Ragdoll*> _dolls;
 
+    // the contact cache, along with the storage used to build it
+    QVector<ShapePair> _candidatePairs;
+    SweepAndPrune _broadphase;
+    QVector<int> _broadphaseEntities;
+    QVector<QVector<AABox> > _shapeBounds;
+    QVector<IndexPair> _entityPairs;
+
+    // a collision list for each of the narrowphase jobs, merged into _collisionList when they're done
+    QVector<CollisionList*> _jobCollisionLists;
+
+    // the largest correction made by each of the constraint jobs
+    QVector<float> _jobErrors;
+
     // some stats
     int _numIterations;
     int _numCollisions;
@@ -40,9 +40,14 @@ public:
     Enum lastFlag() const { return (Enum)_maxFlag; }
     
     void setHasProperty(Enum flag, bool value = true);
-    bool getHasProperty(Enum flag);
-    QByteArray encode();
-    void decode(const QByteArray& fromEncoded);
+    bool getHasProperty(Enum flag) const;
+    QByteArray encode() const;
+
+    /// Decodes the flags from the start of the encoded bytes, returning the number of bytes they took up (the encoded
+    /// flags may be followed by other data).
+    int decode(const unsigned char* data, int length);
+    int decode(const QByteArray& fromEncoded) { return decode((const unsigned char*)fromEncoded.constData(),
+                                                              fromEncoded.size()); }
 
 
     bool operator==(const PropertyFlags& other) const { return _flags == other._flags; }
@@ -133,7 +138,7 @@ template<typename Enum> inline void PropertyFlags<Enum>::setHasProperty(Enum fla
     }
 }
 
-template<typename Enum> inline bool PropertyFlags<Enum>::getHasProperty(Enum flag) {
+template<typename Enum> inline bool PropertyFlags<Enum>::getHasProperty(Enum flag) const {
     if (flag > _maxFlag) {
         return _trailingFlipped; // usually false
     }
@@ -142,7 +147,7 @@ template<typename Enum> inline bool PropertyFlags<Enum>::getHasProperty(Enum fla
 
 const int BITS_PER_BYTE = 8;
 
-template<typename Enum> inline QByteArray PropertyFlags<Enum>::encode() {
+template<typename Enum> inline QByteArray PropertyFlags<Enum>::encode() const {
     QByteArray output;
     
     if (_maxFlag < _minFlag) {
@@ -178,45 +183,33 @@ template<typename Enum> inline QByteArray PropertyFlags<Enum>::encode() {
     return output;
 }
 
-template<typename Enum> inline void PropertyFlags<Enum>::decode(const QByteArray& fromEncodedBytes) {
+template<typename Enum> inline int PropertyFlags<Enum>::decode(const unsigned char* data, int length) {
 
     clear(); // we are cleared out!
 
-    // first convert the ByteArray into a BitArray...
-    QBitArray encodedBits;
-    int bitCount = BITS_PER_BYTE * fromEncodedBytes.count();
-    encodedBits.resize(bitCount);
-    
-    for(int byte = 0; byte < fromEncodedBytes.count(); byte++) {
-        char originalByte = fromEncodedBytes.at(byte);
-        for(int bit = 0; bit < BITS_PER_BYTE; bit++) {
-            int shiftBy = BITS_PER_BYTE - (bit + 1);
-            char maskBit = ( 1 << shiftBy);
-            bool bitValue = originalByte & maskBit;
-            encodedBits.setBit(byte * BITS_PER_BYTE + bit, bitValue);
-        }
-    }
-    
-    // next, read the leading bits to determine the correct number of bytes to decode (may not match the QByteArray)
+    // read the leading bits to determine the correct number of bytes to decode (may not match the length), and only
+    // look at those bytes
+    int bitCount = BITS_PER_BYTE * length;
     int encodedByteCount = 0;
     int bitAt;
     for (bitAt = 0; bitAt < bitCount; bitAt++) {
-        if (encodedBits.at(bitAt)) {
+        if (data[bitAt / BITS_PER_BYTE] & (1 << (BITS_PER_BYTE - ((bitAt % BITS_PER_BYTE) + 1)))) {
             encodedByteCount++;
         } else {
             break;
         }
     }
     encodedByteCount++; // always at least one byte
-    int expectedBitCount = encodedByteCount * BITS_PER_BYTE;
-    
+    int expectedBitCount = std::min(encodedByteCount * BITS_PER_BYTE, bitCount);
+
     // Now, keep reading...
-    int flagsStartAt = bitAt + 1; 
+    int flagsStartAt = bitAt + 1;
     for (bitAt = flagsStartAt; bitAt < expectedBitCount; bitAt++) {
-        if (encodedBits.at(bitAt)) {
+        if (data[bitAt / BITS_PER_BYTE] & (1 << (BITS_PER_BYTE - ((bitAt % BITS_PER_BYTE) + 1)))) {
             setHasProperty((Enum)(bitAt - flagsStartAt));
         }
     }
+    return encodedByteCount;
 }
 
 template<typename Enum> inline void PropertyFlags<Enum>::debugDumpBits() {
@@ -16,6 +16,10 @@
 #include "SharedUtil.h"
 #include "SphereShape.h"
 
+// the batches a point belongs to are tracked as bits, so past this many the last batch takes the rest (which then may
+// share points, costing nothing but independence)
+const int MAX_DISTANCE_BATCHES = 32;
+
 // ----------------------------------------------------------------------------
 // VerletPoint
 // ----------------------------------------------------------------------------
@@ -33,89 +37,121 @@ void VerletPoint::applyAccumulatedDelta() {
 }
 
 // ----------------------------------------------------------------------------
-// FixedConstraint
+// Ragdoll
 // ----------------------------------------------------------------------------
-FixedConstraint::FixedConstraint(VerletPoint* point, const glm::vec3& anchor) : _point(point), _anchor(anchor) {
-}
-
-float FixedConstraint::enforce() {
-    assert(_point != NULL);
-    // TODO: use fast approximate sqrt here
-    float distance = glm::distance(_anchor, _point->_position);
-    _point->_position = _anchor;
-    return distance;
-}
 
-void FixedConstraint::setPoint(VerletPoint* point) {
-    assert(point);
-    _point = point;
-    _point->_mass = MAX_SHAPE_MASS;
+Ragdoll::Ragdoll() {
 }
 
-void FixedConstraint::setAnchor(const glm::vec3& anchor) {
-    _anchor = anchor;
+Ragdoll::~Ragdoll() {
+    clearRagdollConstraintsAndPoints();
 }
-
-// ----------------------------------------------------------------------------
-// DistanceConstraint
-// ----------------------------------------------------------------------------
-DistanceConstraint::DistanceConstraint(VerletPoint* startPoint, VerletPoint* endPoint) : _distance(-1.0f) {
-    _points[0] = startPoint;
-    _points[1] = endPoint;
-    _distance = glm::distance(_points[0]->_position, _points[1]->_position);
+    
+void Ragdoll::clearRagdollConstraintsAndPoints() {
+    _fixedPoints.clear();
+    _fixedAnchors.clear();
+    _distanceStarts.clear();
+    _distanceEnds.clear();
+    _distanceLengths.clear();
+    _distanceBatchEnds.clear();
+    _ragdollPoints.clear();
 }
 
-DistanceConstraint::DistanceConstraint(const DistanceConstraint& other) {
-    _distance = other._distance;
-    _points[0] = other._points[0];
-    _points[1] = other._points[1];
+void Ragdoll::addFixedConstraint(int pointIndex, const glm::vec3& anchor) {
+    assert(pointIndex >= 0 && pointIndex < _ragdollPoints.size());
+    _fixedPoints.push_back(pointIndex);
+    _fixedAnchors.push_back(anchor);
 }
 
-void DistanceConstraint::setDistance(float distance) {
-    _distance = fabsf(distance);
+void Ragdoll::addDistanceConstraint(int startIndex, int endIndex) {
+    assert(startIndex >= 0 && startIndex < _ragdollPoints.size());
+    assert(endIndex >= 0 && endIndex < _ragdollPoints.size());
+    _distanceStarts.push_back(startIndex);
+    _distanceEnds.push_back(endIndex);
+    _distanceLengths.push_back(glm::distance(_ragdollPoints.at(startIndex)._position, _ragdollPoints.at(endIndex)._position));
+    _distanceBatchEnds.clear();
 }
 
-float DistanceConstraint::enforce() {
-    // TODO: use a fast distance approximation
-    float newDistance = glm::distance(_points[0]->_position, _points[1]->_position);
-    glm::vec3 direction(0.0f, 1.0f, 0.0f);
-    if (newDistance > EPSILON) {
-        direction = (_points[0]->_position - _points[1]->_position) / newDistance;
+float Ragdoll::enforceRagdollConstraints() {
+    if (_distanceBatchEnds.isEmpty() && !_distanceLengths.isEmpty()) {
+        batchDistanceConstraints();
     }
-    glm::vec3 center = 0.5f * (_points[0]->_position + _points[1]->_position);
-    _points[0]->_position = center + (0.5f * _distance) * direction;
-    _points[1]->_position = center - (0.5f * _distance) * direction;
-    return glm::abs(newDistance - _distance);
-}
+    VerletPoint* points = _ragdollPoints.data();
+    float maxDistance = 0.0f;
 
-// ----------------------------------------------------------------------------
-// Ragdoll
-// ----------------------------------------------------------------------------
+    const int numFixedConstraints = _fixedAnchors.size();
+    for (int i = 0; i < numFixedConstraints; ++i) {
+        VerletPoint& point = points[_fixedPoints.at(i)];
+        const glm::vec3& anchor = _fixedAnchors.at(i);
+        maxDistance = glm::max(maxDistance, glm::distance(anchor, point._position));
+        point._position = anchor;
+    }
 
-Ragdoll::Ragdoll() {
+    // the constraints within a batch share no points, so each one can be enforced without waiting on the one before
+    const int* starts = _distanceStarts.constData();
+    const int* ends = _distanceEnds.constData();
+    const float* lengths = _distanceLengths.constData();
+    int begin = 0;
+    foreach (int end, _distanceBatchEnds) {
+        for (int i = begin; i < end; ++i) {
+            VerletPoint& start = points[starts[i]];
+            VerletPoint& finish = points[ends[i]];
+            float newDistance = glm::distance(start._position, finish._position);
+            glm::vec3 direction(0.0f, 1.0f, 0.0f);
+            if (newDistance > EPSILON) {
+                direction = (start._position - finish._position) / newDistance;
+            }
+            glm::vec3 center = 0.5f * (start._position + finish._position);
+            start._position = center + (0.5f * lengths[i]) * direction;
+            finish._position = center - (0.5f * lengths[i]) * direction;
+            maxDistance = glm::max(maxDistance, glm::abs(newDistance - lengths[i]));
+        }
+        begin = end;
+    }
+    return maxDistance;
 }
 
-Ragdoll::~Ragdoll() {
-    clearRagdollConstraintsAndPoints();
-}
-    
-void Ragdoll::clearRagdollConstraintsAndPoints() {
-    int numConstraints = _ragdollConstraints.size();
+void Ragdoll::batchDistanceConstraints() {
+    // greedy coloring: each constraint goes in the first batch that doesn't already hold either of its points
+    const int numConstraints = _distanceLengths.size();
+    QVector<int> batches(numConstraints);
+    QVector<quint32> pointBatches(_ragdollPoints.size(), 0);
+    int numBatches = 0;
     for (int i = 0; i < numConstraints; ++i) {
-        delete _ragdollConstraints[i];
+        int start = _distanceStarts.at(i);
+        int end = _distanceEnds.at(i);
+        quint32 usedBatches = pointBatches.at(start) | pointBatches.at(end);
+        int batch = 0;
+        while (batch < MAX_DISTANCE_BATCHES - 1 && (usedBatches & (1U << batch))) {
+            batch++;
+        }
+        batches[i] = batch;
+        pointBatches[start] |= (1U << batch);
+        pointBatches[end] |= (1U << batch);
+        numBatches = qMax(numBatches, batch + 1);
     }
-    _ragdollConstraints.clear();
-    _ragdollPoints.clear();
-}
 
-float Ragdoll::enforceRagdollConstraints() {
-    float maxDistance = 0.0f;
-    const int numConstraints = _ragdollConstraints.size();
+    // sort by batch, keeping the order within each batch
+    _distanceBatchEnds.fill(0, numBatches);
     for (int i = 0; i < numConstraints; ++i) {
-        DistanceConstraint* c = static_cast<DistanceConstraint*>(_ragdollConstraints[i]);
-        //maxDistance = glm::max(maxDistance, _ragdollConstraints[i]->enforce());
-        maxDistance = glm::max(maxDistance, c->enforce());
+        _distanceBatchEnds[batches.at(i)]++;
     }
-    return maxDistance;
+    QVector<int> offsets(numBatches);
+    int offset = 0;
+    for (int i = 0; i < numBatches; ++i) {
+        offsets[i] = offset;
+        offset += _distanceBatchEnds.at(i);
+        _distanceBatchEnds[i] = offset;
+    }
+    QVector<int> starts(numConstraints), ends(numConstraints);
+    QVector<float> lengths(numConstraints);
+    for (int i = 0; i < numConstraints; ++i) {
+        int index = offsets[batches.at(i)]++;
+        starts[index] = _distanceStarts.at(i);
+        ends[index] = _distanceEnds.at(i);
+        lengths[index] = _distanceLengths.at(i);
+    }
+    _distanceStarts.swap(starts);
+    _distanceEnds.swap(ends);
+    _distanceLengths.swap(lengths);
 }
-
@@ -44,42 +44,6 @@ private:
     int _numDeltas;
 };
 
-class Constraint {
-public:
-    Constraint() {}
-    virtual ~Constraint() {}
-
-    /// Enforce contraint by moving relevant points.
-    /// \return max distance of point movement
-    virtual float enforce() = 0;
-
-protected:
-    int _type;
-};
-
-class FixedConstraint : public Constraint {
-public:
-    FixedConstraint(VerletPoint* point, const glm::vec3& anchor);
-    float enforce();
-    void setPoint(VerletPoint* point);
-    void setAnchor(const glm::vec3& anchor);
-private:
-    VerletPoint* _point;
-    glm::vec3 _anchor;
-};
-
-class DistanceConstraint : public Constraint {
-public:
-    DistanceConstraint(VerletPoint* startPoint, VerletPoint* endPoint);
-    DistanceConstraint(const DistanceConstraint& other);
-    float enforce();
-    void setDistance(float distance);
-    float getDistance() const { return _distance; }
-private:
-    float _distance;
-    VerletPoint* _points[2];
-};
-
 class Ragdoll {
 public:
 
@@ -95,13 +59,36 @@ public:
     const QVector<VerletPoint>& getRagdollPoints() const { return _ragdollPoints; }
     QVector<VerletPoint>& getRagdollPoints() { return _ragdollPoints; }
 
+    int getNumDistanceConstraints() const { return _distanceLengths.size(); }
+    int getNumFixedConstraints() const { return _fixedAnchors.size(); }
+
 protected:
     void clearRagdollConstraintsAndPoints();
     virtual void initRagdollPoints() = 0;
     virtual void buildRagdollConstraints() = 0;
 
+    /// Holds the point at the anchor.
+    void addFixedConstraint(int pointIndex, const glm::vec3& anchor);
+
+    /// Holds the two points at their current distance from each other.
+    void addDistanceConstraint(int startIndex, int endIndex);
+
     QVector<VerletPoint> _ragdollPoints;
-    QVector<Constraint*> _ragdollConstraints;
+
+private:
+    /// Sorts the distance constraints into batches in which no two constraints share a point.
+    void batchDistanceConstraints();
+
+    // the constraints are kept by type, as parallel arrays of point indices and parameters
+    QVector<int> _fixedPoints;
+    QVector<glm::vec3> _fixedAnchors;
+
+    QVector<int> _distanceStarts;
+    QVector<int> _distanceEnds;
+    QVector<float> _distanceLengths;
+
+    // the end of each batch in the distance arrays, or empty if the constraints have changed since they were batched
+    QVector<int> _distanceBatchEnds;
 };
 
 #endif // hifi_Ragdoll_h
@@ -17,10 +17,13 @@
 #include <QtDebug>
 
 #include "ResourceCache.h"
+#include "ResourceDiskCache.h"
 
 ResourceCache::ResourceCache(QObject* parent) :
     QObject(parent),
-    _lastLRUKey(0) {
+    _lastLRUKey(0),
+    _unusedResourcesSize(0),
+    _unusedResourcesMaxSize(DEFAULT_UNUSED_RESOURCES_MAX_SIZE) {
 }
 
 ResourceCache::~ResourceCache() {
@@ -30,6 +33,11 @@ ResourceCache::~ResourceCache() {
     }
 }
 
+void ResourceCache::setUnusedResourcesMaxSize(qint64 unusedResourcesMaxSize) {
+    _unusedResourcesMaxSize = unusedResourcesMaxSize;
+    unloadUnusedResources();
+}
+
 void ResourceCache::refresh(const QUrl& url) {
     QSharedPointer<Resource> resource = _resources.value(url);
     if (!resource.isNull()) {
@@ -50,21 +58,34 @@ QSharedPointer<Resource> ResourceCache::getResource(const QUrl& url, const QUrl&
         _resources.insert(url, resource);
         
     } else {
-        _unusedResources.remove(resource->getLRUKey());
+        removeUnusedResource(resource);
     }
     return resource;
 }
 
 void ResourceCache::addUnusedResource(const QSharedPointer<Resource>& resource) {
-    const int RETAINED_RESOURCE_COUNT = 50;
-    if (_unusedResources.size() > RETAINED_RESOURCE_COUNT) {
-        // unload the oldest resource
+    // the size is noted as of now, so that the total stays right even if the resource changes while it's unused
+    resource->setLRUKey(++_lastLRUKey);
+    resource->_lruBytes = resource->getBytes();
+    _unusedResources.insert(resource->getLRUKey(), resource);
+    _unusedResourcesSize += resource->_lruBytes;
+    unloadUnusedResources();
+}
+
+void ResourceCache::removeUnusedResource(const QSharedPointer<Resource>& resource) {
+    if (_unusedResources.remove(resource->getLRUKey()) > 0) {
+        _unusedResourcesSize -= resource->_lruBytes;
+    }
+}
+
+void ResourceCache::unloadUnusedResources() {
+    // unload the oldest resources until we're within our budget (but always keep the newest)
+    while (_unusedResourcesSize > _unusedResourcesMaxSize && _unusedResources.size() > 1) {
         QMap<int, QSharedPointer<Resource> >::iterator it = _unusedResources.begin();
+        _unusedResourcesSize -= it.value()->_lruBytes;
         it.value()->setCache(NULL);
         _unusedResources.erase(it);
     }
-    resource->setLRUKey(++_lastLRUKey);
-    _unusedResources.insert(resource->getLRUKey(), resource);
 }
 
 void ResourceCache::attemptRequest(Resource* resource) {
@@ -104,6 +125,7 @@ void ResourceCache::requestCompleted(Resource* resource) {
 }
 
 QNetworkAccessManager* ResourceCache::_networkAccessManager = NULL;
+ResourceDiskCache* ResourceCache::_diskCache = NULL;
 
 const int DEFAULT_REQUEST_LIMIT = 10;
 int ResourceCache::_requestLimit = DEFAULT_REQUEST_LIMIT;
@@ -115,7 +137,9 @@ Resource::Resource(const QUrl& url, bool delayLoad) :
     _url(url),
     _request(url),
     _lruKey(0),
-    _reply(NULL) {
+    _lruBytes(0),
+    _reply(NULL),
+    _bytes(0) {
     
     init();
     
@@ -259,6 +283,13 @@ void Resource::handleDownloadProgress(qint64 bytesReceived, qint64 bytesTotal) {
     _replyTimer = NULL;
     ResourceCache::requestCompleted(this);
     
+    reply = checkDiskCache(reply);
+    if (!reply) {
+        // what we had on disk has gone missing; ask again, unconditionally this time
+        attemptRequest();
+        return;
+    }
+    _bytes = reply->bytesAvailable();
     downloadFinished(reply);
 }
 
@@ -272,7 +303,25 @@ void Resource::handleReplyTimeout() {
 }
 
 void Resource::makeRequest() {
-    _reply = ResourceCache::getNetworkAccessManager()->get(_request);
+    ResourceDiskCache* diskCache = ResourceCache::getDiskCache();
+    if (diskCache && (_url.scheme() == "http" || _url.scheme() == "https")) {
+        // content that's still fresh on disk needn't go to the network at all (unless we're refreshing)
+        QByteArray content;
+        if (_request.attribute(QNetworkRequest::CacheLoadControlAttribute).toInt() != QNetworkRequest::AlwaysNetwork &&
+                diskCache->load(_url, content)) {
+            _reply = new ResourceDiskReply(_request, content);
+        
+        } else {
+            // the disk cache stands in for the network access manager's
+            QNetworkRequest request = _request;
+            diskCache->addValidators(_url, request);
+            request.setAttribute(QNetworkRequest::CacheLoadControlAttribute, QNetworkRequest::AlwaysNetwork);
+            request.setAttribute(QNetworkRequest::CacheSaveControlAttribute, false);
+            _reply = ResourceCache::getNetworkAccessManager()->get(request);
+        }
+    } else {
+        _reply = ResourceCache::getNetworkAccessManager()->get(_request);
+    }
     
     connect(_reply, SIGNAL(downloadProgress(qint64,qint64)), SLOT(handleDownloadProgress(qint64,qint64)));
     connect(_reply, SIGNAL(error(QNetworkReply::NetworkError)), SLOT(handleReplyError()));
@@ -285,6 +334,26 @@ void Resource::makeRequest() {
     _bytesReceived = _bytesTotal = 0;
 }
 
+QNetworkReply* Resource::checkDiskCache(QNetworkReply* reply) {
+    ResourceDiskCache* diskCache = ResourceCache::getDiskCache();
+    if (!diskCache || qobject_cast<ResourceDiskReply*>(reply) ||
+            !(_url.scheme() == "http" || _url.scheme() == "https")) {
+        return reply;
+    }
+    const int HTTP_NOT_MODIFIED = 304;
+    if (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == HTTP_NOT_MODIFIED) {
+        // what we have on disk is still good
+        QByteArray content;
+        bool loaded = diskCache->loadValidated(_url, reply, content);
+        reply->deleteLater();
+        return loaded ? new ResourceDiskReply(_request, content) : NULL;
+    }
+    if (reply->error() == QNetworkReply::NoError) {
+        diskCache->store(_url, reply, reply->peek(reply->bytesAvailable()));
+    }
+    return reply;
+}
+
 void Resource::handleReplyError(QNetworkReply::NetworkError error, QDebug debug) {
     _reply->disconnect(this);
     _reply->deleteLater();
@@ -27,6 +27,9 @@ class QNetworkReply;
 class QTimer;
 
 class Resource;
+class ResourceDiskCache;
+
+const qint64 DEFAULT_UNUSED_RESOURCES_MAX_SIZE = 100 * 1024 * 1024;
 
 /// Base class for resource caches.
 class ResourceCache : public QObject {
@@ -44,9 +47,21 @@ public:
 
     static int getPendingRequestCount() { return _pendingRequests.size(); }
 
+    /// Sets the disk tier consulted before the network (none, by default).
+    static void setDiskCache(ResourceDiskCache* diskCache) { _diskCache = diskCache; }
+    static ResourceDiskCache* getDiskCache() { return _diskCache; }
+
     ResourceCache(QObject* parent = NULL);
     virtual ~ResourceCache();
 
+    /// Sets the number of bytes the resources that are no longer in use may take up before the least recently used are
+    /// unloaded.
+    void setUnusedResourcesMaxSize(qint64 unusedResourcesMaxSize);
+    qint64 getUnusedResourcesMaxSize() const { return _unusedResourcesMaxSize; }
+
+    /// Returns the number of bytes taken up by the resources that are no longer in use.
+    qint64 getUnusedResourcesSize() const { return _unusedResourcesSize; }
+
     void refresh(const QUrl& url);
 
 protected:
@@ -65,6 +80,7 @@ protected:
         const QSharedPointer<Resource>& fallback, bool delayLoad, const void* extra) = 0;
 
     void addUnusedResource(const QSharedPointer<Resource>& resource);
+    void removeUnusedResource(const QSharedPointer<Resource>& resource);
     
     static void attemptRequest(Resource* resource);
     static void requestCompleted(Resource* resource);
@@ -73,10 +89,15 @@ private:
     
     friend class Resource;
 
+    void unloadUnusedResources();
+
     QHash<QUrl, QWeakPointer<Resource> > _resources;
     int _lastLRUKey;
+    qint64 _unusedResourcesSize;
+    qint64 _unusedResourcesMaxSize;
     
     static QNetworkAccessManager* _networkAccessManager;
+    static ResourceDiskCache* _diskCache;
     static int _requestLimit;
     static QList<QPointer<Resource> > _pendingRequests;
     static QList<Resource*> _loadingRequests;
@@ -121,6 +142,9 @@ public:
     /// For loading resources, returns the load progress.
     float getProgress() const { return (_bytesTotal == 0) ? 0.0f : (float)_bytesReceived / _bytesTotal; }
 
+    /// Returns the number of bytes of memory the resource takes up: by default, the size of its downloaded data.
+    qint64 getBytes() const { return _bytes; }
+
     /// Refreshes the resource.
     void refresh();
 
@@ -147,6 +171,9 @@ protected:
     /// Reinserts this resource into the cache.
     virtual void reinsert();
 
+    /// Should be called by subclasses whose loaded data takes up a different amount of memory than what was downloaded.
+    void setBytes(qint64 bytes) { _bytes = bytes; }
+
     QUrl _url;
     QNetworkRequest _request;
     bool _startedLoading;
@@ -168,17 +195,20 @@ private:
     void setLRUKey(int lruKey) { _lruKey = lruKey; }
     
     void makeRequest();
+    QNetworkReply* checkDiskCache(QNetworkReply* reply);
     
     void handleReplyError(QNetworkReply::NetworkError error, QDebug debug);
     
     friend class ResourceCache;
     
     int _lruKey;
+    qint64 _lruBytes;
     QNetworkReply* _reply;
     QTimer* _replyTimer;
     int _index;
     qint64 _bytesReceived;
     qint64 _bytesTotal;
+    qint64 _bytes;
     int _attempts;
 };
 
@@ -0,0 +1,291 @@
+//
+//  ResourceDiskCache.cpp
+//  libraries/shared/src
+//
+//  Copyright 2014 High Fidelity, Inc.
+//
+//  Distributed under the Apache License, Version 2.0.
+//  See the accompanying file LICENSE or http://www.apache.org/licenses/LICENSE-2.0.html
+//
+
+#include <cctype>
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QNetworkAccessManager>
+#include <QPointer>
+#include <QSaveFile>
+#include <QTimer>
+#include <QtDebug>
+
+#include "ResourceDiskCache.h"
+
+const quint32 INDEX_VERSION = 1;
+const char* INDEX_FILENAME = "index";
+
+// how long after a change to the index we save it, so that the changes made in the meantime are saved along with it
+const int SAVE_INDEX_DELAY_MSECS = 5000;
+
+const int HTTP_OK = 200;
+const qint64 MSECS_PER_SECOND = 1000;
+const qint64 MAX_HEURISTIC_FRESHNESS_MSECS = 24 * 60 * 60 * MSECS_PER_SECOND;
+
+QDataStream& operator<<(QDataStream& out, const ResourceDiskCacheEntry& entry) {
+    return out << entry.hash << entry.eTag << entry.lastModified << entry.size << entry.freshUntil << entry.lastUsed;
+}
+
+QDataStream& operator>>(QDataStream& in, ResourceDiskCacheEntry& entry) {
+    return in >> entry.hash >> entry.eTag >> entry.lastModified >> entry.size >> entry.freshUntil >> entry.lastUsed;
+}
+
+// returns the time until which the content of the reply may be used without revalidating it, per its caching headers
+static qint64 getFreshUntil(const QNetworkReply* reply) {
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    QByteArray cacheControl = reply->rawHeader("Cache-Control").toLower();
+    if (cacheControl.contains("no-cache")) {
+        return now;
+    }
+    const QByteArray MAX_AGE = "max-age=";
+    int maxAgeIndex = cacheControl.indexOf(MAX_AGE);
+    if (maxAgeIndex != -1) {
+        int start = maxAgeIndex + MAX_AGE.size();
+        int end = start;
+        while (end < cacheControl.size() && isdigit(cacheControl.at(end))) {
+            end++;
+        }
+        return now + cacheControl.mid(start, end - start).toLongLong() * MSECS_PER_SECOND;
+    }
+
+    // lacking those, the usual heuristic: a tenth of the time since the content was last modified
+    QDateTime lastModified = reply->header(QNetworkRequest::LastModifiedHeader).toDateTime();
+    if (lastModified.isValid()) {
+        return now + qBound((qint64)0, lastModified.msecsTo(QDateTime::currentDateTimeUtc()) / 10,
+            MAX_HEURISTIC_FRESHNESS_MSECS);
+    }
+    return now;
+}
+
+ResourceDiskCache::ResourceDiskCache(const QString& directory, QObject* parent) :
+    QObject(parent),
+    _directory(directory),
+    _maximumSize(DEFAULT_RESOURCE_DISK_CACHE_SIZE),
+    _size(0),
+    _indexChanged(false),
+    _saveTimer(new QTimer(this)) {
+
+    _saveTimer->setSingleShot(true);
+    _saveTimer->setInterval(SAVE_INDEX_DELAY_MSECS);
+    connect(_saveTimer, SIGNAL(timeout()), SLOT(saveIndex()));
+
+    QDir().mkpath(_directory);
+    loadIndex();
+}
+
+ResourceDiskCache::~ResourceDiskCache() {
+    if (_indexChanged) {
+        saveIndex();
+    }
+}
+
+void ResourceDiskCache::setMaximumSize(qint64 maximumSize) {
+    _maximumSize = maximumSize;
+    evict();
+    scheduleSaveIndex();
+}
+
+bool ResourceDiskCache::load(const QUrl& url, QByteArray& content) {
+    QHash<QUrl, ResourceDiskCacheEntry>::iterator it = _entries.find(url);
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    if (it == _entries.end() || it.value().freshUntil <= now) {
+        return false;
+    }
+    QFile file(getObjectPath(it.value().hash));
+    if (!file.open(QIODevice::ReadOnly)) {
+        removeEntry(url);
+        return false;
+    }
+    content = file.readAll();
+    setLastUsed(url, it.value(), now);
+    scheduleSaveIndex();
+    return true;
+}
+
+void ResourceDiskCache::addValidators(const QUrl& url, QNetworkRequest& request) const {
+    QHash<QUrl, ResourceDiskCacheEntry>::const_iterator it = _entries.constFind(url);
+    if (it == _entries.constEnd()) {
+        return;
+    }
+    if (!it.value().eTag.isEmpty()) {
+        request.setRawHeader("If-None-Match", it.value().eTag);
+    }
+    if (!it.value().lastModified.isEmpty()) {
+        request.setRawHeader("If-Modified-Since", it.value().lastModified);
+    }
+}
+
+bool ResourceDiskCache::loadValidated(const QUrl& url, const QNetworkReply* reply, QByteArray& content) {
+    QHash<QUrl, ResourceDiskCacheEntry>::iterator it = _entries.find(url);
+    if (it == _entries.end()) {
+        return false;
+    }
+    QFile file(getObjectPath(it.value().hash));
+    if (!file.open(QIODevice::ReadOnly)) {
+        removeEntry(url);
+        return false;
+    }
+    content = file.readAll();
+    it.value().freshUntil = getFreshUntil(reply);
+    setLastUsed(url, it.value(), QDateTime::currentMSecsSinceEpoch());
+    scheduleSaveIndex();
+    return true;
+}
+
+void ResourceDiskCache::store(const QUrl& url, const QNetworkReply* reply, const QByteArray& content) {
+    if (reply->rawHeader("Cache-Control").toLower().contains("no-store")) {
+        return;
+    }
+    removeEntry(url);
+    scheduleSaveIndex();
+
+    ResourceDiskCacheEntry entry;
+    entry.hash = QCryptographicHash::hash(content, QCryptographicHash::Sha1).toHex();
+    entry.eTag = reply->rawHeader("ETag");
+    entry.lastModified = reply->rawHeader("Last-Modified");
+    entry.size = content.size();
+    entry.freshUntil = getFreshUntil(reply);
+    entry.lastUsed = QDateTime::currentMSecsSinceEpoch();
+
+    // the same content at another URL is already stored
+    if (!_objectReferences.contains(entry.hash)) {
+        QSaveFile file(getObjectPath(entry.hash));
+        if (!(file.open(QIODevice::WriteOnly) && file.write(content) == content.size() && file.commit())) {
+            qDebug() << "Failed to store" << url << "in the disk cache:" << file.errorString();
+            return;
+        }
+        _size += entry.size;
+    }
+    addEntry(url, entry);
+    evict();
+}
+
+QString ResourceDiskCache::getObjectPath(const QByteArray& hash) const {
+    return QDir(_directory).filePath(QString::fromLatin1(hash));
+}
+
+void ResourceDiskCache::addEntry(const QUrl& url, const ResourceDiskCacheEntry& entry) {
+    _objectReferences[entry.hash]++;
+    _entries.insert(url, entry);
+    _usageOrder.insert(entry.lastUsed, url);
+}
+
+void ResourceDiskCache::removeEntry(const QUrl& url) {
+    QHash<QUrl, ResourceDiskCacheEntry>::iterator it = _entries.find(url);
+    if (it == _entries.end()) {
+        return;
+    }
+    QHash<QByteArray, int>::iterator references = _objectReferences.find(it.value().hash);
+    if (references != _objectReferences.end() && --references.value() == 0) {
+        QFile::remove(getObjectPath(it.value().hash));
+        _size -= it.value().size;
+        _objectReferences.erase(references);
+    }
+    _usageOrder.remove(it.value().lastUsed, url);
+    _entries.erase(it);
+}
+
+void ResourceDiskCache::setLastUsed(const QUrl& url, ResourceDiskCacheEntry& entry, qint64 lastUsed) {
+    _usageOrder.remove(entry.lastUsed, url);
+    entry.lastUsed = lastUsed;
+    _usageOrder.insert(lastUsed, url);
+}
+
+void ResourceDiskCache::evict() {
+    // remove the least recently used
+    while (_size > _maximumSize && !_usageOrder.isEmpty()) {
+        QUrl oldestURL = _usageOrder.constBegin().value();
+        removeEntry(oldestURL);
+    }
+}
+
+void ResourceDiskCache::loadIndex() {
+    QFile file(QDir(_directory).filePath(INDEX_FILENAME));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+    QDataStream in(&file);
+    quint32 version;
+    in >> version;
+    if (version != INDEX_VERSION) {
+        return;
+    }
+    QHash<QUrl, ResourceDiskCacheEntry> entries;
+    in >> entries;
+
+    // keep only the entries whose content is still there
+    for (QHash<QUrl, ResourceDiskCacheEntry>::const_iterator it = entries.constBegin(); it != entries.constEnd(); it++) {
+        if (!QFile::exists(getObjectPath(it.value().hash))) {
+            continue;
+        }
+        if (!_objectReferences.contains(it.value().hash)) {
+            _size += it.value().size;
+        }
+        addEntry(it.key(), it.value());
+    }
+}
+
+void ResourceDiskCache::saveIndex() {
+    QSaveFile file(QDir(_directory).filePath(INDEX_FILENAME));
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "Failed to save the disk cache index:" << file.errorString();
+        return;
+    }
+    QDataStream out(&file);
+    out << INDEX_VERSION << _entries;
+    file.commit();
+    _indexChanged = false;
+    _saveTimer->stop();
+}
+
+void ResourceDiskCache::scheduleSaveIndex() {
+    if (!_indexChanged) {
+        _indexChanged = true;
+        _saveTimer->start();
+    }
+}
+
+ResourceDiskReply::ResourceDiskReply(const QNetworkRequest& request, const QByteArray& content, QObject* parent) :
+    QNetworkReply(parent),
+    _content(content),
+    _offset(0) {
+
+    setRequest(request);
+    setUrl(request.url());
+    setOperation(QNetworkAccessManager::GetOperation);
+    setHeader(QNetworkRequest::ContentLengthHeader, _content.size());
+    setAttribute(QNetworkRequest::HttpStatusCodeAttribute, HTTP_OK);
+    setAttribute(QNetworkRequest::SourceIsFromCacheAttribute, true);
+    open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+    setFinished(true);
+
+    // like network replies, report on the next pass through the event loop
+    QMetaObject::invokeMethod(this, "finish", Qt::QueuedConnection);
+}
+
+qint64 ResourceDiskReply::readData(char* data, qint64 maxSize) {
+    qint64 bytesRead = qMin(maxSize, _content.size() - _offset);
+    memcpy(data, _content.constData() + _offset, bytesRead);
+    _offset += bytesRead;
+    return bytesRead;
+}
+
+void ResourceDiskReply::finish() {
+    // the receivers may well delete us
+    QPointer<ResourceDiskReply> self(this);
+    emit downloadProgress(_content.size(), _content.size());
+    if (self) {
+        emit finished();
+    }
+}
@@ -0,0 +1,126 @@
+//
+//  ResourceDiskCache.h
+//  libraries/shared/src
+//
+//  Copyright 2014 High Fidelity, Inc.
+//
+//  A local disk tier for the resource caches, consulted before the network
+//
+//  Distributed under the Apache License, Version 2.0.
+//  See the accompanying file LICENSE or http://www.apache.org/licenses/LICENSE-2.0.html
+//
+
+#ifndef hifi_ResourceDiskCache_h
+#define hifi_ResourceDiskCache_h
+
+#include <QByteArray>
+#include <QHash>
+#include <QMultiMap>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QObject>
+#include <QUrl>
+
+class QTimer;
+
+const qint64 DEFAULT_RESOURCE_DISK_CACHE_SIZE = 1024 * 1024 * 1024;
+
+/// What the disk cache knows about one URL.
+class ResourceDiskCacheEntry {
+public:
+    QByteArray hash; ///< the SHA-1 of the content, which names the file it's stored in
+    QByteArray eTag;
+    QByteArray lastModified;
+    qint64 size;
+    qint64 freshUntil; ///< until when (in msecs since the epoch) the content may be used without revalidating it
+    qint64 lastUsed;
+};
+
+/// Keeps the content of downloaded resources on disk, so that they needn't be downloaded again.  Content is stored once per
+/// distinct content (files are named by the SHA-1 of what they hold), and an index maps URLs to it along with their
+/// validators (ETag, Last-Modified).  Content that's still fresh by its caching headers (or, lacking those, for a tenth of
+/// the time since it was last modified, up to a day) is used without going to the network; stale content is revalidated
+/// with a conditional request.  The least recently used content is evicted to keep to the maximum size.  Changes to the
+/// index are saved a little while after they're made (and when the cache is destroyed), so that a burst of them costs one
+/// write.  Used from the thread of the network access manager only.
+class ResourceDiskCache : public QObject {
+    Q_OBJECT
+
+public:
+
+    ResourceDiskCache(const QString& directory, QObject* parent = NULL);
+    virtual ~ResourceDiskCache();
+
+    void setMaximumSize(qint64 maximumSize);
+    qint64 getMaximumSize() const { return _maximumSize; }
+
+    /// Returns the total size of the stored content.
+    qint64 getSize() const { return _size; }
+
+    /// Reads the content stored for the URL if it's still fresh.
+    /// \return whether the content was read
+    bool load(const QUrl& url, QByteArray& content);
+
+    /// Adds the validators of the content stored for the URL (if any) to a request for it.
+    void addValidators(const QUrl& url, QNetworkRequest& request) const;
+
+    /// Reads the content stored for the URL after the server has replied that it hasn't been modified.
+    /// \return whether the content was read
+    bool loadValidated(const QUrl& url, const QNetworkReply* reply, QByteArray& content);
+
+    /// Stores the content of a successful reply for the URL.
+    void store(const QUrl& url, const QNetworkReply* reply, const QByteArray& content);
+
+private slots:
+
+    void saveIndex();
+
+private:
+
+    QString getObjectPath(const QByteArray& hash) const;
+    void addEntry(const QUrl& url, const ResourceDiskCacheEntry& entry);
+    void removeEntry(const QUrl& url);
+    void setLastUsed(const QUrl& url, ResourceDiskCacheEntry& entry, qint64 lastUsed);
+    void evict();
+    void loadIndex();
+    void scheduleSaveIndex();
+
+    QString _directory;
+    qint64 _maximumSize;
+    qint64 _size;
+
+    QHash<QUrl, ResourceDiskCacheEntry> _entries;
+    QMultiMap<qint64, QUrl> _usageOrder; // the URLs by when they were last used, so the least recently used come first
+    QHash<QByteArray, int> _objectReferences; // how many URLs share each stored content
+
+    bool _indexChanged; // whether there are changes to the index that haven't been saved
+    QTimer* _saveTimer;
+};
+
+/// A reply that serves content from the disk cache in place of one from the network.
+class ResourceDiskReply : public QNetworkReply {
+    Q_OBJECT
+
+public:
+
+    ResourceDiskReply(const QNetworkRequest& request, const QByteArray& content, QObject* parent = NULL);
+
+    virtual void abort() { }
+    virtual bool isSequential() const { return true; }
+    virtual qint64 bytesAvailable() const { return _content.size() - _offset + QNetworkReply::bytesAvailable(); }
+
+protected:
+
+    virtual qint64 readData(char* data, qint64 maxSize);
+
+private slots:
+
+    void finish();
+
+private:
+
+    QByteArray _content;
+    qint64 _offset;
+};
+
+#endif // hifi_ResourceDiskCache_h
@@ -0,0 +1,72 @@
+//
+//  SweepAndPrune.cpp
+//  libraries/shared/src
+//
+//  Copyright 2014 High Fidelity, Inc.
+//
+//  Distributed under the Apache License, Version 2.0.
+//  See the accompanying file LICENSE or http://www.apache.org/licenses/LICENSE-2.0.html
+//
+
+#include <QtAlgorithms>
+
+#include "SweepAndPrune.h"
+
+void SweepAndPrune::clear() {
+    _minima.clear();
+    _maxima.clear();
+}
+
+int SweepAndPrune::addBox(const glm::vec3& minimum, const glm::vec3& maximum) {
+    _minima.append(minimum);
+    _maxima.append(maximum);
+    return _minima.size() - 1;
+}
+
+int SweepAndPrune::addSphere(const glm::vec3& center, float radius) {
+    glm::vec3 extent(radius, radius, radius);
+    return addBox(center - extent, center + extent);
+}
+
+/// Orders box indices by the lower x bounds of their boxes.
+class MinimumXLessThan {
+public:
+    MinimumXLessThan(const QVector<glm::vec3>& minima) : _minima(minima) { }
+    bool operator()(int first, int second) const { return _minima.at(first).x < _minima.at(second).x; }
+private:
+    const QVector<glm::vec3>& _minima;
+};
+
+void SweepAndPrune::findOverlappingPairs(QVector<IndexPair>& pairs) {
+    pairs.clear();
+    int boxCount = _minima.size();
+    _sortedIndices.resize(boxCount);
+    for (int i = 0; i < boxCount; i++) {
+        _sortedIndices[i] = i;
+    }
+    qSort(_sortedIndices.begin(), _sortedIndices.end(), MinimumXLessThan(_minima));
+
+    // the active boxes are the ones whose x ranges include the current box's lower bound
+    _activeIndices.clear();
+    foreach (int index, _sortedIndices) {
+        const glm::vec3& minimum = _minima.at(index);
+        const glm::vec3& maximum = _maxima.at(index);
+        for (int i = 0; i < _activeIndices.size(); ) {
+            int activeIndex = _activeIndices.at(i);
+            const glm::vec3& activeMaximum = _maxima.at(activeIndex);
+            if (activeMaximum.x < minimum.x) {
+                // the sweep has passed this one by; order doesn't matter, so swap in the last rather than shifting
+                _activeIndices[i] = _activeIndices.last();
+                _activeIndices.removeLast();
+                continue;
+            }
+            const glm::vec3& activeMinimum = _minima.at(activeIndex);
+            if (activeMinimum.y <= maximum.y && minimum.y <= activeMaximum.y &&
+                    activeMinimum.z <= maximum.z && minimum.z <= activeMaximum.z) {
+                pairs.append(IndexPair(qMin(index, activeIndex), qMax(index, activeIndex)));
+            }
+            i++;
+        }
+        _activeIndices.append(index);
+    }
+}
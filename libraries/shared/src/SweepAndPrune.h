@@ -0,0 +1,53 @@
+//
+//  SweepAndPrune.h
+//  libraries/shared/src
+//
+//  Copyright 2014 High Fidelity, Inc.
+//
+//  Broadphase that finds overlapping pairs of axis-aligned boxes
+//
+//  Distributed under the Apache License, Version 2.0.
+//  See the accompanying file LICENSE or http://www.apache.org/licenses/LICENSE-2.0.html
+//
+
+#ifndef hifi_SweepAndPrune_h
+#define hifi_SweepAndPrune_h
+
+#include <glm/glm.hpp>
+
+#include <QPair>
+#include <QVector>
+
+typedef QPair<int, int> IndexPair;
+
+/// Finds the pairs of overlapping axis-aligned boxes by sorting them along the x axis and sweeping, so that the cost of
+/// finding candidates for a narrowphase test depends on how many things are near each other rather than on the square of
+/// their number.  Fill it with the frame's boxes, find the pairs, and clear it for the next frame.
+class SweepAndPrune {
+public:
+
+    /// Removes all of the boxes.
+    void clear();
+
+    /// Adds a box and returns its index.
+    int addBox(const glm::vec3& minimum, const glm::vec3& maximum);
+
+    /// Adds the box bounding a sphere and returns its index.
+    int addSphere(const glm::vec3& center, float radius);
+
+    int getBoxCount() const { return _minima.size(); }
+
+    /// Finds the pairs of boxes that overlap (including those that merely touch).
+    /// \param pairs[out] the indices of the overlapping boxes, the lower index first in each pair
+    /// \remark Side effect: any initial contents in pairs will be lost
+    void findOverlappingPairs(QVector<IndexPair>& pairs);
+
+private:
+
+    QVector<glm::vec3> _minima;
+    QVector<glm::vec3> _maxima;
+    QVector<int> _sortedIndices;
+    QVector<int> _activeIndices;
+};
+
+#endif // hifi_SweepAndPrune_h
@@ -34,10 +34,14 @@ VerletCapsuleShape::VerletCapsuleShape(float radius, VerletPoint* startPoint, Ve
 const glm::quat& VerletCapsuleShape::getRotation() const {
     // NOTE: The "rotation" of this shape must be computed on the fly, 
     // which makes this method MUCH more more expensive than you might expect.
+    // It's only written back when it has changed, so that concurrent readers of a capsule whose points
+    // have been read since they last moved (see PhysicsSimulation::computeCollisions()) never write to it.
     glm::vec3 axis;
     computeNormalizedAxis(axis);
-    VerletCapsuleShape* thisCapsule = const_cast<VerletCapsuleShape*>(this);
-    thisCapsule->_rotation = computeNewRotation(axis);
+    glm::quat rotation = computeNewRotation(axis);
+    if (rotation != _rotation) {
+        const_cast<VerletCapsuleShape*>(this)->_rotation = rotation;
+    }
     return _rotation;
 }
 
@@ -64,9 +68,11 @@ void VerletCapsuleShape::setTranslation(const glm::vec3& position) {
 }
 
 const glm::vec3& VerletCapsuleShape::getTranslation() const {
-    // the "translation" of this shape must be computed on the fly
-    VerletCapsuleShape* thisCapsule = const_cast<VerletCapsuleShape*>(this);
-    thisCapsule->_translation = 0.5f * (_startPoint->_position + _endPoint->_position);
+    // the "translation" of this shape must be computed on the fly, and like the rotation is only written back when changed
+    glm::vec3 translation = 0.5f * (_startPoint->_position + _endPoint->_position);
+    if (translation != _translation) {
+        const_cast<VerletCapsuleShape*>(this)->_translation = translation;
+    }
     return _translation;
 }
 
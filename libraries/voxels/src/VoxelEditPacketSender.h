@@ -49,5 +49,10 @@ public:
 
     // My server type is the voxel server
     virtual char getMyNodeType() const { return NodeType::VoxelServer; }
+
+    // voxel edits are an octcode followed by a color, so a later edit of the same voxel replaces an earlier one
+    virtual bool isCoalescableEditType(PacketType type) const {
+        return type == PacketTypeVoxelSet || type == PacketTypeVoxelSetDestructive || type == PacketTypeVoxelErase;
+    }
 };
 #endif // hifi_VoxelEditPacketSender_h
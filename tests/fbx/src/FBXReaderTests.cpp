@@ -0,0 +1,257 @@
+//
+//  FBXReaderTests.cpp
+//  tests/fbx/src
+//
+//  Copyright 2014 High Fidelity, Inc.
+//
+//  Distributed under the Apache License, Version 2.0.
+//  See the accompanying file LICENSE or http://www.apache.org/licenses/LICENSE-2.0.html
+//
+
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QtEndian>
+
+#include <FBXReader.h>
+#include <SharedUtil.h>
+
+#include "FBXReaderTests.h"
+
+const int GRID_SIZE = 300;
+
+// the binary format, written much as the exporters do, so that we can check what's read against what was written
+class BinaryFBXWriter {
+public:
+
+    BinaryFBXWriter() : _file("Kaydara FBX Binary  \0\x1a\0", 23) {
+        appendValue(_file, (quint32)7400);
+    }
+
+    /// Starts a node with the given (encoded) properties; its children follow until it's ended.
+    void beginNode(const QByteArray& name, const QList<QByteArray>& properties) {
+        _nodeStarts.append(_file.size());
+        QByteArray propertyList;
+        foreach (const QByteArray& property, properties) {
+            propertyList += property;
+        }
+        appendValue(_file, (quint32)0); // the end offset, filled in when the node is ended
+        appendValue(_file, (quint32)properties.size());
+        appendValue(_file, (quint32)propertyList.size());
+        appendValue(_file, (quint8)name.size());
+        _file += name + propertyList;
+    }
+
+    void endNode(bool hasChildren) {
+        if (hasChildren) {
+            appendNullNode();
+        }
+        quint32 endOffset = qToLittleEndian<quint32>(_file.size());
+        memcpy(_file.data() + _nodeStarts.takeLast(), &endOffset, sizeof(endOffset));
+    }
+
+    const QByteArray& finish() {
+        appendNullNode();
+        return _file;
+    }
+
+    template<class T> static QByteArray encodeValue(char type, T value) {
+        QByteArray property(1, type);
+        appendValue(property, value);
+        return property;
+    }
+
+    static QByteArray encodeString(const QByteArray& value) {
+        QByteArray property(1, 'S');
+        appendValue(property, (quint32)value.size());
+        return property + value;
+    }
+
+    template<class T> static QByteArray encodeArray(char type, const QVector<T>& values, bool compressed) {
+        QByteArray elements;
+        foreach (T value, values) {
+            appendValue(elements, value);
+        }
+        if (compressed) {
+            elements = qCompress(elements).mid(sizeof(quint32)); // without Qt's length prefix
+        }
+        QByteArray property(1, type);
+        appendValue(property, (quint32)values.size());
+        appendValue(property, (quint32)(compressed ? 1 : 0));
+        appendValue(property, (quint32)elements.size());
+        return property + elements;
+    }
+
+private:
+
+    template<class T> static void appendValue(QByteArray& data, T value) {
+        QDataStream out(&data, QIODevice::Append);
+        out.setByteOrder(QDataStream::LittleEndian);
+        out.setFloatingPointPrecision(QDataStream::DoublePrecision);
+        out << value;
+    }
+
+    void appendNullNode() {
+        const int NULL_NODE_SIZE = 13;
+        _file += QByteArray(NULL_NODE_SIZE, 0);
+    }
+
+    QByteArray _file;
+    QList<int> _nodeStarts;
+};
+
+// a bumpy grid of triangles, big enough that its arrays are inflated on the inflater threads
+static QByteArray createGridModel(const QVector<double>& vertices, const QVector<qint32>& indices, bool compressed) {
+    BinaryFBXWriter writer;
+    writer.beginNode("Objects", QList<QByteArray>());
+    writer.beginNode("Geometry", QList<QByteArray>() << BinaryFBXWriter::encodeValue('L', (qint64)1) <<
+        BinaryFBXWriter::encodeString("grid") << BinaryFBXWriter::encodeString("Mesh"));
+    writer.beginNode("Vertices", QList<QByteArray>() << BinaryFBXWriter::encodeArray('d', vertices, compressed));
+    writer.endNode(false);
+    writer.beginNode("PolygonVertexIndex", QList<QByteArray>() << BinaryFBXWriter::encodeArray('i', indices, compressed));
+    writer.endNode(false);
+    writer.endNode(true);
+    writer.endNode(true);
+    return writer.finish();
+}
+
+static void createGrid(QVector<double>& vertices, QVector<qint32>& indices) {
+    for (int i = 0; i < GRID_SIZE; i++) {
+        for (int j = 0; j < GRID_SIZE; j++) {
+            vertices << i << randFloat() << j;
+        }
+    }
+    for (int i = 0; i < GRID_SIZE - 1; i++) {
+        for (int j = 0; j < GRID_SIZE - 1; j++) {
+            int corner = i * GRID_SIZE + j;
+            // the last index of each polygon is complemented
+            indices << corner << corner + 1 << ~(corner + GRID_SIZE);
+            indices << corner + 1 << corner + GRID_SIZE + 1 << ~(corner + GRID_SIZE);
+        }
+    }
+}
+
+static const FBXNode* findNode(const FBXNode& parent, const QByteArray& name) {
+    for (int i = 0; i < parent.children.size(); i++) {
+        const FBXNode& child = parent.children.at(i);
+        if (child.name == name) {
+            return &child;
+        }
+        const FBXNode* descendant = findNode(child, name);
+        if (descendant) {
+            return descendant;
+        }
+    }
+    return NULL;
+}
+
+void FBXReaderTests::parsingTests() {
+    qDebug() << "******************************************************************************************";
+    qDebug() << "FBXReaderTests::parsingTests()";
+
+    QVector<double> vertices;
+    QVector<qint32> indices;
+    createGrid(vertices, indices);
+
+    QVector<FBXGeometry> geometries;
+    for (int compressed = 0; compressed <= 1; compressed++) {
+        QByteArray model = createGridModel(vertices, indices, compressed);
+        try {
+            FBXNode top = parseFBX(model);
+            const FBXNode* verticesNode = findNode(top, "Vertices");
+            const FBXNode* indicesNode = findNode(top, "PolygonVertexIndex");
+            if (!(verticesNode && indicesNode)) {
+                qDebug() << "FAIL: parsed" << (compressed ? "compressed" : "uncompressed") << "model is missing its arrays";
+                continue;
+            }
+            if (verticesNode->properties.at(0).value<QVector<double> >() != vertices ||
+                    indicesNode->properties.at(0).value<QVector<int> >() != indices) {
+                qDebug() << "FAIL: parsed" << (compressed ? "compressed" : "uncompressed") <<
+                    "arrays differ from those written";
+            }
+            geometries.append(readFBX(model, QVariantHash()));
+
+        } catch (const QString& error) {
+            qDebug() << "FAIL: error parsing" << (compressed ? "compressed" : "uncompressed") << "model:" << error;
+        }
+    }
+    if (geometries.size() == 2) {
+        if (geometries.at(0).meshes.size() != 1 || geometries.at(1).meshes.size() != 1) {
+            qDebug() << "FAIL: expected a mesh in each model, got" << geometries.at(0).meshes.size() << "and" <<
+                geometries.at(1).meshes.size();
+
+        } else if (geometries.at(0).meshes.at(0).vertices != geometries.at(1).meshes.at(0).vertices) {
+            qDebug() << "FAIL: compressed and uncompressed models have different vertices";
+        }
+    }
+
+    // truncated models should be reported as such, rather than read as zeros
+    QByteArray model = createGridModel(vertices, indices, true);
+    bool threw = false;
+    try {
+        readFBX(model.left(model.size() / 2), QVariantHash());
+
+    } catch (const QString&) {
+        threw = true;
+    }
+    if (!threw) {
+        qDebug() << "FAIL: truncated model was read without error";
+    }
+}
+
+static void benchmarkModel(const QString& name, const QByteArray& model) {
+    const int ITERATIONS = 10;
+    const float USECS_PER_MSEC = 1000.0f;
+    const float BYTES_PER_MEGABYTE = 1024.0f * 1024.0f;
+    try {
+        quint64 start = usecTimestampNow();
+        for (int i = 0; i < ITERATIONS; i++) {
+            parseFBX(model);
+        }
+        quint64 parseTime = (usecTimestampNow() - start) / ITERATIONS;
+
+        start = usecTimestampNow();
+        for (int i = 0; i < ITERATIONS; i++) {
+            readFBX(model, QVariantHash());
+        }
+        quint64 readTime = (usecTimestampNow() - start) / ITERATIONS;
+
+        qDebug() << "TIME -" << name << "(" << model.size() << "bytes): parse" << parseTime / USECS_PER_MSEC << "msecs (" <<
+            model.size() / BYTES_PER_MEGABYTE / (parseTime / (USECS_PER_MSEC * USECS_PER_MSEC)) << "MB/s ), read" <<
+            readTime / USECS_PER_MSEC << "msecs";
+
+    } catch (const QString& error) {
+        qDebug() << "FAIL: error reading" << name << ":" << error;
+    }
+}
+
+void FBXReaderTests::parsingBenchmark(const QStringList& models) {
+    qDebug() << "******************************************************************************************";
+    qDebug() << "FBXReaderTests::parsingBenchmark()";
+
+    QStringList paths = models;
+    foreach (const QFileInfo& info, QDir(SAMPLE_MODELS_DIRECTORY).entryInfoList(QStringList() << "*.fbx")) {
+        paths.append(info.filePath());
+    }
+    foreach (const QString& path, paths) {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            qDebug() << "FAIL: couldn't open" << path;
+            continue;
+        }
+        benchmarkModel(QFileInfo(path).fileName(), file.readAll());
+    }
+
+    QVector<double> vertices;
+    QVector<qint32> indices;
+    createGrid(vertices, indices);
+    benchmarkModel("uncompressed grid", createGridModel(vertices, indices, false));
+    benchmarkModel("compressed grid", createGridModel(vertices, indices, true));
+}
+
+void FBXReaderTests::runAllTests(const QStringList& models) {
+    parsingTests();
+    parsingBenchmark(models);
+}
@@ -0,0 +1,24 @@
+//
+//  FBXReaderTests.h
+//  tests/fbx/src
+//
+//  Copyright 2014 High Fidelity, Inc.
+//
+//  Distributed under the Apache License, Version 2.0.
+//  See the accompanying file LICENSE or http://www.apache.org/licenses/LICENSE-2.0.html
+//
+
+#ifndef hifi_FBXReaderTests_h
+#define hifi_FBXReaderTests_h
+
+#include <QStringList>
+
+namespace FBXReaderTests {
+
+    void parsingTests();
+    void parsingBenchmark(const QStringList& models);
+
+    void runAllTests(const QStringList& models);
+}
+
+#endif // hifi_FBXReaderTests_h
@@ -11,11 +11,16 @@
 
 #include <stdlib.h>
 
+#include <QElapsedTimer>
 #include <QScriptValueIterator>
+#include <QTemporaryDir>
+#include <QThreadPool>
 
 #include <SharedUtil.h>
 
+#include <MetavoxelImporter.h>
 #include <MetavoxelMessages.h>
+#include <MetavoxelSnapshotStore.h>
 
 #include "MetavoxelTests.h"
 
@@ -439,6 +444,16 @@ static bool testSerialization(Bitstream::MetadataType metadataType) {
     return false;
 }
 
+static void runSerializationBenchmark();
+
+static bool testSnapshotStore();
+
+static bool testVolumeImport();
+
+static bool testPropertyAccessors();
+
+static bool testRaySpannerIntersection();
+
 bool MetavoxelTests::run() {
     LimitedNodeList::createInstance();
 
@@ -558,6 +573,49 @@ bool MetavoxelTests::run() {
             "spanner mutations";
     }
     
+    if (test == 0 || test == 7) {
+        qDebug() << "Running snapshot store test...";
+        qDebug();
+        
+        if (testSnapshotStore()) {
+            return true;
+        }
+    }
+    
+    if (test == 0 || test == 8) {
+        qDebug() << "Running volume import test...";
+        qDebug();
+        
+        if (testVolumeImport()) {
+            return true;
+        }
+    }
+    
+    if (test == 0 || test == 9) {
+        qDebug() << "Running property accessor test...";
+        qDebug();
+        
+        if (testPropertyAccessors()) {
+            return true;
+        }
+    }
+    
+    if (test == 0 || test == 10) {
+        qDebug() << "Running ray spanner intersection test...";
+        qDebug();
+        
+        if (testRaySpannerIntersection()) {
+            return true;
+        }
+    }
+    
+    if (test == 6) {
+        qDebug() << "Running serialization benchmark...";
+        qDebug();
+        
+        runSerializationBenchmark();
+    }
+    
     qDebug() << "All tests passed!";
     
     return false;
@@ -830,6 +888,332 @@ int MutateVisitor::visit(MetavoxelInfo& info) {
     return STOP_RECURSION;
 }
 
+static bool testSnapshotStore() {
+    QTemporaryDir directory;
+    QString filename = directory.path() + "/metavoxels.snapshots";
+    
+    MetavoxelData data;
+    MetavoxelSnapshotStore store(filename);
+    if (store.load(data)) {
+        qDebug() << "Loaded snapshot from nonexistent file.";
+        return true;
+    }
+    data.expand();
+    RandomVisitor visitor;
+    data.guide(visitor);
+    if (!store.save(data)) {
+        qDebug() << "Failed to write initial snapshot.";
+        return true;
+    }
+    int initialNodes = store.getNodesWritten();
+    
+    const int SNAPSHOT_COUNT = 10;
+    for (int i = 0; i < SNAPSHOT_COUNT; i++) {
+        MutateVisitor mutator;
+        data.guide(mutator);
+        int nodesWritten = store.getNodesWritten();
+        if (!store.save(data)) {
+            qDebug() << "Failed to write snapshot" << i;
+            return true;
+        }
+        // only the mutated leaves and their ancestors should have been written
+        if (store.getNodesWritten() - nodesWritten >= initialNodes) {
+            qDebug() << "Snapshot" << i << "rewrote unchanged nodes.";
+            return true;
+        }
+    }
+    
+    MetavoxelData loaded;
+    MetavoxelSnapshotStore loadingStore(filename);
+    if (!loadingStore.load(loaded) || !loaded.deepEquals(data)) {
+        qDebug() << "Loaded snapshot doesn't match saved data.";
+        return true;
+    }
+    
+    qDebug() << "Wrote" << store.getNodesWritten() << "nodes, shared" << store.getNodesShared() << "in" <<
+        store.getFileSize() << "bytes";
+    qDebug();
+    
+    return false;
+}
+
+/// A volume of randomly colored blocks, with the odd voxel changed so that not everything merges.
+class TestVolume : public MetavoxelVolume {
+public:
+    
+    TestVolume(int resolution);
+    
+    virtual void* getValue(int x, int y, int z) const;
+
+private:
+    
+    QVector<QRgb> _colors;
+};
+
+const int TEST_VOLUME_BLOCK_SIZE = 4;
+
+TestVolume::TestVolume(int resolution) :
+    MetavoxelVolume(AttributeRegistry::getInstance()->getColorAttribute(), resolution),
+    _colors(resolution * resolution * resolution) {
+    
+    int blocksPerSide = resolution / TEST_VOLUME_BLOCK_SIZE;
+    QVector<QRgb> blockColors(blocksPerSide * blocksPerSide * blocksPerSide);
+    for (int i = 0; i < blockColors.size(); i++) {
+        blockColors[i] = randomBoolean() ? QRgb() : qRgb(randomColorValue(), randomColorValue(), randomColorValue());
+    }
+    for (int z = 0, index = 0; z < resolution; z++) {
+        for (int y = 0; y < resolution; y++) {
+            for (int x = 0; x < resolution; x++, index++) {
+                _colors[index] = blockColors.at(((z / TEST_VOLUME_BLOCK_SIZE) * blocksPerSide +
+                    y / TEST_VOLUME_BLOCK_SIZE) * blocksPerSide + x / TEST_VOLUME_BLOCK_SIZE);
+            }
+        }
+    }
+    const int ODD_VOXEL_COUNT = 100;
+    for (int i = 0; i < ODD_VOXEL_COUNT; i++) {
+        _colors[randIntInRange(0, _colors.size() - 1)] = qRgb(randomColorValue(), randomColorValue(), randomColorValue());
+    }
+}
+
+void* TestVolume::getValue(int x, int y, int z) const {
+    return encodeInline(_colors.at((z * _resolution + y) * _resolution + x));
+}
+
+/// Compares the voxels of a volume with the leaves they were imported into.
+class VolumeCheckVisitor : public MetavoxelVisitor {
+public:
+    
+    int leafCount;
+    int mismatches;
+    
+    VolumeCheckVisitor(const MetavoxelVolume& volume, const glm::vec3& minimum, float size);
+    virtual int visit(MetavoxelInfo& info);
+
+private:
+    
+    const MetavoxelVolume& _volume;
+    glm::vec3 _minimum;
+    float _voxelSize;
+};
+
+VolumeCheckVisitor::VolumeCheckVisitor(const MetavoxelVolume& volume, const glm::vec3& minimum, float size) :
+    MetavoxelVisitor(QVector<AttributePointer>() << volume.getAttribute()),
+    leafCount(0),
+    mismatches(0),
+    _volume(volume),
+    _minimum(minimum),
+    _voxelSize(size / volume.getResolution()) {
+}
+
+int VolumeCheckVisitor::visit(MetavoxelInfo& info) {
+    if (!info.isLeaf) {
+        return DEFAULT_ORDER;
+    }
+    leafCount++;
+    glm::ivec3 start = glm::ivec3(glm::round((info.minimum - _minimum) / _voxelSize));
+    int voxels = qMax((int)glm::round(info.size / _voxelSize), 1);
+    QRgb value = info.inputValues.at(0).getInlineValue<QRgb>();
+    for (int z = start.z; z < start.z + voxels; z++) {
+        for (int y = start.y; y < start.y + voxels; y++) {
+            for (int x = start.x; x < start.x + voxels; x++) {
+                if (decodeInline<QRgb>(_volume.getValue(x, y, z)) != value) {
+                    mismatches++;
+                }
+            }
+        }
+    }
+    return STOP_RECURSION;
+}
+
+static bool testVolumeImport() {
+    const int TEST_VOLUME_RESOLUTION = 64;
+    TestVolume volume(TEST_VOLUME_RESOLUTION);
+    
+    MetavoxelData data;
+    importMetavoxelVolume(data, data.getMinimum(), data.getSize(), volume);
+    
+    VolumeCheckVisitor visitor(volume, data.getMinimum(), data.getSize());
+    data.guide(visitor);
+    if (visitor.mismatches != 0) {
+        qDebug() << "Imported volume has" << visitor.mismatches << "mismatched voxels.";
+        return true;
+    }
+    const int MAX_UNMERGED_LEAVES = TEST_VOLUME_RESOLUTION * TEST_VOLUME_RESOLUTION * TEST_VOLUME_RESOLUTION / 8;
+    if (visitor.leafCount > MAX_UNMERGED_LEAVES) {
+        qDebug() << "Imported volume wasn't merged:" << visitor.leafCount << "leaves.";
+        return true;
+    }
+    
+    qDebug() << "Imported" << TEST_VOLUME_RESOLUTION << "cubed volume into" << visitor.leafCount << "leaves";
+    qDebug();
+    
+    return false;
+}
+
+static Sphere* createRandomSphere() {
+    Sphere* sphere = new Sphere();
+    sphere->setTranslation(glm::vec3(randFloat(), randFloat(), randFloat()));
+    sphere->setRotation(glm::angleAxis(randFloat() * PI, glm::vec3(0.0f, 1.0f, 0.0f)));
+    sphere->setScale(randFloat());
+    sphere->setColor(QColor(randIntInRange(0, 255), randIntInRange(0, 255), randIntInRange(0, 255)));
+    return sphere;
+}
+
+/// Writes the object through its properties' type streamers, as the streamer does for properties without accessors.
+static void writeReflectively(Bitstream& out, const QObject* object, const QObject* reference) {
+    const ObjectStreamer* streamer = Bitstream::getObjectStreamer(object->metaObject());
+    foreach (const StreamerPropertyPair& property, streamer->getProperties()) {
+        if (reference) {
+            property.first->writeDelta(out, property.second.read(object), property.second.read(reference));
+        } else {
+            property.first->write(out, property.second.read(object));
+        }
+    }
+}
+
+static bool testPropertyAccessors() {
+    const int SPHERE_COUNT = 100;
+    for (int i = 0; i < SPHERE_COUNT; i++) {
+        SharedObjectPointer sphere(createRandomSphere());
+        SharedObjectPointer reference = (i % 2 == 0) ? SharedObjectPointer(createRandomSphere()) : sphere->clone(true);
+        const ObjectStreamer* streamer = Bitstream::getObjectStreamer(sphere->metaObject());
+        
+        QByteArray fastArray, reflectiveArray;
+        {
+            QDataStream fastStream(&fastArray, QIODevice::WriteOnly);
+            Bitstream fast(fastStream);
+            streamer->write(fast, sphere.data());
+            streamer->writeRawDelta(fast, sphere.data(), reference.data());
+            fast.flush();
+            
+            QDataStream reflectiveStream(&reflectiveArray, QIODevice::WriteOnly);
+            Bitstream reflective(reflectiveStream);
+            writeReflectively(reflective, sphere.data(), NULL);
+            writeReflectively(reflective, sphere.data(), reference.data());
+            reflective.flush();
+        }
+        if (fastArray != reflectiveArray) {
+            qDebug() << "Accessors wrote different bits than the type streamers." << fastArray.toHex() <<
+                reflectiveArray.toHex();
+            return true;
+        }
+        bool reflectivelyEqual = true;
+        foreach (const StreamerPropertyPair& property, streamer->getProperties()) {
+            if (!property.first->equal(property.second.read(sphere.data()), property.second.read(reference.data()))) {
+                reflectivelyEqual = false;
+                break;
+            }
+        }
+        if (streamer->equal(sphere.data(), reference.data()) != reflectivelyEqual) {
+            qDebug() << "Accessors disagree with the type streamers on equality.";
+            return true;
+        }
+    }
+    return false;
+}
+
+static Sphere* createSphere(const glm::vec3& translation, float radius) {
+    Sphere* sphere = new Sphere();
+    sphere->setTranslation(translation);
+    sphere->setScale(radius);
+    sphere->setPlacementGranularity(radius * 0.25f);
+    return sphere;
+}
+
+static bool testRaySpannerIntersection() {
+    // the root's octants meet at the origin: the large sphere crosses from the first octant along the ray into the next,
+    // and hides the small one in the first octant behind its near side
+    MetavoxelData data;
+    AttributePointer attribute = AttributeRegistry::getInstance()->getSpannersAttribute();
+    SharedObjectPointer crossing(createSphere(glm::vec3(0.0f, -0.25f, -0.25f), 0.1f));
+    data.insert(attribute, crossing);
+    data.insert(attribute, createSphere(glm::vec3(-0.05f, -0.25f, -0.25f), 0.02f));
+    data.insert(attribute, createSphere(glm::vec3(0.3f, -0.25f, -0.25f), 0.05f));
+    
+    // the octants must be toured in parallel for the test to mean anything
+    QThreadPool::globalInstance()->setMaxThreadCount(qMax(QThreadPool::globalInstance()->maxThreadCount(), 2));
+    
+    const glm::vec3 ORIGIN(-0.45f, -0.25f, -0.25f);
+    const glm::vec3 DIRECTION(1.0f, 0.0f, 0.0f);
+    const float EXPECTED_DISTANCE = 0.35f;
+    const float DISTANCE_EPSILON = 0.001f;
+    const int QUERY_COUNT = 1000;
+    for (int i = 0; i < QUERY_COUNT; i++) {
+        float distance;
+        SharedObjectPointer spanner = data.findFirstRaySpannerIntersection(ORIGIN, DIRECTION, attribute, distance);
+        if (spanner != crossing || qAbs(distance - EXPECTED_DISTANCE) > DISTANCE_EPSILON) {
+            qDebug() << "Wrong first intersection on query" << i << ": expected distance" << EXPECTED_DISTANCE <<
+                "to the crossing sphere, got" << distance << (spanner == crossing ? "to it" : "to another");
+            return true;
+        }
+    }
+    return false;
+}
+
+const int BENCHMARK_ITERATIONS = 50;
+
+static void reportThroughput(const char* name, qint64 bytes, qint64 elapsed) {
+    const float BYTES_PER_MEGABYTE = 1024.0f * 1024.0f;
+    qDebug() << name << (bytes / BENCHMARK_ITERATIONS) << "bytes," <<
+        (bytes / BYTES_PER_MEGABYTE) / qMax(elapsed / (float)MSECS_PER_SECOND, 0.001f) << "MB/s";
+}
+
+static void runSerializationBenchmark() {
+    MetavoxelData data;
+    data.expand();
+    data.expand();
+    data.expand();
+    
+    RandomVisitor visitor;
+    data.guide(visitor);
+    qDebug() << "Created" << visitor.leafCount << "leaves";
+    
+    // mutate a copy so that the delta has something to say
+    MetavoxelData reference = data;
+    const int BENCHMARK_MUTATIONS = 100;
+    for (int i = 0; i < BENCHMARK_MUTATIONS; i++) {
+        MutateVisitor mutator;
+        data.guide(mutator);
+    }
+    
+    QByteArray array;
+    QElapsedTimer timer;
+    qint64 bytes = 0;
+    timer.start();
+    for (int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        array.clear();
+        QDataStream outStream(&array, QIODevice::WriteOnly);
+        Bitstream out(outStream);
+        data.write(out);
+        out.flush();
+        bytes += array.size();
+    }
+    reportThroughput("MetavoxelData::write:", bytes, timer.elapsed());
+    
+    bytes = 0;
+    timer.restart();
+    for (int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        QDataStream inStream(array);
+        Bitstream in(inStream);
+        MetavoxelData readData;
+        readData.read(in);
+        bytes += array.size();
+    }
+    reportThroughput("MetavoxelData::read:", bytes, timer.elapsed());
+    
+    bytes = 0;
+    timer.restart();
+    for (int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        array.clear();
+        QDataStream outStream(&array, QIODevice::WriteOnly);
+        Bitstream out(outStream);
+        data.writeDelta(reference, MetavoxelLOD(), out, MetavoxelLOD());
+        out.flush();
+        bytes += array.size();
+    }
+    reportThroughput("MetavoxelData::writeDelta:", bytes, timer.elapsed());
+}
+
 bool TestEndpoint::simulate(int iterationNumber) {
     // update/send our delayed datagrams
     for (QList<ByteArrayIntPair>::iterator it = _delayedDatagrams.begin(); it != _delayedDatagrams.end(); ) {
@@ -21,6 +21,7 @@ void SequenceNumberStatsTests::runAllTests() {
     earlyLateTest();
     duplicateTest();
     pruneTest();
+    burstHistogramTest();
 }
 
 const int UINT16_RANGE = std::numeric_limits<quint16>::max() + 1;
@@ -265,3 +266,50 @@ void SequenceNumberStatsTests::pruneTest() {
         stats.reset();
     }
 }
+
+void SequenceNumberStatsTests::burstHistogramTest() {
+
+    SequenceNumberStats stats;
+    quint16 seq = 65500;    // start close to rollover so the missing window wraps
+
+    quint32 expectedBursts[NUM_BURST_LENGTH_BUCKETS] = { 0 };
+
+    // the first packet only establishes where the stream starts
+    stats.sequenceNumberReceived(seq);
+    seq = seq + (quint16)1;
+
+    for (int T = 0; T < 100; T++) {
+        // skip bursts of 1, 2, 4 and 100, each followed by 3 received
+        const int BURST_LENGTHS[] = { 1, 2, 4, 100 };
+        const int BURST_BUCKETS[] = { 0, 1, 2, 7 };
+        for (int b = 0; b < 4; b++) {
+            quint16 firstSkipped = seq;
+            seq = seq + (quint16)BURST_LENGTHS[b];
+            expectedBursts[BURST_BUCKETS[b]]++;
+
+            for (int i = 0; i < 3; i++) {
+                stats.sequenceNumberReceived(seq);
+                seq = seq + (quint16)1;
+            }
+
+            // every skipped sequence number should be reported missing, and recovering one removes it
+            for (int i = 0; i < BURST_LENGTHS[b]; i++) {
+                assert(stats.isMissing(firstSkipped + (quint16)i));
+            }
+            stats.sequenceNumberReceived(firstSkipped);
+            assert(!stats.isMissing(firstSkipped));
+            assert(!stats.getMissingSet().contains(firstSkipped));
+        }
+
+        for (int i = 0; i < NUM_BURST_LENGTH_BUCKETS; i++) {
+            assert(stats.getBurstLengthHistogram()[i] == expectedBursts[i]);
+        }
+    }
+
+    // every packet but the first has an inter-arrival time
+    quint32 totalInterArrivals = 0;
+    for (int i = 0; i < NUM_INTER_ARRIVAL_BUCKETS; i++) {
+        totalInterArrivals += stats.getInterArrivalHistogram()[i];
+    }
+    assert(totalInterArrivals == stats.getNumReceived() - 1);
+}
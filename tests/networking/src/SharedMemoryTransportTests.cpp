@@ -0,0 +1,153 @@
+//
+//  SharedMemoryTransportTests.cpp
+//  tests/networking/src
+//
+//  Copyright 2014 High Fidelity, Inc.
+//
+//  Distributed under the Apache License, Version 2.0.
+//  See the accompanying file LICENSE or http://www.apache.org/licenses/LICENSE-2.0.html
+//
+
+#include <assert.h>
+
+#include <QtCore/QThread>
+#include <QtNetwork/QUdpSocket>
+
+#include "SharedMemoryTransport.h"
+#include "SharedMemoryTransportTests.h"
+
+// the transport checks that a receiver is still around this often, plus a little
+const unsigned long LIVENESS_CHECK_WAIT_MSECS = 1100;
+
+// more than the slots in a ring
+const int MAX_QUEUED_DATAGRAMS = 1024;
+
+void SharedMemoryTransportTests::runAllTests() {
+
+    // there's no shared memory transport on Windows, everything goes over UDP there
+#ifndef _WIN32
+    roundTripTest();
+    anyAddressSenderTest();
+    fullRingTest();
+    deadReceiverTest();
+#endif
+}
+
+static QByteArray createDatagram(int index) {
+    return QByteArray("datagram ") + QByteArray::number(index);
+}
+
+void SharedMemoryTransportTests::roundTripTest() {
+
+    // the transports work on the sockets of two node lists on this host, bound to the loopback address
+    QUdpSocket socketA, socketB;
+    socketA.bind(QHostAddress::LocalHost, 0);
+    socketB.bind(QHostAddress::LocalHost, 0);
+    HifiSockAddr sockAddrA(QHostAddress::LocalHost, socketA.localPort());
+    HifiSockAddr sockAddrB(QHostAddress::LocalHost, socketB.localPort());
+
+    SharedMemoryTransport transportA(socketA), transportB(socketB);
+    bool listening = transportA.listen() && transportB.listen();
+    assert(listening);
+
+    // there and back again, with the senders' addresses as they'd have come over UDP
+    QByteArray datagram;
+    HifiSockAddr senderSockAddr;
+    bool written = transportA.writeDatagram(createDatagram(0), sockAddrB);
+    assert(written);
+    bool read = transportB.readDatagram(datagram, senderSockAddr);
+    assert(read && datagram == createDatagram(0) && senderSockAddr == sockAddrA);
+
+    written = transportB.writeDatagram(createDatagram(1), sockAddrA);
+    assert(written);
+    read = transportA.readDatagram(datagram, senderSockAddr);
+    assert(read && datagram == createDatagram(1) && senderSockAddr == sockAddrB);
+
+    read = transportA.readDatagram(datagram, senderSockAddr) || transportB.readDatagram(datagram, senderSockAddr);
+    assert(!read);
+    assert(transportA.getDatagramsWritten() == 1 && transportB.getDatagramsRead() == 1);
+
+    // IPv6 destinations are left to UDP, since the rings only hold IPv4 addresses
+    written = transportA.writeDatagram(createDatagram(2), HifiSockAddr(QHostAddress::LocalHostIPv6, socketB.localPort()));
+    assert(!written);
+}
+
+void SharedMemoryTransportTests::anyAddressSenderTest() {
+
+    // servers bind to any address, and over UDP their packets to the loopback address come from the loopback address,
+    // which is what the domain server looks for to spot nodes on its own box
+    QUdpSocket senderSocket, receiverSocket;
+    senderSocket.bind(QHostAddress::Any, 0);
+    receiverSocket.bind(QHostAddress::Any, 0);
+    HifiSockAddr receiverSockAddr(QHostAddress::LocalHost, receiverSocket.localPort());
+
+    SharedMemoryTransport sender(senderSocket), receiver(receiverSocket);
+    bool listening = receiver.listen();
+    assert(listening);
+
+    QByteArray datagram;
+    HifiSockAddr senderSockAddr;
+    bool written = sender.writeDatagram(createDatagram(0), receiverSockAddr);
+    assert(written);
+    bool read = receiver.readDatagram(datagram, senderSockAddr);
+    assert(read && datagram == createDatagram(0));
+    assert(senderSockAddr.getAddress().isLoopback() && senderSockAddr.getPort() == senderSocket.localPort());
+}
+
+void SharedMemoryTransportTests::fullRingTest() {
+
+    QUdpSocket senderSocket, receiverSocket;
+    senderSocket.bind(QHostAddress::LocalHost, 0);
+    receiverSocket.bind(QHostAddress::LocalHost, 0);
+    HifiSockAddr receiverSockAddr(QHostAddress::LocalHost, receiverSocket.localPort());
+
+    SharedMemoryTransport sender(senderSocket), receiver(receiverSocket);
+    bool listening = receiver.listen();
+    assert(listening);
+
+    // write until the ring fills up, at which point the caller is told to use UDP
+    int numWritten = 0;
+    while (numWritten < MAX_QUEUED_DATAGRAMS && sender.writeDatagram(createDatagram(numWritten), receiverSockAddr)) {
+        numWritten++;
+    }
+    assert(numWritten > 0 && numWritten < MAX_QUEUED_DATAGRAMS);
+
+    // everything that went into the ring comes out in order, after which there's room again
+    QByteArray datagram;
+    HifiSockAddr senderSockAddr;
+    for (int i = 0; i < numWritten; i++) {
+        bool read = receiver.readDatagram(datagram, senderSockAddr);
+        assert(read && datagram == createDatagram(i));
+    }
+    bool read = receiver.readDatagram(datagram, senderSockAddr);
+    assert(!read);
+
+    bool written = sender.writeDatagram(createDatagram(numWritten), receiverSockAddr);
+    assert(written);
+}
+
+void SharedMemoryTransportTests::deadReceiverTest() {
+
+    QUdpSocket senderSocket, receiverSocket;
+    senderSocket.bind(QHostAddress::LocalHost, 0);
+    receiverSocket.bind(QHostAddress::LocalHost, 0);
+    HifiSockAddr receiverSockAddr(QHostAddress::LocalHost, receiverSocket.localPort());
+
+    SharedMemoryTransport sender(senderSocket);
+    SharedMemoryTransport* receiver = new SharedMemoryTransport(receiverSocket);
+    bool listening = receiver->listen();
+    assert(listening);
+
+    bool written = sender.writeDatagram(createDatagram(0), receiverSockAddr);
+    assert(written);
+
+    // once the sender next checks on the receiver, it notices it's gone and falls back to UDP
+    delete receiver;
+    QThread::msleep(LIVENESS_CHECK_WAIT_MSECS);
+    written = sender.writeDatagram(createDatagram(1), receiverSockAddr);
+    assert(!written);
+
+    // and keeps doing so, without a segment to write to
+    written = sender.writeDatagram(createDatagram(2), receiverSockAddr);
+    assert(!written);
+}
@@ -0,0 +1,24 @@
+//
+//  SharedMemoryTransportTests.h
+//  tests/networking/src
+//
+//  Copyright 2014 High Fidelity, Inc.
+//
+//  Distributed under the Apache License, Version 2.0.
+//  See the accompanying file LICENSE or http://www.apache.org/licenses/LICENSE-2.0.html
+//
+
+#ifndef hifi_SharedMemoryTransportTests_h
+#define hifi_SharedMemoryTransportTests_h
+
+namespace SharedMemoryTransportTests {
+
+    void runAllTests();
+
+    void roundTripTest();
+    void anyAddressSenderTest();
+    void fullRingTest();
+    void deadReceiverTest();
+};
+
+#endif // hifi_SharedMemoryTransportTests_h
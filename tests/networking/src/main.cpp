@@ -9,10 +9,12 @@
 //
 
 #include "SequenceNumberStatsTests.h"
+#include "SharedMemoryTransportTests.h"
 #include <stdio.h>
 
 int main(int argc, char** argv) {
     SequenceNumberStatsTests::runAllTests();
+    SharedMemoryTransportTests::runAllTests();
     printf("tests passed! press enter to exit");
     getchar();
     return 0;
@@ -13,7 +13,9 @@
 //
 
 #include <QDebug>
+#include <QDir>
 
+#include <ModelBoundsCache.h>
 #include <Octree.h>
 #include <ModelItem.h>
 #include <ModelTree.h>
@@ -21,6 +23,7 @@
 #include <OctreeConstants.h>
 #include <PropertyFlags.h>
 #include <SharedUtil.h>
+#include <ViewFrustum.h>
 
 #include "ModelTests.h"
 
@@ -251,6 +254,257 @@ void ModelTests::modelTreeTests(bool verbose) {
         qDebug() << "TIME - Test" << testsTaken <<":" << qPrintable(testName) << "elapsed=" << elapsedInMSecs << "msecs";
     }
 
+    {
+        testsTaken++;
+        QString testName = "send only the changed properties of a model";
+        if (verbose) {
+            qDebug() << "Test" << testsTaken <<":" << qPrintable(testName);
+        }
+
+        ModelItem model;
+        model.setPosition(positionAtCenterInTreeUnits);
+        model.setRadius(halfMeter / (float)TREE_SCALE);
+        model.setModelURL("https://s3-us-west-1.amazonaws.com/highfidelity-public/ozan/theater.fbx");
+        model.setAnimationIsPlaying(true);
+
+        ReadBitstreamToTreeParams args(WANT_COLOR, NO_EXISTS_BITS, NULL, QUuid(), SharedNodePointer(), false,
+                                       VERSION_MODELS_HAVE_PROPERTY_FLAGS);
+
+        // the viewer is sent the whole model first...
+        OctreePacketData wholeData;
+        model.appendModelData(&wholeData, model.getChangedProperties(0));
+        ModelItem viewerModel;
+        bool wholeIsComplete = false;
+        int wholeBytesRead = viewerModel.readModelDataFromBuffer(wholeData.getUncompressedData(),
+                                                                 wholeData.getUncompressedSize(), args, &wholeIsComplete);
+
+        // ...at a time after the model's properties were set...
+        quint64 lastSet = usecTimestampNow();
+        quint64 sentAt = lastSet;
+        while (sentAt == lastSet) {
+            sentAt = usecTimestampNow();
+        }
+
+        // ...and then only the frame index, once the animation has advanced
+        const float ADVANCED_FRAME_INDEX = 10.0f;
+        model.setAnimationFrameIndex(ADVANCED_FRAME_INDEX);
+        ModelPropertyFlags changedProperties = model.getChangedProperties(sentAt);
+        OctreePacketData changedData;
+        model.appendModelData(&changedData, changedProperties);
+        bool changedIsComplete = true;
+        int changedBytesRead = viewerModel.readModelDataFromBuffer(changedData.getUncompressedData(),
+                                                                   changedData.getUncompressedSize(), args, &changedIsComplete);
+
+        bool passed = wholeIsComplete && wholeBytesRead == wholeData.getUncompressedSize() &&
+            !changedIsComplete && changedBytesRead == changedData.getUncompressedSize() &&
+            changedProperties == ModelPropertyFlags(MODEL_PROPERTY_ANIMATION_FRAME_INDEX) &&
+            changedData.getUncompressedSize() < wholeData.getUncompressedSize() &&
+            viewerModel.getAnimationFrameIndex() == ADVANCED_FRAME_INDEX &&
+            viewerModel.getModelURL() == model.getModelURL() && viewerModel.getPosition() == model.getPosition();
+        if (passed) {
+            testsPassed++;
+        } else {
+            testsFailed++;
+            qDebug() << "FAILED - Test" << testsTaken <<":" << qPrintable(testName);
+        }
+        qDebug() << "SIZE - Test" << testsTaken <<":" << qPrintable(testName) << "whole model bytes=" <<
+            wholeData.getUncompressedSize() << "changed properties bytes=" << changedData.getUncompressedSize();
+    }
+
+    qDebug() << "   tests passed:" << testsPassed << "out of" << testsTaken;
+    if (verbose) {
+        qDebug() << "******************************************************************************************";
+    }
+}
+
+
+// hands out the same geometry for every model, or none at all
+class TestFBXService : public ModelItemFBXService {
+public:
+    TestFBXService() : _geometry(NULL) { }
+    void setGeometry(const FBXGeometry* geometry) { _geometry = geometry; }
+    virtual const FBXGeometry* getGeometryForModel(const ModelItem& modelItem) { return _geometry; }
+private:
+    const FBXGeometry* _geometry;
+};
+
+static FBXGeometry createBoxGeometry(const glm::vec3& minimum, const glm::vec3& maximum) {
+    FBXGeometry geometry;
+    FBXMesh mesh;
+    mesh.meshExtents.minimum = minimum;
+    mesh.meshExtents.maximum = maximum;
+    geometry.meshes.append(mesh);
+    geometry.meshExtents = mesh.meshExtents;
+    return geometry;
+}
+
+void ModelTests::modelCullingTests(bool verbose) {
+    int testsTaken = 0;
+    int testsPassed = 0;
+    int testsFailed = 0;
+
+    if (verbose) {
+        qDebug() << "******************************************************************************************";
+    }
+
+    qDebug() << "ModelTests::modelCullingTests()";
+
+    TestFBXService fbxService;
+    ModelTree tree;
+    tree.setFBXService(&fbxService);
+    ModelTreeElement* element = tree.getRoot();
+
+    // the viewer is in the middle of the domain, looking down -z with a 90 degree field of view (in meters)
+    const float halfOfDomain = TREE_SCALE * 0.5f;
+    const glm::vec3 viewerPosition(halfOfDomain, halfOfDomain, halfOfDomain);
+    ViewFrustum viewFrustum;
+    viewFrustum.setPosition(viewerPosition);
+    viewFrustum.setFieldOfView(90.0f);
+    viewFrustum.setAspectRatio(1.0f);
+    viewFrustum.setNearClip(0.1f);
+    viewFrustum.setFarClip(1000.0f);
+    viewFrustum.calculate();
+    EncodeBitstreamParams params(INT_MAX, &viewFrustum);
+
+    ModelItemID modelID(1);
+    modelID.isKnownID = false;
+    ModelItemProperties properties;
+    properties.setModelURL("http://example.com/model.fbx");
+
+    {
+        testsTaken++;
+        QString testName = "cull a long, thin model outside the view whose radius cube is in it";
+        if (verbose) {
+            qDebug() << "Test" << testsTaken <<":" << qPrintable(testName);
+        }
+
+        // a rod along x, which fills the width of its radius cube but hardly any of its height
+        FBXGeometry rod = createBoxGeometry(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(10.0f, 0.1f, 0.1f));
+        const float ROD_RADIUS = 10.0f;
+        properties.setRadius(ROD_RADIUS);
+
+        // above the view, but for the bottom of its radius cube
+        properties.setPosition(viewerPosition + glm::vec3(0.0f, 25.0f, -20.0f));
+        ModelItem aboveModel(modelID, properties);
+        fbxService.setGeometry(NULL);
+        bool aboveInViewByRadius = element->isModelInView(aboveModel, params);
+        fbxService.setGeometry(&rod);
+        bool aboveInViewByGeometry = element->isModelInView(aboveModel, params);
+
+        // straight ahead, where the rod itself is in view
+        properties.setPosition(viewerPosition + glm::vec3(0.0f, 0.0f, -20.0f));
+        ModelItem aheadModel(modelID, properties);
+        bool aheadInViewByGeometry = element->isModelInView(aheadModel, params);
+
+        bool passed = aboveInViewByRadius && !aboveInViewByGeometry && aheadInViewByGeometry;
+        if (passed) {
+            testsPassed++;
+        } else {
+            testsFailed++;
+            qDebug() << "FAILED - Test" << testsTaken <<":" << qPrintable(testName) << "above by radius:" <<
+                aboveInViewByRadius << "above by geometry:" << aboveInViewByGeometry << "ahead by geometry:" <<
+                aheadInViewByGeometry;
+        }
+    }
+
+    {
+        testsTaken++;
+        QString testName = "withhold a model past its LOD distance";
+        if (verbose) {
+            qDebug() << "Test" << testsTaken <<":" << qPrintable(testName);
+        }
+
+        // at the default LOD, a half meter model of a cube (whose sides come to 0.58 meters) is sent to within 231 meters
+        FBXGeometry cube = createBoxGeometry(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1.0f, 1.0f, 1.0f));
+        fbxService.setGeometry(&cube);
+        properties.setRadius(0.5f);
+        const float NEAR_DISTANCE = 100.0f;
+        const float FAR_DISTANCE = 300.0f;
+
+        properties.setPosition(viewerPosition + glm::vec3(0.0f, 0.0f, -NEAR_DISTANCE));
+        bool nearInView = element->isModelInView(ModelItem(modelID, properties), params);
+        properties.setPosition(viewerPosition + glm::vec3(0.0f, 0.0f, -FAR_DISTANCE));
+        bool farInView = element->isModelInView(ModelItem(modelID, properties), params);
+
+        bool passed = nearInView && !farInView;
+        if (passed) {
+            testsPassed++;
+        } else {
+            testsFailed++;
+            qDebug() << "FAILED - Test" << testsTaken <<":" << qPrintable(testName) << "near:" << nearInView <<
+                "far:" << farInView;
+        }
+    }
+    fbxService.setGeometry(NULL);
+
+    {
+        testsTaken++;
+        QString testName = "merge the meshes of a model's proxy so that they still cover the original ones";
+        if (verbose) {
+            qDebug() << "Test" << testsTaken <<":" << qPrintable(testName);
+        }
+
+        // more meshes than the proxy keeps, in a row along x, of various heights
+        const int MESHES = MAX_MODEL_PROXY_MESHES * 2 + 3;
+        FBXGeometry geometry;
+        geometry.meshExtents.reset();
+        for (int i = 0; i < MESHES; i++) {
+            FBXMesh mesh;
+            mesh.meshExtents.minimum = glm::vec3((float)i, 0.0f, 0.0f);
+            mesh.meshExtents.maximum = glm::vec3(i + 0.5f, 1.0f + (i % 3), 1.0f);
+            geometry.meshes.append(mesh);
+            geometry.meshExtents.addExtents(mesh.meshExtents);
+        }
+        FBXGeometry* bounds = ModelBoundsCache::extractBounds(geometry);
+
+        bool passed = (bounds->meshes.size() == MAX_MODEL_PROXY_MESHES) &&
+            bounds->meshExtents.minimum == geometry.meshExtents.minimum &&
+            bounds->meshExtents.maximum == geometry.meshExtents.maximum;
+        foreach (const FBXMesh& mesh, geometry.meshes) {
+            bool covered = false;
+            foreach (const FBXMesh& proxyMesh, bounds->meshes) {
+                if (proxyMesh.meshExtents.containsPoint(mesh.meshExtents.minimum) &&
+                        proxyMesh.meshExtents.containsPoint(mesh.meshExtents.maximum)) {
+                    covered = true;
+                    break;
+                }
+            }
+            passed = passed && covered;
+        }
+        delete bounds;
+
+        if (passed) {
+            testsPassed++;
+        } else {
+            testsFailed++;
+            qDebug() << "FAILED - Test" << testsTaken <<":" << qPrintable(testName);
+        }
+    }
+
+    {
+        testsTaken++;
+        QString testName = "keep the local paths of model URLs inside the model directory";
+        if (verbose) {
+            qDebug() << "Test" << testsTaken <<":" << qPrintable(testName);
+        }
+
+        QString directory = QDir::cleanPath(QDir(QDir::temp().filePath("ModelBoundsCacheTests")).absolutePath());
+        ModelBoundsCache cache(directory);
+
+        bool passed = cache.getLocalPath("http://example.com/models/chair.fbx") ==
+                directory + "/example.com/models/chair.fbx" &&
+            cache.getLocalPath("http://example.com/../../etc/passwd").isEmpty() &&
+            cache.getLocalPath("http://example.com/models/../../../etc/passwd").isEmpty() &&
+            cache.getLocalPath("file:///etc/passwd").isEmpty() &&
+            cache.getLocalPath("/etc/passwd").isEmpty();
+        if (passed) {
+            testsPassed++;
+        } else {
+            testsFailed++;
+            qDebug() << "FAILED - Test" << testsTaken <<":" << qPrintable(testName);
+        }
+    }
+
     qDebug() << "   tests passed:" << testsPassed << "out of" << testsTaken;
     if (verbose) {
         qDebug() << "******************************************************************************************";
@@ -260,5 +514,6 @@ void ModelTests::modelTreeTests(bool verbose) {
 
 void ModelTests::runAllTests(bool verbose) {
     modelTreeTests(verbose);
+    modelCullingTests(verbose);
 }
 
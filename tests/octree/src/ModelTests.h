@@ -14,6 +14,7 @@
 
 namespace ModelTests {
     void modelTreeTests(bool verbose = false);
+    void modelCullingTests(bool verbose = false);
     void runAllTests(bool verbose = false);
 }
 
@@ -0,0 +1,335 @@
+//
+//  OctreeItemIndexTests.cpp
+//  tests/octree/src
+//
+//  Copyright 2014 High Fidelity, Inc.
+//
+//  Distributed under the Apache License, Version 2.0.
+//  See the accompanying file LICENSE or http://www.apache.org/licenses/LICENSE-2.0.html
+//
+
+#include <QDebug>
+#include <QHash>
+#include <QThread>
+#include <QUuid>
+
+#include <ModelTree.h>
+#include <ModelTreeElement.h>
+#include <OctreeConstants.h>
+#include <PacketHeaders.h>
+#include <ParticleTree.h>
+#include <ParticleTreeElement.h>
+#include <SharedUtil.h>
+
+#include "OctreeItemIndexTests.h"
+
+const int NUM_ITEMS = 200;
+
+// the IDs the server "assigns" to the items created with creator tokens, well clear of the ones added with known IDs
+const uint32_t FIRST_ASSIGNED_ID = 1000;
+
+static glm::vec3 randomPositionInMeters() {
+    // away from the edges of the tree, so that the moving particles stay inside it
+    return glm::vec3(randFloatInRange(0.1f, 0.9f), randFloatInRange(0.1f, 0.9f), randFloatInRange(0.1f, 0.9f)) *
+        (float)TREE_SCALE;
+}
+
+/// Builds the response the server sends when it has assigned an ID to an item we created.
+static QByteArray createAddResponse(PacketType type, uint32_t creatorTokenID, uint32_t id) {
+    QByteArray packet = byteArrayWithPopulatedHeader(type, QUuid::createUuid());
+    packet.append(reinterpret_cast<const char*>(&creatorTokenID), sizeof(creatorTokenID));
+    packet.append(reinterpret_cast<const char*>(&id), sizeof(id));
+    return packet;
+}
+
+static bool findParticleElementsOperation(OctreeElement* element, void* extraData) {
+    QHash<uint32_t, ParticleTreeElement*>* elements = static_cast<QHash<uint32_t, ParticleTreeElement*>*>(extraData);
+    ParticleTreeElement* particleTreeElement = static_cast<ParticleTreeElement*>(element);
+    foreach (const Particle& particle, particleTreeElement->getParticles()) {
+        if (particle.getID() != NEW_PARTICLE) {
+            elements->insert(particle.getID(), particleTreeElement);
+        }
+    }
+    return true;
+}
+
+/// Checks that the index finds each of the IDs in the element that a search of the whole tree finds it in, if any.
+static bool particleIndexMatchesTree(ParticleTree& tree, const QList<uint32_t>& ids) {
+    QHash<uint32_t, ParticleTreeElement*> elements;
+    tree.recurseTreeWithOperation(findParticleElementsOperation, &elements);
+    foreach (uint32_t id, ids) {
+        if (tree.getContainingElement(id) != elements.value(id)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool findModelElementsOperation(OctreeElement* element, void* extraData) {
+    QHash<uint32_t, ModelTreeElement*>* elements = static_cast<QHash<uint32_t, ModelTreeElement*>*>(extraData);
+    ModelTreeElement* modelTreeElement = static_cast<ModelTreeElement*>(element);
+    foreach (const ModelItem& model, modelTreeElement->getModels()) {
+        if (model.getID() != NEW_MODEL) {
+            elements->insert(model.getID(), modelTreeElement);
+        }
+    }
+    return true;
+}
+
+static bool modelIndexMatchesTree(ModelTree& tree, const QList<uint32_t>& ids) {
+    QHash<uint32_t, ModelTreeElement*> elements;
+    tree.recurseTreeWithOperation(findModelElementsOperation, &elements);
+    foreach (uint32_t id, ids) {
+        if (tree.getContainingElement(id) != elements.value(id)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void OctreeItemIndexTests::particleIndexTests(bool verbose) {
+    int testsTaken = 0;
+    int testsPassed = 0;
+    int testsFailed = 0;
+
+    if (verbose) {
+        qDebug() << "******************************************************************************************";
+    }
+
+    qDebug() << "OctreeItemIndexTests::particleIndexTests()";
+
+    // every ID that's been in the tree, so that we check the index has forgotten the ones that left it
+    QList<uint32_t> ids;
+    ParticleTree tree;
+
+    {
+        testsTaken++;
+        QString testName = "index particles as they're stored";
+        if (verbose) {
+            qDebug() << "Test" << testsTaken <<":" << qPrintable(testName);
+        }
+
+        // some with known IDs, moving slowly enough to stay in the tree but fast enough to change elements
+        const float SPEED = 16.0f;
+        for (int i = 0; i < NUM_ITEMS; i++) {
+            ParticleID particleID(i + 1);
+            particleID.isKnownID = false; // as with the model tests, allows local particles to be added with known IDs
+            ParticleProperties properties;
+            properties.setPosition(randomPositionInMeters());
+            properties.setRadius(0.5f);
+            properties.setVelocity(glm::vec3(randFloatInRange(-SPEED, SPEED), randFloatInRange(-SPEED, SPEED),
+                randFloatInRange(-SPEED, SPEED)));
+            properties.setGravity(glm::vec3(0.0f, 0.0f, 0.0f));
+            tree.addParticle(particleID, properties);
+            ids.append(i + 1);
+        }
+
+        // and some still waiting for the server to assign their IDs
+        for (int i = 0; i < NUM_ITEMS; i++) {
+            ParticleProperties properties;
+            properties.setPosition(randomPositionInMeters());
+            properties.setRadius(0.5f);
+            properties.setGravity(glm::vec3(0.0f, 0.0f, 0.0f));
+            tree.addParticle(ParticleID(NEW_PARTICLE, i + 1, false), properties);
+            ids.append(FIRST_ASSIGNED_ID + i);
+        }
+
+        bool passed = particleIndexMatchesTree(tree, ids);
+        if (passed) {
+            testsPassed++;
+        } else {
+            testsFailed++;
+            qDebug() << "FAILED - Test" << testsTaken <<":" << qPrintable(testName);
+        }
+    }
+
+    {
+        testsTaken++;
+        QString testName = "index particles under the IDs the server assigns them";
+        if (verbose) {
+            qDebug() << "Test" << testsTaken <<":" << qPrintable(testName);
+        }
+
+        for (int i = 0; i < NUM_ITEMS; i++) {
+            tree.handleAddParticleResponse(createAddResponse(PacketTypeParticleAddResponse, i + 1, FIRST_ASSIGNED_ID + i));
+        }
+
+        bool passed = particleIndexMatchesTree(tree, ids) && tree.getContainingElement(FIRST_ASSIGNED_ID);
+        if (passed) {
+            testsPassed++;
+        } else {
+            testsFailed++;
+            qDebug() << "FAILED - Test" << testsTaken <<":" << qPrintable(testName);
+        }
+    }
+
+    {
+        testsTaken++;
+        QString testName = "follow particles as they move between elements";
+        if (verbose) {
+            qDebug() << "Test" << testsTaken <<":" << qPrintable(testName);
+        }
+
+        const int TICKS = 10;
+        const unsigned long TICK_MSECS = 10;
+        bool passed = true;
+        for (int i = 0; i < TICKS && passed; i++) {
+            QThread::msleep(TICK_MSECS);
+            tree.update();
+            passed = particleIndexMatchesTree(tree, ids);
+        }
+        if (passed) {
+            testsPassed++;
+        } else {
+            testsFailed++;
+            qDebug() << "FAILED - Test" << testsTaken <<":" << qPrintable(testName);
+        }
+    }
+
+    {
+        testsTaken++;
+        QString testName = "forget deleted particles";
+        if (verbose) {
+            qDebug() << "Test" << testsTaken <<":" << qPrintable(testName);
+        }
+
+        for (int i = 0; i < ids.size(); i += 3) {
+            tree.deleteParticle(ParticleID(ids.at(i)));
+        }
+
+        bool passed = particleIndexMatchesTree(tree, ids) && !tree.getContainingElement(ids.at(0));
+        if (passed) {
+            testsPassed++;
+        } else {
+            testsFailed++;
+            qDebug() << "FAILED - Test" << testsTaken <<":" << qPrintable(testName);
+        }
+    }
+
+    qDebug() << "   tests passed:" << testsPassed << "out of" << testsTaken;
+    if (verbose) {
+        qDebug() << "******************************************************************************************";
+    }
+}
+
+void OctreeItemIndexTests::modelIndexTests(bool verbose) {
+    int testsTaken = 0;
+    int testsPassed = 0;
+    int testsFailed = 0;
+
+    if (verbose) {
+        qDebug() << "******************************************************************************************";
+    }
+
+    qDebug() << "OctreeItemIndexTests::modelIndexTests()";
+
+    QList<uint32_t> ids;
+    ModelTree tree;
+
+    {
+        testsTaken++;
+        QString testName = "index models as they're stored";
+        if (verbose) {
+            qDebug() << "Test" << testsTaken <<":" << qPrintable(testName);
+        }
+
+        for (int i = 0; i < NUM_ITEMS; i++) {
+            ModelItemID modelID(i + 1);
+            modelID.isKnownID = false; // a temporary workaround to allow local tree models to be added with known IDs
+            ModelItemProperties properties;
+            properties.setPosition(randomPositionInMeters());
+            properties.setRadius(0.5f);
+            tree.addModel(modelID, properties);
+            ids.append(i + 1);
+        }
+        for (int i = 0; i < NUM_ITEMS; i++) {
+            ModelItemProperties properties;
+            properties.setPosition(randomPositionInMeters());
+            properties.setRadius(0.5f);
+            tree.addModel(ModelItemID(NEW_MODEL, i + 1, false), properties);
+            ids.append(FIRST_ASSIGNED_ID + i);
+        }
+
+        bool passed = modelIndexMatchesTree(tree, ids);
+        if (passed) {
+            testsPassed++;
+        } else {
+            testsFailed++;
+            qDebug() << "FAILED - Test" << testsTaken <<":" << qPrintable(testName);
+        }
+    }
+
+    {
+        testsTaken++;
+        QString testName = "index models under the IDs the server assigns them";
+        if (verbose) {
+            qDebug() << "Test" << testsTaken <<":" << qPrintable(testName);
+        }
+
+        for (int i = 0; i < NUM_ITEMS; i++) {
+            tree.handleAddModelResponse(createAddResponse(PacketTypeModelAddResponse, i + 1, FIRST_ASSIGNED_ID + i));
+        }
+
+        bool passed = modelIndexMatchesTree(tree, ids) && tree.getContainingElement(FIRST_ASSIGNED_ID);
+        if (passed) {
+            testsPassed++;
+        } else {
+            testsFailed++;
+            qDebug() << "FAILED - Test" << testsTaken <<":" << qPrintable(testName);
+        }
+    }
+
+    {
+        testsTaken++;
+        QString testName = "follow models moved by edits";
+        if (verbose) {
+            qDebug() << "Test" << testsTaken <<":" << qPrintable(testName);
+        }
+
+        // the edited elements move the models that have left them in the next update
+        for (int i = 0; i < ids.size(); i += 2) {
+            ModelItemProperties properties;
+            properties.setPosition(randomPositionInMeters());
+            tree.updateModel(ModelItemID(ids.at(i)), properties);
+        }
+        tree.update();
+
+        bool passed = modelIndexMatchesTree(tree, ids);
+        if (passed) {
+            testsPassed++;
+        } else {
+            testsFailed++;
+            qDebug() << "FAILED - Test" << testsTaken <<":" << qPrintable(testName);
+        }
+    }
+
+    {
+        testsTaken++;
+        QString testName = "forget deleted models";
+        if (verbose) {
+            qDebug() << "Test" << testsTaken <<":" << qPrintable(testName);
+        }
+
+        for (int i = 0; i < ids.size(); i += 3) {
+            tree.deleteModel(ModelItemID(ids.at(i)));
+        }
+
+        bool passed = modelIndexMatchesTree(tree, ids) && !tree.getContainingElement(ids.at(0));
+        if (passed) {
+            testsPassed++;
+        } else {
+            testsFailed++;
+            qDebug() << "FAILED - Test" << testsTaken <<":" << qPrintable(testName);
+        }
+    }
+
+    qDebug() << "   tests passed:" << testsPassed << "out of" << testsTaken;
+    if (verbose) {
+        qDebug() << "******************************************************************************************";
+    }
+}
+
+void OctreeItemIndexTests::runAllTests(bool verbose) {
+    particleIndexTests(verbose);
+    modelIndexTests(verbose);
+}
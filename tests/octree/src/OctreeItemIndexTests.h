@@ -0,0 +1,20 @@
+//
+//  OctreeItemIndexTests.h
+//  tests/octree/src
+//
+//  Copyright 2014 High Fidelity, Inc.
+//
+//  Distributed under the Apache License, Version 2.0.
+//  See the accompanying file LICENSE or http://www.apache.org/licenses/LICENSE-2.0.html
+//
+
+#ifndef hifi_OctreeItemIndexTests_h
+#define hifi_OctreeItemIndexTests_h
+
+namespace OctreeItemIndexTests {
+    void particleIndexTests(bool verbose = false);
+    void modelIndexTests(bool verbose = false);
+    void runAllTests(bool verbose = false);
+}
+
+#endif // hifi_OctreeItemIndexTests_h
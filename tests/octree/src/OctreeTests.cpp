@@ -10,9 +10,14 @@
 //
 
 #include <QDebug>
+#include <QSet>
 
+#include <OctreeConstants.h>
+#include <OctreeDeletionLog.h>
 #include <PropertyFlags.h>
 #include <SharedUtil.h>
+#include <VoxelDetail.h>
+#include <VoxelTree.h>
 
 #include "OctreeTests.h"
 
@@ -411,6 +416,201 @@ void OctreeTests::propertyFlagsTests() {
     qDebug() << "******************************************************************************************";
 }
 
+void OctreeTests::batchedQueryTests() {
+    int testsTaken = 0;
+    int testsPassed = 0;
+
+    qDebug() << "******************************************************************************************";
+    qDebug() << "OctreeTests::batchedQueryTests()";
+
+    const int VOXELS = 5000;
+    const float VOXEL_SCALE = 1.0f / 128.0f;
+    const int QUERIES = 2000;
+    const float USECS_PER_MSECS = 1000.0f;
+
+    VoxelTree tree;
+    for (int i = 0; i < VOXELS; i++) {
+        tree.createVoxel(floorf(randFloat() / VOXEL_SCALE) * VOXEL_SCALE, floorf(randFloat() / VOXEL_SCALE) * VOXEL_SCALE,
+            floorf(randFloat() / VOXEL_SCALE) * VOXEL_SCALE, VOXEL_SCALE, randomColorValue(), randomColorValue(),
+            randomColorValue());
+    }
+
+    {
+        testsTaken++;
+        QString testName = "batched ray casts match single ray casts";
+        qDebug() << "Test" << testsTaken <<":" << qPrintable(testName);
+
+        QVector<OctreeRayQuery> queries;
+        for (int i = 0; i < QUERIES; i++) {
+            glm::vec3 origin(randFloatInRange(0.0f, (float)TREE_SCALE), randFloatInRange(0.0f, (float)TREE_SCALE),
+                randFloatInRange(0.0f, (float)TREE_SCALE));
+            glm::vec3 direction = glm::normalize(glm::vec3(randFloatInRange(-1.0f, 1.0f), randFloatInRange(-1.0f, 1.0f),
+                randFloatInRange(-1.0f, 1.0f)));
+            queries.append(OctreeRayQuery(origin, direction));
+        }
+        // some axis-aligned rays too, which have zero components in their directions
+        queries.append(OctreeRayQuery(glm::vec3(0.5f, 0.5f, 0.5f) * (float)TREE_SCALE, glm::vec3(1.0f, 0.0f, 0.0f)));
+        queries.append(OctreeRayQuery(glm::vec3(0.25f, 0.0f, 0.75f) * (float)TREE_SCALE, glm::vec3(0.0f, 1.0f, 0.0f)));
+
+        quint64 start = usecTimestampNow();
+        QVector<OctreeRayQuery> singleResults;
+        foreach (const OctreeRayQuery& query, queries) {
+            OctreeRayQuery result = query;
+            result.found = tree.findRayIntersection(query.origin, query.direction, result.element, result.distance,
+                result.face, NULL, Octree::Lock);
+            singleResults.append(result);
+        }
+        quint64 singleEnd = usecTimestampNow();
+        tree.findRayIntersections(queries, Octree::Lock);
+        quint64 batchEnd = usecTimestampNow();
+
+        bool passed = true;
+        for (int i = 0; i < queries.size() && passed; i++) {
+            const OctreeRayQuery& single = singleResults.at(i);
+            const OctreeRayQuery& batched = queries.at(i);
+            passed = (single.found == batched.found) &&
+                (!single.found || (single.element == batched.element && single.distance == batched.distance &&
+                    single.face == batched.face));
+            if (!passed) {
+                qDebug() << "ray" << i << "single found:" << single.found << "distance:" << single.distance <<
+                    "batched found:" << batched.found << "distance:" << batched.distance;
+            }
+        }
+        if (passed) {
+            testsPassed++;
+        } else {
+            qDebug() << "FAILED - Test" << testsTaken <<":" << qPrintable(testName);
+        }
+        qDebug() << "TIME - Test" << testsTaken <<":" << qPrintable(testName) << queries.size() << "rays, single=" <<
+            ((float)(singleEnd - start) / USECS_PER_MSECS) << "msecs, batched=" <<
+            ((float)(batchEnd - singleEnd) / USECS_PER_MSECS) << "msecs";
+    }
+
+    {
+        testsTaken++;
+        QString testName = "batched sphere penetrations match single sphere penetrations";
+        qDebug() << "Test" << testsTaken <<":" << qPrintable(testName);
+
+        const float MAX_RADIUS = 4.0f;
+        QVector<OctreeSphereQuery> queries;
+        for (int i = 0; i < QUERIES; i++) {
+            glm::vec3 center(randFloatInRange(0.0f, (float)TREE_SCALE), randFloatInRange(0.0f, (float)TREE_SCALE),
+                randFloatInRange(0.0f, (float)TREE_SCALE));
+            queries.append(OctreeSphereQuery(center, randFloatInRange(0.0f, MAX_RADIUS)));
+        }
+
+        quint64 start = usecTimestampNow();
+        QVector<OctreeSphereQuery> singleResults;
+        foreach (const OctreeSphereQuery& query, queries) {
+            OctreeSphereQuery result = query;
+            result.found = tree.findSpherePenetration(query.center, query.radius, result.penetration,
+                &result.penetratedObject, Octree::Lock);
+            singleResults.append(result);
+        }
+        quint64 singleEnd = usecTimestampNow();
+        tree.findSpherePenetrations(queries, Octree::Lock);
+        quint64 batchEnd = usecTimestampNow();
+
+        const float PENETRATION_TOLERANCE = 0.0001f;
+        bool passed = true;
+        for (int i = 0; i < queries.size(); i++) {
+            const OctreeSphereQuery& single = singleResults.at(i);
+            const OctreeSphereQuery& batched = queries.at(i);
+            if (passed && (single.found != batched.found ||
+                    glm::distance(single.penetration, batched.penetration) > PENETRATION_TOLERANCE)) {
+                passed = false;
+                qDebug() << "sphere" << i << "single found:" << single.found << "batched found:" << batched.found;
+            }
+            delete static_cast<VoxelDetail*>(single.penetratedObject);
+            delete static_cast<VoxelDetail*>(batched.penetratedObject);
+        }
+        if (passed) {
+            testsPassed++;
+        } else {
+            qDebug() << "FAILED - Test" << testsTaken <<":" << qPrintable(testName);
+        }
+        qDebug() << "TIME - Test" << testsTaken <<":" << qPrintable(testName) << queries.size() << "spheres, single=" <<
+            ((float)(singleEnd - start) / USECS_PER_MSECS) << "msecs, batched=" <<
+            ((float)(batchEnd - singleEnd) / USECS_PER_MSECS) << "msecs";
+    }
+
+    qDebug() << "   tests passed:" << testsPassed << "out of" << testsTaken;
+    qDebug() << "******************************************************************************************";
+}
+
+void OctreeTests::deletionLogTests() {
+    int testsTaken = 0;
+    int testsPassed = 0;
+
+    qDebug() << "******************************************************************************************";
+    qDebug() << "OctreeTests::deletionLogTests()";
+
+    const int CAPACITY = 100;
+    const float USECS_PER_MSECS = 1000.0f;
+
+    {
+        testsTaken++;
+        QString testName = "a viewer that keeps up is sent only the new deletions";
+        qDebug() << "Test" << testsTaken <<":" << qPrintable(testName);
+
+        OctreeDeletionLog log(CAPACITY);
+        quint64 sequence = 0;
+        QVector<uint32_t> ids;
+        bool passed = true;
+        for (uint32_t id = 1; id <= 10 * CAPACITY && passed; id++) {
+            log.itemDeleted(id);
+            ids.clear();
+            log.getDeletedSince(sequence, ids);
+            log.forgetDeletedBefore(sequence);
+            passed = (ids.size() == 1 && ids.at(0) == id && !log.hasDeletedSince(sequence) &&
+                log.getTombstoneRangeCount() == 0);
+        }
+        if (passed) {
+            testsPassed++;
+        } else {
+            qDebug() << "FAILED - Test" << testsTaken <<":" << qPrintable(testName);
+        }
+    }
+
+    {
+        testsTaken++;
+        QString testName = "a viewer that falls behind is sent the compacted tombstones";
+        qDebug() << "Test" << testsTaken <<":" << qPrintable(testName);
+
+        OctreeDeletionLog log(CAPACITY);
+        const int DELETIONS = 20000;
+        quint64 start = usecTimestampNow();
+        for (int i = 0; i < DELETIONS; i++) {
+            // every other ID, and then the rest, so that the ranges merge
+            uint32_t id = (i < DELETIONS / 2) ? (i * 2) : ((i - DELETIONS / 2) * 2 + 1);
+            log.itemDeleted(id);
+        }
+        quint64 end = usecTimestampNow();
+
+        quint64 sequence = 0;
+        QVector<uint32_t> ids;
+        log.getDeletedSince(sequence, ids);
+        QSet<uint32_t> uniqueIDs = QSet<uint32_t>::fromList(ids.toList());
+
+        // all but the even IDs deleted alongside the odd ones still in the ring have merged into a single range
+        bool passed = (log.getTombstoneRangeCount() <= CAPACITY && uniqueIDs.size() == DELETIONS &&
+            sequence == log.getNextSequence() && !log.hasDeletedSince(sequence));
+        if (passed) {
+            testsPassed++;
+        } else {
+            qDebug() << "FAILED - Test" << testsTaken <<":" << qPrintable(testName);
+            qDebug() << "tombstone ranges:" << log.getTombstoneRangeCount() << "ids:" << uniqueIDs.size();
+        }
+        qDebug() << "TIME - Test" << testsTaken <<":" << qPrintable(testName) << DELETIONS << "deletions, elapsed=" <<
+            ((float)(end - start) / USECS_PER_MSECS) << "msecs";
+    }
+
+    qDebug() << "   tests passed:" << testsPassed << "out of" << testsTaken;
+    qDebug() << "******************************************************************************************";
+}
+
 void OctreeTests::runAllTests() {
     propertyFlagsTests();
+    batchedQueryTests();
+    deletionLogTests();
 }
@@ -15,6 +15,8 @@
 namespace OctreeTests {
 
     void propertyFlagsTests();
+    void batchedQueryTests();
+    void deletionLogTests();
 
     void runAllTests(); 
 }
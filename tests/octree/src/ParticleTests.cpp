@@ -0,0 +1,323 @@
+//
+//  ParticleTests.cpp
+//  tests/octree/src
+//
+//  Copyright 2014 High Fidelity, Inc.
+//
+//  Distributed under the Apache License, Version 2.0.
+//  See the accompanying file LICENSE or http://www.apache.org/licenses/LICENSE-2.0.html
+//
+
+#include <QDebug>
+#include <QThread>
+
+#include <NodeList.h>
+#include <OctreeConstants.h>
+#include <Particle.h>
+#include <ParticleCollisionSystem.h>
+#include <ParticleEditPacketSender.h>
+#include <ParticleScriptPool.h>
+#include <ParticleTree.h>
+#include <ScriptEngine.h>
+#include <SharedUtil.h>
+#include <VoxelTree.h>
+
+#include "ParticleTests.h"
+
+// counts the ticks in the red channel, so that we can tell whether every particle's script ran every tick
+const QString COUNTING_SCRIPT =
+    "Particle.update.connect(function () {"
+    "    var color = Particle.getColor();"
+    "    color.red = (color.red + 1) % 256;"
+    "    Particle.setColor(color);"
+    "});";
+
+// the same script with a different source, so that the tree needs two engines
+const QString OTHER_COUNTING_SCRIPT = "// other\n" + COUNTING_SCRIPT;
+
+// counts in the green channel at top level, which runs for each particle every time its script does
+const QString TOP_LEVEL_COUNTING_SCRIPT =
+    "var color = Particle.getColor();"
+    "color.green = (color.green + 1) % 256;"
+    "Particle.setColor(color);";
+
+void ParticleTests::particleScriptTests(bool verbose) {
+    int testsTaken = 0;
+    int testsPassed = 0;
+    int testsFailed = 0;
+
+    if (verbose) {
+        qDebug() << "******************************************************************************************";
+    }
+
+    qDebug() << "ParticleTests::particleScriptTests()";
+
+    const int SCRIPTED_PARTICLES = 2000;
+    const int TICKS = 10;
+    const float USECS_PER_MSECS = 1000.0f;
+
+    ParticleTree tree;
+    for (int i = 0; i < SCRIPTED_PARTICLES; i++) {
+        ParticleID particleID(i + 1);
+        particleID.isKnownID = false; // as with the model tests, allows local particles to be added with known IDs
+        ParticleProperties properties;
+        properties.setPosition(glm::vec3(randFloatInRange(0.0f, (float)TREE_SCALE),
+            randFloatInRange(0.0f, (float)TREE_SCALE), randFloatInRange(0.0f, (float)TREE_SCALE)));
+        properties.setRadius(0.5f);
+        properties.setGravity(glm::vec3(0.0f, 0.0f, 0.0f));
+        properties.setScript((i % 2 == 0) ? COUNTING_SCRIPT : OTHER_COUNTING_SCRIPT);
+        tree.addParticle(particleID, properties);
+    }
+
+    {
+        testsTaken++;
+        QString testName = "update scripted particles through the script pool";
+        if (verbose) {
+            qDebug() << "Test" << testsTaken <<":" << qPrintable(testName);
+        }
+
+        quint64 start = usecTimestampNow();
+        for (int i = 0; i < TICKS; i++) {
+            tree.update();
+        }
+        quint64 end = usecTimestampNow();
+
+        bool passed = (ParticleScriptPool::getInstance()->getVMCount() == 2);
+        for (int i = 0; i < SCRIPTED_PARTICLES && passed; i++) {
+            const Particle* particle = tree.findParticleByID(i + 1);
+            passed = (particle && particle->getXColor().red == TICKS);
+        }
+        if (passed) {
+            testsPassed++;
+        } else {
+            testsFailed++;
+            qDebug() << "FAILED - Test" << testsTaken <<":" << qPrintable(testName);
+        }
+        float elapsedInMSecs = (float)(end - start) / USECS_PER_MSECS;
+        qDebug() << "TIME - Test" << testsTaken <<":" << qPrintable(testName) << SCRIPTED_PARTICLES << "particles," <<
+            TICKS << "ticks, elapsed=" << elapsedInMSecs << "msecs," <<
+            (SCRIPTED_PARTICLES * TICKS * USECS_PER_SECOND / (float)qMax(end - start, (quint64)1)) << "updates/sec";
+    }
+
+    {
+        testsTaken++;
+        QString testName = "run the top-level program of a pooled script for each particle";
+        if (verbose) {
+            qDebug() << "Test" << testsTaken <<":" << qPrintable(testName);
+        }
+
+        const int TOP_LEVEL_PARTICLES = 100;
+        ParticleTree topLevelTree;
+        for (int i = 0; i < TOP_LEVEL_PARTICLES; i++) {
+            ParticleID particleID(i + 1);
+            particleID.isKnownID = false;
+            ParticleProperties properties;
+            properties.setPosition(glm::vec3(randFloatInRange(0.0f, (float)TREE_SCALE),
+                randFloatInRange(0.0f, (float)TREE_SCALE), randFloatInRange(0.0f, (float)TREE_SCALE)));
+            properties.setRadius(0.5f);
+            properties.setGravity(glm::vec3(0.0f, 0.0f, 0.0f));
+            properties.setScript(TOP_LEVEL_COUNTING_SCRIPT);
+            topLevelTree.addParticle(particleID, properties);
+        }
+        for (int i = 0; i < TICKS; i++) {
+            topLevelTree.update();
+        }
+
+        // each particle should have been counted once per tick: not once per engine, and never against no particle
+        bool passed = true;
+        for (int i = 0; i < TOP_LEVEL_PARTICLES && passed; i++) {
+            const Particle* particle = topLevelTree.findParticleByID(i + 1);
+            passed = (particle && particle->getXColor().green == TICKS);
+        }
+        if (passed) {
+            testsPassed++;
+        } else {
+            testsFailed++;
+            qDebug() << "FAILED - Test" << testsTaken <<":" << qPrintable(testName);
+        }
+    }
+
+    {
+        testsTaken++;
+        QString testName = "bind and update scripted particles with an engine per particle vs. a pooled engine";
+        if (verbose) {
+            qDebug() << "Test" << testsTaken <<":" << qPrintable(testName);
+        }
+
+        // only a sample, since an engine per particle is what we're trying to get away from
+        const int SAMPLE_PARTICLES = 50;
+        QVector<Particle> particles(SAMPLE_PARTICLES);
+
+        // the old way: a new engine per particle, which parses and compiles the source again every time
+        quint64 start = usecTimestampNow();
+        for (int i = 0; i < SAMPLE_PARTICLES; i++) {
+            ScriptEngine engine(COUNTING_SCRIPT);
+            ParticleScriptObject particleScriptable(&particles[i]);
+            engine.registerGlobalObject("Particle", &particleScriptable);
+            engine.evaluate();
+            particleScriptable.emitUpdate();
+        }
+        quint64 end = usecTimestampNow();
+        float unpooledUSecs = (float)qMax(end - start, (quint64)1);
+
+        // the pooled way: one engine and one compiled program, with only the top level run again per particle
+        ParticleScriptVM vm(COUNTING_SCRIPT);
+        start = usecTimestampNow();
+        for (int i = 0; i < SAMPLE_PARTICLES; i++) {
+            vm.bind(&particles[i]).emitUpdate();
+        }
+        vm.unbind();
+        end = usecTimestampNow();
+        float pooledUSecs = (float)qMax(end - start, (quint64)1);
+
+        // both ways should have run each particle's handler once
+        bool passed = true;
+        for (int i = 0; i < SAMPLE_PARTICLES && passed; i++) {
+            passed = (particles.at(i).getXColor().red == 2);
+        }
+        if (passed) {
+            testsPassed++;
+        } else {
+            testsFailed++;
+            qDebug() << "FAILED - Test" << testsTaken <<":" << qPrintable(testName);
+        }
+        qDebug() << "TIME - Test" << testsTaken <<":" << qPrintable(testName) << SAMPLE_PARTICLES << "particles," <<
+            "engine per particle elapsed=" << (unpooledUSecs / USECS_PER_MSECS) << "msecs," <<
+            (SAMPLE_PARTICLES * USECS_PER_SECOND / unpooledUSecs) << "updates/sec," <<
+            "pooled elapsed=" << (pooledUSecs / USECS_PER_MSECS) << "msecs," <<
+            (SAMPLE_PARTICLES * USECS_PER_SECOND / pooledUSecs) << "updates/sec";
+    }
+
+    {
+        testsTaken++;
+        QString testName = "update particles at rest";
+        if (verbose) {
+            qDebug() << "Test" << testsTaken <<":" << qPrintable(testName);
+        }
+
+        const int RESTING_PARTICLES = 10000;
+        const float LONG_LIFETIME = 1000.0f;
+        ParticleTree restingTree;
+        for (int i = 0; i < RESTING_PARTICLES; i++) {
+            ParticleID particleID(i + 1);
+            particleID.isKnownID = false;
+            ParticleProperties properties;
+            properties.setPosition(glm::vec3(randFloatInRange(0.0f, (float)TREE_SCALE),
+                randFloatInRange(0.0f, (float)TREE_SCALE), randFloatInRange(0.0f, (float)TREE_SCALE)));
+            properties.setRadius(0.5f);
+            properties.setGravity(glm::vec3(0.0f, 0.0f, 0.0f));
+            properties.setLifetime(LONG_LIFETIME);
+            restingTree.addParticle(particleID, properties);
+        }
+
+        // the first update visits the newly added particles and finds them at rest; the rest should leave them alone
+        restingTree.update();
+        restingTree.clearDirtyBit();
+        quint64 start = usecTimestampNow();
+        for (int i = 0; i < TICKS; i++) {
+            restingTree.update();
+        }
+        quint64 end = usecTimestampNow();
+
+        bool passed = !restingTree.isDirty();
+        if (passed) {
+            testsPassed++;
+        } else {
+            testsFailed++;
+            qDebug() << "FAILED - Test" << testsTaken <<":" << qPrintable(testName);
+        }
+        float elapsedInMSecs = (float)(end - start) / USECS_PER_MSECS;
+        qDebug() << "TIME - Test" << testsTaken <<":" << qPrintable(testName) << RESTING_PARTICLES << "particles," <<
+            TICKS << "ticks, elapsed=" << elapsedInMSecs << "msecs";
+    }
+
+    qDebug() << "   tests passed:" << testsPassed << "out of" << testsTaken;
+    if (verbose) {
+        qDebug() << "******************************************************************************************";
+    }
+}
+
+void ParticleTests::particleCollisionTests(bool verbose) {
+    int testsTaken = 0;
+    int testsPassed = 0;
+    int testsFailed = 0;
+
+    if (verbose) {
+        qDebug() << "******************************************************************************************";
+    }
+
+    qDebug() << "ParticleTests::particleCollisionTests()";
+
+    // the collision system releases its edits through the node list, which has no servers to send them to here
+    NodeList::createInstance(NodeType::Agent);
+
+    {
+        testsTaken++;
+        QString testName = "move a particle at rest in the update after a collision";
+        if (verbose) {
+            qDebug() << "Test" << testsTaken <<":" << qPrintable(testName);
+        }
+
+        // a small particle at rest just below the middle of the tree, and a larger one (stored in another element) just
+        // above the middle overlapping it and moving towards it, slowly enough that even the resting one, knocked away at
+        // up to twice the speed, makes no sound
+        const uint32_t RESTING_ID = 1;
+        const uint32_t MOVING_ID = 2;
+        const float LONG_LIFETIME = 1000.0f;
+        const float SLOW_SPEED = 0.1f;
+        ParticleTree tree;
+        ParticleID restingID(RESTING_ID);
+        restingID.isKnownID = false;
+        ParticleProperties restingProperties;
+        restingProperties.setPosition(glm::vec3(0.49f, 0.5f, 0.5f) * (float)TREE_SCALE);
+        restingProperties.setRadius(0.005f * TREE_SCALE);
+        restingProperties.setGravity(glm::vec3(0.0f, 0.0f, 0.0f));
+        restingProperties.setLifetime(LONG_LIFETIME);
+        tree.addParticle(restingID, restingProperties);
+
+        ParticleID movingID(MOVING_ID);
+        movingID.isKnownID = false;
+        ParticleProperties movingProperties;
+        movingProperties.setPosition(glm::vec3(0.52f, 0.5f, 0.5f) * (float)TREE_SCALE);
+        movingProperties.setRadius(0.03f * TREE_SCALE);
+        movingProperties.setVelocity(glm::vec3(-SLOW_SPEED, 0.0f, 0.0f));
+        movingProperties.setGravity(glm::vec3(0.0f, 0.0f, 0.0f));
+        movingProperties.setLifetime(LONG_LIFETIME);
+        tree.addParticle(movingID, movingProperties);
+
+        // let the resting particle's element come to rest, then collide the two
+        tree.update();
+        ParticleEditPacketSender packetSender;
+        VoxelTree voxels;
+        ParticleCollisionSystem collisionSystem(&packetSender, &tree, &voxels);
+        collisionSystem.update();
+
+        const Particle* resting = tree.findParticleByID(RESTING_ID);
+        bool passed = resting && resting->getVelocity() != glm::vec3(0.0f, 0.0f, 0.0f);
+        if (passed) {
+            // give it time to move a measurable distance at that speed
+            const unsigned long MOVING_MSECS = 100;
+            glm::vec3 collidedPosition = resting->getPosition();
+            QThread::msleep(MOVING_MSECS);
+            tree.update();
+            resting = tree.findParticleByID(RESTING_ID);
+            passed = resting && resting->getPosition() != collidedPosition;
+        }
+        if (passed) {
+            testsPassed++;
+        } else {
+            testsFailed++;
+            qDebug() << "FAILED - Test" << testsTaken <<":" << qPrintable(testName);
+        }
+    }
+
+    qDebug() << "   tests passed:" << testsPassed << "out of" << testsTaken;
+    if (verbose) {
+        qDebug() << "******************************************************************************************";
+    }
+}
+
+void ParticleTests::runAllTests(bool verbose) {
+    particleScriptTests(verbose);
+    particleCollisionTests(verbose);
+}
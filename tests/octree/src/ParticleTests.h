@@ -0,0 +1,20 @@
+//
+//  ParticleTests.h
+//  tests/octree/src
+//
+//  Copyright 2014 High Fidelity, Inc.
+//
+//  Distributed under the Apache License, Version 2.0.
+//  See the accompanying file LICENSE or http://www.apache.org/licenses/LICENSE-2.0.html
+//
+
+#ifndef hifi_ParticleTests_h
+#define hifi_ParticleTests_h
+
+namespace ParticleTests {
+    void particleScriptTests(bool verbose = false);
+    void particleCollisionTests(bool verbose = false);
+    void runAllTests(bool verbose = false);
+}
+
+#endif // hifi_ParticleTests_h
@@ -11,10 +11,14 @@
 #include "ModelTests.h"
 #include "OctreeTests.h"
 #include "AABoxCubeTests.h"
+#include "OctreeItemIndexTests.h"
+#include "ParticleTests.h"
 
 int main(int argc, char** argv) {
     OctreeTests::runAllTests();
     AABoxCubeTests::runAllTests();
     ModelTests::runAllTests(true);
+    ParticleTests::runAllTests(true);
+    OctreeItemIndexTests::runAllTests(true);
     return 0;
 }
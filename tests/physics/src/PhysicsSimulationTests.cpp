@@ -0,0 +1,282 @@
+//
+//  PhysicsSimulationTests.cpp
+//  tests/physics/src
+//
+//  Copyright 2014 High Fidelity, Inc.
+//
+//  Distributed under the Apache License, Version 2.0.
+//  See the accompanying file LICENSE or http://www.apache.org/licenses/LICENSE-2.0.html
+//
+
+#include <iostream>
+#include <float.h>
+#include <math.h>
+
+#include <glm/glm.hpp>
+
+#include <CollisionInfo.h>
+#include <PhysicsEntity.h>
+#include <PhysicsSimulation.h>
+#include <Ragdoll.h>
+#include <ShapeCollider.h>
+#include <SharedUtil.h>
+#include <VerletCapsuleShape.h>
+
+#include "PhysicsSimulationTests.h"
+
+const int NUM_DOLLS = 48;
+const int NUM_DOLL_ROWS = 6;
+const float DOLL_SPACING = 0.25f;
+const int NUM_DOLL_SEGMENTS = 8;
+const float DOLL_SEGMENT_LENGTH = 0.15f;
+const float DOLL_RADIUS = 0.1f;
+const glm::vec3 GRAVITY(0.0f, -9.8f, 0.0f);
+
+const float STEP_TIME = 1.0f / 60.0f;
+const float MIN_ERROR = 0.01f;
+const int MAX_ITERATIONS = 4;
+const quint64 MAX_USEC = 1000000;
+
+// the simulation keeps at most this many collisions per pass, so the exhaustive count stops there too
+const int MAX_COLLISIONS = 256;
+
+/// A chain of capsules that falls over onto the floor, where the chains pile up on each other.
+class ChainRagdoll : public PhysicsEntity, public Ragdoll {
+public:
+
+    ChainRagdoll(const glm::vec3& base, float lean);
+    virtual ~ChainRagdoll();
+
+    virtual void buildShapes();
+    virtual void stepRagdollForward(float deltaTime);
+
+protected:
+
+    virtual void initRagdollPoints();
+    virtual void buildRagdollConstraints();
+
+private:
+
+    glm::vec3 _base;
+    float _lean;
+};
+
+ChainRagdoll::ChainRagdoll(const glm::vec3& base, float lean) : _base(base), _lean(lean) {
+    initRagdollPoints();
+    buildRagdollConstraints();
+    setEnableShapes(true);
+}
+
+ChainRagdoll::~ChainRagdoll() {
+    clearShapes();
+}
+
+void ChainRagdoll::buildShapes() {
+    // the shapes point into _ragdollPoints, which mustn't be resized from here on
+    for (int i = 0; i < NUM_DOLL_SEGMENTS; ++i) {
+        _shapes.push_back(new VerletCapsuleShape(DOLL_RADIUS, &_ragdollPoints[i], &_ragdollPoints[i + 1]));
+    }
+    setShapeBackPointers();
+    disableCurrentSelfCollisions();
+}
+
+void ChainRagdoll::stepRagdollForward(float deltaTime) {
+    glm::vec3 gravityStep = GRAVITY * (deltaTime * deltaTime);
+    for (int i = 0; i < _ragdollPoints.size(); ++i) {
+        VerletPoint& point = _ragdollPoints[i];
+        glm::vec3 velocity = point._position - point._lastPosition;
+        point._lastPosition = point._position;
+        point._position += velocity + gravityStep;
+
+        // the floor
+        if (point._position.y < DOLL_RADIUS) {
+            point._position.y = DOLL_RADIUS;
+        }
+    }
+}
+
+void ChainRagdoll::initRagdollPoints() {
+    _ragdollPoints.resize(NUM_DOLL_SEGMENTS + 1);
+    glm::vec3 direction = glm::normalize(glm::vec3(_lean, 1.0f, 0.0f));
+    for (int i = 0; i < _ragdollPoints.size(); ++i) {
+        VerletPoint& point = _ragdollPoints[i];
+        point._position = _base + direction * (DOLL_SEGMENT_LENGTH * i);
+        point._lastPosition = point._position;
+    }
+}
+
+void ChainRagdoll::buildRagdollConstraints() {
+    for (int i = 0; i < NUM_DOLL_SEGMENTS; ++i) {
+        addDistanceConstraint(i, i + 1);
+    }
+}
+
+static void addDolls(PhysicsSimulation& simulation, QVector<ChainRagdoll*>& dolls) {
+    const float LEAN = 0.3f;
+    for (int i = 0; i < NUM_DOLLS; ++i) {
+        glm::vec3 base(DOLL_SPACING * (i / NUM_DOLL_ROWS), DOLL_RADIUS, DOLL_SPACING * (i % NUM_DOLL_ROWS));
+        ChainRagdoll* doll = new ChainRagdoll(base, (i % 2 == 0) ? LEAN : -LEAN);
+        if (!(simulation.addEntity(doll) && simulation.addRagdoll(doll))) {
+            std::cout << __FILE__ << ":" << __LINE__ << " ERROR: simulation should accept " << NUM_DOLLS 
+                << " dolls" << std::endl;
+        }
+        dolls.push_back(doll);
+    }
+}
+
+static void removeDolls(PhysicsSimulation& simulation, QVector<ChainRagdoll*>& dolls) {
+    foreach (ChainRagdoll* doll, dolls) {
+        simulation.removeRagdoll(doll);
+        simulation.removeEntity(doll);
+        delete doll;
+    }
+    dolls.clear();
+}
+
+/// Counts the collisions between all pairs of shapes, the way the simulation did before it had a broadphase.
+static int countCollisionsExhaustively(const QVector<ChainRagdoll*>& dolls) {
+    CollisionList collisions(MAX_COLLISIONS);
+    for (int i = 0; i < dolls.size(); ++i) {
+        const QVector<Shape*>& shapes = dolls.at(i)->getShapes();
+        for (int j = 0; j < shapes.size(); ++j) {
+            for (int k = 0; k < j; ++k) {
+                if (dolls.at(i)->collisionsAreEnabled(k, j)) {
+                    ShapeCollider::collideShapes(shapes.at(k), shapes.at(j), collisions);
+                }
+            }
+            for (int k = i + 1; k < dolls.size(); ++k) {
+                const QVector<Shape*>& otherShapes = dolls.at(k)->getShapes();
+                for (int l = 0; l < otherShapes.size(); ++l) {
+                    ShapeCollider::collideShapes(shapes.at(j), otherShapes.at(l), collisions);
+                }
+            }
+        }
+    }
+    return collisions.size();
+}
+
+void PhysicsSimulationTests::ragdollConstraintsConverge() {
+    ChainRagdoll doll(glm::vec3(0.0f, DOLL_RADIUS, 0.0f), 0.0f);
+    if (doll.getNumDistanceConstraints() != NUM_DOLL_SEGMENTS) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: doll should have " << NUM_DOLL_SEGMENTS 
+            << " distance constraints but has " << doll.getNumDistanceConstraints() << std::endl;
+    }
+
+    // stretch the chain out of shape
+    QVector<VerletPoint>& points = doll.getRagdollPoints();
+    for (int i = 0; i < points.size(); ++i) {
+        points[i]._position += glm::vec3((i % 2 == 0) ? 0.1f : -0.1f, 0.05f * i, 0.0f);
+    }
+
+    const int MAX_PASSES = 100;
+    float error = 0.0f;
+    for (int i = 0; i < MAX_PASSES; ++i) {
+        error = doll.enforceRagdollConstraints();
+    }
+    if (error > MIN_ERROR) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: constraints should converge, but error = " 
+            << error << std::endl;
+    }
+    for (int i = 0; i < NUM_DOLL_SEGMENTS; ++i) {
+        float length = glm::distance(points.at(i)._position, points.at(i + 1)._position);
+        if (fabsf(length - DOLL_SEGMENT_LENGTH) > MIN_ERROR) {
+            std::cout << __FILE__ << ":" << __LINE__ << " ERROR: segment " << i << " has length " << length 
+                << " but should have " << DOLL_SEGMENT_LENGTH << std::endl;
+        }
+    }
+}
+
+/// Notes where the dolls' points are when the contact cache is built.
+static void recordPositions(const QVector<ChainRagdoll*>& dolls, QVector<glm::vec3>& positions) {
+    positions.clear();
+    foreach (ChainRagdoll* doll, dolls) {
+        foreach (const VerletPoint& point, doll->getRagdollPoints()) {
+            positions.push_back(point._position);
+        }
+    }
+}
+
+/// \return the farthest any of the dolls' points has moved from the recorded positions, or FLT_MAX if there are none
+static float computeLargestMovement(const QVector<ChainRagdoll*>& dolls, const QVector<glm::vec3>& positions) {
+    if (positions.isEmpty()) {
+        return FLT_MAX;
+    }
+    float largestMovement = 0.0f;
+    int index = 0;
+    foreach (ChainRagdoll* doll, dolls) {
+        foreach (const VerletPoint& point, doll->getRagdollPoints()) {
+            largestMovement = glm::max(largestMovement, glm::distance(point._position, positions.at(index++)));
+        }
+    }
+    return largestMovement;
+}
+
+void PhysicsSimulationTests::contactCacheFindsAllCollisions() {
+    PhysicsSimulation simulation;
+    QVector<ChainRagdoll*> dolls;
+    addDolls(simulation, dolls);
+
+    // the simulation builds the cache at the start of each step and keeps it through the iterations that follow, so the
+    // cache must find every collision until the shapes have moved by its margin: here it's kept through whole steps
+    // instead, and only rebuilt once some point has moved that far
+    const int NUM_STEPS = 60;
+    QVector<glm::vec3> cachedPositions;
+    int numCacheBuilds = 0;
+    for (int i = 1; i <= NUM_STEPS; ++i) {
+        simulation.moveRagdolls(STEP_TIME);
+        if (computeLargestMovement(dolls, cachedPositions) >= CONTACT_CACHE_MARGIN) {
+            simulation.updateContactCache();
+            recordPositions(dolls, cachedPositions);
+            ++numCacheBuilds;
+        }
+        simulation.computeCollisions();
+        int expectedCollisions = countCollisionsExhaustively(dolls);
+        if (simulation.getNumCollisions() != expectedCollisions) {
+            std::cout << __FILE__ << ":" << __LINE__ << " ERROR: step " << i << " found " 
+                << simulation.getNumCollisions() << " collisions but expected " << expectedCollisions << std::endl;
+        }
+        simulation.processCollisions();
+        simulation.enforceConstraints();
+    }
+    if (numCacheBuilds == NUM_STEPS) {
+        std::cout << __FILE__ << ":" << __LINE__ << " ERROR: the dolls moved too fast for the cache to be kept through "
+            "any steps" << std::endl;
+    }
+    removeDolls(simulation, dolls);
+}
+
+void PhysicsSimulationTests::stepManyRagdolls() {
+    PhysicsSimulation simulation;
+    QVector<ChainRagdoll*> dolls;
+    addDolls(simulation, dolls);
+
+    const int NUM_STEPS = 300;
+    int totalCandidatePairs = 0;
+    int totalCollisions = 0;
+    int totalIterations = 0;
+    quint64 elapsed = 0;
+    quint64 longestStep = 0;
+    for (int i = 0; i < NUM_STEPS; ++i) {
+        simulation.stepForward(STEP_TIME, MIN_ERROR, MAX_ITERATIONS, MAX_USEC);
+        totalCandidatePairs += simulation.getNumCandidatePairs();
+        totalCollisions += simulation.getNumCollisions();
+        totalIterations += simulation.getNumIterations();
+        elapsed += simulation.getStepTime();
+        longestStep = qMax(longestStep, simulation.getStepTime());
+    }
+
+    int numShapes = NUM_DOLLS * NUM_DOLL_SEGMENTS;
+    std::cout << "PhysicsSimulationTests: " << NUM_DOLLS << " ragdolls (" << numShapes << " shapes, " 
+        << (numShapes * (numShapes - 1) / 2) << " possible pairs), " << NUM_STEPS << " steps: " 
+        << (elapsed / NUM_STEPS) << " usec/step (longest " << longestStep << "), " 
+        << (totalCandidatePairs / NUM_STEPS) << " candidate pairs/step, " << (totalCollisions / NUM_STEPS) 
+        << " collisions/step, " << ((float)totalIterations / NUM_STEPS) << " iterations/step" << std::endl;
+
+    removeDolls(simulation, dolls);
+}
+
+void PhysicsSimulationTests::runAllTests() {
+    ragdollConstraintsConverge();
+    contactCacheFindsAllCollisions();
+    stepManyRagdolls();
+}
@@ -0,0 +1,230 @@
+//
+//  ResourceCacheTests.cpp
+//  tests/shared/src
+//
+//  Copyright 2014 High Fidelity, Inc.
+//
+//  Distributed under the Apache License, Version 2.0.
+//  See the accompanying file LICENSE or http://www.apache.org/licenses/LICENSE-2.0.html
+//
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QNetworkAccessManager>
+#include <QTcpSocket>
+
+#include "ResourceDiskCache.h"
+
+#include "ResourceCacheTests.h"
+
+// how many times the content of a test resource the memory it takes up is
+const int DECODED_SIZE_FACTOR = 4;
+
+// longer than the resource cache waits before retrying a reply that timed out
+const int LOAD_TIMEOUT_MSECS = 10000;
+
+static QByteArray getSHA1(const QByteArray& content) {
+    return QCryptographicHash::hash(content, QCryptographicHash::Sha1).toHex();
+}
+
+TestHTTPServer::TestHTTPServer() {
+    connect(this, SIGNAL(newConnection()), SLOT(acceptConnections()));
+    listen(QHostAddress::LocalHost);
+}
+
+void TestHTTPServer::setResponse(const QString& path, const QByteArray& cacheControl, const QByteArray& content) {
+    Response response;
+    response.cacheControl = cacheControl;
+    response.eTag = "\"" + getSHA1(content) + "\"";
+    response.content = content;
+    _responses.insert(path, response);
+}
+
+QUrl TestHTTPServer::getURL(const QString& path) const {
+    return QUrl("http://127.0.0.1:" + QString::number(serverPort()) + path);
+}
+
+void TestHTTPServer::acceptConnections() {
+    while (hasPendingConnections()) {
+        QTcpSocket* socket = nextPendingConnection();
+        connect(socket, SIGNAL(readyRead()), SLOT(readRequest()));
+        connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+    }
+}
+
+void TestHTTPServer::readRequest() {
+    QTcpSocket* socket = static_cast<QTcpSocket*>(sender());
+    QByteArray& request = _requests[socket];
+    request += socket->readAll();
+    int headersEnd = request.indexOf("\r\n\r\n");
+    if (headersEnd == -1) {
+        return; // wait for the rest of the headers
+    }
+    QList<QByteArray> lines = request.left(headersEnd).split('\n');
+    _requests.remove(socket);
+
+    QString path = QString::fromLatin1(lines.first().split(' ').value(1));
+    QByteArray ifNoneMatch;
+    foreach (const QByteArray& line, lines.mid(1)) {
+        int colon = line.indexOf(':');
+        if (colon != -1 && line.left(colon).trimmed().toLower() == "if-none-match") {
+            ifNoneMatch = line.mid(colon + 1).trimmed();
+        }
+    }
+    _requestCounts[path]++;
+
+    // every response closes the connection, so that each request gets its own
+    QHash<QString, Response>::const_iterator it = _responses.constFind(path);
+    if (it == _responses.constEnd()) {
+        socket->write("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+
+    } else if (ifNoneMatch == it.value().eTag) {
+        _notModifiedCounts[path]++;
+        socket->write("HTTP/1.1 304 Not Modified\r\nCache-Control: " + it.value().cacheControl + "\r\nETag: " +
+            it.value().eTag + "\r\nConnection: close\r\n\r\n");
+
+    } else {
+        socket->write("HTTP/1.1 200 OK\r\nContent-Length: " + QByteArray::number(it.value().content.size()) +
+            "\r\nCache-Control: " + it.value().cacheControl + "\r\nETag: " + it.value().eTag +
+            "\r\nConnection: close\r\n\r\n" + it.value().content);
+    }
+    socket->disconnectFromHost();
+}
+
+TestResource::TestResource(const QUrl& url) :
+    Resource(url) {
+}
+
+void TestResource::downloadFinished(QNetworkReply* reply) {
+    _content = reply->readAll();
+    setBytes(_content.size() * DECODED_SIZE_FACTOR);
+    reply->deleteLater();
+    finishedLoading(true);
+}
+
+QSharedPointer<Resource> TestResourceCache::createResource(const QUrl& url,
+        const QSharedPointer<Resource>& fallback, bool delayLoad, const void* extra) {
+    return QSharedPointer<Resource>(new TestResource(url), &Resource::allReferencesCleared);
+}
+
+static bool loads(TestResourceCache& cache, const QUrl& url, const QByteArray& expected) {
+    QSharedPointer<TestResource> resource = cache.getTestResource(url);
+    QElapsedTimer timer;
+    timer.start();
+    while (!(resource->isLoaded() || resource->hasFailedToLoad()) && timer.elapsed() < LOAD_TIMEOUT_MSECS) {
+        QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+    }
+    return resource->isLoaded() && resource->getContent() == expected;
+}
+
+void ResourceCacheTests::runAllTests() {
+    qDebug() << "testing the resource cache...";
+
+    QDir directory(QDir::temp().filePath("ResourceCacheTests"));
+    directory.removeRecursively();
+
+    TestHTTPServer server;
+    QNetworkAccessManager networkAccessManager;
+    ResourceDiskCache diskCache(directory.path());
+    ResourceCache::setNetworkAccessManager(&networkAccessManager);
+    ResourceCache::setDiskCache(&diskCache);
+
+    const QString FRESH_PATH = "/fresh.fbx";
+    const QString REVALIDATED_PATH = "/revalidated.png";
+    const QString MISSING_PATH = "/missing.png";
+    const QString PRIVATE_PATH = "/private.fst";
+    const QByteArray FRESH_CONTENT(1000, 'f');
+    const QByteArray REVALIDATED_CONTENT(500, 'r');
+    const QByteArray MISSING_CONTENT(250, 'm');
+    const QByteArray PRIVATE_CONTENT(100, 'p');
+    server.setResponse(FRESH_PATH, "max-age=3600", FRESH_CONTENT);
+    server.setResponse(REVALIDATED_PATH, "no-cache", REVALIDATED_CONTENT);
+    server.setResponse(MISSING_PATH, "no-cache", MISSING_CONTENT);
+    server.setResponse(PRIVATE_PATH, "no-store", PRIVATE_CONTENT);
+
+    // the first time through, everything comes from the network
+    {
+        TestResourceCache cache;
+        if (!(loads(cache, server.getURL(FRESH_PATH), FRESH_CONTENT) &&
+                loads(cache, server.getURL(REVALIDATED_PATH), REVALIDATED_CONTENT) &&
+                loads(cache, server.getURL(MISSING_PATH), MISSING_CONTENT) &&
+                loads(cache, server.getURL(PRIVATE_PATH), PRIVATE_CONTENT))) {
+            qDebug() << "FAIL: resources weren't loaded from the network";
+        }
+        if (diskCache.getSize() != FRESH_CONTENT.size() + REVALIDATED_CONTENT.size() + MISSING_CONTENT.size()) {
+            qDebug() << "FAIL: disk cache takes" << diskCache.getSize() << "bytes, expected" <<
+                FRESH_CONTENT.size() + REVALIDATED_CONTENT.size() + MISSING_CONTENT.size();
+        }
+    }
+
+    // as though the stored content had been deleted behind the index's back
+    QFile::remove(directory.filePath(getSHA1(MISSING_CONTENT)));
+
+    // a new cache has nothing in memory, so it goes to the disk cache
+    {
+        TestResourceCache cache;
+        if (!loads(cache, server.getURL(FRESH_PATH), FRESH_CONTENT) || server.getRequestCount(FRESH_PATH) != 1) {
+            qDebug() << "FAIL: fresh content wasn't served from disk, requests:" << server.getRequestCount(FRESH_PATH);
+        }
+        if (!loads(cache, server.getURL(REVALIDATED_PATH), REVALIDATED_CONTENT) ||
+                server.getRequestCount(REVALIDATED_PATH) != 2 || server.getNotModifiedCount(REVALIDATED_PATH) != 1) {
+            qDebug() << "FAIL: stale content wasn't revalidated and served from disk, requests:" <<
+                server.getRequestCount(REVALIDATED_PATH) << "not modified:" << server.getNotModifiedCount(REVALIDATED_PATH);
+        }
+        // the server says what we have is fine, but we don't have it any more, so we ask again without validators
+        if (!loads(cache, server.getURL(MISSING_PATH), MISSING_CONTENT) ||
+                server.getRequestCount(MISSING_PATH) != 3 || server.getNotModifiedCount(MISSING_PATH) != 1) {
+            qDebug() << "FAIL: missing content wasn't requested again, requests:" <<
+                server.getRequestCount(MISSING_PATH) << "not modified:" << server.getNotModifiedCount(MISSING_PATH);
+        }
+        if (!loads(cache, server.getURL(PRIVATE_PATH), PRIVATE_CONTENT) || server.getRequestCount(PRIVATE_PATH) != 2) {
+            qDebug() << "FAIL: content marked no-store wasn't requested again, requests:" <<
+                server.getRequestCount(PRIVATE_PATH);
+        }
+    }
+
+    // resources no longer in use are unloaded by the memory they take up, which here is more than they downloaded
+    {
+        const QByteArray UNUSED_CONTENT(100, 'u');
+        const qint64 UNUSED_BYTES = UNUSED_CONTENT.size() * DECODED_SIZE_FACTOR;
+        const int UNUSED_RESOURCES = 3;
+        QList<QUrl> urls;
+        for (int i = 0; i < UNUSED_RESOURCES; i++) {
+            QString path = "/unused" + QString::number(i) + ".png";
+            server.setResponse(path, "max-age=3600", UNUSED_CONTENT);
+            urls.append(server.getURL(path));
+        }
+
+        TestResourceCache cache;
+        cache.setUnusedResourcesMaxSize((UNUSED_RESOURCES - 1) * UNUSED_BYTES);
+        foreach (const QUrl& url, urls) {
+            if (!loads(cache, url, UNUSED_CONTENT)) {
+                qDebug() << "FAIL: unused resource wasn't loaded:" << url;
+            }
+        }
+        if (cache.getUnusedResourcesSize() != (UNUSED_RESOURCES - 1) * UNUSED_BYTES) {
+            qDebug() << "FAIL: unused resources take" << cache.getUnusedResourcesSize() << "bytes, expected" <<
+                (UNUSED_RESOURCES - 1) * UNUSED_BYTES;
+        }
+
+        // the least recently used was unloaded, so it has to be loaded again; the most recently used is still there
+        if (cache.getTestResource(urls.first())->isLoaded() || !cache.getTestResource(urls.last())->isLoaded()) {
+            qDebug() << "FAIL: the least recently used resource wasn't the one unloaded";
+        }
+
+        // the newest is kept even when it's over the limit by itself
+        cache.setUnusedResourcesMaxSize(0);
+        if (cache.getUnusedResourcesSize() != UNUSED_BYTES || !cache.getTestResource(urls.last())->isLoaded()) {
+            qDebug() << "FAIL: unused resources take" << cache.getUnusedResourcesSize() << "bytes, expected" <<
+                UNUSED_BYTES;
+        }
+    }
+
+    ResourceCache::setDiskCache(NULL);
+    ResourceCache::setNetworkAccessManager(NULL);
+    directory.removeRecursively();
+}
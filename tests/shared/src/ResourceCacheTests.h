@@ -0,0 +1,98 @@
+//
+//  ResourceCacheTests.h
+//  tests/shared/src
+//
+//  Copyright 2014 High Fidelity, Inc.
+//
+//  Distributed under the Apache License, Version 2.0.
+//  See the accompanying file LICENSE or http://www.apache.org/licenses/LICENSE-2.0.html
+//
+
+#ifndef hifi_ResourceCacheTests_h
+#define hifi_ResourceCacheTests_h
+
+#include <QHash>
+#include <QTcpServer>
+
+#include "ResourceCache.h"
+
+class QTcpSocket;
+
+namespace ResourceCacheTests {
+
+    void runAllTests();
+}
+
+/// Serves fixed responses over HTTP on the loopback address, tagged with the SHA-1 of their content and answering
+/// conditional requests for that tag with 304s.  Counts the requests it gets for each path.
+class TestHTTPServer : public QTcpServer {
+    Q_OBJECT
+
+public:
+
+    TestHTTPServer();
+
+    void setResponse(const QString& path, const QByteArray& cacheControl, const QByteArray& content);
+
+    QUrl getURL(const QString& path) const;
+
+    int getRequestCount(const QString& path) const { return _requestCounts.value(path); }
+    int getNotModifiedCount(const QString& path) const { return _notModifiedCounts.value(path); }
+
+private slots:
+
+    void acceptConnections();
+    void readRequest();
+
+private:
+
+    class Response {
+    public:
+        QByteArray cacheControl;
+        QByteArray eTag;
+        QByteArray content;
+    };
+
+    QHash<QString, Response> _responses;
+    QHash<QTcpSocket*, QByteArray> _requests;
+    QHash<QString, int> _requestCounts;
+    QHash<QString, int> _notModifiedCounts;
+};
+
+/// A resource that keeps the content it downloaded, and says it takes up more memory than that (as a texture does once
+/// it's decoded its image).
+class TestResource : public Resource {
+    Q_OBJECT
+
+public:
+
+    TestResource(const QUrl& url);
+
+    bool hasFailedToLoad() const { return _failedToLoad; }
+
+    const QByteArray& getContent() const { return _content; }
+
+protected:
+
+    virtual void downloadFinished(QNetworkReply* reply);
+
+private:
+
+    QByteArray _content;
+};
+
+/// A cache of test resources.
+class TestResourceCache : public ResourceCache {
+    Q_OBJECT
+
+public:
+
+    QSharedPointer<TestResource> getTestResource(const QUrl& url) { return getResource(url).staticCast<TestResource>(); }
+
+protected:
+
+    virtual QSharedPointer<Resource> createResource(const QUrl& url,
+        const QSharedPointer<Resource>& fallback, bool delayLoad, const void* extra);
+};
+
+#endif // hifi_ResourceCacheTests_h
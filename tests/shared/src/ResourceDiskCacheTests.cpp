@@ -0,0 +1,111 @@
+//
+//  ResourceDiskCacheTests.cpp
+//  tests/shared/src
+//
+//  Copyright 2014 High Fidelity, Inc.
+//
+//  Distributed under the Apache License, Version 2.0.
+//  See the accompanying file LICENSE or http://www.apache.org/licenses/LICENSE-2.0.html
+//
+
+#include <QDebug>
+#include <QDir>
+#include <QThread>
+
+#include "ResourceDiskCache.h"
+
+#include "ResourceDiskCacheTests.h"
+
+// stands in for a network reply, carrying just the headers the cache reads
+class HeaderReply : public QNetworkReply {
+public:
+    HeaderReply(const QByteArray& cacheControl, const QByteArray& eTag = QByteArray()) {
+        setRawHeader("Cache-Control", cacheControl);
+        if (!eTag.isEmpty()) {
+            setRawHeader("ETag", eTag);
+        }
+    }
+    virtual void abort() { }
+
+protected:
+    virtual qint64 readData(char* data, qint64 maxSize) { return -1; }
+};
+
+static bool loads(ResourceDiskCache& cache, const QUrl& url, const QByteArray& expected) {
+    QByteArray content;
+    return cache.load(url, content) && content == expected;
+}
+
+void ResourceDiskCacheTests::runAllTests() {
+    qDebug() << "testing the resource disk cache...";
+
+    QDir directory(QDir::temp().filePath("ResourceDiskCacheTests"));
+    directory.removeRecursively();
+
+    const QUrl FRESH_URL("http://example.com/fresh.fbx");
+    const QUrl COPY_URL("http://example.com/copy.fbx");
+    const QUrl STALE_URL("http://example.com/stale.png");
+    const QByteArray FRESH_CONTENT(1000, 'f');
+    const QByteArray STALE_CONTENT(500, 's');
+    const QByteArray ETAG = "\"v1\"";
+    HeaderReply freshReply("max-age=3600");
+    HeaderReply staleReply("no-cache", ETAG);
+    HeaderReply privateReply("no-store");
+    {
+        ResourceDiskCache cache(directory.path());
+        cache.store(FRESH_URL, &freshReply, FRESH_CONTENT);
+        if (!loads(cache, FRESH_URL, FRESH_CONTENT)) {
+            qDebug() << "FAIL: fresh content wasn't loaded";
+        }
+
+        // the same content at another URL is stored once
+        cache.store(COPY_URL, &freshReply, FRESH_CONTENT);
+        if (cache.getSize() != FRESH_CONTENT.size()) {
+            qDebug() << "FAIL: shared content takes" << cache.getSize() << "bytes, expected" << FRESH_CONTENT.size();
+        }
+
+        // stale content must be revalidated
+        cache.store(STALE_URL, &staleReply, STALE_CONTENT);
+        if (loads(cache, STALE_URL, STALE_CONTENT)) {
+            qDebug() << "FAIL: stale content was loaded without revalidating it";
+        }
+        QNetworkRequest request(STALE_URL);
+        cache.addValidators(STALE_URL, request);
+        if (request.rawHeader("If-None-Match") != ETAG) {
+            qDebug() << "FAIL: If-None-Match was" << request.rawHeader("If-None-Match") << ", expected" << ETAG;
+        }
+        QByteArray content;
+        if (!(cache.loadValidated(STALE_URL, &freshReply, content) && content == STALE_CONTENT)) {
+            qDebug() << "FAIL: revalidated content wasn't loaded";
+        }
+        if (!loads(cache, STALE_URL, STALE_CONTENT)) {
+            qDebug() << "FAIL: revalidated content wasn't made fresh";
+        }
+
+        // nothing is kept for content that mustn't be stored
+        cache.store(QUrl("http://example.com/private"), &privateReply, STALE_CONTENT);
+        if (loads(cache, QUrl("http://example.com/private"), STALE_CONTENT)) {
+            qDebug() << "FAIL: content marked no-store was stored";
+        }
+    }
+
+    // the index persists, and eviction removes the least recently used content
+    {
+        ResourceDiskCache cache(directory.path());
+        QThread::msleep(1); // so that these uses are more recent than the last
+        if (!loads(cache, FRESH_URL, FRESH_CONTENT) || !loads(cache, COPY_URL, FRESH_CONTENT)) {
+            qDebug() << "FAIL: content wasn't loaded from the saved index";
+        }
+        if (cache.getSize() != FRESH_CONTENT.size() + STALE_CONTENT.size()) {
+            qDebug() << "FAIL: reloaded cache takes" << cache.getSize() << "bytes, expected" <<
+                FRESH_CONTENT.size() + STALE_CONTENT.size();
+        }
+        cache.setMaximumSize(FRESH_CONTENT.size());
+        if (cache.getSize() > cache.getMaximumSize() || loads(cache, STALE_URL, STALE_CONTENT) ||
+                !loads(cache, FRESH_URL, FRESH_CONTENT)) {
+            qDebug() << "FAIL: eviction didn't remove the least recently used content";
+        }
+    }
+
+    directory.removeRecursively();
+}
@@ -0,0 +1,19 @@
+//
+//  ResourceDiskCacheTests.h
+//  tests/shared/src
+//
+//  Copyright 2014 High Fidelity, Inc.
+//
+//  Distributed under the Apache License, Version 2.0.
+//  See the accompanying file LICENSE or http://www.apache.org/licenses/LICENSE-2.0.html
+//
+
+#ifndef hifi_ResourceDiskCacheTests_h
+#define hifi_ResourceDiskCacheTests_h
+
+namespace ResourceDiskCacheTests {
+
+    void runAllTests();
+}
+
+#endif // hifi_ResourceDiskCacheTests_h
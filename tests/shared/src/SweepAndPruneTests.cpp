@@ -0,0 +1,72 @@
+//
+//  SweepAndPruneTests.cpp
+//  tests/shared/src
+//
+//  Copyright 2014 High Fidelity, Inc.
+//
+//  Distributed under the Apache License, Version 2.0.
+//  See the accompanying file LICENSE or http://www.apache.org/licenses/LICENSE-2.0.html
+//
+
+#include <QDebug>
+#include <QSet>
+
+#include "SharedUtil.h"
+#include "SweepAndPrune.h"
+
+#include "SweepAndPruneTests.h"
+
+void SweepAndPruneTests::runAllTests() {
+    const int BOX_COUNT = 2000;
+    const float WORLD_SIZE = 100.0f;
+    const float MAX_RADIUS = 1.0f;
+
+    qDebug() << "testing sweep and prune with" << BOX_COUNT << "spheres...";
+
+    SweepAndPrune broadphase;
+    QVector<glm::vec3> centers;
+    QVector<float> radii;
+    for (int i = 0; i < BOX_COUNT; i++) {
+        centers.append(glm::vec3(randFloatInRange(0.0f, WORLD_SIZE), randFloatInRange(0.0f, WORLD_SIZE),
+            randFloatInRange(0.0f, WORLD_SIZE)));
+        radii.append(randFloatInRange(0.0f, MAX_RADIUS));
+        broadphase.addSphere(centers.last(), radii.last());
+    }
+
+    quint64 start = usecTimestampNow();
+    QVector<IndexPair> pairs;
+    broadphase.findOverlappingPairs(pairs);
+    quint64 sweepTime = usecTimestampNow() - start;
+
+    // the sweep should find exactly the pairs that the brute force comparison does
+    start = usecTimestampNow();
+    QSet<IndexPair> expectedPairs;
+    for (int i = 0; i < BOX_COUNT; i++) {
+        for (int j = i + 1; j < BOX_COUNT; j++) {
+            glm::vec3 separation = glm::abs(centers.at(i) - centers.at(j));
+            float reach = radii.at(i) + radii.at(j);
+            if (separation.x <= reach && separation.y <= reach && separation.z <= reach) {
+                expectedPairs.insert(IndexPair(i, j));
+            }
+        }
+    }
+    quint64 bruteForceTime = usecTimestampNow() - start;
+
+    QSet<IndexPair> foundPairs;
+    foreach (const IndexPair& pair, pairs) {
+        foundPairs.insert(pair);
+    }
+    if (foundPairs != expectedPairs || pairs.size() != foundPairs.size()) {
+        qDebug() << "FAIL: sweep found" << pairs.size() << "pairs (" << foundPairs.size() << "distinct ), expected" <<
+            expectedPairs.size();
+    } else {
+        qDebug() << "\t found" << pairs.size() << "pairs in" << sweepTime << "usecs (brute force:" << bruteForceTime <<
+            "usecs)";
+    }
+
+    broadphase.clear();
+    broadphase.findOverlappingPairs(pairs);
+    if (!pairs.isEmpty()) {
+        qDebug() << "FAIL: cleared broadphase found" << pairs.size() << "pairs";
+    }
+}
@@ -8,9 +8,20 @@
 //  See the accompanying file LICENSE or http://www.apache.org/licenses/LICENSE-2.0.html
 //
 
+#include <QCoreApplication>
+
 #include "MovingPercentileTests.h"
+#include "ResourceCacheTests.h"
+#include "ResourceDiskCacheTests.h"
+#include "SweepAndPruneTests.h"
 
 int main(int argc, char** argv) {
+    // the resource caches load over the network, and the disk cache saves its index on a timer
+    QCoreApplication app(argc, argv);
+
     MovingPercentileTests::runAllTests();
+    SweepAndPruneTests::runAllTests();
+    ResourceDiskCacheTests::runAllTests();
+    ResourceCacheTests::runAllTests();
     return 0;
 }